@@ -114,6 +114,10 @@ bool
 #undef ocpiAssert
 #endif
 
+// The level is checked for this source file before any arguments are evaluated
+#define ocpiLogAt(n, ...)						\
+  (::OCPI::OS::logWillLogAt((n), __FILE__) ?				\
+   ::OCPI::OS::logPrintAt((n), __FILE__, __VA_ARGS__) : (void)0)
 #define ocpiWeird(...) ocpiLog(OCPI_LOG_WEIRD, __VA_ARGS__)
 #define ocpiInfo(...) ocpiLog(OCPI_LOG_INFO, __VA_ARGS__)
 #define ocpiBad(...) ocpiLog(OCPI_LOG_BAD, __VA_ARGS__)
@@ -124,15 +128,15 @@ bool
 #define ocpiDebug1(fmt, ...) ((void)0)
 #define ocpiDebug2(fmt, ...) ((void)0)
 #define ocpiDebug3(fmt, ...) ((void)0)
-#define ocpiLog(n, ...) ((n) > OCPI_LOG_DEBUG_MIN ? 0 : (::OCPI::OS::logPrint(n, __VA_ARGS__),0))
+#define ocpiLog(n, ...) ((n) > OCPI_LOG_DEBUG_MIN ? 0 : (ocpiLogAt(n, __VA_ARGS__),0))
 #else
 #define ocpiAssert(cond) ((::OCPI::OS::testAssertion ((cond) ? true : false)) || ::OCPI::OS::assertionFailed (#cond, __FILE__, __LINE__))
 #define ocpiCheck(cond) ocpiAssert(cond)
-#define ocpiDebug(...) ::OCPI::OS::logPrint(OCPI_LOG_DEBUG_MIN, __VA_ARGS__)
-#define ocpiDebug1(fmt, ...) ::OCPI::OS::logPrint(OCPI_LOG_DEBUG_MIN+1, (fmt), __VA_ARGS__)
-#define ocpiDebug2(fmt, ...) ::OCPI::OS::logPrint(OCPI_LOG_DEBUG_MIN+2, (fmt), __VA_ARGS__)
-#define ocpiDebug3(fmt, ...) ::OCPI::OS::logPrint(OCPI_LOG_DEBUG_MIN+3, (fmt), __VA_ARGS__)
-#define ocpiLog(n, ...) ::OCPI::OS::logPrint(n, __VA_ARGS__)
+#define ocpiDebug(...) ocpiLogAt(OCPI_LOG_DEBUG_MIN, __VA_ARGS__)
+#define ocpiDebug1(fmt, ...) ocpiLogAt(OCPI_LOG_DEBUG_MIN+1, (fmt), __VA_ARGS__)
+#define ocpiDebug2(fmt, ...) ocpiLogAt(OCPI_LOG_DEBUG_MIN+2, (fmt), __VA_ARGS__)
+#define ocpiDebug3(fmt, ...) ocpiLogAt(OCPI_LOG_DEBUG_MIN+3, (fmt), __VA_ARGS__)
+#define ocpiLog(n, ...) ocpiLogAt(n, __VA_ARGS__)
 #endif
 
 #endif
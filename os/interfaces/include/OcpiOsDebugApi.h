@@ -99,6 +99,48 @@ namespace OCPI {
     bool logWillLog(unsigned n);
     void logPrint(unsigned n, const char *fmt, ...) throw() __attribute__((format(printf, 2, 3)));
     void logPrintV(unsigned n, const char *fmt, va_list ap) throw();
+
+    /**
+     * Sets log levels for subsystems, as "name=level,name=level...".  A
+     * subsystem is any source file whose path contains the name, and the
+     * longest matching name applies.  Other files use the global level.
+     * The OCPI_LOG_LEVELS environment variable is used at startup.
+     */
+    void logSetSubsystemLevels(const char *levels);
+
+    /**
+     * Queues log records in per-thread rings, holding the format pointer and
+     * the raw arguments, to be formatted and written by a background thread.
+     * Records still queued when the program crashes are lost, so use the
+     * flight recorder below to keep the last ones.  The OCPI_LOG_ASYNC
+     * environment variable enables this at startup.
+     */
+    void logSetAsync(bool async);
+
+    /**
+     * Keeps the last \a n records at or below \a level in memory, whether
+     * or not they are printed, to be dumped by logDumpRecorder() or when the
+     * program crashes.  Records are formatted when logged, and lines longer
+     * than 247 bytes are truncated.  The OCPI_LOG_RECORDER environment
+     * variable ("n" or "n:level") is used at startup.  Zero disables it.
+     */
+    void logSetRecorder(size_t n, unsigned level = OCPI_LOG_DEBUG);
+    void logDumpRecorder(int fd = 2) throw();
+
+    /**
+     * Writes any queued records before returning.
+     */
+    void logFlush() throw();
+
+    // For the log macros, which check before evaluating any arguments
+    extern unsigned logThreshold;  // the highest level anything is logged at
+    extern bool logBySubsystem;    // whether levels depend on the source file
+    bool logSubsystemWillLog(unsigned n, const char *file) throw();
+    inline bool logWillLogAt(unsigned n, const char *file) throw() {
+      return n <= logThreshold && (!logBySubsystem || logSubsystemWillLog(n, file));
+    }
+    void logPrintAt(unsigned n, const char *file, const char *fmt, ...) throw()
+      __attribute__((format(printf, 3, 4)));
   }
 }
 
@@ -196,11 +196,20 @@ namespace OCPI {
 		     size_t addrlen) throw (std::string);
       size_t recvfrom(char  *buf, size_t amount, int flags, char *  src_addr,
 		      size_t *addrlen, unsigned timeoutms = 0) throw (std::string);
+      // Datagram batches: "msgs" is an array of "struct msghdr", which are sent or received
+      // with as few system calls as the OS allows (sendmmsg/recvmmsg on linux).
+      // sendmmsg sends them all.  recvmmsg waits up to timeoutms for the first one, then
+      // takes what is already queued, setting each received length in "lengths" and
+      // returning the number received, zero on timeout.
+      void sendmmsg(const void *msgs, unsigned count, int flags) throw (std::string);
+      unsigned recvmmsg(void *msgs, size_t *lengths, unsigned count, int flags,
+			unsigned timeoutms = 0) throw (std::string);
     protected:
       OCPI::OS::uint64_t m_osOpaque[1];
 
     private:
       unsigned m_timeoutms;
+      void setRecvTimeout(unsigned timeoutms) throw (std::string);
       /**
        * Not implemented.
        */
@@ -143,6 +143,18 @@ namespace OCPI {
       size_t recvfrom(char  *buf, size_t amount, int flags,
 		      char *  src_addr, size_t *addrlen, unsigned timeoutms = 0)
       throw (std::string);
+      /**
+       * Receives data from the peer into several buffers (scatter) in one call.
+       *
+       * \param[in] iov     The buffers (a struct iovec array on POSIX).
+       * \param[in] iovcnt  The number of buffers.
+       * \return       The number of octets read, filling the buffers in order,
+       *               zero at end of data, or SIZE_MAX on timeout.
+       *
+       * \throw std::string In case of error, such as a broken connection.
+       */
+      size_t recvv(const void *iov, unsigned iovcnt, unsigned timeoutms = 0)
+        throw (std::string);
 
       /**
        * Sends data to the peer.
@@ -162,6 +174,14 @@ namespace OCPI {
         throw (std::string);
       size_t sendmsg(const void * iovect, unsigned int flags )
         throw (std::string);
+      /**
+       * Sends several buffers to the peer (gather), usually in one system call.
+       *
+       * Like send(), keeps trying until all bytes are sent.  The iov array
+       * (a struct iovec array on POSIX) is consumed, i.e. modified, in the process.
+       */
+      size_t sendv(void *iov, unsigned iovcnt)
+        throw (std::string);
       size_t sendto(const char * data, size_t amount, int flags,  char * src_addr,
 		    size_t addrlen)
 	throw (std::string);
@@ -292,6 +312,7 @@ namespace OCPI {
     protected:
       uint64_t m_osOpaque[1];
     private:
+      void setRecvTimeout(unsigned timeoutms) throw (std::string);
       bool m_temporary; // kludge to make up for broken interface
       unsigned m_timeoutms;
     };
@@ -20,10 +20,18 @@
 
 #include <signal.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <link.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <sys/time.h>
 #include <execinfo.h>
 #include <stdarg.h>
 #include <cstdlib>
+#include <vector>
+#include <algorithm>
 #include <iostream>
 #include <cstdio>
 #include <climits>
@@ -74,48 +82,926 @@ namespace OCPI {
     }
 
     // We can't use the C++ mutex since its destruction is unpredictable and
-    // we want logging to work in destructors
+    // we want logging to work in destructors.  For the same reason nothing here
+    // is a static object with a destructor.
     pthread_mutex_t mine = PTHREAD_MUTEX_INITIALIZER;
     static unsigned logLevel = UINT_MAX;
+    // Until initialized, these send the macros into logSubsystemWillLog, which initializes
+    unsigned logThreshold = UINT_MAX;
+    bool logBySubsystem = true;
+    static pthread_once_t logOnce = PTHREAD_ONCE_INIT;
+    static void logInit();
+    static void logUpdate();
+
+    // Per-subsystem levels, and a cache of the level for each __FILE__ pointer seen.
+    // A cache entry holds the generation of the subsystem table it was computed from.
+    struct LogSubsystem {
+      char name[64];
+      unsigned level;
+    };
+    static const unsigned LOG_SUBSYSTEMS = 32, LOG_SITES = 1024, LOG_PROBES = 16;
+    static LogSubsystem logSubsystems[LOG_SUBSYSTEMS];
+    static unsigned nLogSubsystems, logGeneration = 1;
+    static struct LogSite {
+      const char *file;
+      uint64_t state; // generation << 32 | level
+    } logSites[LOG_SITES];
+
+    static unsigned
+    logComputeLevel(const char *file) {
+      unsigned level = logLevel;
+      size_t best = 0;
+      for (unsigned n = 0; n < nLogSubsystems; n++) {
+	size_t len = strlen(logSubsystems[n].name);
+	if (len > best && strstr(file, logSubsystems[n].name)) {
+	  best = len;
+	  level = logSubsystems[n].level;
+	}
+      }
+      return level;
+    }
+
+    // The level for messages from a source file, or the global level without one
+    static unsigned
+    logLevelFor(const char *file) {
+      if (!file || !nLogSubsystems)
+	return logLevel;
+      uint32_t gen = __atomic_load_n(&logGeneration, __ATOMIC_ACQUIRE);
+      size_t h = ((uintptr_t)file >> 3) * 0x9E3779B97F4A7C15ull >> 54;
+      for (unsigned i = 0; i < LOG_PROBES; i++) {
+	LogSite &s = logSites[(h + i) % LOG_SITES];
+	const char *f = __atomic_load_n(&s.file, __ATOMIC_ACQUIRE);
+	if (!f && __atomic_compare_exchange_n(&s.file, &f, file, false, __ATOMIC_ACQ_REL,
+					      __ATOMIC_ACQUIRE))
+	  f = file;
+	if (f == file) {
+	  uint64_t state = __atomic_load_n(&s.state, __ATOMIC_ACQUIRE);
+	  if ((uint32_t)(state >> 32) == gen)
+	    return (unsigned)state;
+	  unsigned level = logComputeLevel(file);
+	  __atomic_store_n(&s.state, (uint64_t)gen << 32 | level, __ATOMIC_RELEASE);
+	  return level;
+	}
+      }
+      return logComputeLevel(file);
+    }
+
+    static void
+    logSubsystemLevels(const char *levels) {
+      pthread_mutex_lock(&mine);
+      unsigned n = 0;
+      for (const char *cp = levels; cp && *cp && n < LOG_SUBSYSTEMS; ) {
+	size_t len = strcspn(cp, ",");
+	const char *eq = (const char *)memchr(cp, '=', len);
+	if (eq && eq != cp && (size_t)(eq - cp) < sizeof(logSubsystems[n].name)) {
+	  size_t nameLen = (size_t)(eq - cp);
+	  memcpy(logSubsystems[n].name, cp, nameLen);
+	  logSubsystems[n].name[nameLen] = '\0';
+	  logSubsystems[n++].level = (unsigned)atoi(eq + 1);
+	}
+	cp += len + (cp[len] ? 1 : 0);
+      }
+      nLogSubsystems = n;
+      __atomic_add_fetch(&logGeneration, 1, __ATOMIC_RELEASE);
+      logUpdate();
+      pthread_mutex_unlock(&mine);
+    }
+    void
+    logSetSubsystemLevels(const char *levels) {
+      pthread_once(&logOnce, logInit);
+      logSubsystemLevels(levels);
+    }
+
+    // The flight recorder: fixed size slots claimed round-robin by all threads.  A slot's
+    // sequence number is zero while being written.  Recorders are never freed since
+    // other threads may still be writing into one that is replaced.
+    static const size_t LOG_SLOT = 256;
+    struct LogRecorder {
+      size_t nSlots;
+      unsigned level;
+      uint64_t next;
+      uint8_t *slots;
+    };
+    static LogRecorder *logRecorder;
+
+    // Records whose formatting is deferred: the format pointer, and the arguments as
+    // 8 byte words, with copies of strings after them.  A string argument is its
+    // offset in the record, or zero for NULL.  When the format is not in read-only
+    // memory it is copied too, and when it has conversions that cannot be deferred,
+    // the formatted text is stored instead.
+    struct LogRecord {
+      uint32_t size;   // bytes including this header, a multiple of 8
+      uint16_t level;
+      uint8_t  flags;
+      uint8_t  nArgs;
+      uint64_t nsecs;  // CLOCK_REALTIME
+      union {
+	const char *fmt;
+	uint64_t fmtOffset;
+      };
+    };
+    enum { LOG_PAD = 1, LOG_TEXT = 2, LOG_FMT_COPY = 4 };
+    static const size_t LOG_MAX_RECORD = 16 * 1024, LOG_RING = 256 * 1024,
+      LOG_LDOUBLE_WORDS = (sizeof(long double) + 7) / 8;
+    static const uint64_t LOG_EMPTY_STRING = UINT64_MAX;
+
+    enum LogArgType {
+      LOG_ARG_INT, LOG_ARG_LONG, LOG_ARG_LLONG, LOG_ARG_SIZE, LOG_ARG_PTRDIFF, LOG_ARG_INTMAX,
+      LOG_ARG_DOUBLE, LOG_ARG_LDOUBLE, LOG_ARG_STRING, LOG_ARG_POINTER, LOG_ARG_BAD
+    };
+    struct LogSpec {
+      const char *start;
+      size_t length;
+      unsigned stars;
+      LogArgType type;
+    };
+    // Parse a conversion specification, starting after its '%'.  Positional arguments,
+    // wide characters, %n and %m are not deferred.
+    static const char *
+    logParseSpec(const char *p, LogSpec &s) {
+      s.start = p - 1;
+      s.stars = 0;
+      s.type = LOG_ARG_BAD;
+      while (*p && strchr("-+ #0'I", *p))
+	p++;
+      if (*p == '*')
+	s.stars++, p++;
+      else
+	while (*p >= '0' && *p <= '9')
+	  p++;
+      if (*p == '$')
+	return p;
+      if (*p == '.') {
+	if (*++p == '*')
+	  s.stars++, p++;
+	else
+	  while (*p >= '0' && *p <= '9')
+	    p++;
+      }
+      char length = 0;
+      switch (*p) {
+      case 'h':
+	p += p[1] == 'h' ? 2 : 1;
+	break;
+      case 'l':
+	if (p[1] == 'l')
+	  length = 'q', p += 2;
+	else
+	  length = *p++;
+	break;
+      case 'L': case 'q': case 'j': case 'z': case 'Z': case 't':
+	length = *p++;
+	break;
+      }
+      switch (*p) {
+      case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+	s.type =
+	  length == 'l' ? LOG_ARG_LONG : length == 'q' ? LOG_ARG_LLONG :
+	  length == 'j' ? LOG_ARG_INTMAX : length == 'z' || length == 'Z' ? LOG_ARG_SIZE :
+	  length == 't' ? LOG_ARG_PTRDIFF : length == 'L' ? LOG_ARG_BAD : LOG_ARG_INT;
+	break;
+      case 'c':
+	s.type = length ? LOG_ARG_BAD : LOG_ARG_INT;
+	break;
+      case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+	s.type = length == 'L' ? LOG_ARG_LDOUBLE : length && length != 'l' ? LOG_ARG_BAD :
+	  LOG_ARG_DOUBLE;
+	break;
+      case 's':
+	s.type = length ? LOG_ARG_BAD : LOG_ARG_STRING;
+	break;
+      case 'p':
+	s.type = LOG_ARG_POINTER;
+	break;
+      default:
+	return p;
+      }
+      s.length = (size_t)(++p - s.start);
+      if (s.length >= 32)
+	s.type = LOG_ARG_BAD;
+      return p;
+    }
+
+    // Read-only segments of loaded objects, where string literals are.  Rescanned at
+    // most once a second when a format is not found, since objects may be loaded later.
+    struct LogSegment {
+      uintptr_t start, end;
+      bool operator<(const LogSegment &other) const { return start < other.start; }
+    };
+    static const unsigned LOG_SEGMENTS = 512;
+    static LogSegment logSegments[2][LOG_SEGMENTS];
+    static uint32_t logSegmentTable; // which table << 16 | count
+    static time_t logSegmentScan;
+    static pthread_mutex_t logSegmentMutex = PTHREAD_MUTEX_INITIALIZER;
+
+    static int
+    logAddSegments(struct dl_phdr_info *info, size_t, void *arg) {
+      std::vector<LogSegment> &segs = *(std::vector<LogSegment> *)arg;
+      for (unsigned n = 0; n < info->dlpi_phnum && segs.size() < LOG_SEGMENTS; n++) {
+	const ElfW(Phdr) &ph = info->dlpi_phdr[n];
+	if (ph.p_type == PT_LOAD && !(ph.p_flags & PF_W)) {
+	  LogSegment seg = { info->dlpi_addr + ph.p_vaddr, info->dlpi_addr + ph.p_vaddr + ph.p_memsz };
+	  segs.push_back(seg);
+	}
+      }
+      return 0;
+    }
+    static bool
+    logFindSegment(uintptr_t addr) {
+      uint32_t table = __atomic_load_n(&logSegmentTable, __ATOMIC_ACQUIRE);
+      const LogSegment *segs = logSegments[table >> 16];
+      LogSegment key = { addr, addr };
+      const LogSegment *s = std::upper_bound(segs, segs + (table & 0xffff), key);
+      return s != segs && addr < s[-1].end;
+    }
+    static bool
+    logIsLiteral(const char *fmt) {
+      if (logFindSegment((uintptr_t)fmt))
+	return true;
+      time_t now = time(NULL);
+      if (now == logSegmentScan || pthread_mutex_trylock(&logSegmentMutex))
+	return false;
+      logSegmentScan = now;
+      std::vector<LogSegment> segs;
+      dl_iterate_phdr(logAddSegments, &segs);
+      std::sort(segs.begin(), segs.end());
+      unsigned table = (__atomic_load_n(&logSegmentTable, __ATOMIC_ACQUIRE) >> 16) ^ 1;
+      std::copy(segs.begin(), segs.end(), logSegments[table]);
+      __atomic_store_n(&logSegmentTable, table << 16 | (unsigned)segs.size(), __ATOMIC_RELEASE);
+      pthread_mutex_unlock(&logSegmentMutex);
+      return logFindSegment((uintptr_t)fmt);
+    }
+
+    // The argument types of formats in read-only memory, found by their address, so
+    // they are only parsed once.  Star widths and precisions are int arguments.
+    static const unsigned LOG_FORMATS = 1024, LOG_MAX_ARGS = 30;
+    static struct LogFormat {
+      const char *fmt;
+      bool ready;
+      uint8_t nArgs, nWords;
+      uint8_t types[LOG_MAX_ARGS];
+    } logFormats[LOG_FORMATS];
+
+    static bool
+    logParseFormat(const char *fmt, LogFormat &f) {
+      LogSpec spec;
+      f.nArgs = f.nWords = 0;
+      for (const char *p = fmt; *p; )
+	if (*p++ == '%') {
+	  if (*p == '%') {
+	    p++;
+	    continue;
+	  }
+	  p = logParseSpec(p, spec);
+	  if (spec.type == LOG_ARG_BAD || f.nArgs + spec.stars >= LOG_MAX_ARGS)
+	    return false;
+	  for (unsigned i = 0; i < spec.stars; i++)
+	    f.types[f.nArgs++] = LOG_ARG_INT;
+	  f.types[f.nArgs++] = (uint8_t)spec.type;
+	  f.nWords = (uint8_t)(f.nWords + spec.stars +
+			       (spec.type == LOG_ARG_LDOUBLE ? LOG_LDOUBLE_WORDS : 1));
+	}
+      return true;
+    }
+
+    // Return the argument types of a format, or NULL if it cannot be deferred.  Sets
+    // "literal" when the format will outlive the record.
+    static const LogFormat *
+    logGetFormat(const char *fmt, LogFormat &local, bool &literal) {
+      size_t h = ((uintptr_t)fmt >> 2) * 0x9E3779B97F4A7C15ull >> 54;
+      LogFormat *slot = NULL;
+      for (unsigned i = 0; i < LOG_PROBES; i++) {
+	LogFormat &f = logFormats[(h + i) % LOG_FORMATS];
+	const char *ff = __atomic_load_n(&f.fmt, __ATOMIC_ACQUIRE);
+	if (ff == fmt) {
+	  if (!__atomic_load_n(&f.ready, __ATOMIC_ACQUIRE))
+	    break;
+	  literal = true;
+	  return &f;
+	}
+	if (!ff) {
+	  slot = &f;
+	  break;
+	}
+      }
+      if (!logParseFormat(fmt, local))
+	return NULL;
+      literal = logIsLiteral(fmt);
+      const char *empty = NULL;
+      if (literal && slot &&
+	  __atomic_compare_exchange_n(&slot->fmt, &empty, fmt, false, __ATOMIC_ACQ_REL,
+				      __ATOMIC_ACQUIRE)) {
+	slot->nArgs = local.nArgs;
+	slot->nWords = local.nWords;
+	memcpy(slot->types, local.types, local.nArgs);
+	__atomic_store_n(&slot->ready, true, __ATOMIC_RELEASE);
+      }
+      return &local;
+    }
+
+    // Capture a record into a buffer of the given capacity, truncating strings to fit
+    static size_t
+    logCapture(uint8_t *buf, size_t cap, unsigned n, uint64_t nsecs, const char *fmt,
+	       va_list ap) {
+      LogRecord &r = *(LogRecord *)buf;
+      r.level = (uint16_t)n;
+      r.flags = 0;
+      r.nsecs = nsecs;
+      r.fmt = fmt;
+      LogFormat local;
+      bool literal = false;
+      const LogFormat *f = logGetFormat(fmt, local, literal);
+      bool ok = f != NULL;
+      size_t nArgs = ok ? f->nWords : 0;
+      size_t off = sizeof(LogRecord) + nArgs * 8;
+      if (ok && off < cap && !literal) {
+	size_t len = strlen(fmt) + 1;
+	if ((ok = len <= cap - off)) {
+	  memcpy(buf + off, fmt, len);
+	  r.flags = LOG_FMT_COPY;
+	  r.fmtOffset = off;
+	  off += len;
+	}
+      }
+      if (ok && off < cap) {
+	r.nArgs = (uint8_t)nArgs;
+	uint64_t *args = (uint64_t *)(buf + sizeof(LogRecord));
+	for (unsigned a = 0; a < f->nArgs; a++)
+	  switch (f->types[a]) {
+	  case LOG_ARG_INT: *args++ = (uint64_t)va_arg(ap, int); break;
+	  case LOG_ARG_LONG: *args++ = (uint64_t)va_arg(ap, long); break;
+	  case LOG_ARG_LLONG: *args++ = (uint64_t)va_arg(ap, long long); break;
+	  case LOG_ARG_SIZE: *args++ = (uint64_t)va_arg(ap, size_t); break;
+	  case LOG_ARG_PTRDIFF: *args++ = (uint64_t)va_arg(ap, ptrdiff_t); break;
+	  case LOG_ARG_INTMAX: *args++ = (uint64_t)va_arg(ap, intmax_t); break;
+	  case LOG_ARG_POINTER: *args++ = (uint64_t)(uintptr_t)va_arg(ap, void *); break;
+	  case LOG_ARG_DOUBLE: {
+	    double d = va_arg(ap, double);
+	    memcpy(args++, &d, sizeof(d));
+	    break;
+	  }
+	  case LOG_ARG_LDOUBLE: {
+	    long double d = va_arg(ap, long double);
+	    memcpy(args, &d, sizeof(d));
+	    args += LOG_LDOUBLE_WORDS;
+	    break;
+	  }
+	  case LOG_ARG_STRING: {
+	    const char *s = va_arg(ap, const char *);
+	    if (!s)
+	      *args++ = 0;
+	    else if (off >= cap)
+	      *args++ = LOG_EMPTY_STRING;
+	    else {
+	      size_t len = strnlen(s, cap - off - 1);
+	      memcpy(buf + off, s, len);
+	      buf[off + len] = '\0';
+	      *args++ = off;
+	      off += len + 1;
+	    }
+	    break;
+	  }
+	  default:
+	    ;
+	  }
+      } else {
+	r.flags = LOG_TEXT;
+	r.nArgs = 0;
+	char *text = (char *)buf + sizeof(LogRecord);
+	int len = vsnprintf(text, cap - sizeof(LogRecord), fmt, ap);
+	off = sizeof(LogRecord) +
+	  std::min((size_t)(len < 0 ? 0 : len), cap - sizeof(LogRecord) - 1) + 1;
+      }
+      return r.size = (uint32_t)((off + 7) & ~(size_t)7);
+    }
+
+    template <typename T> static int
+    logFormatArg(char *out, size_t room, const char *spec, unsigned stars, const int *star,
+		 T value) {
+      return
+	stars == 0 ? snprintf(out, room, spec, value) :
+	stars == 1 ? snprintf(out, room, spec, star[0], value) :
+	snprintf(out, room, spec, star[0], star[1], value);
+    }
+
+    // Format a record as a line like the synchronous logPrintV does, returning its length
+    static size_t
+    logRender(const LogRecord &r, char *out, size_t cap) {
+      time_t secs = (time_t)(r.nsecs / 1000000000);
+      unsigned usecs = (unsigned)(r.nsecs % 1000000000 / 1000);
+      size_t len = 0, max = cap - 1; // room for the newline
+      int k = snprintf(out, max, "OCPI(%2d:%3u.%04u): ", r.level, (unsigned)(secs%1000),
+		       (usecs+500)/1000);
+      len = std::min((size_t)(k < 0 ? 0 : k), max - 1);
+      const char *fmt = r.flags & LOG_FMT_COPY ? (const char *)&r + r.fmtOffset : r.fmt;
+      if (r.flags & LOG_TEXT) {
+	const char *text = (const char *)(&r + 1);
+	size_t n = std::min(strlen(text), max - 1 - len);
+	memcpy(out + len, text, n);
+	len += n;
+	fmt = text;
+      } else {
+	const uint64_t *args = (const uint64_t *)(&r + 1);
+	LogSpec s;
+	for (const char *p = fmt; *p && len < max - 1; ) {
+	  if (*p != '%' || p[1] == '%') {
+	    out[len++] = *p;
+	    p += *p == '%' ? 2 : 1;
+	    continue;
+	  }
+	  p = logParseSpec(p + 1, s);
+	  char spec[32];
+	  memcpy(spec, s.start, s.length);
+	  spec[s.length] = '\0';
+	  int star[2];
+	  for (unsigned i = 0; i < s.stars; i++)
+	    star[i] = (int)*args++;
+	  char *o = out + len;
+	  size_t room = max - len;
+	  switch (s.type) {
+	  case LOG_ARG_INT: k = logFormatArg(o, room, spec, s.stars, star, (int)*args++); break;
+	  case LOG_ARG_LONG: k = logFormatArg(o, room, spec, s.stars, star, (long)*args++); break;
+	  case LOG_ARG_LLONG:
+	    k = logFormatArg(o, room, spec, s.stars, star, (long long)*args++);
+	    break;
+	  case LOG_ARG_SIZE: k = logFormatArg(o, room, spec, s.stars, star, (size_t)*args++); break;
+	  case LOG_ARG_PTRDIFF:
+	    k = logFormatArg(o, room, spec, s.stars, star, (ptrdiff_t)*args++);
+	    break;
+	  case LOG_ARG_INTMAX:
+	    k = logFormatArg(o, room, spec, s.stars, star, (intmax_t)*args++);
+	    break;
+	  case LOG_ARG_POINTER:
+	    k = logFormatArg(o, room, spec, s.stars, star, (void *)(uintptr_t)*args++);
+	    break;
+	  case LOG_ARG_DOUBLE: {
+	    double d;
+	    memcpy(&d, args++, sizeof(d));
+	    k = logFormatArg(o, room, spec, s.stars, star, d);
+	    break;
+	  }
+	  case LOG_ARG_LDOUBLE: {
+	    long double d;
+	    memcpy(&d, args, sizeof(d));
+	    args += LOG_LDOUBLE_WORDS;
+	    k = logFormatArg(o, room, spec, s.stars, star, d);
+	    break;
+	  }
+	  case LOG_ARG_STRING: {
+	    uint64_t a = *args++;
+	    const char *str =
+	      !a ? NULL : a == LOG_EMPTY_STRING ? "" : (const char *)&r + a;
+	    k = logFormatArg(o, room, spec, s.stars, star, str);
+	    break;
+	  }
+	  default:
+	    k = 0;
+	  }
+	  len += std::min((size_t)(k < 0 ? 0 : k), room - 1);
+	}
+      }
+      if (!*fmt || fmt[strlen(fmt)-1] != '\n')
+	out[len++] = '\n';
+      return len;
+    }
+
+    // Per-thread rings written by their thread and read by whoever drains them.  Rings
+    // are never freed: a thread's ring is orphaned when it exits and reused once drained.
+    struct LogRing {
+      LogRing *next;
+      uint64_t head;     // advanced by the owner
+      uint64_t tail;     // advanced by the drainer
+      uint64_t drainTo;
+      bool orphaned;
+      uint8_t *data;
+      uint8_t *scratch;
+    };
+    static LogRing *logRings;
+    static __thread LogRing *logMyRing;
+    static pthread_key_t logRingKey;
+    static bool logAsync, logWriterRunning, logStopping;
+    static pthread_t logWriterThread;
+    static pthread_mutex_t
+      logRingMutex = PTHREAD_MUTEX_INITIALIZER,   // for the list of rings
+      logDrainMutex = PTHREAD_MUTEX_INITIALIZER,  // for reading the rings
+      logWriterMutex = PTHREAD_MUTEX_INITIALIZER; // for waking the writer thread
+    static pthread_cond_t logWriterCond = PTHREAD_COND_INITIALIZER;
+
+    static void
+    logOrphanRing(void *ring) {
+      __atomic_store_n(&((LogRing *)ring)->orphaned, true, __ATOMIC_RELEASE);
+    }
+
+    static LogRing *
+    logGetRing() {
+      if (logMyRing)
+	return logMyRing;
+      pthread_mutex_lock(&logRingMutex);
+      LogRing *r;
+      for (r = logRings; r; r = r->next)
+	if (__atomic_load_n(&r->orphaned, __ATOMIC_ACQUIRE) &&
+	    __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == r->head) {
+	  r->orphaned = false;
+	  break;
+	}
+      if (!r && (r = (LogRing *)calloc(1, sizeof(LogRing)))) {
+	r->data = (uint8_t *)malloc(LOG_RING);
+	r->scratch = (uint8_t *)malloc(LOG_MAX_RECORD);
+	if (!r->data || !r->scratch) {
+	  free(r->data);
+	  free(r->scratch);
+	  free(r);
+	  r = NULL;
+	} else {
+	  r->next = logRings;
+	  __atomic_store_n(&logRings, r, __ATOMIC_RELEASE);
+	}
+      }
+      pthread_mutex_unlock(&logRingMutex);
+      if (r)
+	pthread_setspecific(logRingKey, r);
+      return logMyRing = r;
+    }
+
+    // Queue a record on this thread's ring, waiting for room if it is full
+    static bool
+    logQueue(unsigned n, uint64_t nsecs, const char *fmt, va_list ap) {
+      LogRing *r = logGetRing();
+      if (!r)
+	return false;
+      size_t size = logCapture(r->scratch, LOG_MAX_RECORD, n, nsecs, fmt, ap);
+      size_t pos = (size_t)(r->head % LOG_RING), pad = LOG_RING - pos < size ? LOG_RING - pos : 0;
+      for (unsigned spins = 0;
+	   LOG_RING - (r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) < pad + size;
+	   spins++) {
+	if (!(spins & 63))
+	  pthread_cond_signal(&logWriterCond);
+	sched_yield();
+      }
+      if (pad) {
+	LogRecord &p = *(LogRecord *)(r->data + pos);
+	p.size = (uint32_t)pad;
+	p.flags = LOG_PAD;
+	pos = 0;
+      }
+      memcpy(r->data + pos, r->scratch, size);
+      uint64_t head = r->head + pad + size;
+      __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+      if (head - __atomic_load_n(&r->tail, __ATOMIC_RELAXED) > LOG_RING / 2)
+	pthread_cond_signal(&logWriterCond);
+      return true;
+    }
+
+    struct LogEntry {
+      uint64_t nsecs;
+      const LogRecord *record;
+      bool operator<(const LogEntry &other) const { return nsecs < other.nsecs; }
+    };
+    // Write all queued records, merged in time order.  Returns whether there were any.
+    static bool
+    logDrainLocked() {
+      static std::vector<LogEntry> *entries = new std::vector<LogEntry>;
+      static std::vector<char> *out = new std::vector<char>(64 * 1024);
+      entries->clear();
+      for (LogRing *r = __atomic_load_n(&logRings, __ATOMIC_ACQUIRE); r; r = r->next) {
+	r->drainTo = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	for (uint64_t pos = r->tail; pos < r->drainTo; ) {
+	  const LogRecord &rec = *(LogRecord *)(r->data + pos % LOG_RING);
+	  if (!(rec.flags & LOG_PAD)) {
+	    LogEntry e = { rec.nsecs, &rec };
+	    entries->push_back(e);
+	  }
+	  pos += rec.size;
+	}
+      }
+      std::stable_sort(entries->begin(), entries->end());
+      size_t len = 0;
+      pthread_mutex_lock(&mine);
+      for (std::vector<LogEntry>::const_iterator it = entries->begin(); it != entries->end();
+	   ++it) {
+	if (out->size() - len < 2 * LOG_MAX_RECORD) {
+	  fwrite(&(*out)[0], 1, len, stderr);
+	  len = 0;
+	}
+	len += logRender(*it->record, &(*out)[len], 2 * LOG_MAX_RECORD);
+      }
+      fwrite(&(*out)[0], 1, len, stderr);
+      fflush(stderr);
+      pthread_mutex_unlock(&mine);
+      for (LogRing *r = __atomic_load_n(&logRings, __ATOMIC_ACQUIRE); r; r = r->next)
+	__atomic_store_n(&r->tail, r->drainTo, __ATOMIC_RELEASE);
+      return !entries->empty();
+    }
+    static bool
+    logDrain() {
+      pthread_mutex_lock(&logDrainMutex);
+      bool any = logDrainLocked();
+      pthread_mutex_unlock(&logDrainMutex);
+      return any;
+    }
+
+    static void *
+    logWriter(void *) {
+      pthread_mutex_lock(&logWriterMutex);
+      while (!logStopping) {
+	pthread_mutex_unlock(&logWriterMutex);
+	bool any = logDrain();
+	pthread_mutex_lock(&logWriterMutex);
+	if (!any && !logStopping) {
+	  struct timespec ts;
+	  clock_gettime(CLOCK_REALTIME, &ts);
+	  if ((ts.tv_nsec += 10000000) >= 1000000000)
+	    ts.tv_sec++, ts.tv_nsec -= 1000000000;
+	  pthread_cond_timedwait(&logWriterCond, &logWriterMutex, &ts);
+	}
+      }
+      pthread_mutex_unlock(&logWriterMutex);
+      return NULL;
+    }
+
+    // Records logged after this, e.g. in later static destructors, are written directly
+    static void
+    logExit() {
+      logAsync = false;
+      pthread_mutex_lock(&logWriterMutex);
+      logStopping = true;
+      pthread_cond_signal(&logWriterCond);
+      pthread_mutex_unlock(&logWriterMutex);
+      pthread_join(logWriterThread, NULL);
+      logWriterRunning = false;
+      logDrain();
+    }
+
+    static void
+    logForkChild() {
+      logAsync = logWriterRunning = false;
+    }
+
+    // On a crash, write what the flight recorder holds, then let the previous action for
+    // the signal happen.  Queued records still need formatting, which is not
+    // async-signal-safe, so they are lost.
+    static const int logCrashSignals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+    static const unsigned LOG_CRASH_SIGNALS = sizeof(logCrashSignals)/sizeof(int);
+    static struct sigaction logOldActions[LOG_CRASH_SIGNALS];
+
+    static void
+    logCrash(int sig) {
+      static volatile sig_atomic_t crashing;
+      // If "mine" is held, e.g. by a crash while printing, nothing is written
+      if (!crashing++ && !pthread_mutex_trylock(&mine)) {
+	logDumpRecorder(2);
+	pthread_mutex_unlock(&mine);
+      }
+      for (unsigned n = 0; n < LOG_CRASH_SIGNALS; n++)
+	if (logCrashSignals[n] == sig)
+	  sigaction(sig, &logOldActions[n], NULL);
+      raise(sig);
+    }
+
+    static void
+    logCatchCrashes() {
+      static pthread_once_t once = PTHREAD_ONCE_INIT;
+      struct Local {
+	static void init() {
+	  struct sigaction sa;
+	  memset(&sa, 0, sizeof(sa));
+	  sa.sa_handler = logCrash;
+	  sigemptyset(&sa.sa_mask);
+	  for (unsigned n = 0; n < LOG_CRASH_SIGNALS; n++)
+	    sigaction(logCrashSignals[n], &sa, &logOldActions[n]);
+	}
+      };
+      pthread_once(&once, Local::init);
+    }
+
+    static void
+    logStartWriter() {
+      pthread_mutex_lock(&logRingMutex);
+      if (!logWriterRunning && !logStopping &&
+	  !pthread_key_create(&logRingKey, logOrphanRing) &&
+	  !pthread_create(&logWriterThread, NULL, logWriter, NULL)) {
+	logWriterRunning = true;
+	atexit(logExit);
+	pthread_atfork(NULL, NULL, logForkChild);
+      }
+      pthread_mutex_unlock(&logRingMutex);
+    }
+
+    static void
+    logAsyncMode(bool async) {
+      if (async) {
+	logStartWriter();
+	logCatchCrashes();
+	logAsync = logWriterRunning;
+      } else {
+	logAsync = false;
+	logFlush();
+      }
+    }
+    void
+    logSetAsync(bool async) {
+      pthread_once(&logOnce, logInit);
+      logAsyncMode(async);
+    }
+
+    void
+    logFlush() throw() {
+      if (logWriterRunning)
+	logDrain();
+    }
+
+    static void
+    logRecorderMode(size_t n, unsigned level) {
+      LogRecorder *r = NULL;
+      if (n && (r = (LogRecorder *)calloc(1, sizeof(LogRecorder))) &&
+	  !(r->slots = (uint8_t *)calloc(n, LOG_SLOT))) {
+	free(r);
+	r = NULL;
+      }
+      if (r) {
+	r->nSlots = n;
+	r->level = level;
+	logCatchCrashes();
+      }
+      pthread_mutex_lock(&mine);
+      __atomic_store_n(&logRecorder, r, __ATOMIC_RELEASE);
+      logUpdate();
+      pthread_mutex_unlock(&mine);
+    }
+    void
+    logSetRecorder(size_t n, unsigned level) {
+      pthread_once(&logOnce, logInit);
+      logRecorderMode(n, level);
+    }
+
+    // Slots hold the formatted line, so that a crash handler only has to write it
+    static void
+    logRecord(LogRecorder &r, unsigned n, uint64_t nsecs, const char *fmt, va_list ap) {
+      uint64_t seq = __atomic_fetch_add(&r.next, 1, __ATOMIC_RELAXED);
+      uint8_t *slot = r.slots + (seq % r.nSlots) * LOG_SLOT;
+      __atomic_store_n((uint64_t *)slot, 0, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_RELEASE);
+      char *text = (char *)slot + 8;
+      size_t max = LOG_SLOT - 8 - 1, len; // room for the newline
+      unsigned usecs = (unsigned)(nsecs % 1000000000 / 1000);
+      int k = snprintf(text, max, "OCPI(%2d:%3u.%04u): ", n,
+		       (unsigned)(nsecs / 1000000000 % 1000), (usecs+500)/1000);
+      len = std::min((size_t)(k < 0 ? 0 : k), max - 1);
+      k = vsnprintf(text + len, max - len, fmt, ap);
+      len += std::min((size_t)(k < 0 ? 0 : k), max - len - 1);
+      if (!len || text[len-1] != '\n')
+	text[len++] = '\n';
+      text[len] = '\0';
+      __atomic_store_n((uint64_t *)slot, seq + 1, __ATOMIC_RELEASE);
+    }
+
+    // Append a string or a number without stdio, which is not async-signal-safe
+    static char *
+    logAppend(char *p, const char *s) {
+      while (*s)
+	*p++ = *s++;
+      return p;
+    }
+    static char *
+    logAppend(char *p, uint64_t n) {
+      char digits[20];
+      unsigned k = 0;
+      do
+	digits[k++] = (char)('0' + n % 10);
+      while (n /= 10);
+      while (k)
+	*p++ = digits[--k];
+      return p;
+    }
+
+    // Used from the crash handler, so only async-signal-safe calls here
+    void
+    logDumpRecorder(int fd) throw() {
+      LogRecorder *r = __atomic_load_n(&logRecorder, __ATOMIC_ACQUIRE);
+      if (!r)
+	return;
+      char line[LOG_SLOT];
+      uint64_t next = __atomic_load_n(&r->next, __ATOMIC_ACQUIRE),
+	first = next > r->nSlots ? next - r->nSlots : 0;
+      char *p = logAppend(line, "OCPI flight recorder: the last ");
+      p = logAppend(logAppend(logAppend(p, next - first), " of "), next);
+      p = logAppend(p, " log records:\n");
+      if (write(fd, line, (size_t)(p - line)) < 0)
+	return;
+      for (uint64_t seq = first; seq < next; seq++) {
+	const uint8_t *slot = r->slots + (seq % r->nSlots) * LOG_SLOT;
+	if (__atomic_load_n((const uint64_t *)slot, __ATOMIC_ACQUIRE) != seq + 1)
+	  continue;
+	memcpy(line, slot + 8, LOG_SLOT - 8);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n((const uint64_t *)slot, __ATOMIC_RELAXED) != seq + 1)
+	  continue; // reused while we copied it
+	if (write(fd, line, strlen(line)) < 0)
+	  return;
+      }
+    }
+
+    // Called with "mine" held or during initialization
+    static void
+    logUpdate() {
+      unsigned threshold = logLevel;
+      for (unsigned n = 0; n < nLogSubsystems; n++)
+	threshold = std::max(threshold, logSubsystems[n].level);
+      if (logRecorder)
+	threshold = std::max(threshold, logRecorder->level);
+      logBySubsystem = nLogSubsystems != 0;
+      logThreshold = threshold;
+    }
+
+    static void
+    logInit() {
+      const char *e;
+      if (logLevel == UINT_MAX) {
+	e = getenv("OCPI_LOG_LEVEL");
+	logLevel = e ? (unsigned)atoi(e) : OCPI_LOG_WEIRD;
+      }
+      logUpdate();
+      if ((e = getenv("OCPI_LOG_LEVELS")))
+	logSubsystemLevels(e);
+      if ((e = getenv("OCPI_LOG_RECORDER"))) {
+	char *end;
+	size_t n = strtoul(e, &end, 0);
+	logRecorderMode(n, *end == ':' ? (unsigned)atoi(end + 1) : OCPI_LOG_DEBUG);
+      }
+      if ((e = getenv("OCPI_LOG_ASYNC")) && *e && strcmp(e, "0"))
+	logAsyncMode(true);
+    }
+
     void
     logSetLevel(unsigned level) {
+      pthread_once(&logOnce, logInit);
+      pthread_mutex_lock(&mine);
       logLevel = level;
+      __atomic_add_fetch(&logGeneration, 1, __ATOMIC_RELEASE);
+      logUpdate();
+      pthread_mutex_unlock(&mine);
     }
     unsigned
     logGetLevel() {
+      pthread_once(&logOnce, logInit);
       return logLevel;
     }
+    bool
+    logWillLog(unsigned n) {
+      pthread_once(&logOnce, logInit);
+      return n <= logLevel;
+    }
+    bool
+    logSubsystemWillLog(unsigned n, const char *file) throw() {
+      pthread_once(&logOnce, logInit);
+      LogRecorder *r = logRecorder;
+      return n <= logLevelFor(file) || (r && n <= r->level);
+    }
+
+    static void
+    logEmit(unsigned n, const char *file, const char *fmt, va_list ap) {
+      pthread_once(&logOnce, logInit);
+      LogRecorder *r = __atomic_load_n(&logRecorder, __ATOMIC_ACQUIRE);
+      bool print = n <= logLevelFor(file), record = r && n <= r->level;
+      if (!print && !record)
+	return;
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      uint64_t nsecs = (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+      if (record) {
+	va_list aq;
+	va_copy(aq, ap);
+	logRecord(*r, n, nsecs, fmt, aq);
+	va_end(aq);
+      }
+      if (!print || (logAsync && logQueue(n, nsecs, fmt, ap)))
+	return;
+      pthread_mutex_lock (&mine);
+      fprintf(stderr, "OCPI(%2d:%3u.%04u): ", n, (unsigned)(ts.tv_sec%1000),
+	      (unsigned)((ts.tv_nsec/1000+500)/1000));
+      vfprintf(stderr, fmt, ap);
+      if (!*fmt || fmt[strlen(fmt)-1] != '\n')
+	fprintf(stderr, "\n");
+      fflush(stderr);
+      pthread_mutex_unlock (&mine);
+    }
     void
     logPrint(unsigned n, const char *fmt, ...) throw() {
 	va_list ap;
 	va_start(ap, fmt);
-	logPrintV(n, fmt, ap);
+	logEmit(n, NULL, fmt, ap);
 	va_end(ap);
     }
-    bool
-    logWillLog(unsigned n) {
-      if (logLevel != UINT_MAX && n > logLevel)
-	return false;
-      if (logLevel == UINT_MAX) {
-	const char *e = getenv("OCPI_LOG_LEVEL");
-	logLevel = e ? atoi(e) : OCPI_LOG_WEIRD;
-      }
-      return n <= logLevel;
+    void
+    logPrintAt(unsigned n, const char *file, const char *fmt, ...) throw() {
+	va_list ap;
+	va_start(ap, fmt);
+	logEmit(n, file, fmt, ap);
+	va_end(ap);
     }
     void
     logPrintV(unsigned n, const char *fmt, va_list ap) throw() {
-      if (logWillLog(n)) {
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
-	pthread_mutex_lock (&mine);
-	fprintf(stderr, "OCPI(%2d:%3u.%04u): ", n, (unsigned)(tv.tv_sec%1000),
-		(unsigned)((tv.tv_usec+500)/1000));
-	vfprintf(stderr, fmt, ap);
-	if (fmt[strlen(fmt)-1] != '\n')
-	  fprintf(stderr, "\n");
-	fflush(stderr);
-	pthread_mutex_unlock (&mine);
-      }
+      logEmit(n, NULL, fmt, ap);
     }
   }
 }
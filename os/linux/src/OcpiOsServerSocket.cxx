@@ -257,6 +257,20 @@ sendto (const char * data, size_t amount, int flags,  char * src_addr, size_t ad
 size_t ServerSocket::
 recvfrom(char  *buf, size_t amount, int flags,
 	 char * src_addr, size_t * addrlen, unsigned timeoutms) throw (std::string) {
+  setRecvTimeout(timeoutms);
+  struct sockaddr * si_other = reinterpret_cast< struct sockaddr *>(src_addr);
+  ssize_t ret;
+  ret= ::recvfrom (o2fd (m_osOpaque), buf, amount, flags, si_other, (socklen_t*)addrlen);
+  if (ret == -1) {
+    if (errno != EAGAIN && errno != EINTR)
+      throw Posix::getErrorMessage(errno);
+    return 0;
+  }
+  return static_cast<size_t> (ret);
+}
+
+void ServerSocket::
+setRecvTimeout(unsigned timeoutms) throw (std::string) {
   if (timeoutms != m_timeoutms) {
     struct timeval tv;
     tv.tv_sec = timeoutms/1000;
@@ -266,15 +280,74 @@ recvfrom(char  *buf, size_t amount, int flags,
       throw Posix::getErrorMessage (errno);
     m_timeoutms = timeoutms;
   }
-  struct sockaddr * si_other = reinterpret_cast< struct sockaddr *>(src_addr);
-  ssize_t ret;
-  ret= ::recvfrom (o2fd (m_osOpaque), buf, amount, flags, si_other, (socklen_t*)addrlen);
-  if (ret == -1) {
-    if (errno != EAGAIN && errno != EINTR)
+}
+
+#ifdef OCPI_OS_linux
+// The kernel wants its own array, so convert in chunks of this many
+static const unsigned MMSG_CHUNK = 64;
+#endif
+
+void ServerSocket::
+sendmmsg(const void *msgs, unsigned count, int flags) throw (std::string) {
+  const struct msghdr *msg = static_cast<const struct msghdr *>(msgs);
+#ifdef OCPI_OS_linux
+  struct mmsghdr mmsg[MMSG_CHUNK];
+  while (count) {
+    unsigned n = count > MMSG_CHUNK ? MMSG_CHUNK : count;
+    for (unsigned i = 0; i < n; i++)
+      mmsg[i].msg_hdr = msg[i];
+    int ret = ::sendmmsg(o2fd(m_osOpaque), mmsg, n, flags);
+    if (ret < 0) {
+      if (errno == EINTR)
+	continue;
       throw Posix::getErrorMessage(errno);
-    return 0;
+    }
+    msg += ret;
+    count -= (unsigned)ret;
   }
-  return static_cast<size_t> (ret);
+#else
+  for (; count; count--, msg++)
+    while (::sendmsg(o2fd(m_osOpaque), msg, flags) < 0)
+      if (errno != EINTR)
+	throw Posix::getErrorMessage(errno);
+#endif
+}
+
+unsigned ServerSocket::
+recvmmsg(void *msgs, size_t *lengths, unsigned count, int flags, unsigned timeoutms)
+  throw (std::string) {
+  struct msghdr *msg = static_cast<struct msghdr *>(msgs);
+  setRecvTimeout(timeoutms);
+#ifdef OCPI_OS_linux
+  struct mmsghdr mmsg[MMSG_CHUNK];
+  if (count > MMSG_CHUNK)
+    count = MMSG_CHUNK;
+  for (unsigned i = 0; i < count; i++)
+    mmsg[i].msg_hdr = msg[i];
+  int ret;
+  // Block (with the socket's timeout) for the first one, but not for the rest
+  while ((ret = ::recvmmsg(o2fd(m_osOpaque), mmsg, count, flags | MSG_WAITFORONE, NULL)) < 0)
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return 0;
+    else if (errno != EINTR)
+      throw Posix::getErrorMessage(errno);
+  for (int i = 0; i < ret; i++) {
+    msg[i].msg_namelen = mmsg[i].msg_hdr.msg_namelen;
+    msg[i].msg_flags = mmsg[i].msg_hdr.msg_flags;
+    lengths[i] = mmsg[i].msg_len;
+  }
+  return (unsigned)ret;
+#else
+  (void)count;
+  ssize_t ret;
+  while ((ret = ::recvmsg(o2fd(m_osOpaque), msg, flags)) < 0)
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return 0;
+    else if (errno != EINTR)
+      throw Posix::getErrorMessage(errno);
+  lengths[0] = (size_t)ret;
+  return 1;
+#endif
 }
 
 
@@ -23,6 +23,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -156,8 +157,8 @@ connect(const std::string & remoteHost, uint16_t remotePort, bool udp) throw (st
   o2fd(m_osOpaque) = fileno;
 }
 
-size_t Socket::
-recv(char *buffer, size_t amount, unsigned timeoutms, bool all) throw (std::string) {
+void Socket::
+setRecvTimeout(unsigned timeoutms) throw (std::string) {
   if (timeoutms != m_timeoutms) {
     struct timeval tv;
     tv.tv_sec = timeoutms/1000;
@@ -167,6 +168,11 @@ recv(char *buffer, size_t amount, unsigned timeoutms, bool all) throw (std::stri
       throw "Error setting timeout option for sending: " + Posix::getErrorMessage(errno);
     m_timeoutms = timeoutms;
   }
+}
+
+size_t Socket::
+recv(char *buffer, size_t amount, unsigned timeoutms, bool all) throw (std::string) {
+  setRecvTimeout(timeoutms);
   size_t nread = 0;
   do {
     ssize_t n = ::recv(o2fd(m_osOpaque), buffer, amount, 0);
@@ -193,6 +199,19 @@ recv(char *buffer, size_t amount, unsigned timeoutms, bool all) throw (std::stri
   return nread;
 }
 
+size_t Socket::
+recvv(const void *iov, unsigned iovcnt, unsigned timeoutms) throw (std::string) {
+  setRecvTimeout(timeoutms);
+  ssize_t n;
+  while ((n = ::readv(o2fd(m_osOpaque), (const struct iovec *)iov, (int)iovcnt)) < 0)
+    if (errno == EAGAIN || errno == EWOULDBLOCK) { // timeout errors
+      assert(timeoutms);
+      return SIZE_MAX;
+    } else if (errno != EINTR)
+      throw "Error receiving from network: " + Posix::getErrorMessage (errno);
+  return (size_t)n;
+}
+
 size_t Socket::
 recvfrom(char  *buf, size_t amount, int flags,
 	 char * src_addr, size_t * addrlen, unsigned timeoutms) throw (std::string) {
@@ -253,6 +272,41 @@ send(const char * data, size_t amount) throw (std::string) {
   return amount;
 }
 
+size_t Socket::
+sendv(void *vec, unsigned iovcnt) throw (std::string) {
+  struct iovec *iov = (struct iovec *)vec;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  size_t amount = 0;
+  for (unsigned n = 0; n < iovcnt; n++)
+    amount += iov[n].iov_len;
+  for (size_t left = amount; left; ) {
+    // Skip buffers that have been completely sent
+    while (!iov->iov_len)
+      iov++, iovcnt--;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt > IOV_MAX ? IOV_MAX : iovcnt;
+    ssize_t nsent = ::sendmsg(o2fd(m_osOpaque), &msg, SEND_OPTS);
+    if (nsent == 0)
+      throw std::string("Error sending to network: got EOF");
+    else if (nsent < 0) {
+      if (errno == EINTR)
+	continue;
+      throw "Error sending to network: " + Posix::getErrorMessage(errno);
+    }
+    left -= (size_t)nsent;
+    for (size_t n = (size_t)nsent; n; ) {
+      size_t taken = n < iov->iov_len ? n : iov->iov_len;
+      iov->iov_base = (char *)iov->iov_base + taken;
+      iov->iov_len -= taken;
+      n -= taken;
+      if (!iov->iov_len && n)
+	iov++, iovcnt--;
+    }
+  }
+  return amount;
+}
+
 // NOTE THIS CODE IS REPLICATED IN THE SERVER FOR DATAGRAMS
 size_t Socket::
 sendmsg (const void * iovect, unsigned int flags  ) throw (std::string) {
@@ -0,0 +1,45 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This file contains the implementation for the bias_scaled worker in C++
+ */
+
+#include "bias_scaled-worker.hh"
+
+using namespace OCPI::RCC; // for easy access to RCC data types and constants
+
+class Bias_scaledWorker : public Bias_scaledWorkerTypes::Bias_scaledWorkerBase {
+  RCCResult run(bool /*timedout*/) {
+    const uint32_t *inData  = in.data().data().data();   // data arg of data message at "in" port
+    uint32_t *outData = out.data().data().data();  // same at "out" port
+
+    out.checkLength(in.length());               // make sure input will fit in output buffer
+    for (size_t n = in.data().data().size(); n; n--) // n is length in sequence elements of input
+      *outData++ = *inData++ + properties().biasValue;
+    out.setInfo(in.opCode(), in.length());      // Set the metadata for the output message
+    return RCC_ADVANCE;
+  }
+};
+
+BIAS_SCALED_START_INFO
+// Insert any static info assignments here (memSize, memSizes, portInfo)
+// e.g.: info.memSize = sizeof(MyMemoryStruct);
+BIAS_SCALED_END_INFO
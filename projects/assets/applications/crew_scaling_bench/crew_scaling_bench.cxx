@@ -0,0 +1,107 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Throughput of a pattern source feeding a capture sink through a crew of bias_scaled
+ * workers, for crew sizes (scale) from 1 up to a maximum.  The pattern output is spread
+ * over the crew members by least busy member, and the members' outputs are merged into
+ * the capture.  Within a process, messages pass between the members and the ports they
+ * are connected to by lending buffers rather than copying them.  Each scale runs in its
+ * own process with as many RCC threads as crew members.  The bias_scaled worker is built in
+ * the local library of this directory.
+ *
+ * usage: crew_scaling_bench [max-scale [messages [message-size]]]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "OcpiApi.hh"
+
+namespace OA = OCPI::API;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int run(unsigned scale, unsigned long nMessages, size_t size) {
+  char buf[2048];
+  snprintf(buf, sizeof(buf), "%u", scale);
+  setenv("OCPI_RCC_THREADS", buf, 1);
+  // The pattern's messages all come from its one metadata record: size bytes, opcode 0
+  snprintf(buf, sizeof(buf),
+	   "<application>"
+	   "  <instance component='ocpi.assets.base_comps.pattern' connect='bias'>"
+	   "    <property name='messagesToSend' value='%lu'/>"
+	   "    <property name='metadata' value='{%zu,0,0,0}'/>"
+	   "  </instance>"
+	   "  <instance component='local.bias_scaled' name='bias' connect='capture'"
+	   "            scale='%u'/>"
+	   "  <instance component='ocpi.assets.base_comps.capture'>"
+	   "    <property name='control' value='1'/>"
+	   "  </instance>"
+	   "</application>", nMessages, size, scale);
+  try {
+    OA::Application app(buf);
+    app.initialize();
+    double start = now();
+    app.start();
+    unsigned long received;
+    while ((received = app.getPropertyValue<uint32_t>("capture", "metadataCount")) <
+	   nMessages)
+      usleep(1000);
+    double elapsed = now() - start;
+    printf("scale: %u  messages: %8lu  size: %4zu  msgs/sec: %10.0f  MB/sec: %8.1f\n",
+	   scale, received, size, (double)received / elapsed,
+	   (double)received * (double)size / elapsed / 1e6);
+    app.stop();
+    return 0;
+  } catch (std::string &e) {
+    fprintf(stderr, "Exception thrown: %s\n", e.c_str());
+  }
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  unsigned maxScale = argc > 1 ? (unsigned)atoi(argv[1]) : 8;
+  unsigned long nMessages = argc > 2 ? strtoul(argv[2], NULL, 0) : 200000;
+  size_t size = argc > 3 ? strtoul(argv[3], NULL, 0) : 64;
+  // The pattern's data memory is 16 words
+  if (maxScale < 1 || size > 64 || size % 4) {
+    fprintf(stderr, "Usage is: %s [max-scale [messages [message-size]]]\n"
+	    "  message-size must be a multiple of 4, at most 64\n", argv[0]);
+    return 1;
+  }
+  int status = 0;
+  for (unsigned s = 1; s <= maxScale; s++) {
+    pid_t pid = fork();
+    if (pid == 0)
+      return run(s, nMessages, size);
+    int ws;
+    if (pid < 0 || waitpid(pid, &ws, 0) < 0 || !WIFEXITED(ws) || WEXITSTATUS(ws))
+      status = 1;
+  }
+  return status;
+}
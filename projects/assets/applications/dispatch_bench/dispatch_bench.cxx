@@ -0,0 +1,114 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Cost of transport dispatch as the number of circuits in one container grows: a chain of
+ * RCC bias workers, one circuit per connection, with messages pushed in at one end and
+ * pulled out of the other by this program.  Dispatch used to visit every circuit on each
+ * pass, so the time per message per hop grew with the length of the chain; now it only
+ * visits circuits with queued transfers.
+ *
+ * usage: dispatch_bench [max-workers [messages [message-size]]]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <time.h>
+#include "OcpiApi.hh"
+
+namespace OA = OCPI::API;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static bool run(unsigned nWorkers, unsigned long nMessages, size_t size) {
+  std::string xml("<application package='ocpi.core'>");
+  for (unsigned n = 0; n < nWorkers; n++) {
+    char inst[200];
+    snprintf(inst, sizeof(inst),
+	     "<instance component='bias' name='bias%u' model='rcc'%s%s", n,
+	     n == 0 ? " external='in'" : "", n == nWorkers - 1 ? " external='out'" : "");
+    xml += inst;
+    if (n != nWorkers - 1) {
+      snprintf(inst, sizeof(inst), " connect='bias%u'", n + 1);
+      xml += inst;
+    }
+    xml += "/>";
+  }
+  xml += "</application>";
+  try {
+    OA::Application app(xml);
+    app.initialize();
+    OA::ExternalPort &in = app.getPort("in"), &out = app.getPort("out");
+    app.start();
+    unsigned long sent = 0, received = 0;
+    double start = now();
+    while (received < nMessages) {
+      bool did = false;
+      OA::ExternalBuffer *b;
+      uint8_t *data, opCode;
+      size_t length;
+      bool eof;
+      if (sent < nMessages && (b = in.getBuffer(data, length))) {
+	length = length < size ? length : size;
+	memset(data, (int)sent, length);
+	b->put(length);
+	sent++;
+	did = true;
+      }
+      if ((b = out.getBuffer(data, length, opCode, eof))) {
+	b->release();
+	received++;
+	did = true;
+      }
+      if (!did)
+	sleep(0);
+    }
+    double elapsed = now() - start;
+    printf("workers: %4u  circuits: %4u  msgs/sec: %10.0f  usecs/msg/hop: %8.2f\n",
+	   nWorkers, nWorkers + 1, (double)nMessages / elapsed,
+	   elapsed * 1e6 / (double)nMessages / (nWorkers + 1));
+    app.stop();
+    return true;
+  } catch (std::string &e) {
+    fprintf(stderr, "Exception thrown: %s\n", e.c_str());
+  }
+  return false;
+}
+
+int main(int argc, char **argv) {
+  unsigned maxWorkers = argc > 1 ? (unsigned)atoi(argv[1]) : 128;
+  unsigned long nMessages = argc > 2 ? strtoul(argv[2], NULL, 0) : 5000;
+  size_t size = argc > 3 ? strtoul(argv[3], NULL, 0) : 1024;
+  if (maxWorkers < 1) {
+    fprintf(stderr, "Usage is: %s [max-workers [messages [message-size]]]\n", argv[0]);
+    return 1;
+  }
+  for (unsigned n = 1; n <= maxWorkers; n *= 2)
+    if (!run(n, nMessages, size))
+      return 1;
+  return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Throughput of the dsp_comps sample processing kernels in Msamples/sec, for each engine
+ * this CPU supports.  Every engine's output is checked against the generic one, which
+ * processes one sample at a time as the workers used to.
+ *
+ * usage: dsp_kernels_bench [samples [repetitions]]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <time.h>
+#include "dsp_kernels.h"
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static const unsigned NTAPS = 32;
+static size_t nSamples;
+static unsigned nReps;
+static std::vector<int16_t> s16, s16taps;
+static std::vector<float> f32, f32taps;
+
+// Each kernel processes nSamples samples into the output buffer
+struct Kernel {
+  const char *name;
+  size_t (*run)(std::vector<uint8_t> &out);
+};
+
+static size_t firReal(std::vector<uint8_t> &out) {
+  dsp_fir_s16(&s16taps[0], NTAPS, 1, &s16[0], (int16_t *)&out[0], nSamples, 15);
+  return nSamples * sizeof(int16_t);
+}
+static size_t firComplex(std::vector<uint8_t> &out) {
+  dsp_fir_s16(&s16taps[0], NTAPS, 2, &s16[0], (int16_t *)&out[0], 2 * nSamples, 15);
+  return 2 * nSamples * sizeof(int16_t);
+}
+static size_t firFloat(std::vector<uint8_t> &out) {
+  dsp_fir_f32(&f32taps[0], NTAPS, 1, &f32[0], (float *)&out[0], nSamples);
+  return nSamples * sizeof(float);
+}
+static size_t mixer(std::vector<uint8_t> &out) {
+  DspNco nco = { 0 };
+  dsp_nco_mix_s16c(&nco, 0x12345679, &s16[0], (int16_t *)&out[0], nSamples);
+  return 2 * nSamples * sizeof(int16_t);
+}
+static size_t mixerFloat(std::vector<uint8_t> &out) {
+  DspNcoF nco = { 0 };
+  dsp_ncof_mix_s16c(&nco, 0.0123456, &s16[0], (int16_t *)&out[0], nSamples);
+  return 2 * nSamples * sizeof(int16_t);
+}
+static size_t cic(std::vector<uint8_t> &out) {
+  DspCic c;
+  dsp_cic_init(&c, 4, 8, 12);
+  return 2 * sizeof(int16_t) * dsp_cic_dec_s16c(&c, &s16[0], nSamples, (int16_t *)&out[0]);
+}
+static size_t discrim(std::vector<uint8_t> &out) {
+  int16_t prev[2] = { 1, 0 };
+  dsp_fm_discrim_s16c(prev, &s16[0], (int16_t *)&out[0], nSamples);
+  return nSamples * sizeof(int16_t);
+}
+static size_t slicer(std::vector<uint8_t> &out) {
+  dsp_slice_s16(&s16[0], (uint16_t *)&out[0], nSamples / 16);
+  return nSamples / 16 * sizeof(uint16_t);
+}
+
+static const Kernel kernels[] = {
+  { "fir real s16", firReal }, { "fir complex s16", firComplex }, { "fir real f32", firFloat },
+  { "nco mixer s16", mixer }, { "nco mixer f32", mixerFloat },
+  { "cic decimator s16", cic }, { "fm discrim s16", discrim },
+  { "slicer s16", slicer },
+};
+
+int main(int argc, char **argv) {
+  nSamples = argc > 1 ? strtoul(argv[1], NULL, 0) : 64 * 1024;
+  nReps = argc > 2 ? (unsigned)atoi(argv[2]) : 200;
+  // Complex samples and FIR history, as a noisy tone that uses the full range
+  size_t nElements = 2 * nSamples + 2 * NTAPS;
+  unsigned seed = 1;
+  s16.resize(nElements);
+  f32.resize(nElements);
+  for (size_t n = 0; n < nElements; n++) {
+    s16[n] = (int16_t)(24000 * sin((double)n * 0.01) + (int)(rand_r(&seed) % 16001) - 8000);
+    f32[n] = s16[n] / 32768.0f;
+  }
+  for (unsigned k = 0; k < NTAPS; k++) {
+    s16taps.push_back((int16_t)(rand_r(&seed) % 8192 - 4096));
+    f32taps.push_back(s16taps[k] / 32768.0f);
+  }
+  static const char *engines[] = { "generic", "sse2", "avx2" };
+  int status = 0;
+  printf("samples: %zu, repetitions: %u\n", nSamples, nReps);
+  for (unsigned k = 0; k < sizeof(kernels)/sizeof(kernels[0]); k++) {
+    std::vector<uint8_t> expected(nElements * sizeof(float)), out(expected.size());
+    size_t nBytes = 0;
+    for (unsigned e = 0; e < sizeof(engines)/sizeof(engines[0]); e++) {
+      if (!dsp_set_engine(engines[e]))
+	continue;
+      std::vector<uint8_t> &o = e ? out : expected;
+      double start = now();
+      for (unsigned r = 0; r < nReps; r++)
+	nBytes = kernels[k].run(o);
+      double elapsed = now() - start;
+      bool ok = !e || !memcmp(&out[0], &expected[0], nBytes);
+      if (!ok)
+	status = 1;
+      printf("%-18s %-8s %9.1f Msamples/sec%s\n", kernels[k].name, engines[e],
+	     (double)nSamples * nReps / elapsed / 1e6, ok ? "" : "  MISMATCH");
+    }
+  }
+  return status;
+}
@@ -0,0 +1,176 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Throughput and CPU cost of streaming through an RCC bias worker from and to this
+ * program, with one thread feeding the input port and another draining the output port.
+ * The "poll" mode is how ACI programs had to do it: try getBuffer and yield when there is
+ * none.  The "block" mode uses the getBuffer calls that wait with a timeout.  The "batch"
+ * mode gets and puts several buffers at a time with getBuffers and putBuffers.  CPU time
+ * is for the whole process, including the container's threads.
+ *
+ * usage: external_port_bench [messages [message-size [batch]]]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "OcpiApi.hh"
+
+namespace OA = OCPI::API;
+
+enum Mode { POLL, BLOCK, BATCH };
+static const char *modeNames[] = { "poll", "block", "batch" };
+static Mode mode;
+static unsigned long nMessages;
+static size_t size, batch;
+static const unsigned long TIMEOUT_US = 1000000;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double cpu() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+    (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static void *
+producer(void *arg) {
+  OA::ExternalPort &in = *(OA::ExternalPort *)arg;
+  std::vector<OA::ExternalBuffer *> bufs(batch);
+  std::vector<uint8_t *> datas(batch);
+  std::vector<size_t> lengths(batch);
+  for (unsigned long sent = 0; sent < nMessages; ) {
+    uint8_t *data;
+    size_t length;
+    OA::ExternalBuffer *b;
+    switch (mode) {
+    case POLL:
+      if (!(b = in.getBuffer(data, length))) {
+	sleep(0);
+	continue;
+      }
+      break;
+    case BLOCK:
+      if (!(b = in.getBuffer(data, length, TIMEOUT_US)))
+	continue;
+      break;
+    case BATCH:
+      {
+	size_t n = in.getBuffers(&bufs[0], &datas[0], &lengths[0], NULL, NULL,
+				 std::min(batch, (size_t)(nMessages - sent)), true, TIMEOUT_US);
+	for (size_t i = 0; i < n; i++) {
+	  lengths[i] = std::min(size, lengths[i]);
+	  memset(datas[i], (int)(sent + i), lengths[i]);
+	}
+	in.putBuffers(&bufs[0], n, &lengths[0]);
+	sent += n;
+      }
+      continue;
+    }
+    length = std::min(length, size);
+    memset(data, (int)sent, length);
+    b->put(length);
+    sent++;
+  }
+  return NULL;
+}
+
+static bool run(Mode a_mode) {
+  mode = a_mode;
+  try {
+    OA::Application
+      app("<application package='ocpi.core'>"
+	  "  <instance component='bias' model='rcc' externals='1'/>"
+	  "</application>");
+    app.initialize();
+    OA::ExternalPort &in = app.getPort("in"), &out = app.getPort("out");
+    app.start();
+    std::vector<OA::ExternalBuffer *> bufs(batch);
+    std::vector<uint8_t *> datas(batch);
+    std::vector<size_t> lengths(batch);
+    double start = now(), startCpu = cpu();
+    pthread_t thread;
+    pthread_create(&thread, NULL, producer, &in);
+    unsigned long received = 0;
+    size_t bytes = 0;
+    while (received < nMessages) {
+      uint8_t *data, opCode;
+      size_t length;
+      bool eof;
+      OA::ExternalBuffer *b;
+      switch (mode) {
+      case POLL:
+	if ((b = out.getBuffer(data, length, opCode, eof))) {
+	  bytes += length;
+	  b->release();
+	  received++;
+	} else
+	  sleep(0);
+	break;
+      case BLOCK:
+	if ((b = out.getBuffer(data, length, opCode, eof, TIMEOUT_US))) {
+	  bytes += length;
+	  b->release();
+	  received++;
+	}
+	break;
+      case BATCH:
+	for (size_t n = out.getBuffers(&bufs[0], &datas[0], &lengths[0], NULL, NULL, batch, true,
+				       TIMEOUT_US), i = 0; i < n; i++) {
+	  bytes += lengths[i];
+	  bufs[i]->release();
+	  received++;
+	}
+      }
+    }
+    pthread_join(thread, NULL);
+    double elapsed = now() - start, cpuSecs = cpu() - startCpu;
+    printf("%-6s %10.1f MB/sec  %8.3f secs  %8.3f cpu secs  %6.2f cpu/wall\n",
+	   modeNames[mode], (double)bytes / elapsed / 1e6, elapsed, cpuSecs, cpuSecs / elapsed);
+    app.stop();
+    return true;
+  } catch (std::string &e) {
+    fprintf(stderr, "Exception thrown: %s\n", e.c_str());
+  }
+  return false;
+}
+
+int main(int argc, char **argv) {
+  nMessages = argc > 1 ? strtoul(argv[1], NULL, 0) : 100000;
+  size = argc > 2 ? strtoul(argv[2], NULL, 0) : 4096;
+  batch = argc > 3 ? strtoul(argv[3], NULL, 0) : 8;
+  if (!nMessages || !batch) {
+    fprintf(stderr, "Usage is: %s [messages [message-size [batch]]]\n", argv[0]);
+    return 1;
+  }
+  printf("messages: %lu of %zu bytes, batch: %zu\n", nMessages, size, batch);
+  return run(POLL) && run(BLOCK) && run(BATCH) ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Throughput of file_read feeding file_write with messages in the file, for each of the
+ * ways they can do their I/O: read() and write() per header and payload (the original
+ * behavior), file_read mapping the file or reading it with O_DIRECT, and file_write
+ * batching messages into large writes.  The input file is generated once, and each run's
+ * output is checked against it byte for byte.  Messages have lengths from zero up to the
+ * message size and varying opcodes, so message boundaries land anywhere in file_read's
+ * windows and file_write's batches, and some messages are too big to be batched at all.
+ * Use a file bigger than memory to see the effect of the page cache.
+ *
+ * usage: file_io_bench [file-megabytes [message-size [directory]]]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <time.h>
+#include "OcpiApi.hh"
+
+namespace OA = OCPI::API;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+struct Header {
+  uint32_t length;
+  uint32_t opcode;
+};
+
+static bool generate(const std::string &name, size_t fileBytes, size_t size) {
+  FILE *f = fopen(name.c_str(), "w");
+  if (!f)
+    return false;
+  std::vector<uint8_t> payload(size);
+  for (size_t written = 0, n = 0; written < fileBytes; n++) {
+    Header h = { (uint32_t)(n * 7919 % (size + 1)), (uint32_t)(n & 0xff) };
+    written += sizeof(Header) + h.length;
+    for (size_t i = 0; i < h.length; i++)
+      payload[i] = (uint8_t)(n + i);
+    if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+	(h.length && fwrite(&payload[0], h.length, 1, f) != 1)) {
+      fclose(f);
+      return false;
+    }
+  }
+  return fclose(f) == 0;
+}
+
+static bool same(const std::string &a, const std::string &b) {
+  FILE *fa = fopen(a.c_str(), "r"), *fb = fopen(b.c_str(), "r");
+  bool ok = fa && fb;
+  std::vector<char> ba(1024*1024), bb(1024*1024);
+  while (ok) {
+    size_t na = fread(&ba[0], 1, ba.size(), fa), nb = fread(&bb[0], 1, bb.size(), fb);
+    if (na != nb || memcmp(&ba[0], &bb[0], na))
+      ok = false;
+    else if (!na)
+      break;
+  }
+  if (fa)
+    fclose(fa);
+  if (fb)
+    fclose(fb);
+  return ok;
+}
+
+static bool run(const char *name, const char *readProps, const char *writeProps,
+		const std::string &in, const std::string &out, size_t fileBytes, size_t size) {
+  char buf[4096];
+  snprintf(buf, sizeof(buf),
+	   "<application package='ocpi.core'>"
+	   "  <instance component='file_read' connect='file_write'>"
+	   "    <property name='fileName' value='%s'/>"
+	   "    <property name='messagesInFile' value='true'/>"
+	   "    %s"
+	   "  </instance>"
+	   "  <instance component='file_write'>"
+	   "    <property name='fileName' value='%s'/>"
+	   "    <property name='messagesInFile' value='true'/>"
+	   "    %s"
+	   "  </instance>"
+	   "  <connection>"
+	   "    <port instance='file_read' name='out'/>"
+	   "    <port instance='file_write' name='in' buffersize='%zu'/>"
+	   "  </connection>"
+	   "</application>", in.c_str(), readProps, out.c_str(), writeProps, size);
+  try {
+    OA::Application app(buf);
+    app.initialize();
+    double start = now();
+    app.start();
+    app.wait();
+    app.finish();
+    double elapsed = now() - start;
+    bool ok = same(in, out);
+    printf("%-16s %8.1f MB/sec  %8.3f secs  %s\n", name, (double)fileBytes / elapsed / 1e6,
+	   elapsed, ok ? "output matches" : "OUTPUT DIFFERS");
+    unlink(out.c_str());
+    return ok;
+  } catch (std::string &e) {
+    fprintf(stderr, "%s: exception thrown: %s\n", name, e.c_str());
+  }
+  return false;
+}
+
+int main(int argc, char **argv) {
+  size_t fileBytes = (argc > 1 ? strtoul(argv[1], NULL, 0) : 1024) * 1024 * 1024;
+  size_t size = argc > 2 ? strtoul(argv[2], NULL, 0) : 4096;
+  std::string dir = argc > 3 ? argv[3] : ".";
+  if (!size || !fileBytes) {
+    fprintf(stderr, "Usage is: %s [file-megabytes [message-size [directory]]]\n", argv[0]);
+    return 1;
+  }
+  std::string in = dir + "/file_io_bench.in", out = dir + "/file_io_bench.out";
+  if (!generate(in, fileBytes, size)) {
+    fprintf(stderr, "Could not create input file %s\n", in.c_str());
+    return 1;
+  }
+  printf("file: %zu MB of messages up to %zu bytes\n", fileBytes / (1024 * 1024), size);
+  static const char batch[] = "<property name='batchSize' value='1048576'/>";
+  char smallBatch[100];
+  snprintf(smallBatch, sizeof(smallBatch), "<property name='batchSize' value='%zu'/>",
+	   size / 2 + 1);
+  bool ok =
+    run("read/write", "", "", in, out, fileBytes, size) &&
+    run("mapped/write", "<property name='mapped' value='true'/>", "", in, out, fileBytes,
+	size) &&
+    run("direct/write", "<property name='direct' value='true'/>", "", in, out, fileBytes,
+	size) &&
+    run("read/batched", "", batch, in, out, fileBytes, size) &&
+    run("mapped/batched", "<property name='mapped' value='true'/>", batch, in, out, fileBytes,
+	size) &&
+    run("mapped/small", "<property name='mapped' value='true'/>", smallBatch, in, out,
+	fileBytes, size);
+  unlink(in.c_str());
+  return ok ? 0 : 1;
+}
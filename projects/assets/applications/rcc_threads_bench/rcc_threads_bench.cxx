@@ -0,0 +1,125 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Throughput of a chain of RCC bias workers as the number of threads given to the
+ * RCC container grows.  Messages are pushed in at one end of the chain and pulled
+ * out of the other by this program.  Each thread count runs in its own process,
+ * since the container's thread pool is set (by OCPI_RCC_THREADS) when the container
+ * is created.
+ *
+ * usage: rcc_threads_bench [max-threads [workers [messages [message-size]]]]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "OcpiApi.hh"
+
+namespace OA = OCPI::API;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int run(unsigned nThreads, unsigned nWorkers, unsigned long nMessages, size_t size) {
+  char buf[20];
+  snprintf(buf, sizeof(buf), "%u", nThreads);
+  setenv("OCPI_RCC_THREADS", buf, 1);
+  std::string xml("<application package='ocpi.core'>");
+  for (unsigned n = 0; n < nWorkers; n++) {
+    char inst[200];
+    snprintf(inst, sizeof(inst),
+	     "<instance component='bias' name='bias%u' model='rcc'%s%s", n,
+	     n == 0 ? " external='in'" : "", n == nWorkers - 1 ? " external='out'" : "");
+    xml += inst;
+    if (n != nWorkers - 1) {
+      snprintf(inst, sizeof(inst), " connect='bias%u'", n + 1);
+      xml += inst;
+    }
+    xml += "/>";
+  }
+  xml += "</application>";
+  try {
+    OA::Application app(xml);
+    app.initialize();
+    OA::ExternalPort &in = app.getPort("in"), &out = app.getPort("out");
+    app.start();
+    unsigned long sent = 0, received = 0;
+    double start = now();
+    while (received < nMessages) {
+      bool did = false;
+      OA::ExternalBuffer *b;
+      uint8_t *data, opCode;
+      size_t length;
+      bool eof;
+      if (sent < nMessages && (b = in.getBuffer(data, length))) {
+	length = length < size ? length : size;
+	memset(data, (int)sent, length);
+	b->put(length);
+	sent++;
+	did = true;
+      }
+      if ((b = out.getBuffer(data, length, opCode, eof))) {
+	b->release();
+	received++;
+	did = true;
+      }
+      if (!did)
+	sleep(0);
+    }
+    double elapsed = now() - start;
+    printf("threads: %2u  workers: %2u  messages: %8lu  size: %6zu  msgs/sec: %10.0f  MB/sec: %8.1f\n",
+	   nThreads, nWorkers, nMessages, size, (double)nMessages / elapsed,
+	   (double)nMessages * (double)size * nWorkers / elapsed / 1e6);
+    app.stop();
+    return 0;
+  } catch (std::string &e) {
+    fprintf(stderr, "Exception thrown: %s\n", e.c_str());
+  }
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  unsigned maxThreads = argc > 1 ? (unsigned)atoi(argv[1]) : (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned nWorkers = argc > 2 ? (unsigned)atoi(argv[2]) : 8;
+  unsigned long nMessages = argc > 3 ? strtoul(argv[3], NULL, 0) : 20000;
+  size_t size = argc > 4 ? strtoul(argv[4], NULL, 0) : 16*1024;
+  if (nWorkers < 1 || maxThreads < 1) {
+    fprintf(stderr, "Usage is: %s [max-threads [workers [messages [message-size]]]]\n", argv[0]);
+    return 1;
+  }
+  int status = 0;
+  for (unsigned t = 1; t <= maxThreads; t *= 2) {
+    pid_t pid = fork();
+    if (pid == 0)
+      return run(t, nWorkers, nMessages, size);
+    int ws;
+    if (pid < 0 || waitpid(pid, &ws, 0) < 0 || !WIFEXITED(ws) || WEXITSTATUS(ws))
+      status = 1;
+  }
+  return status;
+}
@@ -27,33 +27,20 @@
  */
 
 #include "complex_mixer-worker.hh"
-#include "liquid/liquid.h"
-#include <cmath>
-#include <iostream>
+#include "dsp_kernels.h"
+#include <cstring>
 #include <climits>
 
 using namespace OCPI::RCC; // for easy access to RCC data types and constants
 using namespace Complex_mixerWorkerTypes;
-using namespace std;
-
-#define Uscale(x)  (float)((float)(x) / (pow(2,15) -1))
-#define Scale(x)   (int16_t)((float)(x) * (pow(2,15) -1))
 
 class Complex_mixerWorker : public Complex_mixerWorkerBase
 {
-  nco_crcf q;
+  DspNcoF m_nco;
 
   RCCResult initialize()
   {
-    q = nco_crcf_create(LIQUID_NCO);
-    nco_crcf_set_phase(q, 0.0f);
-
-    return RCC_OK;
-  }
-
-  RCCResult release()
-  {
-    nco_crcf_destroy(q);
+    m_nco.phase = 0;
 
     return RCC_OK;
   }
@@ -67,35 +54,13 @@ class Complex_mixerWorker : public Complex_mixerWorkerBase
 
     // set each time so that if the conatiner changes it gets updated
     // might be better to put this into a write sync function but this is for training
-    float phase_inc = properties().phs_inc * ((2*M_PI)/(SHRT_MAX * 2));
-    nco_crcf_set_frequency(q,phase_inc);
-
-    liquid_float_complex out_sample;
-    liquid_float_complex in_sample;
-
-    for (unsigned int j = 0; j < num_of_elements; j++)
-    {
-      if (properties().enable)
-      {
-        in_sample.real = Uscale(inData->I);
-        in_sample.imag = Uscale(inData->Q);
-
-        nco_crcf_step(q);
-        nco_crcf_mix_up(q, in_sample, &out_sample);
-        outData->I = Scale(out_sample.real);
-        outData->Q = Scale(out_sample.imag);
-
-        inData++;
-        outData++;
-      }
-      else
-      {
-        outData->I = inData->I;
-        outData->Q = inData->Q;
-        inData++;
-        outData++;
-      }
-    }
+    double phase_inc = properties().phs_inc * ((2*M_PI)/(SHRT_MAX * 2));
+    // Within 1 LSB of, but not bit-exact with, the per-sample liquid-dsp NCO used before
+    if (properties().enable)
+      dsp_ncof_mix_s16c(&m_nco, phase_inc, (const int16_t*)inData, (int16_t*)outData,
+                        num_of_elements);
+    else
+      memcpy(outData, inData, num_of_elements * sizeof(*inData));
 
     return num_of_elements ? RCC_ADVANCE : RCC_ADVANCE_DONE;
   }
@@ -0,0 +1,755 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Sample processing kernels for the RCC workers in this library, usable from C and C++.
+ *
+ * Each kernel has a generic implementation and, on x86, SSE2 and sometimes AVX2 ones.  The
+ * implementation is chosen on first use according to what the CPU supports, or forced by
+ * the OCPI_DSP_ENGINE environment variable ("generic", "sse2" or "avx2").  All
+ * implementations of a kernel produce bit-identical results: integer kernels use 32 bit
+ * wrapping arithmetic, and float kernels do the same IEEE operations in the same order.
+ *
+ * Complex samples are interleaved I/Q pairs, and counts are in samples, not elements.
+ */
+#ifndef DSP_KERNELS_H
+#define DSP_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DSP_X86 1
+#include <immintrin.h>
+#define DSP_AVX2 __attribute__((target("avx2")))
+#endif
+
+typedef enum { DSP_GENERIC, DSP_SSE2, DSP_AVX2_ENGINE, DSP_UNSET } DspEngine;
+
+static inline const char *dsp_engine_name(DspEngine e) {
+  return e == DSP_AVX2_ENGINE ? "avx2" : e == DSP_SSE2 ? "sse2" : "generic";
+}
+
+static inline int dsp_engine_supported(DspEngine e) {
+#ifdef DSP_X86
+  __builtin_cpu_init();
+  return e == DSP_GENERIC || (e == DSP_SSE2 && __builtin_cpu_supports("sse2")) ||
+    (e == DSP_AVX2_ENGINE && __builtin_cpu_supports("avx2"));
+#else
+  return e == DSP_GENERIC;
+#endif
+}
+
+static inline DspEngine *dsp_engine_state(void) {
+  static DspEngine engine = DSP_UNSET;
+  return &engine;
+}
+
+// For benchmarks: force the engine by name, returning zero if it is not supported
+static inline int dsp_set_engine(const char *name) {
+  DspEngine e;
+  for (e = DSP_GENERIC; e < DSP_UNSET; e = (DspEngine)(e + 1))
+    if (!strcmp(name, dsp_engine_name(e)) && dsp_engine_supported(e)) {
+      *dsp_engine_state() = e;
+      return 1;
+    }
+  return 0;
+}
+
+static inline DspEngine dsp_engine(void) {
+  DspEngine *e = dsp_engine_state();
+  if (*e == DSP_UNSET) {
+    const char *env = getenv("OCPI_DSP_ENGINE");
+    if (!env || !dsp_set_engine(env))
+      *e = dsp_engine_supported(DSP_AVX2_ENGINE) ? DSP_AVX2_ENGINE :
+	dsp_engine_supported(DSP_SSE2) ? DSP_SSE2 : DSP_GENERIC;
+  }
+  return *e;
+}
+
+static inline int16_t dsp_sat16(int32_t x) {
+  return (int16_t)(x > INT16_MAX ? INT16_MAX : x < INT16_MIN ? INT16_MIN : x);
+}
+
+/*
+ * FIR filter of 16 bit samples with 16 bit taps:
+ *   out[e] = saturate((sum(taps[k] * in[e + k * stride]) + round) >> shift)
+ * for n output elements, where stride is 1 for real samples and 2 for complex ones, so
+ * "in" must hold n + (ntaps - 1) * stride elements, starting with the history.  The sum
+ * wraps at 32 bits.  Shift must be 1 to 31.
+ */
+static inline void
+dsp_fir_s16_generic(const int16_t *taps, unsigned ntaps, unsigned stride, const int16_t *in,
+		    int16_t *out, size_t n, unsigned shift) {
+  size_t e;
+  unsigned k;
+  for (e = 0; e < n; e++) {
+    uint32_t acc = 1u << (shift - 1);
+    for (k = 0; k < ntaps; k++)
+      acc += (uint32_t)((int32_t)taps[k] * in[e + k * stride]);
+    out[e] = dsp_sat16((int32_t)acc >> shift);
+  }
+}
+
+#ifdef DSP_X86
+// Taps are taken in pairs so one multiply-add does two of them
+static inline void
+dsp_fir_s16_sse2(const int16_t *taps, unsigned ntaps, unsigned stride, const int16_t *in,
+		 int16_t *out, size_t n, unsigned shift) {
+  const __m128i round = _mm_set1_epi32(1 << (shift - 1)), count = _mm_cvtsi32_si128((int)shift);
+  size_t e;
+  unsigned k;
+  for (e = 0; e + 8 <= n; e += 8) {
+    __m128i acc0 = round, acc1 = round;
+    for (k = 0; k < ntaps; k += 2) {
+      const int16_t *x = in + e + k * stride;
+      __m128i a = _mm_loadu_si128((const __m128i *)x), b, t;
+      if (k + 1 < ntaps) {
+	b = _mm_loadu_si128((const __m128i *)(x + stride));
+	t = _mm_set1_epi32((int32_t)((uint32_t)(uint16_t)taps[k] |
+				     (uint32_t)(uint16_t)taps[k + 1] << 16));
+      } else {
+	b = _mm_setzero_si128();
+	t = _mm_set1_epi32((uint16_t)taps[k]);
+      }
+      acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), t));
+      acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), t));
+    }
+    _mm_storeu_si128((__m128i *)(out + e),
+		     _mm_packs_epi32(_mm_sra_epi32(acc0, count), _mm_sra_epi32(acc1, count)));
+  }
+  dsp_fir_s16_generic(taps, ntaps, stride, in + e, out + e, n - e, shift);
+}
+
+// The in-lane unpacks and packs cancel out, so outputs stay in order
+static inline DSP_AVX2 void
+dsp_fir_s16_avx2(const int16_t *taps, unsigned ntaps, unsigned stride, const int16_t *in,
+		 int16_t *out, size_t n, unsigned shift) {
+  const __m256i round = _mm256_set1_epi32(1 << (shift - 1));
+  const __m128i count = _mm_cvtsi32_si128((int)shift);
+  size_t e;
+  unsigned k;
+  for (e = 0; e + 16 <= n; e += 16) {
+    __m256i acc0 = round, acc1 = round;
+    for (k = 0; k < ntaps; k += 2) {
+      const int16_t *x = in + e + k * stride;
+      __m256i a = _mm256_loadu_si256((const __m256i *)x), b, t;
+      if (k + 1 < ntaps) {
+	b = _mm256_loadu_si256((const __m256i *)(x + stride));
+	t = _mm256_set1_epi32((int32_t)((uint32_t)(uint16_t)taps[k] |
+					(uint32_t)(uint16_t)taps[k + 1] << 16));
+      } else {
+	b = _mm256_setzero_si256();
+	t = _mm256_set1_epi32((uint16_t)taps[k]);
+      }
+      acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), t));
+      acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), t));
+    }
+    _mm256_storeu_si256((__m256i *)(out + e),
+			_mm256_packs_epi32(_mm256_sra_epi32(acc0, count),
+					   _mm256_sra_epi32(acc1, count)));
+  }
+  dsp_fir_s16_sse2(taps, ntaps, stride, in + e, out + e, n - e, shift);
+}
+#endif
+
+static inline void
+dsp_fir_s16(const int16_t *taps, unsigned ntaps, unsigned stride, const int16_t *in,
+	    int16_t *out, size_t n, unsigned shift) {
+  switch (dsp_engine()) {
+#ifdef DSP_X86
+  case DSP_AVX2_ENGINE:
+    dsp_fir_s16_avx2(taps, ntaps, stride, in, out, n, shift);
+    return;
+  case DSP_SSE2:
+    dsp_fir_s16_sse2(taps, ntaps, stride, in, out, n, shift);
+    return;
+#endif
+  default:
+    dsp_fir_s16_generic(taps, ntaps, stride, in, out, n, shift);
+  }
+}
+
+/*
+ * FIR filter of float samples, laid out as for dsp_fir_s16.  Each output is summed in tap
+ * order.
+ */
+static inline void
+dsp_fir_f32_generic(const float *taps, unsigned ntaps, unsigned stride, const float *in,
+		    float *out, size_t n) {
+  size_t e;
+  unsigned k;
+  for (e = 0; e < n; e++) {
+    float acc = 0;
+    for (k = 0; k < ntaps; k++) {
+      float p = taps[k] * in[e + k * stride];
+      acc += p;
+    }
+    out[e] = acc;
+  }
+}
+
+#ifdef DSP_X86
+static inline void
+dsp_fir_f32_sse2(const float *taps, unsigned ntaps, unsigned stride, const float *in,
+		 float *out, size_t n) {
+  size_t e;
+  unsigned k;
+  for (e = 0; e + 8 <= n; e += 8) {
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    for (k = 0; k < ntaps; k++) {
+      __m128 t = _mm_set1_ps(taps[k]);
+      const float *x = in + e + k * stride;
+      acc0 = _mm_add_ps(acc0, _mm_mul_ps(t, _mm_loadu_ps(x)));
+      acc1 = _mm_add_ps(acc1, _mm_mul_ps(t, _mm_loadu_ps(x + 4)));
+    }
+    _mm_storeu_ps(out + e, acc0);
+    _mm_storeu_ps(out + e + 4, acc1);
+  }
+  dsp_fir_f32_generic(taps, ntaps, stride, in + e, out + e, n - e);
+}
+
+static inline DSP_AVX2 void
+dsp_fir_f32_avx2(const float *taps, unsigned ntaps, unsigned stride, const float *in,
+		 float *out, size_t n) {
+  size_t e;
+  unsigned k;
+  for (e = 0; e + 16 <= n; e += 16) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    for (k = 0; k < ntaps; k++) {
+      __m256 t = _mm256_set1_ps(taps[k]);
+      const float *x = in + e + k * stride;
+      acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(t, _mm256_loadu_ps(x)));
+      acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(t, _mm256_loadu_ps(x + 8)));
+    }
+    _mm256_storeu_ps(out + e, acc0);
+    _mm256_storeu_ps(out + e + 8, acc1);
+  }
+  dsp_fir_f32_sse2(taps, ntaps, stride, in + e, out + e, n - e);
+}
+#endif
+
+static inline void
+dsp_fir_f32(const float *taps, unsigned ntaps, unsigned stride, const float *in,
+	    float *out, size_t n) {
+  switch (dsp_engine()) {
+#ifdef DSP_X86
+  case DSP_AVX2_ENGINE:
+    dsp_fir_f32_avx2(taps, ntaps, stride, in, out, n);
+    return;
+  case DSP_SSE2:
+    dsp_fir_f32_sse2(taps, ntaps, stride, in, out, n);
+    return;
+#endif
+  default:
+    dsp_fir_f32_generic(taps, ntaps, stride, in, out, n);
+  }
+}
+
+/*
+ * NCO and mixer for complex 16 bit samples.  The phase accumulator is 32 bits, advanced
+ * by "inc" before each sample, and its top DSP_NCO_BITS bits index a Q15 cos/sin table.
+ *   out = saturate((in * (cos + j sin) + round) >> 15)
+ * The table is kept as packed (cos, -sin) and (sin, cos) pairs for multiply-adds.
+ */
+#define DSP_NCO_BITS 12
+
+typedef struct {
+  uint32_t phase;
+} DspNco;
+
+static inline const uint32_t *dsp_nco_table(void) {
+  static uint32_t table[2 << DSP_NCO_BITS];
+  static int done;
+  if (!done) {
+    unsigned i;
+    for (i = 0; i < 1u << DSP_NCO_BITS; i++) {
+      double a = 2 * 3.14159265358979323846 * i / (1 << DSP_NCO_BITS);
+      int16_t c = (int16_t)lrint(cos(a) * 32767), s = (int16_t)lrint(sin(a) * 32767);
+      table[2 * i] = (uint16_t)c | (uint32_t)(uint16_t)-s << 16;
+      table[2 * i + 1] = (uint16_t)s | (uint32_t)(uint16_t)c << 16;
+    }
+    done = 1;
+  }
+  return table;
+}
+
+static inline void
+dsp_nco_mix_s16c_generic(DspNco *nco, uint32_t inc, const int16_t *in, int16_t *out,
+			 size_t n) {
+  const uint32_t *table = dsp_nco_table();
+  uint32_t phase = nco->phase;
+  size_t i;
+  for (i = 0; i < n; i++) {
+    const uint32_t *t = table + 2 * ((phase += inc) >> (32 - DSP_NCO_BITS));
+    int32_t c = (int16_t)t[0], s = (int16_t)t[1], I = in[2 * i], Q = in[2 * i + 1];
+    out[2 * i] = dsp_sat16((I * c - Q * s + (1 << 14)) >> 15);
+    out[2 * i + 1] = dsp_sat16((I * s + Q * c + (1 << 14)) >> 15);
+  }
+  nco->phase = phase;
+}
+
+#ifdef DSP_X86
+// Two multiply-adds give the real and imaginary parts of four samples
+static inline __m128i
+dsp_nco_mix4(__m128i x, __m128i re, __m128i im) {
+  const __m128i round = _mm_set1_epi32(1 << 14);
+  __m128i r = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(x, re), round), 15);
+  __m128i i = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(x, im), round), 15);
+  return _mm_unpacklo_epi16(_mm_packs_epi32(r, r), _mm_packs_epi32(i, i));
+}
+
+static inline void
+dsp_nco_mix_s16c_sse2(DspNco *nco, uint32_t inc, const int16_t *in, int16_t *out,
+		      size_t n) {
+  const uint32_t *table = dsp_nco_table();
+  uint32_t phase = nco->phase, p[4];
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4) {
+    unsigned j;
+    for (j = 0; j < 4; j++)
+      p[j] = 2 * ((phase += inc) >> (32 - DSP_NCO_BITS));
+    __m128i re = _mm_set_epi32((int)table[p[3]], (int)table[p[2]], (int)table[p[1]],
+			       (int)table[p[0]]);
+    __m128i im = _mm_set_epi32((int)table[p[3] + 1], (int)table[p[2] + 1],
+			       (int)table[p[1] + 1], (int)table[p[0] + 1]);
+    _mm_storeu_si128((__m128i *)(out + 2 * i),
+		     dsp_nco_mix4(_mm_loadu_si128((const __m128i *)(in + 2 * i)), re, im));
+  }
+  nco->phase = phase;
+  dsp_nco_mix_s16c_generic(nco, inc, in + 2 * i, out + 2 * i, n - i);
+}
+
+// The phases of eight samples are computed at once and their table entries gathered
+static inline DSP_AVX2 void
+dsp_nco_mix_s16c_avx2(DspNco *nco, uint32_t inc, const int16_t *in, int16_t *out,
+		      size_t n) {
+  const int *table = (const int *)dsp_nco_table();
+  const __m256i steps = _mm256_mullo_epi32(_mm256_set1_epi32((int)inc),
+					   _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 8));
+  const __m256i round = _mm256_set1_epi32(1 << 14);
+  uint32_t phase = nco->phase;
+  size_t i;
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m256i p = _mm256_add_epi32(_mm256_set1_epi32((int)phase), steps);
+    __m256i idx = _mm256_slli_epi32(_mm256_srli_epi32(p, 32 - DSP_NCO_BITS), 1);
+    __m256i re = _mm256_i32gather_epi32(table, idx, 4);
+    __m256i im = _mm256_i32gather_epi32(table + 1, idx, 4);
+    __m256i x = _mm256_loadu_si256((const __m256i *)(in + 2 * i));
+    __m256i r = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(x, re), round), 15);
+    __m256i q = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(x, im), round), 15);
+    _mm256_storeu_si256((__m256i *)(out + 2 * i),
+			_mm256_unpacklo_epi16(_mm256_packs_epi32(r, r),
+					      _mm256_packs_epi32(q, q)));
+    phase += 8 * inc;
+  }
+  nco->phase = phase;
+  dsp_nco_mix_s16c_sse2(nco, inc, in + 2 * i, out + 2 * i, n - i);
+}
+#endif
+
+static inline void
+dsp_nco_mix_s16c(DspNco *nco, uint32_t inc, const int16_t *in, int16_t *out, size_t n) {
+  switch (dsp_engine()) {
+#ifdef DSP_X86
+  case DSP_AVX2_ENGINE:
+    dsp_nco_mix_s16c_avx2(nco, inc, in, out, n);
+    return;
+  case DSP_SSE2:
+    dsp_nco_mix_s16c_sse2(nco, inc, in, out, n);
+    return;
+#endif
+  default:
+    dsp_nco_mix_s16c_generic(nco, inc, in, out, n);
+  }
+}
+
+/*
+ * NCO and mixer in floating point for complex 16 bit samples.  The phase, in radians, is
+ * advanced by "inc" before each sample.  Samples are scaled by 1/32767 to be mixed, and
+ * the products are scaled back by 32767, truncated and saturated:
+ *   out = saturate(trunc((in / 32767) * (cos + j sin) * 32767))
+ * cos and sin are computed exactly at the start of each block of DSP_NCOF_BLOCK samples,
+ * and by rotation within it.
+ */
+#define DSP_NCOF_BLOCK 16
+#define DSP_2PI (2 * 3.14159265358979323846)
+
+typedef struct {
+  double phase;
+} DspNcoF;
+
+static inline void
+dsp_ncof_rotations(double inc, float *rc, float *rs) {
+  unsigned k;
+  for (k = 0; k < DSP_NCOF_BLOCK; k++) {
+    rc[k] = (float)cos((k + 1) * inc);
+    rs[k] = (float)sin((k + 1) * inc);
+  }
+}
+
+static inline int16_t
+dsp_trunc16(float x) {
+  return (int16_t)(x > 32767.0f ? 32767 : x < -32768.0f ? -32768 : (int32_t)x);
+}
+
+static inline void
+dsp_ncof_mix_s16c_generic(DspNcoF *nco, double inc, const int16_t *in, int16_t *out,
+			  size_t n) {
+  float rc[DSP_NCOF_BLOCK], rs[DSP_NCOF_BLOCK];
+  size_t i, k, m;
+  dsp_ncof_rotations(inc, rc, rs);
+  for (i = 0; i < n; i += m) {
+    float c = (float)cos(nco->phase), s = (float)sin(nco->phase);
+    m = n - i < DSP_NCOF_BLOCK ? n - i : DSP_NCOF_BLOCK;
+    for (k = 0; k < m; k++) {
+      float a, b, nc, ns, I, Q, re, im;
+      a = c * rc[k];
+      b = s * rs[k];
+      nc = a - b;
+      a = c * rs[k];
+      b = s * rc[k];
+      ns = a + b;
+      I = (float)in[2 * (i + k)] * (1.0f / 32767);
+      Q = (float)in[2 * (i + k) + 1] * (1.0f / 32767);
+      a = I * nc;
+      b = Q * ns;
+      re = a - b;
+      a = I * ns;
+      b = Q * nc;
+      im = a + b;
+      out[2 * (i + k)] = dsp_trunc16(re * 32767.0f);
+      out[2 * (i + k) + 1] = dsp_trunc16(im * 32767.0f);
+    }
+    nco->phase = fmod(nco->phase + (double)m * inc, DSP_2PI);
+  }
+}
+
+#ifdef DSP_X86
+static inline void
+dsp_ncof_mix_s16c_sse2(DspNcoF *nco, double inc, const int16_t *in, int16_t *out,
+		       size_t n) {
+  const __m128 inScale = _mm_set1_ps(1.0f / 32767), outScale = _mm_set1_ps(32767.0f),
+    lo = _mm_set1_ps(-32768.0f), hi = _mm_set1_ps(32767.0f);
+  const __m128i mask = _mm_set1_epi32(0xffff);
+  float rc[DSP_NCOF_BLOCK], rs[DSP_NCOF_BLOCK];
+  size_t i;
+  unsigned k;
+  dsp_ncof_rotations(inc, rc, rs);
+  for (i = 0; i + DSP_NCOF_BLOCK <= n; i += DSP_NCOF_BLOCK) {
+    __m128 c = _mm_set1_ps((float)cos(nco->phase)), s = _mm_set1_ps((float)sin(nco->phase));
+    for (k = 0; k < DSP_NCOF_BLOCK; k += 4) {
+      // each 32 bit lane is one sample
+      __m128 rck = _mm_loadu_ps(rc + k), rsk = _mm_loadu_ps(rs + k);
+      __m128 nc = _mm_sub_ps(_mm_mul_ps(c, rck), _mm_mul_ps(s, rsk));
+      __m128 ns = _mm_add_ps(_mm_mul_ps(c, rsk), _mm_mul_ps(s, rck));
+      __m128i x = _mm_loadu_si128((const __m128i *)(in + 2 * (i + k)));
+      __m128 I = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(x, 16), 16)),
+			    inScale);
+      __m128 Q = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(x, 16)), inScale);
+      __m128 re = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(I, nc), _mm_mul_ps(Q, ns)), outScale);
+      __m128 im = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(I, ns), _mm_mul_ps(Q, nc)), outScale);
+      __m128i r = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(re, lo), hi));
+      __m128i q = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(im, lo), hi));
+      _mm_storeu_si128((__m128i *)(out + 2 * (i + k)),
+		       _mm_or_si128(_mm_and_si128(r, mask), _mm_slli_epi32(q, 16)));
+    }
+    nco->phase = fmod(nco->phase + (double)DSP_NCOF_BLOCK * inc, DSP_2PI);
+  }
+  dsp_ncof_mix_s16c_generic(nco, inc, in + 2 * i, out + 2 * i, n - i);
+}
+#endif
+
+static inline void
+dsp_ncof_mix_s16c(DspNcoF *nco, double inc, const int16_t *in, int16_t *out, size_t n) {
+#ifdef DSP_X86
+  if (dsp_engine() != DSP_GENERIC) {
+    dsp_ncof_mix_s16c_sse2(nco, inc, in, out, n);
+    return;
+  }
+#endif
+  dsp_ncof_mix_s16c_generic(nco, inc, in, out, n);
+}
+
+/*
+ * CIC decimator for complex 16 bit samples, with unit differential delay.  The
+ * integrators and combs wrap at 32 bits, which is exact as long as
+ * order * log2(decimation) <= 16.  Outputs are saturate(sum >> shift).
+ */
+#define DSP_CIC_MAX_ORDER 8
+#define DSP_CIC_BLOCK 256
+
+typedef struct {
+  unsigned order, decimation, shift, phase;
+  uint32_t integ[DSP_CIC_MAX_ORDER][2], comb[DSP_CIC_MAX_ORDER][2];
+} DspCic;
+
+static inline void
+dsp_cic_init(DspCic *cic, unsigned order, unsigned decimation, unsigned shift) {
+  memset(cic, 0, sizeof(*cic));
+  cic->order = order < DSP_CIC_MAX_ORDER ? order : DSP_CIC_MAX_ORDER;
+  cic->decimation = decimation ? decimation : 1;
+  cic->shift = shift;
+}
+
+// Run the combs on the last integrator's output, returning the filter output
+static inline void
+dsp_cic_comb(DspCic *cic, const uint32_t y[2], int16_t *out) {
+  unsigned c, s;
+  for (c = 0; c < 2; c++) {
+    uint32_t v = y[c];
+    for (s = 0; s < cic->order; s++) {
+      uint32_t prev = cic->comb[s][c];
+      cic->comb[s][c] = v;
+      v -= prev;
+    }
+    out[c] = dsp_sat16((int32_t)v >> cic->shift);
+  }
+}
+
+// Returns the number of output samples
+static inline size_t
+dsp_cic_dec_s16c_generic(DspCic *cic, const int16_t *in, size_t n, int16_t *out) {
+  size_t i, nOut = 0;
+  unsigned c, s;
+  for (i = 0; i < n; i++) {
+    uint32_t y[2];
+    for (c = 0; c < 2; c++) {
+      uint32_t v = (uint32_t)(int32_t)in[2 * i + c];
+      for (s = 0; s < cic->order; s++)
+	v = cic->integ[s][c] += v;
+      y[c] = v;
+    }
+    if (++cic->phase == cic->decimation) {
+      cic->phase = 0;
+      dsp_cic_comb(cic, y, out + 2 * nOut++);
+    }
+  }
+  return nOut;
+}
+
+#ifdef DSP_X86
+// Each integrator stage is a running sum over a block, done two samples at a time
+static inline size_t
+dsp_cic_dec_s16c_sse2(DspCic *cic, const int16_t *in, size_t n, int16_t *out) {
+  uint32_t buf[2 * DSP_CIC_BLOCK];
+  size_t nOut = 0;
+  while (n) {
+    size_t len = n < DSP_CIC_BLOCK ? n : DSP_CIC_BLOCK, i, half = len & ~(size_t)1;
+    unsigned s;
+    for (i = 0; i < 2 * len; i++)
+      buf[i] = (uint32_t)(int32_t)in[i];
+    for (s = 0; s < cic->order; s++) {
+      __m128i carry = _mm_set_epi32((int)cic->integ[s][1], (int)cic->integ[s][0],
+				    (int)cic->integ[s][1], (int)cic->integ[s][0]);
+      for (i = 0; i < half; i += 2) {
+	__m128i v = _mm_loadu_si128((const __m128i *)&buf[2 * i]);
+	v = _mm_add_epi32(_mm_add_epi32(v, _mm_slli_si128(v, 8)), carry);
+	_mm_storeu_si128((__m128i *)&buf[2 * i], v);
+	carry = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 2, 3, 2));
+      }
+      cic->integ[s][0] = (uint32_t)_mm_cvtsi128_si32(carry);
+      cic->integ[s][1] = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(carry, 4));
+      if (half != len) {
+	buf[2 * half] = cic->integ[s][0] += buf[2 * half];
+	buf[2 * half + 1] = cic->integ[s][1] += buf[2 * half + 1];
+      }
+    }
+    for (i = cic->decimation - 1 - cic->phase; i < len; i += cic->decimation)
+      dsp_cic_comb(cic, &buf[2 * i], out + 2 * nOut++);
+    cic->phase = (unsigned)((cic->phase + len) % cic->decimation);
+    in += 2 * len;
+    n -= len;
+  }
+  return nOut;
+}
+#endif
+
+static inline size_t
+dsp_cic_dec_s16c(DspCic *cic, const int16_t *in, size_t n, int16_t *out) {
+#ifdef DSP_X86
+  if (dsp_engine() != DSP_GENERIC)
+    return dsp_cic_dec_s16c_sse2(cic, in, n, out);
+#endif
+  return dsp_cic_dec_s16c_generic(cic, in, n, out);
+}
+
+/*
+ * Polar discriminator (FM demodulator) for complex 16 bit samples:
+ *   out[i] = round(arg(in[i] * conj(in[i - 1])) * 32767 / pi)
+ * where "prev" holds the sample before in[0] and is updated.  The angle comes from a
+ * polynomial atan2 accurate to about 1e-5 radians.
+ */
+#define DSP_ATAN_C0 0.9998660f
+#define DSP_ATAN_C1 -0.3302995f
+#define DSP_ATAN_C2 0.1801410f
+#define DSP_ATAN_C3 -0.0851330f
+#define DSP_ATAN_C4 0.0208351f
+#define DSP_PI_F 3.14159265f
+#define DSP_ANGLE_SCALE (32767.0f / DSP_PI_F)
+
+static inline int16_t
+dsp_discrim1(int32_t i0, int32_t q0, int32_t i1, int32_t q1) {
+  float a, b, re, im, ax, ay, mx, mn, r, s, t;
+  a = (float)i1 * (float)i0;
+  b = (float)q1 * (float)q0;
+  re = a + b;
+  a = (float)q1 * (float)i0;
+  b = (float)i1 * (float)q0;
+  im = a - b;
+  ax = fabsf(re);
+  ay = fabsf(im);
+  mx = ax > ay ? ax : ay;
+  mn = ax > ay ? ay : ax;
+  r = mx > 0 ? mn / mx : 0;
+  s = r * r;
+  t = DSP_ATAN_C4 * s;
+  t = t + DSP_ATAN_C3;
+  t = t * s;
+  t = t + DSP_ATAN_C2;
+  t = t * s;
+  t = t + DSP_ATAN_C1;
+  t = t * s;
+  t = t + DSP_ATAN_C0;
+  r = t * r;
+  if (ay > ax)
+    r = DSP_PI_F / 2 - r;
+  if (re < 0)
+    r = DSP_PI_F - r;
+  if (im < 0)
+    r = -r;
+  return dsp_sat16((int32_t)lrintf(r * DSP_ANGLE_SCALE));
+}
+
+static inline void
+dsp_fm_discrim_s16c_generic(int16_t prev[2], const int16_t *in, int16_t *out, size_t n) {
+  size_t i;
+  for (i = 0; i < n; i++) {
+    out[i] = dsp_discrim1(prev[0], prev[1], in[2 * i], in[2 * i + 1]);
+    prev[0] = in[2 * i];
+    prev[1] = in[2 * i + 1];
+  }
+}
+
+#ifdef DSP_X86
+static inline __m128
+dsp_select(__m128 mask, __m128 a, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline void
+dsp_fm_discrim_s16c_sse2(int16_t prev[2], const int16_t *in, int16_t *out, size_t n) {
+  const __m128 zero = _mm_setzero_ps(), sign = _mm_set1_ps(-0.0f);
+  const __m128 halfPi = _mm_set1_ps(DSP_PI_F / 2), pi = _mm_set1_ps(DSP_PI_F);
+  size_t i;
+  if (!n)
+    return;
+  dsp_fm_discrim_s16c_generic(prev, in, out, 1);
+  for (i = 1; i + 4 <= n; i += 4) {
+    // each 32 bit lane is one sample, the previous one being a sample earlier in memory
+    __m128i x1 = _mm_loadu_si128((const __m128i *)(in + 2 * i));
+    __m128i x0 = _mm_loadu_si128((const __m128i *)(in + 2 * i - 2));
+    __m128 i1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(x1, 16), 16));
+    __m128 q1 = _mm_cvtepi32_ps(_mm_srai_epi32(x1, 16));
+    __m128 i0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(x0, 16), 16));
+    __m128 q0 = _mm_cvtepi32_ps(_mm_srai_epi32(x0, 16));
+    __m128 re = _mm_add_ps(_mm_mul_ps(i1, i0), _mm_mul_ps(q1, q0));
+    __m128 im = _mm_sub_ps(_mm_mul_ps(q1, i0), _mm_mul_ps(i1, q0));
+    __m128 ax = _mm_andnot_ps(sign, re), ay = _mm_andnot_ps(sign, im);
+    __m128 mx = _mm_max_ps(ay, ax), mn = _mm_min_ps(ay, ax);
+    __m128 r = _mm_and_ps(_mm_cmpgt_ps(mx, zero), _mm_div_ps(mn, mx));
+    __m128 s = _mm_mul_ps(r, r);
+    __m128 t = _mm_mul_ps(_mm_set1_ps(DSP_ATAN_C4), s);
+    t = _mm_mul_ps(_mm_add_ps(t, _mm_set1_ps(DSP_ATAN_C3)), s);
+    t = _mm_mul_ps(_mm_add_ps(t, _mm_set1_ps(DSP_ATAN_C2)), s);
+    t = _mm_mul_ps(_mm_add_ps(t, _mm_set1_ps(DSP_ATAN_C1)), s);
+    r = _mm_mul_ps(_mm_add_ps(t, _mm_set1_ps(DSP_ATAN_C0)), r);
+    r = dsp_select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(halfPi, r), r);
+    r = dsp_select(_mm_cmplt_ps(re, zero), _mm_sub_ps(pi, r), r);
+    r = dsp_select(_mm_cmplt_ps(im, zero), _mm_xor_ps(r, sign), r);
+    __m128i y = _mm_cvtps_epi32(_mm_mul_ps(r, _mm_set1_ps(DSP_ANGLE_SCALE)));
+    _mm_storel_epi64((__m128i *)(out + i), _mm_packs_epi32(y, y));
+  }
+  prev[0] = in[2 * i - 2];
+  prev[1] = in[2 * i - 1];
+  dsp_fm_discrim_s16c_generic(prev, in + 2 * i, out + i, n - i);
+}
+#endif
+
+static inline void
+dsp_fm_discrim_s16c(int16_t prev[2], const int16_t *in, int16_t *out, size_t n) {
+#ifdef DSP_X86
+  if (dsp_engine() != DSP_GENERIC) {
+    dsp_fm_discrim_s16c_sse2(prev, in, out, n);
+    return;
+  }
+#endif
+  dsp_fm_discrim_s16c_generic(prev, in, out, n);
+}
+
+/*
+ * Slice real 16 bit samples into bits, one for each sample greater than zero, packed 16
+ * to a word with the first sample in the most significant bit.  n is in words.
+ */
+static inline void
+dsp_slice_s16_generic(const int16_t *in, uint16_t *out, size_t n) {
+  size_t w;
+  unsigned b;
+  for (w = 0; w < n; w++, in += 16) {
+    uint16_t bits = 0;
+    for (b = 0; b < 16; b++)
+      bits = (uint16_t)(bits << 1 | (in[b] > 0));
+    out[w] = bits;
+  }
+}
+
+#ifdef DSP_X86
+static inline void
+dsp_slice_s16_sse2(const int16_t *in, uint16_t *out, size_t n) {
+  const __m128i zero = _mm_setzero_si128();
+  size_t w;
+  for (w = 0; w < n; w++, in += 16) {
+    __m128i a = _mm_cmpgt_epi16(_mm_loadu_si128((const __m128i *)in), zero);
+    __m128i b = _mm_cmpgt_epi16(_mm_loadu_si128((const __m128i *)(in + 8)), zero);
+    uint32_t m = (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(a, b));
+    // movemask puts the first sample in the least significant bit
+    m = (m & 0x5555) << 1 | (m >> 1 & 0x5555);
+    m = (m & 0x3333) << 2 | (m >> 2 & 0x3333);
+    m = (m & 0x0f0f) << 4 | (m >> 4 & 0x0f0f);
+    out[w] = (uint16_t)((m & 0x00ff) << 8 | m >> 8);
+  }
+}
+#endif
+
+static inline void
+dsp_slice_s16(const int16_t *in, uint16_t *out, size_t n) {
+#ifdef DSP_X86
+  if (dsp_engine() != DSP_GENERIC) {
+    dsp_slice_s16_sse2(in, out, n);
+    return;
+  }
+#endif
+  dsp_slice_s16_generic(in, out, n);
+}
+
+#endif
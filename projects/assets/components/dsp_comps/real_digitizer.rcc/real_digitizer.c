@@ -27,6 +27,7 @@
  */
 #include "real_digitizer_Worker.h"
 #include "signal_utils.h"
+#include "dsp_kernels.h"
 typedef struct {
 	uint16_t mask;
 	uint16_t data;
@@ -110,6 +111,15 @@ run(RCCWorker *self, RCCBoolean timedOut, RCCBoolean *newRunCondition) {
      }
      else
      {
+       // Whole words starting at a word boundary are sliced all at once
+       if (mask == 0x8000 && len - i >= 16)
+       {
+         unsigned words = (len - i) / 16;
+         dsp_slice_s16(&inData->real[i], (uint16_t *)&outData->real[j], words);
+         j += words;
+         i += words * 16 - 1;
+         continue;
+       }
 		   if (Uscale(inData->real[i]) > 0)
 			 {
 			   data += mask;
@@ -25,16 +25,27 @@
  *
  * This file contains the RCC implementation skeleton for worker: file_read
  */
+#define _GNU_SOURCE // for O_DIRECT
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "file_read_Worker.h"
 
+// In the mapped and direct modes the file is read through a window: mapped, or read into
+// an aligned buffer.  Windows start on page boundaries, as O_DIRECT and mmap require.
+#define MAPPED_WINDOW (16*1024*1024)
+#define DIRECT_WINDOW (4*1024*1024)
 typedef struct {
   int fd;
   int started;
+  uint8_t *window;
+  size_t windowSize, windowLength; // allocated/mapped size, and how much is valid
+  off_t windowOffset, position, fileSize;
 } MyState;
 static size_t mysizes[] = {sizeof(MyState), 0};
 
@@ -48,14 +59,98 @@ RCCDispatch file_read = {
 /*
  * Methods to implement for worker file_read, based on metadata.
  */
+static void
+unwindow(MyState *s, File_readProperties *p) {
+  if (s->window) {
+    if (p->mapped)
+      munmap(s->window, s->windowLength);
+    else
+      free(s->window);
+    s->window = NULL;
+    s->windowSize = s->windowLength = 0;
+  }
+}
+
+// Return a pointer to up to "n" bytes of the file at the current position, in *got,
+// and advance past them.
+static const uint8_t *
+fetch(RCCWorker *self, size_t n, size_t *got) {
+  MyState *s = self->memories[0];
+  File_readProperties *p = self->properties;
+  if (s->position < s->windowOffset ||
+      s->position + (off_t)n > s->windowOffset + (off_t)s->windowLength) {
+    long page = sysconf(_SC_PAGESIZE);
+    off_t start = s->position & ~(off_t)(page - 1);
+    size_t size = (size_t)(s->position - start) + n + (size_t)page - 1;
+    size -= size % (size_t)page;
+    if (size < (p->mapped ? MAPPED_WINDOW : DIRECT_WINDOW))
+      size = p->mapped ? MAPPED_WINDOW : DIRECT_WINDOW;
+    if (p->mapped) {
+      unwindow(s, p);
+      if (start < s->fileSize) {
+	if (size > (size_t)(s->fileSize - start))
+	  size = (size_t)(s->fileSize - start);
+	void *w = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, s->fd, start);
+	if (w == MAP_FAILED) {
+	  self->container.setError("error mapping file: %s", strerror(errno));
+	  return NULL;
+	}
+	madvise(w, size, MADV_SEQUENTIAL);
+	s->window = w;
+	s->windowLength = size;
+      }
+    } else {
+      if (size > s->windowSize) {
+	unwindow(s, p);
+	if (posix_memalign((void **)&s->window, (size_t)page, size)) {
+	  self->container.setError("error allocating %zu byte read buffer", size);
+	  return NULL;
+	}
+	s->windowSize = size;
+      }
+      ssize_t nread = pread(s->fd, s->window, s->windowSize, start);
+      if (nread < 0) {
+	self->container.setError("error reading file: %s", strerror(errno));
+	return NULL;
+      }
+      s->windowLength = (size_t)nread;
+    }
+    s->windowOffset = start;
+  }
+  off_t avail = s->windowOffset + (off_t)s->windowLength - s->position;
+  static const uint8_t none[1];
+  if (avail <= 0) {
+    *got = 0;
+    return none;
+  }
+  *got = (size_t)avail < n ? (size_t)avail : n;
+  const uint8_t *data = s->window + (s->position - s->windowOffset);
+  s->position += (off_t)*got;
+  return data;
+}
+
 static RCCResult
 start(RCCWorker *self) {
   MyState *s = self->memories[0];
   File_readProperties *p = self->properties;
   if (s->started)
     return RCC_OK;
-  if ((s->fd = open(p->fileName, O_RDONLY)) < 0)
+  s->fd = -1;
+  if (p->direct && !p->mapped &&
+      (s->fd = open(p->fileName, O_RDONLY | O_DIRECT)) < 0 && errno != EINVAL)
+    return self->container.setError("error opening file \"%s\": %s", p->fileName, strerror(errno));
+  // Without O_DIRECT support in the file system, the direct mode still reads in big chunks
+  if (s->fd < 0 && (s->fd = open(p->fileName, O_RDONLY)) < 0)
     return self->container.setError("error opening file \"%s\": %s", p->fileName, strerror(errno));
+  if (p->mapped || p->direct) {
+    struct stat st;
+    if (fstat(s->fd, &st))
+      return self->container.setError("error getting size of file \"%s\": %s", p->fileName,
+				      strerror(errno));
+    s->fileSize = st.st_size;
+    if (p->mapped)
+      posix_fadvise(s->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
   s->started = 1;
   self->ports[FILE_READ_OUT].output.u.operation = p->opcode;
   if (p->granularity)
@@ -66,6 +161,7 @@ start(RCCWorker *self) {
 static RCCResult
 release(RCCWorker *self) {
  MyState *s = self->memories[0];
+  unwindow(s, self->properties);
   if (s->started)
     close(s->fd);
   return RCC_OK;
@@ -78,7 +174,9 @@ run(RCCWorker *self, RCCBoolean timedOut, RCCBoolean *newRunCondition) {
   MyState *s = self->memories[0];
   size_t n2read = props->messageSize ? props->messageSize : port->current.maxLength;
   ssize_t n = 0; // needed only for warning suppression
-  RCCBoolean zlmIn = 0;
+  RCCBoolean zlmIn = 0, windowed = props->mapped || props->direct;
+  const uint8_t *data;
+  size_t got;
   (void)timedOut;(void)newRunCondition;
 
   if (props->messagesInFile) {
@@ -86,7 +184,14 @@ run(RCCWorker *self, RCCBoolean timedOut, RCCBoolean *newRunCondition) {
       uint32_t length;
       uint32_t opcode;
     } m;
-    if ((n = read(s->fd, &m, sizeof(m))) != sizeof(m) && n) {
+    if (windowed) {
+      if (!(data = fetch(self, sizeof(m), &got)))
+	return RCC_ERROR;
+      memcpy(&m, data, got);
+      n = (ssize_t)got;
+    } else
+      n = read(s->fd, &m, sizeof(m));
+    if (n != sizeof(m) && n) {
       props->badMessage = 1;
       return self->container.setError("can't read message header from file (%zd): %s",
 				      n, strerror(errno));
@@ -98,7 +203,12 @@ run(RCCWorker *self, RCCBoolean timedOut, RCCBoolean *newRunCondition) {
   if (n2read > port->current.maxLength)
     return self->container.setError("message size (%zu) too large for max buffer size (%u)",
 				    n2read, port->current.maxLength);
-  if (n2read && (n = read(s->fd, port->current.data, n2read)) < 0)
+  if (n2read && windowed) {
+    if (!(data = fetch(self, n2read, &got)))
+      return RCC_ERROR;
+    memcpy(port->current.data, data, got);
+    n = (ssize_t)got;
+  } else if (n2read && (n = read(s->fd, port->current.data, n2read)) < 0)
     return self->container.setError("error reading file: %s", strerror(errno));
   if (props->messagesInFile && n != (ssize_t)n2read) {
     props->badMessage = 1;
@@ -115,7 +225,8 @@ run(RCCWorker *self, RCCBoolean timedOut, RCCBoolean *newRunCondition) {
     return RCC_ADVANCE;
   }
   if (props->repeat) {
-    if (lseek(s->fd, 0, SEEK_SET) < 0)
+    s->position = 0;
+    if (!windowed && lseek(s->fd, 0, SEEK_SET) < 0)
       return self->container.setError("error rewinding file: %s", strerror(errno));
     return RCC_OK;
   }
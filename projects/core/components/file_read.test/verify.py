@@ -0,0 +1,84 @@
+#!/usr/bin/env python2
+# This file is protected by Copyright. Please refer to the COPYRIGHT file
+# distributed with this source distribution.
+#
+# This file is part of OpenCPI <http://www.opencpi.org>
+#
+# OpenCPI is free software: you can redistribute it and/or modify it under the
+# terms of the GNU Lesser General Public License as published by the Free
+# Software Foundation, either version 3 of the License, or (at your option) any
+# later version.
+#
+# OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+# WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+# A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+# details.
+#
+# You should have received a copy of the GNU Lesser General Public License along
+# with this program. If not, see <http://www.gnu.org/licenses/>.
+
+"""
+File Read: Verify output data when the file is read as raw data
+
+The output file is written with messagesInFile, so each message is an 8 byte header
+(32 bit length, 32 bit opcode) followed by its data.
+
+Verify args:
+1. output data file to verify
+
+Validation Tests:
+#1: Every message but the last is messageSize long, and the last is not longer
+#2: Every message has the fixed opcode
+#3: The data of all the messages together is the whole file that was read
+"""
+import sys
+import os
+import struct
+
+if len(sys.argv) != 2:
+    print("Invalid arguments:  usage is: verify.py <output-file>")
+    sys.exit(1)
+print("    VALIDATE (messages from raw file data):")
+
+message_size = int(os.environ.get("OCPI_TEST_messageSize"))
+opcode = int(os.environ.get("OCPI_TEST_opcode"))
+with open(os.environ.get("OCPI_TEST_fileName"), 'rb') as f:
+    idata = f.read()
+with open(sys.argv[1], 'rb') as f:
+    odata = f.read()
+
+messages = []
+offset = 0
+while offset < len(odata):
+    if offset + 8 > len(odata):
+        print("    FAIL: output file ends inside a message header")
+        sys.exit(1)
+    length, op = struct.unpack_from('<II', odata, offset)
+    offset += 8
+    if offset + length > len(odata):
+        print("    FAIL: output file ends inside message %u" % len(messages))
+        sys.exit(1)
+    messages.append((length, op, odata[offset:offset + length]))
+    offset += length
+
+#Test #1 - Check the message boundaries
+for n, (length, op, data) in enumerate(messages):
+    if length > message_size or (length != message_size and n != len(messages) - 1):
+        print("    FAIL: message %u has length %u, when messageSize is %u" %
+              (n, length, message_size))
+        sys.exit(1)
+print("    PASS: %u messages all have the expected lengths" % len(messages))
+
+#Test #2 - Check the opcodes
+for n, (length, op, data) in enumerate(messages):
+    if op != opcode:
+        print("    FAIL: message %u has opcode %u, when %u was expected" % (n, op, opcode))
+        sys.exit(1)
+print("    PASS: All messages have opcode %u" % opcode)
+
+#Test #3 - Check that the data is the file, no more, no less
+if b''.join(data for length, op, data in messages) != idata:
+    print("    FAIL: Output data does not match the input file (%u bytes out, %u in)" %
+          (sum(length for length, op, data in messages), len(idata)))
+    sys.exit(1)
+print("    PASS: Output data matches the input file")
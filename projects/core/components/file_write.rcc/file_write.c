@@ -28,14 +28,18 @@
 #define _GNU_SOURCE // for asprintf
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/uio.h>
 #include "file_write_Worker.h"
 
 typedef struct {
   int fd;
   int started;
+  uint8_t *batch;     // messages gathered for writing together
+  size_t batchLength;
 } MyState;
 
 FILE_WRITE_METHOD_DECLARATIONS;
@@ -59,16 +63,54 @@ start(RCCWorker *self) {
   if ((s->fd = creat(p->fileName, 0666)) < 0)
     return self->container.setError("error creating file \"%s\": %s",
 				    p->fileName, strerror(errno));
+  if (p->batchSize && !(s->batch = malloc(p->batchSize)))
+    return self->container.setError("error allocating %u byte batch buffer", p->batchSize);
   s->started = 1;
   return RCC_OK;
 } 
 
+// Write all of a gather list, coping with partial writes
+static int
+writeAll(int fd, struct iovec *iov, int iovcnt) {
+  while (iovcnt) {
+    ssize_t n = writev(fd, iov, iovcnt);
+    if (n < 0) {
+      if (errno == EINTR)
+	continue;
+      return -1;
+    }
+    for (; iovcnt && (size_t)n >= iov->iov_len; iov++, iovcnt--)
+      n -= (ssize_t)iov->iov_len;
+    if (iovcnt) {
+      iov->iov_base = (uint8_t *)iov->iov_base + n;
+      iov->iov_len -= (size_t)n;
+    }
+  }
+  return 0;
+}
+
+static RCCResult
+flush(RCCWorker *self) {
+  MyState *s = self->memory;
+  struct iovec iov = { s->batch, s->batchLength };
+  if (s->batchLength && writeAll(s->fd, &iov, 1))
+    return self->container.setError("error writing to file: %s", strerror(errno));
+  s->batchLength = 0;
+  return RCC_OK;
+}
+
 static RCCResult
 release(RCCWorker *self) {
   MyState *s = self->memory;
-  if (s->started)
+  RCCResult rc = RCC_OK;
+  if (s->started) {
+    rc = flush(self);
     close(s->fd);
- return RCC_OK;
+    s->started = 0;
+  }
+  free(s->batch);
+  s->batch = NULL;
+  return rc;
 }
 
 static RCCResult
@@ -82,19 +124,39 @@ run(RCCWorker *self, RCCBoolean timedOut, RCCBoolean *newRunCondition) {
 
  (void)timedOut;(void)newRunCondition;
  if (port->input.eof) // length == 0 && port->input.u.operation == 0 && props->stopOnEOF)
-   return RCC_ADVANCE_DONE;
+   return flush(self) == RCC_OK ? RCC_ADVANCE_DONE : RCC_ERROR;
+ // Gather any batched messages, the header and the data into one write
+ struct {
+   uint32_t length;
+   uint32_t opcode;
+ } m = { (uint32_t)port->input.length, port->input.u.operation };
+ struct iovec iov[3];
+ int n = 0;
+ if (s->batchLength) {
+   iov[n].iov_base = s->batch;
+   iov[n++].iov_len = s->batchLength;
+ }
  if (props->messagesInFile) {
-   struct {
-     uint32_t length;
-     uint32_t opcode;
-   } m = { port->input.length, port->input.u.operation };
-   if (write(s->fd, &m, sizeof(m)) != (ssize_t)sizeof(m))
-     return self->container.setError("error writing header to file: %s", strerror(errno));
+   iov[n].iov_base = &m;
+   iov[n++].iov_len = sizeof(m);
+ }
+ if (port->input.length) {
+   iov[n].iov_base = port->current.data;
+   iov[n++].iov_len = port->input.length;
+ }
+ size_t length = (props->messagesInFile ? sizeof(m) : 0) + port->input.length;
+ if (s->batch && s->batchLength + length <= props->batchSize) {
+   // The message fits in the batch, so just add it
+   for (int i = s->batchLength ? 1 : 0; i < n; i++) {
+     memcpy(s->batch + s->batchLength, iov[i].iov_base, iov[i].iov_len);
+     s->batchLength += iov[i].iov_len;
+   }
+ } else if (n) {
+   if (writeAll(s->fd, iov, n))
+     return self->container.setError("error writing data to file: length %zu(%zx): %s",
+				     port->input.length, port->input.length, strerror(errno));
+   s->batchLength = 0;
  }
- if (port->input.length &&
-     write(s->fd, port->current.data, port->input.length) != (ssize_t)port->input.length)
-   return self->container.setError("error writing data to file: length %zu(%zx): %s",
-				   port->input.length, port->input.length, strerror(errno));
  props->bytesWritten += port->input.length;
  props->messagesWritten++; // this includes non-EOF ZLMs even though no data was written.
  return RCC_ADVANCE;
@@ -72,10 +72,13 @@ namespace OCPI {
       };
       // This structure is used during deployment planning.
       struct Instance {
-	Deployment m_deployment;      // Current deployent when generating all of them
 	Deployment m_bestDeployment;
 	CMap *m_feasibleContainers;   // map per candidate, from findContainers
 	size_t m_nCandidates;         // convenience
+	// Candidates that survived pre-filtering, in the order they are searched:
+	// best score first, then in their original order
+	std::vector<unsigned> m_searchOrder;
+	unsigned m_maxScore;          // the best score of any of them
 	const char *m_containerName;  // used to avoid touching the container
 	// The launcher info for this application instance;
 	OCPI::Container::Launcher::Crew m_crew;
@@ -103,11 +106,38 @@ namespace OCPI {
 	CMap m_usedImpls;         // which fixed implementations in the artifact are in use
 	Booking() : m_artifact(NULL), m_usedImpls(0) {}
       };
+      // The state of a depth first search for the best deployment.  Subtrees of the search
+      // can be explored in parallel, each with its own Search.  Deployments are compared by
+      // score, and then by their "path": the position of each instance's choice in the
+      // order that an exhaustive search would make them, so ties are always resolved
+      // the same way no matter how the search is pruned or split up.
+      struct Search {
+	ApplicationI &m_app;
+	unsigned m_nInstances, m_nContainers;
+	Deployment *m_deployments;      // current choice for each instance
+	Booking *m_bookings;            // current use of each container
+	unsigned *m_path;               // current path
+	Deployment *m_bestDeployments;
+	unsigned *m_bestPath;
+	unsigned m_bestScore;           // zero when nothing has been found
+	unsigned m_startScore;          // for a subtree, the score of the choices before it
+	unsigned m_splitAt;             // when collecting subtrees, the instance they start at
+	std::vector<Search *> *m_subtrees;
+	uint64_t m_nodes;               // partial deployments considered
+	std::string m_error;
+	Search(ApplicationI &app, unsigned nInstances, unsigned nContainers);
+	Search(const Search &other);    // a subtree with the other's current choices
+	~Search();
+	bool better(unsigned score) const;
+      private:
+	Search &operator=(const Search &);
+      };
       Instance *m_instances;
       // The instance objects for the launcher
       OCPI::Container::Launcher::Members m_launchMembers;
       OCPI::Container::Launcher::Connections m_launchConnections;
-      Booking *m_bookings;
+      std::vector<unsigned> m_scoreBounds; // the most that instances n and after can add
+      volatile unsigned m_sharedBestScore; // the best score found by any Search
       // This class represents a mapping from an externally visible property of the assembly
       // to an individual property of an instance. It must be at this layer
       // (not util::assembly or library::assembly) because it potentially depends on the
@@ -195,7 +225,7 @@ namespace OCPI {
       // return our used-container ordinal
       unsigned addContainer(unsigned container, bool existOk = false);
       unsigned getUsedContainer(unsigned container);
-      bool connectionsOk(OCPI::Library::Candidate &c, unsigned instNum);
+      bool connectionsOk(Search &s, OCPI::Library::Candidate &c, unsigned instNum);
       void finalizeProperties(const OCPI::Util::PValue *params);
       const char *finalizePortParam(const OCPI::Util::PValue *params, const char *pName);
       void finalizeExternals();
@@ -203,18 +233,26 @@ namespace OCPI {
       void policyMap( Instance * i, CMap & bestMap);
       void setPolicy(const OCPI::API::PValue *params);
       Property &findProperty(const char * worker_inst_name, const char * prop_name = NULL) const;
-      void dumpDeployment(unsigned score);
-      void doScaledInstance(unsigned instNum, unsigned score);
-      void deployInstance(unsigned instNum, unsigned score, size_t scale,
+      void dumpDeployment(Search &s, unsigned score);
+      void doScaledInstance(Search &s, unsigned instNum, unsigned score);
+      void deployInstance(Search &s, unsigned instNum, unsigned score, size_t scale,
 			  unsigned *containers, const OCPI::Library::Implementation **impls,
 			  CMap feasible);
-      void doInstance(unsigned instNum, unsigned score);
+      bool pruned(Search &s, unsigned instNum, unsigned score);
+      void doInstance(Search &s, unsigned instNum, unsigned score);
+      static void searchSubtree(void *arg);
+      void filterCandidates();
+      void searchDeployments(const PValue *params);
       void checkExternalParams(const char *pName, const OCPI::Util::PValue *params);
       void prepareInstanceProperties(unsigned nInstance,
 				     const OCPI::Library::Implementation &impl,
 				     unsigned *&pn, OCPI::Util::Value *&pv);
       void planDeployment(const PValue *params);
       void importDeployment(const char *file, ezxml_t &xml, const PValue *params);
+      // The plan cache: deployments saved by a hash of everything planning depends on
+      bool planCacheFile(const PValue *params, std::string &file);
+      bool loadCachedPlan(const std::string &file, const PValue *params);
+      void saveCachedPlan(const std::string &file);
     public:
       explicit ApplicationI(OCPI::API::Application &app, const char *file,
 			    const OCPI::API::PValue *params = NULL);
@@ -254,6 +292,7 @@ namespace OCPI {
       void getProperty(const char * wname, const char * pname, std::string &value, bool hex);
       void setProperty(const char* worker_name, const char* prop_name, const char *value,
 		       OCPI::API::AccessList &list = OCPI::API::emptyList);
+      void accessProperties(const PropertyBatchAccess *accesses, size_t n) const;
       void dumpDeployment(const char *appFile, const std::string &file);
       void dumpProperties(bool printParameters, bool printCached, const char *context) const;
       void genScaPrf(const char *outDir) const;
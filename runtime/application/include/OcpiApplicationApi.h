@@ -101,6 +101,10 @@ namespace OCPI {
       void getProperty(const char* instance_name, const char* prop_name, std::string &value,
 		       bool hex = false);
       void setProperty(const char* instance_name, const char* prop_name, const char *value);
+      // Do a batch of accesses to properties of any workers in the application, in order.
+      // Consecutive accesses to the same worker are done as one batch for that worker.
+      // With no accesses, wait until earlier writes to all workers are done.
+      void accessProperties(const PropertyBatchAccess *accesses, size_t n) const;
       void dumpDeployment(const char *appFile, const std::string &file);
       void dumpProperties(bool printParameters = true, bool printCached = true,
 			  const char *context = NULL) const;
@@ -19,7 +19,9 @@
  */
 
 #include <unistd.h>
+#include <inttypes.h>
 #include <climits>
+#include <algorithm>
 #include "OcpiOsFileSystem.h"
 #include "OcpiContainerApi.h"
 #include "OcpiOsMisc.h"
@@ -27,6 +29,8 @@
 #include "OcpiPValue.h"
 #include "OcpiTimeEmit.h"
 #include "OcpiUtilMisc.h"
+#include "OcpiUtilTaskPool.h"
+#include "md5.h"
 #include "ContainerLauncher.h"
 #include "OcpiApplication.h"
 
@@ -161,7 +165,6 @@ namespace OCPI {
       ezxml_free(m_appXml);
       delete [] m_copy;
       delete [] m_instances;
-      delete [] m_bookings;
       delete [] m_properties;
       delete [] m_global2used;
       delete [] m_usedContainers;
@@ -323,10 +326,10 @@ namespace OCPI {
     }
     // Check whether this candidate can be used relative to previous
     // choices for instances it is connected to
-    bool ApplicationI::
-    connectionsOk(OL::Candidate &c, unsigned instNum) {
-      unsigned nPorts = c.impl->m_metadataImpl.nPorts();
-      const OU::Assembly::Instance &ui = m_assembly.instance(instNum).m_utilInstance;
+    // The reason is only formatted when something is rejected since this is called for
+    // every node of the deployment search.
+    static std::string
+    rejectReason(const OU::Assembly::Instance &ui, OL::Candidate &c) {
       std::string reject;
       OU::format(reject,
                  "For instance \"%s\" for spec \"%s\" rejecting implementation \"%s%s%s\" with score %u "
@@ -337,6 +340,12 @@ namespace OCPI {
                  c.impl->m_staticInstance ? "/" : "",
                  c.impl->m_staticInstance ? ezxml_cattr(c.impl->m_staticInstance, "name") : "",
                  c.score, c.impl->m_artifact.name().c_str());
+      return reject;
+    }
+    bool ApplicationI::
+    connectionsOk(Search &s, OL::Candidate &c, unsigned instNum) {
+      unsigned nPorts = c.impl->m_metadataImpl.nPorts();
+      const OU::Assembly::Instance &ui = m_assembly.instance(instNum).m_utilInstance;
       for (unsigned nn = 0; nn < nPorts; nn++) {
         OU::Assembly::Port
           *ap = m_assembly.assyPort(instNum, nn),
@@ -345,10 +354,10 @@ namespace OCPI {
             other &&                       // if the port is connected in the assembly
             other->m_instance < instNum) { // if the other instance has been processed
           const OL::Implementation &otherImpl =
-            *m_instances[other->m_instance].m_deployment.m_impls[0];
+            *s.m_deployments[other->m_instance].m_impls[0];
           // then check for prewired compatibility
           if (m_assembly.badConnection(*c.impl, otherImpl, *ap, nn)) {
-            ocpiInfo("%s due to connectivity conflict", reject.c_str());
+            ocpiInfo("%s due to connectivity conflict", rejectReason(ui, c).c_str());
             ocpiInfo("Other is instance \"%s\" for spec \"%s\" implementation \"%s%s%s\" "
                      "from artifact \"%s\".",
                      m_assembly.instance(other->m_instance).name().c_str(),
@@ -368,13 +377,13 @@ namespace OCPI {
       if (ui.m_slaves.size()) {
         for (unsigned n = 0; n < ui.m_slaves.size(); ++n)
           if (ui.m_slaves[n] < instNum &&
-              !checkSlave(m_instances[ui.m_slaves[n]].m_deployment.m_impl->m_metadataImpl,
-                          c.impl->m_metadataImpl, true, reject))
+              !checkSlave(s.m_deployments[ui.m_slaves[n]].m_impl->m_metadataImpl,
+                          c.impl->m_metadataImpl, true, rejectReason(ui, c)))
               return false;
       } else if (ui.m_hasMaster && ui.m_master < instNum &&
                  !checkSlave(c.impl->m_metadataImpl,
-                             m_instances[ui.m_master].m_deployment.m_impl->m_metadataImpl, false,
-                             reject))
+                             s.m_deployments[ui.m_master].m_impl->m_metadataImpl, false,
+                             rejectReason(ui, c)))
         return false;
       return true;
     }
@@ -636,24 +645,24 @@ namespace OCPI {
       return NULL;
     }
     void ApplicationI::
-    dumpDeployment(unsigned score) {
+    dumpDeployment(Search &s, unsigned score) {
       ocpiDebug("Deployment with score %u is:", score);
-      Instance *i = m_instances;
-      for (unsigned n = 0; n < m_nInstances; n++, i++) {
-        if (i->m_deployment.m_scale == 1) {
-          const OL::Implementation &li = *i->m_deployment.m_impls[0];
+      Deployment *d = s.m_deployments;
+      for (unsigned n = 0; n < m_nInstances; n++, d++) {
+        if (d->m_scale == 1) {
+          const OL::Implementation &li = *d->m_impls[0];
           ocpiDebug(" Instance %2u: Container: %u Instance %s%s%s in %s",
-                    n, i->m_deployment.m_containers[0],
+                    n, d->m_containers[0],
                     li.m_metadataImpl.cname(),
                     li.m_staticInstance ? "/" : "",
                     li.m_staticInstance ? ezxml_cattr(li.m_staticInstance, "name") : "",
                     li.m_artifact.name().c_str());
         } else {
-          ocpiDebug(" Instance %2u: Scale factor: %zu", n, i->m_deployment.m_scale);
-          for (unsigned j = 0; j < i->m_deployment.m_scale; j++) {
-            const OL::Implementation li = *i->m_deployment.m_impls[j];
+          ocpiDebug(" Instance %2u: Scale factor: %zu", n, d->m_scale);
+          for (unsigned j = 0; j < d->m_scale; j++) {
+            const OL::Implementation li = *d->m_impls[j];
             ocpiDebug("   Member %2u: Container: %u Instance %s%s%s in %s",
-                      j, i->m_deployment.m_containers[j], li.m_metadataImpl.cname(),
+                      j, d->m_containers[j], li.m_metadataImpl.cname(),
                       li.m_staticInstance ? "/" : "",
                       li.m_staticInstance ? ezxml_cattr(li.m_staticInstance, "name") : "",
                       li.m_artifact.name().c_str());
@@ -662,46 +671,91 @@ namespace OCPI {
       }
     }
 
+    ApplicationI::Search::
+    Search(ApplicationI &app, unsigned nInstances, unsigned nContainers)
+      : m_app(app), m_nInstances(nInstances), m_nContainers(nContainers),
+        m_deployments(new Deployment[nInstances]), m_bookings(new Booking[nContainers]),
+        m_path(new unsigned[nInstances]), m_bestDeployments(new Deployment[nInstances]),
+        m_bestPath(new unsigned[nInstances]), m_bestScore(0), m_startScore(0), m_splitAt(0),
+        m_subtrees(NULL), m_nodes(0) {
+    }
+    ApplicationI::Search::
+    Search(const Search &other)
+      : m_app(other.m_app), m_nInstances(other.m_nInstances), m_nContainers(other.m_nContainers),
+        m_deployments(new Deployment[m_nInstances]), m_bookings(new Booking[m_nContainers]),
+        m_path(new unsigned[m_nInstances]), m_bestDeployments(new Deployment[m_nInstances]),
+        m_bestPath(new unsigned[m_nInstances]), m_bestScore(0), m_startScore(0),
+        m_splitAt(other.m_splitAt), m_subtrees(NULL), m_nodes(0) {
+      for (unsigned n = 0; n < m_splitAt; n++) {
+        m_deployments[n] = other.m_deployments[n];
+        m_path[n] = other.m_path[n];
+      }
+      std::copy(other.m_bookings, other.m_bookings + m_nContainers, m_bookings);
+    }
+    ApplicationI::Search::
+    ~Search() {
+      delete [] m_deployments;
+      delete [] m_bookings;
+      delete [] m_path;
+      delete [] m_bestDeployments;
+      delete [] m_bestPath;
+    }
+    // Would a complete deployment with this score, at the current path, be better than the
+    // best so far?  Equal scores go to whichever an exhaustive search would find first.
+    bool ApplicationI::Search::
+    better(unsigned score) const {
+      return score && (score > m_bestScore ||
+                       (score == m_bestScore &&
+                        std::lexicographical_compare(m_path, m_path + m_nInstances,
+                                                     m_bestPath, m_bestPath + m_nInstances)));
+    }
+
     // After deciding on a possible instance deployment, record it and recurse for next one.
     // We record the implementation (possibly an array of them in the scaled case).
     // We record the container(s), and the feasible container map too for the unscaled case
     void ApplicationI::
-    deployInstance(unsigned instNum, unsigned score, size_t scale,
+    deployInstance(Search &s, unsigned instNum, unsigned score, size_t scale,
                    unsigned *containers, const OL::Implementation **impls, CMap feasible) {
-      m_instances[instNum].m_deployment.set(scale, containers, impls, feasible);
+      s.m_deployments[instNum].set(scale, containers, impls, feasible);
+      s.m_nodes++;
       ocpiDebug("doInstance ok");
       if (instNum < m_nInstances-1) {
         instNum++;
         if (scale == 1 && (*impls)->m_staticInstance) {
           // FIXME: We don't deal with static instances on scaled instances yet
           Booking
-            &b = m_bookings[*containers],
+            &b = s.m_bookings[*containers],
             save = b;
           b.m_artifact = &(*impls)->m_artifact;
           b.m_usedImpls |= 1u << (*impls)->m_ordinal;
-          doInstance(instNum, score);
+          doInstance(s, instNum, score);
           b = save;
         } else
-          doInstance(instNum, score);
+          doInstance(s, instNum, score);
       } else {
-        dumpDeployment(score);
-        if (score > m_bestScore) {
-          Instance *i = m_instances;
-          for (unsigned n = 0; n < m_nInstances; n++, i++)
-            i->m_bestDeployment = i->m_deployment;
-          m_bestScore = score;
+        dumpDeployment(s, score);
+        if (s.better(score)) {
+          for (unsigned n = 0; n < m_nInstances; n++)
+            s.m_bestDeployments[n] = s.m_deployments[n];
+          std::copy(s.m_path, s.m_path + m_nInstances, s.m_bestPath);
+          s.m_bestScore = score;
+          // Let searches of other subtrees know
+          for (unsigned best = m_sharedBestScore; best < score;
+               best = __sync_val_compare_and_swap(&m_sharedBestScore, best, score))
+            ;
           ocpiDebug("Setting BEST");
         }
       }
     }
 
     void ApplicationI::
-    doScaledInstance(unsigned instNum, unsigned score) {
+    doScaledInstance(Search &s, unsigned instNum, unsigned score) {
       Instance *i = m_instances + instNum;
       OL::Assembly::Instance &li = m_assembly.instance(instNum);
       const OU::Assembly::Instance &ui = li.m_utilInstance;
+      unsigned group = 0;
       for (Instance::ScalableCandidatesIter sci = i->m_scalableCandidates.begin();
-           sci != i->m_scalableCandidates.end(); sci++) {
+           sci != i->m_scalableCandidates.end(); sci++, group++) {
         CMap map = 0;
         for (Instance::CandidatesIter ci = sci->second.begin(); ci != sci->second.end(); ci++)
           map |= i->m_feasibleContainers[*ci];
@@ -737,22 +791,52 @@ namespace OCPI {
               }
         }
       out:
-        deployInstance(instNum, score + li.m_candidates[sci->second.front()].score, scale,
+        s.m_path[instNum] = group;
+        deployInstance(s, instNum, score + li.m_candidates[sci->second.front()].score, scale,
                        containers, impls, map); // the map isn't really relevant yet...
       }
     }
 
+    // Branch and bound: can no deployment that starts with the current choices for the
+    // instances before this one beat the best one found so far?
+    bool ApplicationI::
+    pruned(Search &s, unsigned instNum, unsigned score) {
+      unsigned bound = score + m_scoreBounds[instNum];
+      if (bound < m_sharedBestScore) // some other subtree has done better
+        return true;
+      if (bound != s.m_bestScore)
+        return bound < s.m_bestScore;
+      // Equal to the best: only a deployment that an exhaustive search would find earlier
+      // can replace it, and only if it actually has a score.
+      return !bound ||
+        std::lexicographical_compare(s.m_bestPath, s.m_bestPath + instNum,
+                                     s.m_path, s.m_path + instNum);
+    }
+
     void ApplicationI::
-    doInstance(unsigned instNum, unsigned score) {
+    doInstance(Search &s, unsigned instNum, unsigned score) {
+      if (s.m_subtrees && instNum == s.m_splitAt) {
+        // Collecting subtrees to search in parallel: this is one of them
+        Search *sub = new Search(s);
+        sub->m_startScore = score;
+        s.m_subtrees->push_back(sub);
+        return;
+      }
+      if (pruned(s, instNum, score))
+        return;
       OL::Assembly::Instance &li = m_assembly.instance(instNum);
       if (li.m_scale > 1)
-        doScaledInstance(instNum, score);
+        doScaledInstance(s, instNum, score);
       else {
         Instance &i = m_instances[instNum];
-        for (unsigned m = 0; m < i.m_nCandidates; m++) {
+        for (unsigned k = 0; k < i.m_searchOrder.size(); k++) {
+          unsigned m = i.m_searchOrder[k];
           OL::Candidate &c = li.m_candidates[m];
           ocpiDebug("doInstance %u %u %u", instNum, score, m);
-          if (connectionsOk(c, instNum)) {
+          // Candidates are in descending score order so later ones can't do better
+          if (k && pruned(s, instNum, score + c.score - i.m_maxScore))
+            break;
+          if (connectionsOk(s, c, instNum)) {
             unsigned base = OC::Container::baseContainer().ordinal();
             ocpiDebug("doInstance connections ok: %u", base);
             for (unsigned cont = 0; cont < OC::Manager::s_nContainers; cont++) {
@@ -760,8 +844,9 @@ namespace OCPI {
                         i.m_feasibleContainers[m]);
               if ((c.impl->m_metadataImpl.slaves().empty() || cont == base) &&
                   i.m_feasibleContainers[m] & (1u << cont) &&
-                  bookingOk(m_bookings[cont], c, instNum)) {
-                deployInstance(instNum, score + c.score, 1, &cont, &c.impl,
+                  bookingOk(s.m_bookings[cont], c, instNum)) {
+                s.m_path[instNum] = m * OC::Manager::s_nContainers + cont;
+                deployInstance(s, instNum, score + c.score, 1, &cont, &c.impl,
                                i.m_feasibleContainers[m]);
                 if (!c.impl->m_staticInstance)
                   break;
@@ -772,6 +857,156 @@ namespace OCPI {
       }
     }
 
+    // Orders of candidates for the search in descending score order
+    struct CandidateOrder {
+      const OL::Candidates &m_candidates;
+      CandidateOrder(const OL::Candidates &candidates) : m_candidates(candidates) {}
+      bool operator()(unsigned a, unsigned b) const {
+        return m_candidates[a].score > m_candidates[b].score ||
+          (m_candidates[a].score == m_candidates[b].score && a < b);
+      }
+    };
+
+    // Before searching, drop candidates that can never be part of a deployment:
+    // those with no feasible containers, and those that cannot connect to any of the
+    // remaining candidates of an earlier instance they are connected to.
+    // Then establish the search order and the score bounds used to prune the search.
+    void ApplicationI::
+    filterCandidates() {
+      m_scoreBounds.assign(m_nInstances + 1, 0);
+      for (unsigned n = 0; n < m_nInstances; n++) {
+        Instance &i = m_instances[n];
+        OL::Assembly::Instance &li = m_assembly.instance(n);
+        OL::Candidates &cs = li.m_candidates;
+        i.m_searchOrder.clear();
+        i.m_maxScore = 0;
+        for (unsigned m = 0; m < i.m_nCandidates; m++) {
+          if (!i.m_feasibleContainers[m])
+            continue;
+          if (li.m_scale <= 1) {
+            unsigned nPorts = cs[m].impl->m_metadataImpl.nPorts();
+            bool ok = true;
+            for (unsigned nn = 0; ok && nn < nPorts; nn++) {
+              OU::Assembly::Port
+                *ap = m_assembly.assyPort(n, nn),
+                *other = ap ? ap->m_connectedPort : NULL;
+              if (ap && other && other->m_instance < n) {
+                Instance &oi = m_instances[other->m_instance];
+                OL::Candidates &ocs = m_assembly.instance(other->m_instance).m_candidates;
+                ok = false;
+                for (unsigned k = 0; !ok && k < oi.m_searchOrder.size(); k++)
+                  ok = !m_assembly.badConnection(*cs[m].impl, *ocs[oi.m_searchOrder[k]].impl,
+                                                 *ap, nn);
+              }
+            }
+            if (!ok) {
+              ocpiInfo("%s since it cannot connect to any candidate for a connected instance",
+                       rejectReason(li.m_utilInstance, cs[m]).c_str());
+              continue;
+            }
+          }
+          i.m_searchOrder.push_back(m);
+          i.m_maxScore = std::max(i.m_maxScore, cs[m].score);
+        }
+        if (i.m_searchOrder.empty())
+          throw OU::Error("There are no feasible deployments for the application given the "
+                          "constraints: no implementation for instance \"%s\" can connect to "
+                          "the other instances", li.m_utilInstance.m_name.c_str());
+        std::sort(i.m_searchOrder.begin(), i.m_searchOrder.end(), CandidateOrder(cs));
+      }
+      for (size_t n = m_nInstances; n > 0; n--)
+        m_scoreBounds[n-1] = m_scoreBounds[n] + m_instances[n-1].m_maxScore;
+    }
+
+    void ApplicationI::
+    searchSubtree(void *arg) {
+      Search &s = *(Search *)arg;
+      try {
+        s.m_app.doInstance(s, s.m_splitAt, s.m_startScore);
+      } catch (std::string &e) {
+        s.m_error = e;
+      } catch (...) {
+        s.m_error = "Unexpected exception while searching for a deployment";
+      }
+    }
+
+    // Search for the best deployment.  When there are enough possibilities, the search tree
+    // is split at a depth with several subtrees per thread and the subtrees are searched in
+    // parallel, sharing only the best score found so far.  Since deployments are compared
+    // by score and then by path, the result is the same as a serial search.
+    void ApplicationI::
+    searchDeployments(const PValue *params) {
+      OS::Time start = OS::Time::now();
+      filterCandidates();
+      unsigned nThreads = 0; // default is automatic
+      OU::findULong(params, "planThreads", nThreads);
+      // Estimate the size of the search and find a depth to split it at
+      bool scaled = false;
+      double size = 1;
+      for (unsigned n = 0; n < m_nInstances; n++) {
+        if (m_assembly.instance(n).m_scale > 1)
+          scaled = true; // scaling changes the assembly during the search
+        size *= (double)m_instances[n].m_searchOrder.size();
+      }
+      OU::TaskPool *pool = NULL;
+      if (!scaled && nThreads != 1 && m_nInstances > 1 && size >= 10000) {
+        pool = new OU::TaskPool(nThreads ? nThreads - 1 : 0);
+        nThreads = pool->nThreads() + 1; // the caller joins in
+      } else
+        nThreads = 1;
+      Search top(*this, (unsigned)m_nInstances, OC::Manager::s_nContainers);
+      std::vector<Search *> subtrees;
+      m_sharedBestScore = 0;
+      if (pool) {
+        double split = 1;
+        top.m_splitAt = 0;
+        do
+          split *= (double)m_instances[top.m_splitAt++].m_searchOrder.size();
+        while (split < 4 * nThreads && top.m_splitAt < m_nInstances - 1);
+        top.m_subtrees = &subtrees;
+        doInstance(top, 0, 0);
+        OU::TaskGroup group;
+        for (unsigned n = 0; n < subtrees.size(); n++)
+          pool->add(group, searchSubtree, subtrees[n]);
+        pool->join(group);
+        delete pool;
+      } else
+        doInstance(top, 0, 0);
+      // Merge the subtree results
+      Search *best = &top;
+      uint64_t nodes = top.m_nodes;
+      std::string error;
+      for (unsigned n = 0; n < subtrees.size(); n++) {
+        Search &s = *subtrees[n];
+        nodes += s.m_nodes;
+        if (error.empty())
+          error = s.m_error;
+        if (s.m_bestScore &&
+            (s.m_bestScore > best->m_bestScore ||
+             (s.m_bestScore == best->m_bestScore &&
+              std::lexicographical_compare(s.m_bestPath, s.m_bestPath + m_nInstances,
+                                           best->m_bestPath, best->m_bestPath + m_nInstances))))
+          best = &s;
+      }
+      if (error.empty())
+        for (unsigned n = 0; n < m_nInstances; n++)
+          m_instances[n].m_bestDeployment = best->m_bestDeployments[n];
+      m_bestScore = error.empty() ? best->m_bestScore : 0;
+      for (unsigned n = 0; n < subtrees.size(); n++)
+        delete subtrees[n];
+      if (!error.empty())
+        throw OU::Error("%s", error.c_str());
+      double msecs = (double)(OS::Time::now() - start).bits() * 1000. /
+        (double)OS::Time::ticksPerSecond;
+      ocpiInfo("Deployment planning considered %" PRIu64 " partial deployments in %.3f ms "
+               "using %u thread%s, best score %u", nodes, msecs, nThreads,
+               nThreads == 1 ? "" : "s", m_bestScore);
+      if (m_verbose)
+        fprintf(stderr, "Deployment planning considered %" PRIu64 " partial deployments in "
+                "%.3f ms using %u thread%s.\n", nodes, msecs, nThreads,
+                nThreads == 1 ? "" : "s");
+    }
+
     void ApplicationI::Instance::
     collectCandidate(OL::Candidate &c, unsigned n) {
       OU::Worker &w = c.impl->m_metadataImpl;
@@ -787,7 +1022,6 @@ namespace OCPI {
      // The algorithmic way to figure out a deployment.
     void ApplicationI::
     planDeployment(const PValue *params) {
-      m_bookings = new Booking[OC::Manager::s_nContainers];
       // Set the instance map policy
       setPolicy(params);
       // First pass - make sure there are some containers to support some candidate
@@ -866,8 +1100,7 @@ namespace OCPI {
       // FIXME: we are assuming that an artifact is exclusive if is has static instances.
       // FIXME: we are assuming that if an artifact has a static instance, all of its instances are
 
-      m_bestScore = 0;
-      doInstance(0, 0);
+      searchDeployments(params);
       if (m_bestScore == 0)
         throw OU::Error("There are no feasible deployments for the application given the constraints");
       // Up to now we have just been "planning" and not doing things.
@@ -939,18 +1172,152 @@ namespace OCPI {
           throw OU::Error("For deployment instance \"%s\", worker for spec %s/%s not found "
                           " in artifact \"%s\"", iname, spec, instance ? instance : "",
                           artifact);
-        i->m_bestDeployment.m_impl = impl;
         if (!m_assembly.instance(n).resolveUtilPorts(*impl, m_assembly))
           throw OU::Error("Port mismatch for instance \"%s\" in artifact \"%s\"",
                           iname, artifact);
+        const OL::Implementation *cimpl = impl;
+        unsigned cont = 0;
         bool execution;
-        if (OU::findBool(params, "execution", execution) && !execution)
-          continue;
-        OC::Container *c = OC::Manager::find(i->m_containerName);
-        if (!c)
-          throw OU::Error("For deployment instance \"%s\", container \"%s\" was not found",
-                          iname, i->m_containerName);
-        i->m_bestDeployment.m_container = getUsedContainer(c->ordinal());
+        if (!OU::findBool(params, "execution", execution) || execution) {
+          OC::Container *c = OC::Manager::find(i->m_containerName);
+          if (!c)
+            throw OU::Error("For deployment instance \"%s\", container \"%s\" was not found",
+                            iname, i->m_containerName);
+          cont = c->ordinal();
+          i->m_usedContainers = &i->m_usedContainer;
+          i->m_usedContainer = getUsedContainer(cont);
+        }
+        // Record it just as planning would
+        i->m_bestDeployment.set(1, &cont, &cimpl, 1u << cont);
+      }
+    }
+
+    // Parameters that only affect output, not the deployment that planning would choose
+    static const char *planIrrelevant[] = {
+      "verbose", "dump", "dumpFile", "dumpPlatforms", "hex", "hidden", "uncached",
+      "planThreads", "planCache", NULL
+    };
+
+    static void
+    hashString(md5_state_t &md5, const std::string &s) {
+      md5_append(&md5, (const md5_byte_t *)s.c_str(), (unsigned)s.size() + 1);
+    }
+
+    // Decide whether the plan cache is in use and if so, which file in it would hold the
+    // deployment for this application.  The file name is a hash of the application XML,
+    // the parameters, the available containers, and the identity and modification time of
+    // every candidate artifact.  Thus any change to the libraries that would change the
+    // candidates or their scores, or any change in the containers, results in a new plan.
+    bool ApplicationI::
+    planCacheFile(const PValue *params, std::string &file) {
+      bool use = true;
+      OU::findBool(params, "planCache", use);
+      const char *dir = getenv("OCPI_PLAN_CACHE_DIR"), *home = getenv("HOME");
+      if (!use || (dir && !*dir) || (!dir && !home))
+        return false;
+      md5_state_t md5;
+      md5_init(&md5);
+      char *xml = ezxml_toxml(m_assembly.xml());
+      hashString(md5, xml);
+      free(xml);
+      const char *env = getenv("OCPI_APPLICATION_PARAMS");
+      hashString(md5, env ? env : "");
+      std::string value;
+      for (const PValue *p = params; p && p->name; p++) {
+        const char **pi;
+        for (pi = planIrrelevant; *pi && strcasecmp(*pi, p->name); pi++)
+          ;
+        if (!*pi) {
+          hashString(md5, p->name);
+          hashString(md5, p->unparse(value));
+        }
+      }
+      OA::Container *c;
+      for (unsigned n = 0; (c = OA::ContainerManager::get(n)); n++)
+        hashString(md5, OU::format(value, "%u %s %s %s", n, c->name().c_str(),
+                                   c->model().c_str(), c->platform().c_str()));
+      for (unsigned n = 0; n < m_nInstances; n++) {
+        OL::Candidates &cs = m_assembly.instance(n).m_candidates;
+        for (unsigned m = 0; m < cs.size(); m++) {
+          const OL::Implementation &impl = *cs[m].impl;
+          const char *uuid = ezxml_cattr(impl.m_artifact.xml(), "uuid");
+          hashString(md5, OU::format(value, "%u %u %s %s %s %s %" PRIu64 " %" PRIu64 " %u", n, m,
+                                     impl.m_metadataImpl.cname(),
+                                     impl.m_staticInstance ?
+                                     ezxml_cattr(impl.m_staticInstance, "name") : "",
+                                     impl.m_artifact.name().c_str(), uuid ? uuid : "",
+                                     (uint64_t)impl.m_artifact.mtime(),
+                                     impl.m_artifact.length(), cs[m].score));
+        }
+      }
+      md5_byte_t digest[16];
+      md5_finish(&md5, digest);
+      std::string cacheDir(dir ? dir : home);
+      if (!dir)
+        cacheDir += "/.cache/opencpi/plans";
+      file = cacheDir + "/";
+      for (unsigned n = 0; n < sizeof(digest); n++)
+        OU::formatAdd(file, "%02x", digest[n]);
+      file += ".xml";
+      return true;
+    }
+
+    // Use a previously saved plan if there is one.  If it cannot be used for any reason,
+    // forget it and return false so that planning happens as usual.
+    bool ApplicationI::
+    loadCachedPlan(const std::string &file, const PValue *params) {
+      if (!OS::FileSystem::exists(file))
+        return false;
+      try {
+        importDeployment(file.c_str(), m_deployXml, params);
+      } catch (std::string &e) {
+        ocpiInfo("Ignoring cached deployment plan \"%s\": %s", file.c_str(), e.c_str());
+        // Undo whatever the import did
+        ezxml_free(m_deployXml);
+        m_deployXml = NULL;
+        m_allMap = 0;
+        m_nContainers = 0;
+        m_currConn = OC::Manager::s_nContainers - 1;
+        delete [] m_instances;
+        m_instances = new Instance[m_nInstances];
+        try {
+          OS::FileSystem::remove(file);
+        } catch (...) {}
+        return false;
+      }
+      ocpiInfo("Using cached deployment plan \"%s\"", file.c_str());
+      if (m_verbose)
+        fprintf(stderr, "Deployment plan read from cache file \"%s\".\n", file.c_str());
+      return true;
+    }
+
+    // Save a plan for next time.  Failure is not an error: it just means no caching.
+    void ApplicationI::
+    saveCachedPlan(const std::string &file) {
+      for (unsigned n = 0; n < m_nInstances; n++)
+        if (m_instances[n].m_bestDeployment.m_scale > 1)
+          return; // deployment files do not describe scaled instances
+      std::string dir(OS::FileSystem::directoryName(file)), tmp;
+      OU::format(tmp, "%s.%lu.tmp", file.c_str(), OS::getProcessId());
+      try {
+        // Create the cache directory and its parents as needed
+        for (size_t slash = 1; slash != std::string::npos; ) {
+          slash = dir.find('/', slash + 1);
+          std::string sub(dir, 0, slash);
+          if (!OS::FileSystem::exists(sub))
+            OS::FileSystem::mkdir(sub, true);
+        }
+        // Write a temporary file and rename it so readers never see a partial plan
+        dumpDeployment(m_assembly.name().c_str(), tmp);
+        OS::FileSystem::rename(tmp, file);
+        ocpiInfo("Saved deployment plan in cache file \"%s\"", file.c_str());
+      } catch (std::string &e) {
+        ocpiInfo("Could not save deployment plan in cache file \"%s\": %s", file.c_str(),
+                 e.c_str());
+        try {
+          if (OS::FileSystem::exists(tmp))
+            OS::FileSystem::remove(tmp);
+        } catch (...) {}
       }
     }
     void ApplicationI::
@@ -959,7 +1326,6 @@ namespace OCPI {
         // In order from class definition except for instance-related
         // We must initialize everything before anything that might cause an exception
         m_instances = NULL;
-        m_bookings = NULL;
         m_properties = NULL;
         m_nProperties = 0;
         m_curMap = 0;
@@ -1007,10 +1373,15 @@ namespace OCPI {
           throw OU::Error("%s", err);
         // We are at the point where we need to either plan or import the deployment.
         const char *dfile = NULL;
+        std::string cacheFile;
         if (m_deployXml || OU::findString(params, "deployment", dfile))
           importDeployment(dfile, m_deployXml, params);
-        else
+        else if (!planCacheFile(params, cacheFile))
+          planDeployment(params);
+        else if (!loadCachedPlan(cacheFile, params)) {
           planDeployment(params);
+          saveCachedPlan(cacheFile);
+        }
         // This array is sized and initialized here since it is needed for property finalization
         initLaunchMembers();
         // All the implementation selection is done, so now do the final check of ports
@@ -1679,6 +2050,24 @@ namespace OCPI {
       return *static_cast<OC::ExternalPort*>(ext.m_external);
     }
 
+    void ApplicationI::
+    accessProperties(const PropertyBatchAccess *accesses, size_t n) const {
+      if (!n) {
+        if (m_launchMembers.empty())
+          throw OU::Error("application is not yet initialized for property access");
+        for (unsigned i = 0; i < m_launchMembers.size(); i++)
+          if (m_launchMembers[i].m_worker)
+            m_launchMembers[i].m_worker->accessProperties(NULL, 0);
+        return;
+      }
+      // Each run of accesses to the same worker is one batch
+      for (size_t first = 0, i = 1; i <= n; i++)
+        if (i == n || &accesses[i].m_property->worker() != &accesses[first].m_property->worker()) {
+          accesses[first].m_property->worker().accessProperties(accesses + first, i - first);
+          first = i;
+        }
+    }
+
     // The name might have a dot in it to separate instance from property name
     Worker &ApplicationI::getPropertyWorker(const char *a_name, const char *&pname) const {
       const char *dot;
@@ -1882,7 +2271,17 @@ namespace OCPI {
     }
     ApplicationI::Deployment &ApplicationI::Deployment::
     operator=(const ApplicationI::Deployment &d) {
-      set(d.m_scale, d.m_containers, d.m_impls, d.m_feasible);
+      if (this == &d)
+        return *this;
+      if (d.m_scale > 1) {
+        // Scaled deployments own their arrays
+        unsigned *containers = new unsigned[d.m_scale];
+        const OL::Implementation **impls = new const OL::Implementation*[d.m_scale];
+        std::copy(d.m_containers, d.m_containers + d.m_scale, containers);
+        std::copy(d.m_impls, d.m_impls + d.m_scale, impls);
+        set(d.m_scale, containers, impls, d.m_feasible);
+      } else
+        set(d.m_scale, d.m_containers, d.m_impls, d.m_feasible);
       return *this;
     }
   }
@@ -2028,6 +2427,11 @@ namespace OCPI {
       return m_application.getPropertyWorker(a_name, pname);
     }
 
+    void Application::
+    accessProperties(const PropertyBatchAccess *accesses, size_t n) const {
+      m_application.accessProperties(accesses, n);
+    }
+
     void Application::
     dumpDeployment(const char *appFile, const std::string &file) {
       return m_application.dumpDeployment(appFile, file);
@@ -58,6 +58,13 @@
 }
 
 %rename(writeBuffer) getBuffer(uint8_t *&data, size_t &length);
+// The blocking and multi-buffer calls are not wrapped: they take arrays and callbacks
+%ignore getBuffer(uint8_t *&data, size_t &length, uint8_t &opCode, bool &endOfData,
+		  unsigned long timeout_us);
+%ignore getBuffer(uint8_t *&data, size_t &length, unsigned long timeout_us);
+%ignore getBuffers;
+%ignore putBuffers;
+%ignore setNotifier;
 
 // ExternalBuffer *getBuffer(uint8_t *&data, size_t &length)
 // Typemaps to adapt the c++ return by reference calls into return values. Allows for data to be written TO
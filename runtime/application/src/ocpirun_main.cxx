@@ -111,6 +111,10 @@
 	                               "not an application XML file") \
   CMD_OPTION(seconds,     , Long,   0, "<seconds> -- legacy, use \"duration\" now") \
   CMD_OPTION(version,     , Bool,   0, "print the OpenCPI release version") \
+  CMD_OPTION(plan_threads,, ULong,  0, "threads to use when searching for a deployment\n" \
+	                               "(default is one per processor for large searches)") \
+  CMD_OPTION(no_plan_cache,, Bool,  0, "do not use or update the cache of deployment plans\n" \
+	                               "(in $OCPI_PLAN_CACHE_DIR, default ~/.cache/opencpi/plans)") \
   /**/
 
 //  CMD_OPTION_S(simulator, H,String, 0, "Create a container with this HDL simulator")
@@ -308,6 +312,10 @@ static int mymain(const char **ap) {
     params.addString("simDir", options.sim_dir());
   if (options.sim_ticks())
     params.addULong("simTicks", options.sim_ticks());
+  if (options.plan_threads())
+    params.addULong("planThreads", options.plan_threads());
+  if (options.no_plan_cache())
+    params.addBool("planCache", false);
   size_t n;
   addParams("worker", options.worker(n), params);
   addParams("selection", options.selection(n), params);
@@ -0,0 +1,330 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Run the subcases of a component unit test as the generated run.sh script would with one ocpirun
+// per subcase, but with each process running many subcases, so that library discovery, artifact
+// loading and container startup happen once per process rather than once per subcase.  Each
+// subcase is still its own application, created from its generated application XML with its
+// own property values, on containers that stay up with their artifacts loaded.  Subcases are
+// independent, so several processes can run them at once.
+// Applications are not reused between subcases, even those that differ only in property
+// values: the file_read and file_write instances and most properties of the worker under
+// test are initial, i.e. only settable before the worker is initialized, and the runtime
+// cannot return a worker to that state.  So the time spent creating and initializing each
+// application is reported separately from the time spent running it, to show what reuse
+// could save.
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+
+#include "OcpiApplicationApi.h"
+#include "OcpiOsDebug.h"
+#include "OcpiUtilMisc.h"
+#include "OcpiUtilException.h"
+#include "OcpiPValue.h"
+#define OCPI_OPTIONS_HELP \
+  "Usage is: ocpitestrun <options>... <subcase-file>\n" \
+  "Runs the test subcases listed in the file (- for stdin), one per line, with the arguments\n" \
+  "of the docase function in testrun.sh: <model> <worker> <case> <subcase> <timeout> <duration>\n"
+
+//         name      abbr type    value description
+#define OCPI_OPTIONS \
+  CMD_OPTION(component,  c, String, 0, "name of the component under test")\
+  CMD_OPTION(platform,   P, String, 0, "platform to run the component under test on")\
+  CMD_OPTION_S(output,   o, String, 0, "<port-name>\n" \
+	                               "output port of the component, whose data is written to a file")\
+  CMD_OPTION_S(selection,s, String, 0, "<instance-name>=<expression>\n" \
+                                       "provide selection expression for worker instance")\
+  CMD_OPTION(processes,  j, ULong,  0, "number of processes running subcases at once\n" \
+	                               "(default is one per processor for RCC, otherwise one)")\
+  CMD_OPTION(timeout,    O, ULong,  0, "<seconds>\n" \
+	                               "time limit for subcases that do not have their own")\
+  CMD_OPTION(applications,, String, "../../gen/applications", \
+	                               "directory containing the generated application XML files")\
+  CMD_OPTION(results,    r, String, 0, "file to write the exit status of each subcase to")\
+  CMD_OPTION(log_level,  l, ULong,  0, "<log-level>\n" \
+	                               "set log level, overriding OCPI_LOG_LEVEL")\
+  /**/
+
+#include "CmdOption.h"
+
+namespace OA = OCPI::API;
+namespace OU = OCPI::Util;
+
+namespace {
+  struct Subcase {
+    std::string m_model, m_worker, m_case, m_subcase, m_name;
+    unsigned long m_timeout, m_duration;
+  };
+  // What a process running subcases sends back for each one
+  struct Result {
+    uint32_t m_index;
+    int32_t  m_status;
+    uint32_t m_setupMs; // creating and initializing the application
+    uint32_t m_runMs;   // starting it until it is finished
+  };
+}
+
+static double
+now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+// Run one subcase with its output going to its log file, and return its exit status
+static int
+runSubcase(const Subcase &s, double &setupSecs, double &runSecs) {
+  OU::PValueList params;
+  params.addBool("verbose", true);
+  params.addBool("hidden", true);
+  params.addBool("dump", true);
+  params.addString("dumpFile", (s.m_name + ".props").c_str());
+  params.addString("simDir", (s.m_name + ".simulation").c_str());
+  std::string model, worker, platform;
+  OU::format(model, "%s=%s", options.component(), s.m_model.c_str());
+  OU::format(worker, "%s=%s", options.component(), s.m_worker.c_str());
+  OU::format(platform, "%s=%s", options.component(), options.platform());
+  const char *err;
+  if ((err = params.add("model", model.c_str())) ||
+      (err = params.add("worker", worker.c_str())) ||
+      (err = params.add("platform", platform.c_str())))
+    throw OU::Error("Parameter error: %s", err);
+  size_t nOutputs;
+  const char **outputs = options.output(nOutputs);
+  for (size_t n = 0; n < nOutputs; n++) {
+    std::string output;
+    OU::format(output, "file_write%s%s=fileName=%s.%s.out", nOutputs == 1 ? "" : "_from_",
+	       nOutputs == 1 ? "" : outputs[n], s.m_name.c_str(), outputs[n]);
+    if ((err = params.add("property", output.c_str())))
+      throw OU::Error("Parameter error: %s", err);
+  }
+  for (const char **sp = options.selection(); sp && *sp; sp++)
+    if ((err = params.add("selection", *sp)))
+      throw OU::Error("Parameter error: %s", err);
+  std::string file;
+  OU::format(file, "%s/%s.%s.xml", options.applications(), s.m_case.c_str(),
+	     s.m_subcase.c_str());
+  // Same time limits as testrun.sh gives ocpirun
+  unsigned long seconds = s.m_timeout ? s.m_timeout : s.m_duration ? s.m_duration :
+    options.timeout();
+  bool timeOutIsError = s.m_timeout || (!s.m_duration && options.timeout());
+
+  int log = open((s.m_name + ".log").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (log < 0)
+    throw OU::Error("Cannot open log file \"%s.log\": %s", s.m_name.c_str(), strerror(errno));
+  fflush(stdout);
+  fflush(stderr);
+  int savedOut = dup(1), savedErr = dup(2);
+  dup2(log, 1);
+  dup2(log, 2);
+  close(log);
+  fprintf(stderr, "Running application %s using worker %s.%s on platform %s\n", file.c_str(),
+	  s.m_worker.c_str(), s.m_model.c_str(), options.platform());
+  double start = now(), started = 0;
+  bool isStarted = false; // setup finished, so the rest of the time was spent running
+  int status = 0;
+  try {
+    OA::Application app(file.c_str(), params);
+    app.initialize();
+    started = now();
+    isStarted = true;
+    app.start();
+    app.wait(seconds * 1000000, timeOutIsError);
+    app.stop();
+    app.finish();
+  } catch (std::string &e) {
+    fprintf(stderr, "Exiting for exception: %s\n", e.c_str());
+    status = 1;
+  } catch (const char *e) {
+    fprintf(stderr, "Exiting for exception: %s\n", e);
+    status = 1;
+  } catch (std::exception &e) {
+    fprintf(stderr, "Exiting for exception: %s\n", e.what());
+    status = 1;
+  } catch (...) {
+    fprintf(stderr, "Exiting for exception: Unexpected exception\n");
+    status = 1;
+  }
+  double end = now();
+  if (!isStarted)
+    started = end;
+  setupSecs = started - start;
+  runSecs = end - started;
+  fprintf(stderr, "\nreal\t%.3fs\nsetup\t%.3fs\nrun\t%.3fs\n", end - start, setupSecs, runSecs);
+  fflush(stdout);
+  fflush(stderr);
+  dup2(savedOut, 1);
+  dup2(savedErr, 2);
+  close(savedOut);
+  close(savedErr);
+  return status;
+}
+
+// The loop of a process running subcases: take the next one not yet taken until none are left
+static void
+runSubcases(const std::vector<Subcase> &subcases, volatile uint32_t *next, int results) {
+  for (uint32_t n; (n = __sync_fetch_and_add(next, 1)) < subcases.size();) {
+    double setupSecs = 0, runSecs = 0;
+    Result r;
+    r.m_index = n;
+    try {
+      r.m_status = runSubcase(subcases[n], setupSecs, runSecs);
+    } catch (std::string &e) {
+      fprintf(stderr, "Subcase %s: %s\n", subcases[n].m_name.c_str(), e.c_str());
+      r.m_status = 1;
+    }
+    r.m_setupMs = (uint32_t)(setupSecs * 1000 + 0.5);
+    r.m_runMs = (uint32_t)(runSecs * 1000 + 0.5);
+    if (write(results, &r, sizeof(r)) != sizeof(r))
+      break;
+  }
+}
+
+static void
+report(const Subcase &s, int status, unsigned ms) {
+  unsigned seconds = (ms + 500) / 1000;
+  fprintf(stderr, "  Executing case %s.%s using worker %s.%s on platform %s...\n",
+	  s.m_case.c_str(), s.m_subcase.c_str(), s.m_worker.c_str(), s.m_model.c_str(),
+	  options.platform());
+  if (!status)
+    fprintf(stderr, "    Execution succeeded, time was %02u:%02u:%02u (%u seconds).\n",
+	    seconds / 3600, seconds / 60 % 60, seconds % 60, seconds);
+  else if (status < 0)
+    fprintf(stderr, "    Execution FAILED - the process running it terminated; "
+	    "log is in run/%s/%s.log\n", options.platform(), s.m_name.c_str());
+  else
+    fprintf(stderr, "    Execution FAILED(%d) - see log in run/%s/%s.log\n", status,
+	    options.platform(), s.m_name.c_str());
+}
+
+static int mymain(const char **ap) {
+  if (options.log_level())
+    OCPI::OS::logSetLevel(options.log_level());
+  if (!*ap || ap[1] || !options.component() || !options.platform())
+    return options.usage();
+  signal(SIGPIPE, SIG_IGN);
+  std::ifstream in;
+  if (strcmp(*ap, "-")) {
+    in.open(*ap);
+    if (!in)
+      throw OU::Error("Cannot open subcase file \"%s\"", *ap);
+  }
+  std::vector<Subcase> subcases;
+  bool allRcc = true;
+  std::string line;
+  while (std::getline(in.is_open() ? in : std::cin, line)) {
+    std::istringstream words(line);
+    Subcase s;
+    if (!(words >> s.m_model))
+      continue;
+    if (!(words >> s.m_worker >> s.m_case >> s.m_subcase >> s.m_timeout >> s.m_duration))
+      throw OU::Error("Invalid subcase line: %s", line.c_str());
+    s.m_name = s.m_case + "." + s.m_subcase + "." + s.m_worker + "." + s.m_model;
+    if (s.m_model != "rcc")
+      allRcc = false;
+    subcases.push_back(s);
+  }
+  // Devices and simulators run one application at a time, so only RCC subcases are spread
+  // across processors by default
+  long nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t nProcesses =
+    options.processes() ? options.processes() : allRcc && nCpus > 1 ? (size_t)nCpus : 1;
+  // The index of the next subcase to run, shared by the processes running them
+  volatile uint32_t *next =
+    (uint32_t *)mmap(NULL, sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+		     -1, 0);
+  if (next == MAP_FAILED)
+    throw OU::Error("Cannot map shared memory: %s", strerror(errno));
+  *next = 0;
+  std::vector<int> status(subcases.size(), -1);
+  double start = now();
+  uint64_t setupMs = 0, runMs = 0;
+  // When a process dies, the subcase it was running fails, and new processes are started for
+  // any subcases that remain
+  while (*next < subcases.size()) {
+    int results[2];
+    if (pipe(results))
+      throw OU::Error("Cannot create pipe: %s", strerror(errno));
+    std::vector<pid_t> pids;
+    for (size_t n = 0; n < nProcesses && n < subcases.size() - *next; n++) {
+      fflush(stdout);
+      fflush(stderr);
+      pid_t pid = fork();
+      if (pid == 0) {
+	close(results[0]);
+	runSubcases(subcases, next, results[1]);
+	close(results[1]);
+	exit(0);
+      }
+      if (pid < 0)
+	throw OU::Error("Cannot start process: %s", strerror(errno));
+      pids.push_back(pid);
+    }
+    close(results[1]);
+    Result r;
+    while (read(results[0], &r, sizeof(r)) == sizeof(r))
+      if (r.m_index < subcases.size()) {
+	status[r.m_index] = r.m_status;
+	setupMs += r.m_setupMs;
+	runMs += r.m_runMs;
+	report(subcases[r.m_index], r.m_status, r.m_setupMs + r.m_runMs);
+      }
+    close(results[0]);
+    for (size_t n = 0; n < pids.size(); n++)
+      waitpid(pids[n], NULL, 0);
+  }
+  FILE *rf = options.results() ? fopen(options.results(), "w") : NULL;
+  if (options.results() && !rf)
+    throw OU::Error("Cannot open results file \"%s\": %s", options.results(), strerror(errno));
+  unsigned nFailed = 0;
+  for (size_t n = 0; n < subcases.size(); n++) {
+    const Subcase &s = subcases[n];
+    if (status[n] < 0)
+      report(s, status[n], 0);
+    if (status[n])
+      nFailed++;
+    if (rf)
+      fprintf(rf, "%s %s %s %s %d\n", s.m_model.c_str(), s.m_worker.c_str(), s.m_case.c_str(),
+	      s.m_subcase.c_str(), status[n]);
+  }
+  if (rf && fclose(rf))
+    throw OU::Error("Cannot write results file \"%s\"", options.results());
+  // The first subcase of each process includes discovery and loading artifacts in its setup
+  fprintf(stderr, "  Subcases took %.3fs in %zu processes: %.3fs creating and initializing "
+	  "applications, %.3fs running them.\n", now() - start, nProcesses,
+	  (double)setupMs / 1000, (double)runMs / 1000);
+  ocpiInfo("ocpitestrun: %zu subcases in %zu processes, %u failed", subcases.size(), nProcesses,
+	   nFailed);
+  return nFailed ? 1 : 0;
+}
@@ -85,6 +85,13 @@ namespace OCPI {
       // This vector will be filled in by derived classes
       Transports m_transports;  // terminology clash is unfortunate....
       BridgedPorts m_bridgedPorts;
+      // Event driven dispatch: when set, the dispatch thread blocks on this when nothing
+      // is runnable, instead of yielding and spinning.
+      DataTransfer::EventManager *m_eventManager;
+      uint32_t m_maxBlockUsecs;  // bound on blocking, since other processes can't notify us
+      volatile bool m_sleeping;  // dispatch thread is (about to be) blocked
+      volatile bool m_wakeAll;   // a notification that is not specific to a worker
+      bool m_selective;          // this pass need only evaluate notified or timed-out workers
       Container(const char *name, const ezxml_t config = NULL,
 		const OCPI::Util::PValue* params = NULL)
         throw (OCPI::Util::EmbeddedException);
@@ -92,7 +99,24 @@ namespace OCPI {
       virtual ~Container();
     private:
       bool runInternal(uint32_t usecs = 0);
+      void stopEvents();
+    protected:
+      void enableEvents(uint32_t maxBlockUsecs);
+      // How long the dispatch thread may block when nothing is runnable
+      virtual uint32_t idleUsecs() { return m_maxBlockUsecs; }
     public:
+      // Tell the dispatch thread that something it may be waiting for has changed.
+      // Unless "all", the workers affected have been notified (see Worker::notify), and
+      // only they need be evaluated.
+      void wakeup(bool all = true);
+      // Wake up event driven containers in this process, other than "except"
+      static void wakeupEvents(Container *except = NULL);
+      // A thread about to block announces it, makes waiterBarrier, and looks once more.
+      // A thread that changes what it waits for makes notifierBarrier, and then looks
+      // for the announcement.  Where the kernel can, the waiter makes the full barrier
+      // for every thread, so notifiers, who are far more frequent, do not.
+      static void waiterBarrier();
+      static void notifierBarrier();
       bool enabled() const { return m_enabled; }
       virtual Driver &driver() = 0;
       virtual const std::string &name() const = 0;
@@ -142,7 +166,7 @@ namespace OCPI {
       // FIXME: default start behavior is for software containers.
       virtual void start();
       //! get the event manager for this container
-      virtual DataTransfer::EventManager* getEventManager() { return NULL; }
+      virtual DataTransfer::EventManager* getEventManager() { return m_eventManager; }
       bool hasName(const char *name);
       inline unsigned ordinal() const { return m_ordinal; }
       static Container &nthContainer(unsigned n);
@@ -98,6 +98,7 @@ namespace OCPI {
       BasicPort       &m_port;   // which port to I belong to
       bool             m_full;   // This buffer has a complete message in it
       bool             m_busy;   // The buffer is in the process of being emptied or filled
+      bool             m_released; // Released before earlier buffers, so still busy
       unsigned         m_position;
       ExternalBuffer  *m_next;   // prewrapped, initialized once, !==NULL indicates shim mode
       // These are for zero-copy.  The header of a non-ZC buffer is used to store
@@ -153,6 +154,7 @@ typedef int pthread_spinlock_t;
       ExternalBuffer *m_lastOutBuffer; // only used for upper level API
       // These two are for external port mode as opposed to shim mode
       ExternalBuffer *m_dtLastBuffer; // the "current buffer" for DT mode
+      std::vector<ExternalBuffer *> m_dtFree; // other wrappers for DT mode, when not held
       OCPI::DataTransport::Port *m_dtPort; // NULL for shim
       // End external port mode
       // Shim mode.  Slightly clever allocation in order to allocate once for headers and data
@@ -162,11 +164,20 @@ typedef int pthread_spinlock_t;
       // Cycle is: get for write, put, get for read, release
       ExternalBuffer  *m_next2write, *m_next2put, *m_next2read, *m_next2release;
       BasicPort *m_allocator;
+      // Buffers lent zero-copy to several readers can come back out of order and from
+      // different threads
+      OCPI::OS::Mutex m_releaseMutex;
+      bool m_lent; // some of our buffers have been put zero-copy to other ports
       // end shim mode
+      // For event loops, called when buffers may have become available
+      void (*m_notify)(void *);
+      void *m_notifyArg;
+      unsigned m_nNotifying; // calls to m_notify in progress, outside the lock
     protected:
       BasicPort *m_forward;  // if set, forward worker-side to this other port
       BasicPort *m_backward; // if set, other is forwarded to here
       size_t m_nRead, m_nWritten;
+      size_t m_nZcPut, m_nZcTaken; // other ports' buffers queued here, and taken by reader
       OCPI::RDT::Desc_t &myDesc; // convenience
       const OCPI::Util::Port &m_metaPort;
       Container &m_container;
@@ -192,6 +203,14 @@ typedef int pthread_spinlock_t;
       virtual uint8_t *allocateBuffers(size_t len);
       virtual void freeBuffers(uint8_t *allocation);
       unsigned fullCount(), emptyCount();
+      // Messages put to this port not yet taken by its reader, including zero-copy ones
+      unsigned backlog();
+      // Is this (or what it forwards to) a shim with its buffers in ordinary memory, so
+      // that buffers can be lent to and from it without copying?
+      bool zeroCopyOk() {
+	BasicPort &p = m_forward ? *m_forward : *this;
+	return p.m_allocation && p.m_allocator == &p && !p.hasAllocator();
+      }
     public:
       Container &container() const { return m_container; }
       inline const OCPI::Util::Port &metaPort() const { return m_metaPort; }
@@ -235,10 +254,37 @@ typedef int pthread_spinlock_t;
 				     OCPI::RDT::PortRole &pRole, unsigned &pOptions);
       OCPI::API::ExternalBuffer
         *getBuffer(uint8_t *&data, size_t &length, uint8_t &opCode, bool &end),
-	*getBuffer(uint8_t *&data, size_t &length);
+	*getBuffer(uint8_t *&data, size_t &length),
+        *getBuffer(uint8_t *&data, size_t &length, uint8_t &opCode, bool &end,
+		   unsigned long timeout_us),
+	*getBuffer(uint8_t *&data, size_t &length, unsigned long timeout_us);
+      size_t getBuffers(OCPI::API::ExternalBuffer *buffers[], uint8_t *data[], size_t lengths[],
+			uint8_t opCodes[], bool ends[], size_t max, bool wait,
+			unsigned long timeout_us);
+      void putBuffers(OCPI::API::ExternalBuffer *buffers[], size_t n, const size_t lengths[],
+		      const uint8_t opCodes[]);
+      void setNotifier(void (*notify)(void *arg), void *arg);
+      // Wake anything waiting for buffers in this process: called for every change
+      static void notifyWaiters();
+    protected:
+      // Something this port may be waiting for has changed: tell whoever moves its buffers
+      virtual void buffersChanged();
+    private:
+      // A buffer in our ring was put, or released: tell the port on the other side
+      void notifyPeer(bool put);
+    public:
       // Internal methods.
       bool peekOpCode(uint8_t &op);
       ExternalBuffer *getFullBuffer(), *getEmptyBuffer();
+    private:
+      // Wait for getFullBuffer or getEmptyBuffer to succeed
+      ExternalBuffer *waitForBuffer(unsigned long timeout_us);
+      // Get up to max buffers that are available now
+      size_t collectBuffers(OCPI::API::ExternalBuffer *buffers[], size_t max);
+      // Get another buffer while others from the transport are held
+      ExternalBuffer *getDtBuffer();
+      void freeDtBuffer(ExternalBuffer &b);
+    public:
          
       bool endOfData();
       bool tryFlush();
@@ -64,7 +64,7 @@ namespace OCPI {
 	                // input:  ditto
 	AsAvailable,    // input: receive from set as available, rotating the look
 	All,            // output: send to all in the specified set
-	Balanced,       // output: if least busy is in specified set, send, else discard
+	Balanced,       // output: send to the least busy in specified set
 	Directed,       // output: take input member from API
 	Hashed,         // output: compute input member based on hash of m_hashField
 	Discard,        // output: discard messages
@@ -106,6 +106,7 @@ namespace OCPI {
       unsigned                       m_firstBridge;         // first one for current local buf
       unsigned                       m_currentBridge;       // current bridge for local buf
       unsigned                       m_nextBridge;          // next one to use for any op
+      bool                           m_lendInput;           // pass bridge buffers, no copy
     protected:
       LocalPort(Container &container, const OCPI::Util::Port &mPort, bool isProvider,
 		const OCPI::Util::PValue *params);
@@ -120,11 +121,14 @@ namespace OCPI {
       // "other" being NULL means the other port is remote in another process
       virtual bool isInProcess(LocalPort *other) const = 0;
       bool getLocalBuffer();
+      bool send2Bridge(ExternalBuffer &local, BridgePort &bridge, bool canLend, bool &lent);
+      size_t leastBusy(const BridgeOp &bo);
       void setupBridging(Launcher::Connection &c);
       void determineBridgeOp(Launcher::Connection &c, const OCPI::Util::Port &output,
 			     const OCPI::Util::Port &input, unsigned op, BridgeOp &bo);
     protected:
       bool initialConnect(Launcher::Connection &c);
+      void buffersChanged();
       bool finalConnect(Launcher::Connection &c);
       //      void insertExternal(Launcher::Connection &c);
       virtual bool canBeExternal() const = 0;
@@ -63,6 +63,7 @@ namespace OCPI {
       virtual void connectURL(const char* url, const OCPI::Util::PValue *myParams,
 			      const OCPI::Util::PValue *otherParams);
       void portIsConnected();
+      void buffersChanged();
     public:
       //      void determineRoles(OCPI::RDT::Descriptors &other);
       inline Port &containerPort() { return *this; }
@@ -128,6 +128,7 @@ namespace OCPI {
       size_t m_member, m_crewSize;
       PortMask m_connectedPorts, m_optionalPorts; // spcm?
       mutable std::vector<Cache *> m_cache; // per property write cache, when needed
+      volatile bool m_notified;  // something it may be waiting for changed since it last looked
       bool beforeStart() const;
     protected:
       void connectPort(OCPI::Util::PortOrdinal ordinal);
@@ -142,6 +143,11 @@ namespace OCPI {
     public:
       inline const Artifact *artifact() const { return m_artifact; }
       bool isOperating() const;
+      // Something this worker may be waiting for, like a buffer on one of its ports, has
+      // changed, so an event driven container should evaluate it after its next wakeup.
+      inline void notify() { m_notified = true; }
+      // For the container: has this worker been notified since it last asked?
+      inline bool takeNotified() { return __sync_lock_test_and_set(&m_notified, false); }
     protected:
       inline ezxml_t myXml() const { return m_xml; }
       inline ezxml_t myInstXml() const { return m_instXml; }
@@ -200,6 +206,17 @@ namespace OCPI {
 		       OCPI::API::PropertyAttributes *a_attributes = NULL) const;
       // Level 5 of 5: The actual local work that involves caching etc.
       void setProperty(unsigned ordinal, const OCPI::Util::Value &v) const; // for launcher
+      // Untyped access to bytes of a property, keeping the cache coherent, for servers
+      void setPropertyData(const OCPI::API::PropertyInfo &info, size_t offset,
+			   const uint8_t *data, size_t nBytes) const;
+      void getPropertyData(const OCPI::API::PropertyInfo &info, size_t offset, uint8_t *data,
+			   size_t nBytes, bool uncached) const;
+      // Batched access to property data, checked before any of it is done
+      void accessProperties(const OCPI::API::PropertyBatchAccess *accesses, size_t n) const;
+    protected:
+      // Do a checked batch: by default one access at a time
+      virtual void accessPropertyData(const OCPI::API::PropertyBatchAccess *accesses,
+				      size_t n) const;
     private:
       void setProperty(const OCPI::API::PropertyInfo &info, const OCPI::Util::Value &v,
 		       const OCPI::Util::Member &m, size_t offset) const;
@@ -211,6 +228,9 @@ namespace OCPI {
 		      bool *dirty = NULL,
 		      OCPI::API::PropertyOptionList &options = OCPI::API::noPropertyOptions,
 		      OCPI::API::PropertyAttributes *a_attributes = NULL) const;
+      Cache *getCache(const OCPI::API::PropertyInfo &info, size_t offset, size_t nBytes,
+		      bool *dirty, OCPI::API::PropertyOptionList &options,
+		      OCPI::API::PropertyAttributes *a_attributes) const;
       void setData(const OCPI::API::PropertyInfo &info, Cache *cache, size_t offset,
 		   const uint8_t *data, size_t nBytes, size_t nBits = 0, size_t sequenceOffset = 0,
 		   size_t sequenceLength = 0, bool last = true) const;
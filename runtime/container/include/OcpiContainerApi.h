@@ -86,6 +86,36 @@ namespace OCPI {
       // Return OA::OCPI_None if opcode is out of range of known protocol information
       // Note nbytes for string "scalars" is max bytes per string
       virtual OCPI::API::BaseType getOperationInfo(uint8_t opCode, size_t &nbytes) = 0;
+      // Calls added later go below, so the ones above keep their places in the vtable.
+      // Blocking versions of getBuffer: wait up to timeout_us microseconds, or forever if
+      // zero, for a buffer.  Return zero on timeout.  Waiters are woken by changes made
+      // in this process.  Changes made by other processes or devices are polled for.
+      virtual ExternalBuffer *
+        getBuffer(uint8_t *&data, size_t &length, uint8_t &opCode, bool &endOfData,
+		  unsigned long timeout_us) = 0;
+      virtual ExternalBuffer *
+	getBuffer(uint8_t *&data, size_t &length, unsigned long timeout_us) = 0;
+      // Get up to "max" buffers at once, to be filled or consumed while others are in
+      // flight.  If "wait" is true, wait as above for at least one.  Return how many were
+      // gotten.  Each buffer's data and length are returned in the corresponding elements
+      // of "data" and "lengths", as getBuffer does; for output buffers the length is the
+      // size of the buffer.  For input buffers, opcodes and end-of-data flags are returned
+      // in "opCodes" and "ends" when they are not NULL.  Input buffers are released
+      // individually, in any order.  Output buffers are put with putBuffers, in the order
+      // they were gotten.
+      virtual size_t
+	getBuffers(ExternalBuffer *buffers[], uint8_t *data[], size_t lengths[],
+		   uint8_t opCodes[], bool ends[], size_t max, bool wait = false,
+		   unsigned long timeout_us = 0) = 0;
+      // Put output buffers from getBuffers.  Opcodes are zero if not supplied.
+      virtual void
+	putBuffers(ExternalBuffer *buffers[], size_t n, const size_t lengths[],
+		   const uint8_t opCodes[] = NULL) = 0;
+      // Register a function that is called, from any thread, whenever buffers on this port
+      // may have become available, e.g. to wake an event loop.  It must not call back
+      // into the port.  NULL removes it, and returns once any call already under way
+      // is finished.  Like waiters, it is only called for changes made in this process.
+      virtual void setNotifier(void (*notify)(void *arg), void *arg = NULL) = 0;
     };
     class Port {
       friend class OCPI::Container::LocalLauncher;
@@ -100,6 +130,16 @@ namespace OCPI {
     };
     class Property;
     class PropertyInfo;
+    // One access to the bytes of a property value, in a batch given to
+    // Worker::accessProperties.  Writes take the bytes from m_data, reads put them there.
+    struct PropertyBatchAccess {
+      const Property *m_property; // a property of the worker doing the batch
+      size_t m_offset;            // byte offset within the property value
+      size_t m_nBytes;
+      void *m_data;
+      bool m_write;
+      bool m_uncached;            // for reads: read the worker, not the cached value
+    };
     class PropertyAccess {
     public:
       virtual ~PropertyAccess();
@@ -189,6 +229,12 @@ namespace OCPI {
       virtual void setProperties(const char *props[][2]) =  0;
       // Typed property list setting - slightly safer, still slow
       virtual void setProperties(const PValue *props) =  0;
+      // Do a batch of property accesses, in order, returning when they are all done.
+      // Writes to workers in remote containers are otherwise deferred until the next read,
+      // control operation or batch, which also sends them.  A batch is sent together, so
+      // polling many properties costs one exchange with the server.  With no accesses,
+      // this just waits until all earlier writes are done.
+      virtual void accessProperties(const PropertyBatchAccess *accesses, size_t n) const = 0;
       virtual bool getProperty(unsigned ordinal, std::string &name, std::string &value,
 			       bool *unreadablep = NULL, bool hex = false,
 			       bool *cachedp = NULL, bool uncached = false, bool *hiddenp = NULL)
@@ -363,6 +409,7 @@ namespace OCPI {
     public:
       inline bool readSync() const { return m_readSync; }
       inline bool writeSync() const { return m_writeSync; }
+      inline const Worker &worker() const { return m_worker; }
       BaseType baseType() const;
       // If it is a string property, how big a buffer should I allocate to retrieve the value?
       size_t stringBufferLength() const;
@@ -19,8 +19,14 @@
  */
 
 #include <signal.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+#endif
 #include "ocpi-config.h"
 #include "OcpiOsMisc.h"
+#include "OcpiUtilAutoMutex.h"
 #include "OcpiUtilCppMacros.h"
 #include "XferManager.h"
 #include "ContainerManager.h"
@@ -43,7 +49,9 @@ namespace OCPI {
       : //m_ourUID(mkUID()),
       OCPI::Time::Emit("Container", a_name ),
       m_enabled(false), m_ownThread(true), m_verbose(false), m_thread(NULL),
-      m_transport(*new OCPI::DataTransport::Transport(&Manager::getTransportGlobal(params), false, this))
+      m_transport(*new OCPI::DataTransport::Transport(&Manager::getTransportGlobal(params), false, this)),
+      m_eventManager(NULL), m_maxBlockUsecs(0), m_sleeping(false), m_wakeAll(false),
+      m_selective(false)
     {
       OU::findBool(params, "verbose", m_verbose);
       OU::SelfAutoMutex guard (this);
@@ -149,8 +157,36 @@ namespace OCPI {
     OCPI::Util::PValue *Container::getProperty(const char *) {
       return 0;
     }
+    // The event driven containers of this process, which are notified when data moves.
+    // Containers are added when events are enabled, and removed before they are torn down.
+    // This is never deleted since containers may be destroyed during static destruction.
+    namespace {
+      struct EventContainers {
+	OS::Mutex m_mutex;
+	std::vector<Container *> m_containers;
+      };
+    }
+    static EventContainers &eventContainers() {
+      static EventContainers *ec = new EventContainers;
+      return *ec;
+    }
+    static volatile unsigned s_nEventContainers; // so there is no locking when there are none
+
+    // After this no other thread will notify us
+    void Container::stopEvents() {
+      EventContainers &ec = eventContainers();
+      OU::AutoMutex guard(ec.m_mutex);
+      for (std::vector<Container *>::iterator ci = ec.m_containers.begin();
+	   ci != ec.m_containers.end(); ++ci)
+	if (*ci == this) {
+	  ec.m_containers.erase(ci);
+	  break;
+	}
+      s_nEventContainers = (unsigned)ec.m_containers.size();
+    }
     // This is for the derived class's destructor to call
     void Container::shutdown() {
+      stopEvents();
       stop();
       if (m_thread) {
 	this->unlock();
@@ -160,13 +196,85 @@ namespace OCPI {
       }
     }
     Container::~Container() {
+      stopEvents();
+      Manager::s_containers[m_ordinal] = 0;
       m_enabled = false;
       if (m_thread) {
+	wakeup();
 	m_thread->join();
 	delete m_thread;
       }
-      Manager::s_containers[m_ordinal] = 0;
       delete &m_transport;
+      delete m_eventManager;
+    }
+
+    void Container::enableEvents(uint32_t maxBlockUsecs) {
+      m_maxBlockUsecs = maxBlockUsecs;
+      if (!m_eventManager) {
+	m_eventManager = new DataTransfer::EventManager;
+	EventContainers &ec = eventContainers();
+	OU::AutoMutex guard(ec.m_mutex);
+	ec.m_containers.push_back(this);
+	s_nEventContainers = (unsigned)ec.m_containers.size();
+      }
+      ocpiInfo("Container %s uses event driven dispatch, blocking at most %u usecs",
+	       name().c_str(), maxBlockUsecs);
+    }
+
+    static bool
+    registerMembarrier() {
+#if defined(__linux__) && defined(SYS_membarrier)
+      return syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
+#else
+      return false;
+#endif
+    }
+    static bool
+    haveMembarrier() {
+      static const bool s_membarrier = registerMembarrier();
+      return s_membarrier;
+    }
+
+    void Container::waiterBarrier() {
+#if defined(__linux__) && defined(SYS_membarrier)
+      if (haveMembarrier()) {
+	syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+	return;
+      }
+#endif
+      __sync_synchronize();
+    }
+
+    void Container::notifierBarrier() {
+      if (haveMembarrier())
+	asm volatile("" ::: "memory"); // waiterBarrier orders this thread for us
+      else
+	__sync_synchronize();
+    }
+
+    // The dispatch thread sets m_sleeping and then makes one more pass before blocking,
+    // while notifiers change state before looking at m_sleeping.  So either that pass sees
+    // the change or we see m_sleeping and notify: the common case of a busy container costs
+    // no system call.
+    void Container::wakeup(bool all) {
+      if (m_eventManager) {
+	if (all)
+	  m_wakeAll = true;
+	notifierBarrier();
+	if (m_sleeping)
+	  m_eventManager->notify();
+      }
+    }
+
+    void Container::wakeupEvents(Container *except) {
+      if (s_nEventContainers) {
+	EventContainers &ec = eventContainers();
+	OU::AutoMutex guard(ec.m_mutex);
+	for (std::vector<Container *>::iterator ci = ec.m_containers.begin();
+	     ci != ec.m_containers.end(); ++ci)
+	  if (*ci != except)
+	    (*ci)->wakeup();
+      }
     }
 
 #if 0
@@ -209,12 +317,19 @@ namespace OCPI {
 	  (*bpi)->runBridge();
       }
       DataTransfer::EventManager *em = getEventManager();
-      switch (dispatch(em)) {
+      DispatchRetCode rc = dispatch(em);
+      m_selective = false;
+      switch (rc) {
       case DispatchNoMore:
 	// All done, exit from dispatch thread.
 	return false;
 
       case MoreWorkNeeded:
+	if (m_eventManager) {
+	  m_sleeping = false;
+	  // Data may have moved to other in-process containers that are blocked
+	  wakeupEvents(this);
+	}
 	// No-op. To prevent blocking the CPU, yield.
 	OCPI::OS::sleep (0);
 	return true;
@@ -224,6 +339,22 @@ namespace OCPI {
 	return false;
 
       case Spin:
+	if (m_eventManager) {
+	  if (!m_sleeping) {
+	    // Announce that we will block, and make one more pass (see wakeup()).
+	    m_sleeping = true;
+	    waiterBarrier();
+	    return true;
+	  }
+	  // Nothing is runnable: block until notified, until the earliest run condition
+	  // timeout, or until the polling bound for changes made by other processes.
+	  DataTransfer::ReturnStatus rs = m_eventManager->waitForEvent(usecs ? usecs : idleUsecs());
+	  m_sleeping = false;
+	  // If only workers' ports were changed, only they (and timed-out ones) need a look
+	  bool all = __sync_lock_test_and_set(&m_wakeAll, false);
+	  m_selective = rs == DataTransfer::EventSuccess && !all;
+	  return true;
+	}
 	/*
 	 * If we have an event manager, ask it to go to sleep and wait for
 	 * an event.  If we are not event driven, the event manager will
@@ -247,6 +378,7 @@ namespace OCPI {
     void Container::stop() {
       //      stop(getEventManager());
       m_enabled = false;
+      wakeup();
     }
     void runContainer(void*arg) {
 
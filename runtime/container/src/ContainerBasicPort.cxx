@@ -20,11 +20,15 @@
 
 #include <stdint.h>
 #include <pthread.h>
+#include <time.h>
+#include <set>
+#include <vector>
 // This is obviously temporary
 #ifdef __APPLE__
 #include "../../../foreign/pwq/src/platform.c"
 #endif
 #include "OcpiOsAssert.h"
+#include "OcpiUtilAutoMutex.h"
 #include "OcpiUtilCDR.h"
 #include "Container.h"
 #include "ContainerPort.h"
@@ -86,7 +90,8 @@ namespace OCPI {
 
     ExternalBuffer::
     ExternalBuffer(BasicPort &a_port, ExternalBuffer *a_next, unsigned n)
-      : m_port(a_port), m_full(false), m_busy(false), m_position(n), m_next(a_next),
+      : m_port(a_port), m_full(false), m_busy(false), m_released(false), m_position(n),
+	m_next(a_next),
 	m_zcHead(NULL), m_zcTail(NULL), m_zcNext(NULL), m_zcHost(NULL), m_dtBuffer(NULL),
 	m_dtData(NULL) {
       memset(&m_hdr, 0, sizeof(m_hdr));
@@ -122,8 +127,8 @@ namespace OCPI {
       : PortData(mPort, a_isProvider, NULL), m_lastInBuffer(NULL), m_lastOutBuffer(NULL),
 	m_dtLastBuffer(NULL), m_dtPort(NULL), m_allocation(NULL), m_bufferStride(0),
 	m_next2write(NULL), m_next2put(NULL), m_next2read(NULL), m_next2release(NULL),
-	m_forward(NULL), m_backward(NULL), m_nRead(0), m_nWritten(0),
-	myDesc(getData().data.desc), m_metaPort(mPort), m_container(c) {
+	m_lent(false), m_notify(NULL), m_notifyArg(NULL), m_nNotifying(0), m_forward(NULL), m_backward(NULL), m_nRead(0), m_nWritten(0), m_nZcPut(0),
+	m_nZcTaken(0), myDesc(getData().data.desc), m_metaPort(mPort), m_container(c) {
       applyPortParams(params);
     }
 
@@ -149,6 +154,10 @@ namespace OCPI {
       if (m_allocation && m_allocator == this)
 	freeBuffers(m_allocation);
       delete m_dtLastBuffer;
+      for (unsigned n = 0; n < m_dtFree.size(); n++)
+	delete m_dtFree[n];
+      if (m_notify)
+	setNotifier(NULL, NULL);
     }
 
     void BasicPort::
@@ -698,7 +707,10 @@ namespace OCPI {
 	ocpiAssert(m_dtBuffer);
 	m_port.m_dtPort->sendOutputBuffer(m_dtBuffer, m_hdr.m_length, m_hdr.m_opCode, m_hdr.m_eof);
 	m_dtBuffer = NULL;
+	if (this != m_port.m_dtLastBuffer)
+	  m_port.freeDtBuffer(*this);
       }
+      m_port.notifyPeer(true);
     }
 
     // Step 2: Standalone EOF.  Returns NULL if it can't go, just like getbuffer.
@@ -724,6 +736,7 @@ namespace OCPI {
 	  b->m_full = true;
 	  m_nWritten++;
 	}
+	b->m_port.notifyPeer(true);
 	return true;
       }
       return false;
@@ -755,18 +768,21 @@ namespace OCPI {
 	assert(b.m_zcHost == NULL);
 	b.m_zcHost = m_next2write;
 	b.m_full = true;
+	b.m_port.m_lent = true;
         pthread_spin_lock(&m_next2write->m_zcLock);
 	if (m_next2write->m_zcTail)
 	  m_next2write->m_zcTail->m_zcNext = &b;
 	else
 	  m_next2write->m_zcHead = &b;
 	m_next2write->m_zcTail = &b;
+	m_nZcPut++;
 	pthread_spin_unlock(&m_next2write->m_zcLock);
       } else if (m_dtPort && b.m_dtBuffer)
 	m_dtPort->sendZcopyInputBuffer(*b.m_dtBuffer,
 				       b.m_hdr.m_length, b.m_hdr.m_opCode, b.m_hdr.m_eof);
       else
 	assert("No support yet for zery-copy send of shim buffer to external port"==0);
+      notifyPeer(true);
     }
 
     bool BasicPort::
@@ -804,6 +820,276 @@ namespace OCPI {
       return b;
     }
 
+    // Waiting for buffers.  Every change to buffers in this process ends with
+    // notifyPeer, which calls notifyWaiters.  Like Container::wakeup, waiters
+    // announce themselves and then look once more before blocking, while notifiers change
+    // state before looking for waiters, so the common case with none costs no system call.
+    // Changes made by other processes or devices are not notified, so ports connected by
+    // a transport also poll, backing off to a millisecond.
+    // Both sides need a full barrier between their store and their load: see
+    // Container::waiterBarrier.
+    static pthread_mutex_t s_waitMutex = PTHREAD_MUTEX_INITIALIZER;
+    static pthread_cond_t s_waitCond = PTHREAD_COND_INITIALIZER;
+    static pthread_cond_t s_notifyCond = PTHREAD_COND_INITIALIZER; // notifier calls finished
+    static volatile unsigned s_nWaiters; // waiting threads and ports with notifiers
+    static unsigned s_waitGeneration;
+    static std::set<BasicPort *> *s_notified;
+    const unsigned long
+      MAX_POLL_USECS = 1000,    // longest back-off when polling a transport
+      MAX_WAIT_USECS = 1000000; // look again at least this often anyway
+
+    // Notifiers are called after the lock is dropped, so they can be slow or take locks of
+    // their own, and setNotifier waits until calls already copied out are finished.
+    void BasicPort::
+    notifyWaiters() {
+      Container::notifierBarrier();
+      if (s_nWaiters) {
+	std::vector<BasicPort *> ports;
+	std::vector<std::pair<void (*)(void *), void *> > calls;
+	pthread_mutex_lock(&s_waitMutex);
+	s_waitGeneration++;
+	pthread_cond_broadcast(&s_waitCond);
+	if (s_notified && !s_notified->empty()) {
+	  ports.reserve(s_notified->size());
+	  calls.reserve(s_notified->size());
+	  for (std::set<BasicPort *>::const_iterator it = s_notified->begin();
+	       it != s_notified->end(); ++it) {
+	    (*it)->m_nNotifying++;
+	    ports.push_back(*it);
+	    calls.push_back(std::make_pair((*it)->m_notify, (*it)->m_notifyArg));
+	  }
+	}
+	pthread_mutex_unlock(&s_waitMutex);
+	if (calls.empty())
+	  return;
+	for (size_t n = 0; n < calls.size(); n++)
+	  calls[n].first(calls[n].second);
+	bool done = false;
+	pthread_mutex_lock(&s_waitMutex);
+	for (size_t n = 0; n < ports.size(); n++)
+	  if (--ports[n]->m_nNotifying == 0)
+	    done = true;
+	if (done)
+	  pthread_cond_broadcast(&s_notifyCond);
+	pthread_mutex_unlock(&s_waitMutex);
+      }
+    }
+
+    void BasicPort::
+    setNotifier(void (*notify)(void *arg), void *arg) {
+      pthread_mutex_lock(&s_waitMutex);
+      if (!s_notified)
+	s_notified = new std::set<BasicPort *>;
+      if (notify && !m_notify) {
+	s_notified->insert(this);
+	s_nWaiters++;
+      } else if (!notify && m_notify) {
+	s_notified->erase(this);
+	s_nWaiters--;
+      }
+      m_notify = notify;
+      m_notifyArg = arg;
+      // The old notifier and its argument may go away when we return
+      while (m_nNotifying)
+	pthread_cond_wait(&s_notifyCond, &s_waitMutex);
+      pthread_mutex_unlock(&s_waitMutex);
+      Container::waiterBarrier();
+    }
+
+    // Ports whose buffers are moved by bridges, which run in some other port's container
+    void BasicPort::
+    buffersChanged() {
+      Container::wakeupEvents();
+    }
+
+    // Two ports share a ring in this process: this one and the one forwarded to it.
+    // Puts wake the reader and releases wake the writer, so only its container, and
+    // usually only its worker, need look.  Without a port forwarded to us, the other side
+    // is our bridges or a transport, and a transport may deliver to any container.
+    void BasicPort::
+    notifyPeer(bool put) {
+      BasicPort &peer = isProvider() == put || !m_backward ? *this : *m_backward;
+      peer.buffersChanged();
+      if (m_dtPort)
+	Container::wakeupEvents(&peer.container());
+      notifyWaiters();
+    }
+
+    static void
+    addUsecs(struct timespec &ts, unsigned long usecs) {
+      ts.tv_sec += (time_t)(usecs / 1000000);
+      if ((ts.tv_nsec += (long)(usecs % 1000000) * 1000) >= 1000000000) {
+	ts.tv_sec++;
+	ts.tv_nsec -= 1000000000;
+      }
+    }
+    static bool
+    before(const struct timespec &a, const struct timespec &b) {
+      return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+    }
+
+    ExternalBuffer *BasicPort::
+    waitForBuffer(unsigned long timeout_us) {
+      struct timespec deadline, now;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      addUsecs(deadline, timeout_us);
+      bool polled = m_dtPort && !m_forward;
+      unsigned long pollUsecs = 10;
+      pthread_mutex_lock(&s_waitMutex);
+      s_nWaiters++;
+      pthread_mutex_unlock(&s_waitMutex);
+      Container::waiterBarrier();
+      ExternalBuffer *b;
+      for (;;) {
+	pthread_mutex_lock(&s_waitMutex);
+	unsigned generation = s_waitGeneration;
+	pthread_mutex_unlock(&s_waitMutex);
+	if ((b = isProvider() ? getFullBuffer() : getEmptyBuffer()))
+	  break;
+	clock_gettime(CLOCK_REALTIME, &now);
+	if (timeout_us && !before(now, deadline))
+	  break;
+	struct timespec until = now;
+	addUsecs(until, polled ? pollUsecs : MAX_WAIT_USECS);
+	if (timeout_us && before(deadline, until))
+	  until = deadline;
+	pthread_mutex_lock(&s_waitMutex);
+	while (generation == s_waitGeneration &&
+	       pthread_cond_timedwait(&s_waitCond, &s_waitMutex, &until) == 0)
+	  ;
+	pthread_mutex_unlock(&s_waitMutex);
+	if (polled && (pollUsecs *= 2) > MAX_POLL_USECS)
+	  pollUsecs = MAX_POLL_USECS;
+      }
+      pthread_mutex_lock(&s_waitMutex);
+      s_nWaiters--;
+      pthread_mutex_unlock(&s_waitMutex);
+      return b;
+    }
+
+    // Blocking high level API for input
+    OA::ExternalBuffer *BasicPort::
+    getBuffer(uint8_t *&data, size_t &length, uint8_t &opCode, bool &end,
+	      unsigned long timeout_us) {
+      OA::ExternalBuffer *ob = getBuffer(data, length, opCode, end);
+      if (ob)
+	return ob;
+      ExternalBuffer *b = waitForBuffer(timeout_us);
+      if (b) {
+	data = b->data();
+	length = b->m_hdr.m_length;
+	opCode = b->m_hdr.m_opCode;
+	end = b->m_hdr.m_eof;
+	m_lastInBuffer = b;
+      }
+      return b;
+    }
+
+    // Blocking high level API for output
+    OA::ExternalBuffer *BasicPort::
+    getBuffer(uint8_t *&data, size_t &length, unsigned long timeout_us) {
+      OA::ExternalBuffer *ob = getBuffer(data, length);
+      if (ob)
+	return ob;
+      ExternalBuffer *b = waitForBuffer(timeout_us);
+      if (b) {
+	data = b->data();
+	length = b->m_hdr.m_length;
+	(m_forward ? m_forward : this)->m_lastOutBuffer = b;
+      }
+      return b;
+    }
+
+    // A transport buffer wrapper other than m_dtLastBuffer, for holding several at once
+    ExternalBuffer *BasicPort::
+    getDtBuffer() {
+      ExternalBuffer *b;
+      if (m_dtFree.empty())
+	b = new ExternalBuffer(*this, NULL, 0);
+      else {
+	b = m_dtFree.back();
+	m_dtFree.pop_back();
+      }
+      size_t length;
+      bool end;
+      if (isProvider() ?
+	  (b->m_dtBuffer =
+	   m_dtPort->getNextFullInputBuffer(b->m_dtData, length, b->m_hdr.m_opCode, end)) :
+	  (b->m_dtBuffer = m_dtPort->getNextEmptyOutputBuffer(b->m_dtData, length))) {
+	b->m_hdr.m_length = OCPI_UTRUNCATE(uint32_t, length);
+	b->m_hdr.m_eof = isProvider() && end ? 1 : 0;
+	return b;
+      }
+      m_dtFree.push_back(b);
+      return NULL;
+    }
+    void BasicPort::
+    freeDtBuffer(ExternalBuffer &b) {
+      OU::SelfAutoMutex guard(this);
+      m_dtFree.push_back(&b);
+    }
+
+    size_t BasicPort::
+    getBuffers(OA::ExternalBuffer *buffers[], uint8_t *data[], size_t lengths[],
+	       uint8_t opCodes[], bool ends[], size_t max, bool wait, unsigned long timeout_us) {
+      BasicPort &p = m_forward ? *m_forward : *this;
+      if (p.m_lastOutBuffer || p.m_lastInBuffer)
+	throw OU::Error("getBuffers called on port \"%s\" without %s previous buffer",
+			name().c_str(), isProvider() ? "releasing" : "putting");
+      size_t n = collectBuffers(buffers, max);
+      if (!n && max && wait && (buffers[0] = waitForBuffer(timeout_us))) {
+	// The transport's wrapper for waiting is now held by the caller
+	if (m_dtPort && buffers[0] == m_dtLastBuffer)
+	  m_dtLastBuffer = NULL;
+	// Take whatever else became available with it
+	n = 1 + collectBuffers(buffers + 1, max - 1);
+      }
+      for (size_t i = 0; i < n; i++) {
+	ExternalBuffer &b = *static_cast<ExternalBuffer *>(buffers[i]);
+	data[i] = b.data();
+	lengths[i] = b.m_hdr.m_length;
+	if (opCodes)
+	  opCodes[i] = b.m_hdr.m_opCode;
+	if (ends)
+	  ends[i] = b.m_hdr.m_eof != 0;
+      }
+      return n;
+    }
+
+    size_t BasicPort::
+    collectBuffers(OA::ExternalBuffer *buffers[], size_t max) {
+      size_t n = 0;
+      if (m_dtPort && !m_forward) {
+	OU::SelfAutoMutex guard(this);
+	// A buffer already gotten by peekOpCode goes first, and is then held by the caller
+	if (max && isProvider() && m_dtLastBuffer && m_dtLastBuffer->m_dtBuffer) {
+	  buffers[n++] = m_dtLastBuffer;
+	  m_dtLastBuffer = NULL;
+	}
+	for (ExternalBuffer *b; n < max && (b = getDtBuffer()); n++)
+	  buffers[n] = b;
+      } else
+	for (ExternalBuffer *b;
+	     n < max && (b = isProvider() ? getFullBuffer() : getEmptyBuffer()); n++)
+	  buffers[n] = b;
+      return n;
+    }
+
+    void BasicPort::
+    putBuffers(OA::ExternalBuffer *buffers[], size_t n, const size_t lengths[],
+	       const uint8_t opCodes[]) {
+      if (isProvider())
+	throw OU::Error("putBuffers called on input port %s", name().c_str());
+      for (size_t i = 0; i < n; i++) {
+	ExternalBuffer &b = *static_cast<ExternalBuffer *>(buffers[i]);
+	b.m_hdr.m_length = OCPI_UTRUNCATE(uint32_t, lengths[i]);
+	b.m_hdr.m_opCode = opCodes ? opCodes[i] : 0;
+	b.m_hdr.m_eof = 0;
+	b.m_hdr.m_direct = 0;
+	b.put();
+      }
+    }
+
     ExternalBuffer *
     ExternalBuffer::zcPeek() {
       // A peek
@@ -843,6 +1129,7 @@ namespace OCPI {
 	    ExternalBuffer *zcb = b->zcPeek();
 	    if (zcb) {
 	      zc = true;
+	      m_nZcTaken++;
 	      zcb->zcPop();
 	      b = zcb;
 	      break;
@@ -946,22 +1233,42 @@ namespace OCPI {
 	b.m_port.releaseBuffer(b);         // release from its true port
       else if (m_next2release) {
 	assert(&b.m_port == this);
-	ocpiAssert(&b == m_next2release); // want trace; having random problems on Jenkins
+	// Only buffers lent to other ports can come back out of order
+	ocpiAssert(m_lent || &b == m_next2release); // want trace; having random problems on Jenkins
 	assert(b.m_busy);
+	OU::AutoMutex guard(m_releaseMutex);
 	b.m_full = false;
-	b.m_busy = false;
 	m_nRead++;
-	m_next2release = b.m_next;
 	ocpiDebug("Release on %p of %p head %p tail %p next %p", this, &b, b.m_zcHead, b.m_zcTail, b.m_zcNext);
 	b.m_zcHead = b.m_zcTail = b.m_zcNext = b.m_zcHost = NULL;
+	if (&b == m_next2release) {
+	  // Retire this buffer and any following ones that were released early.
+	  ExternalBuffer *r = &b;
+	  do {
+	    r->m_released = false;
+	    r->m_busy = false;
+	    r = r->m_next;
+	  } while (r->m_released);
+	  m_next2release = r;
+	} else
+	  // A buffer lent to more than one reader (e.g. a crew's bridge ports) came back
+	  // before an earlier one.  It stays busy so the writer cannot reuse it out of order.
+	  b.m_released = true;
       } else if (m_dtPort) {
 	assert(&b.m_port == this);
 	assert(b.m_dtBuffer);
 	m_dtPort->releaseInputBuffer(b.m_dtBuffer);
 	b.m_dtBuffer = NULL;
+	if (m_lastInBuffer == &b)
+	  m_lastInBuffer = NULL;
+	if (&b != m_dtLastBuffer)
+	  freeDtBuffer(b);
+	notifyPeer(false);
+	return;
       }
       if (m_lastInBuffer == &b)
 	m_lastInBuffer = NULL;
+      notifyPeer(false);
     }
     // Step 4: release input buffers, return them to empty state
     void BasicPort::
@@ -1205,6 +1512,11 @@ namespace OCPI {
       }
       return 0;
     }
+    unsigned BasicPort::backlog() {
+      if (m_forward)
+	return m_forward->backlog();
+      return m_next2read ? fullCount() + OCPI_UTRUNCATE(unsigned, m_nZcPut - m_nZcTaken) : 0;
+    }
     unsigned BasicPort::emptyCount() {
       if (m_forward)
 	return m_forward->emptyCount();
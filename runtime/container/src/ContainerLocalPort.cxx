@@ -18,6 +18,7 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <climits>
 #include <algorithm>
 #include "farmhash.h"
 #include "OcpiOsAssert.h"
@@ -39,7 +40,7 @@ namespace OCPI {
 	 m_scale(0), m_external(NULL), m_connectedBridgePorts(0), m_localBridgePort(NULL),
 	 m_bridgeContainer(NULL), m_localBuffer(NULL),
 	 m_localDistribution(OU::Port::DistributionLimit), m_firstBridge(0), m_currentBridge(0),
-	 m_nextBridge(0) {
+	 m_nextBridge(0), m_lendInput(false) {
     }
 
     LocalPort::
@@ -100,12 +101,14 @@ namespace OCPI {
       bo.m_mode = partialRange(c.m_out.m_scale, c.m_out.m_index, c.m_in.m_scale,
 			       bo.m_first, bo.m_last) ? Discard : CyclicSparse;
     }
-    // Send balanced to all, but discard if not in our range
+    // Send balanced to all, but discard if not in our range.
+    // Every output member has every message here, and they cannot agree on which input
+    // member is least busy, so they rotate in step like oCycP to send each message once.
     void LocalPort::
     oBalP(Launcher::Connection &c, const OU::Port &/*output*/, const OU::Port &/*input*/,
 	  unsigned /*op*/, LocalPort::BridgeOp &bo) {
       bo.m_mode = partialRange(c.m_out.m_scale, c.m_out.m_index, c.m_in.m_scale,
-			       bo.m_first, bo.m_last) ? Discard : Balanced;
+			       bo.m_first, bo.m_last) ? Discard : CyclicSparse;
     }
     // Send balanced to all
     void LocalPort::
@@ -113,20 +116,29 @@ namespace OCPI {
 	 unsigned /*op*/, LocalPort::BridgeOp &bo) {
       bo.m_mode = Balanced;
     }
-    // Send cyclically to all, but discard if not in our range
+    // The hash field of an operation at the input, either specific to the operation or
+    // the port's default.
+    static const OU::Member *
+    hashField(const OU::Port &input, unsigned op) {
+      if (op < input.m_opScaling.size() && input.m_opScaling[op])
+	return input.m_opScaling[op]->m_hashField;
+      return op < input.nOperations() && input.m_defaultHashField.size() ?
+	input.operations()[op].findArg(input.m_defaultHashField.c_str()) : NULL;
+    }
+    // Send by hash to all, but discard if not in our range
     void LocalPort::
     oHashP(Launcher::Connection &c, const OU::Port &/*output*/, const OU::Port &input,
 	  unsigned op, LocalPort::BridgeOp &bo) {
       bo.m_mode = partialRange(c.m_out.m_scale, c.m_out.m_index, c.m_in.m_scale,
 			       bo.m_first, bo.m_last) ? Discard : Hashed;
-      bo.m_hashField = input.m_opScaling[op]->m_hashField;
+      bo.m_hashField = hashField(input, op);
     }
-    // Send cyclically to all
+    // Send by hash to all
     void LocalPort::
     oHash(Launcher::Connection &/*c*/, const OU::Port &/*output*/, const OU::Port &input,
 	  unsigned op, LocalPort::BridgeOp &bo) {
       bo.m_mode = Hashed;
-      bo.m_hashField = input.m_opScaling[op]->m_hashField;
+      bo.m_hashField = hashField(input, op);
     }
     // Send from first to first
     void LocalPort::
@@ -316,6 +328,10 @@ namespace OCPI {
 	else
 	  bp.connectLocal(*other, &c);
 	if (++m_connectedBridgePorts == m_bridgePorts.size()) {
+	  // Input from bridge ports in this process can be lent to an in-process local port
+	  m_lendInput = isProvider() && m_localBridgePort == this && zeroCopyOk();
+	  for (unsigned n = 0; m_lendInput && n < m_bridgePorts.size(); n++)
+	    m_lendInput = m_bridgePorts[n]->zeroCopyOk();
 	  // Save the bridge container so we know it in our destructor when we can't call
 	  // containers' virtual methods
 	  m_bridgeContainer =
@@ -361,13 +377,15 @@ namespace OCPI {
     // since we don't have the opcode yet (input only - output has opcode from local buffer).
     // Thus for a local input, we don't return true unless there is a local buffer AND
     // there is an acceptable incoming message to receive.
+    // When input bridge buffers are lent to the local port, no local buffer is needed.
     inline bool LocalPort::
     getLocalBuffer() {
       BasicPort &lbp = *m_localBridgePort;
       if (m_localBuffer) {
 	if (m_bridgeOp)
 	  return true; // we're processing a local buffer with a known opcode
-      } else if (!((m_localBuffer = 
+      } else if (!(isProvider() && m_lendInput) &&
+		 !((m_localBuffer = 
 		    isProvider() ?
 		    lbp.getEmptyBuffer() : lbp.getFullBuffer())))
 	return false;  // there is no local buffer to work with  
@@ -406,11 +424,49 @@ namespace OCPI {
       return true;
     }
 
-    static inline void
-    send2Bridge(ExternalBuffer &local, ExternalBuffer &bridge) {
-      assert(bridge.length() >= local.length());
-      memcpy(bridge.data(), local.data(), local.length());
-      bridge.send(local.length(), local.opCode(), local.end());
+    // Send a local output buffer to a bridge port, returning false if it has no room yet.
+    // When both are in this process the local buffer itself is lent to the bridge port, to
+    // be released back to the local port by whoever reads it there.  Otherwise it is copied.
+    inline bool LocalPort::
+    send2Bridge(ExternalBuffer &local, BridgePort &bridge, bool canLend, bool &lent) {
+      if (canLend && local.next() && local.m_port.zeroCopyOk() && bridge.zeroCopyOk()) {
+	bridge.put(local);
+	lent = true;
+	return true;
+      }
+      ExternalBuffer *b = bridge.getEmptyBuffer();
+      if (!b)
+	return false;
+      assert(b->length() >= local.length());
+      memcpy(b->data(), local.data(), local.length());
+      b->send(local.length(), local.opCode(), local.end(), local.direct());
+      return true;
+    }
+
+    // The member in the op's range with the fewest messages waiting to be read.
+    // The search starts at the op's next member so that ties are taken in turn.
+    size_t LocalPort::
+    leastBusy(const BridgeOp &bo) {
+      size_t n = bo.m_next, best = n;
+      unsigned least = UINT_MAX;
+      do {
+	unsigned backlog = m_bridgePorts[n]->backlog();
+	if (backlog < least) {
+	  best = n;
+	  if (!(least = backlog))
+	    break;
+	}
+	n = n == bo.m_last ? bo.m_first : n + 1;
+      } while (n != bo.m_next);
+      return best;
+    }
+
+    // Wake our container, and the one running our bridges if that is another
+    void LocalPort::
+    buffersChanged() {
+      container().wakeup(false);
+      if (m_bridgeContainer && m_bridgeContainer != &container())
+	m_bridgeContainer->wakeup(false);
     }
 
     // The callback to do bridge port processing on a local port.
@@ -430,13 +486,18 @@ namespace OCPI {
 	  BridgePort &bp = *m_bridgePorts[bo.m_next];
 	  ExternalBuffer *b = bp.getFullBuffer();
 	  assert(b);
-	  ocpiDebug("bridging for %p got local input %p from local side len %zu %zu",
-		    this, m_localBuffer, m_localBuffer->length(), b->length());
-	  assert(m_localBuffer->length() >= b->length());
-	  assert(m_localBuffer->data());
-	  memcpy(m_localBuffer->data(), b->data(), b->length());
-	  m_localBuffer->send(b->length(), b->opCode(), b->end());
-	  bp.releaseBuffer(*b);
+	  if (m_lendInput)
+	    // The local port's reader releases it back to the bridge port
+	    put(*b);
+	  else {
+	    ocpiDebug("bridging for %p got local input %p from local side len %zu %zu",
+		      this, m_localBuffer, m_localBuffer->length(), b->length());
+	    assert(m_localBuffer->length() >= b->length());
+	    assert(m_localBuffer->data() || !b->length());
+	    memcpy(m_localBuffer->data(), b->data(), b->length());
+	    m_localBuffer->send(b->length(), b->opCode(), b->end(), b->direct());
+	    bp.releaseBuffer(*b);
+	  }
 	  m_localBuffer = NULL;
 	  // Cycle nextBridge globally among all bridge ports.
 	  if (++m_nextBridge == m_bridgePorts.size())
@@ -451,14 +512,18 @@ namespace OCPI {
 		    m_localBuffer, bo.m_mode, bo.m_next, bo.m_last);
 	  size_t next = bo.m_next;
 	  ExternalBuffer *lb = m_localBuffer; // save for later release
+	  bool lent = false;                  // lb was lent to a bridge port, not copied
 	  // Phase 1: figure out which bridge port and whether to discard the message.
 	  switch (bo.m_mode) {
 	  case CyclicSparse:
-	    if (next < bo.m_first || next > bo.m_last)
+	    if (next < bo.m_first || next > bo.m_last) {
 	      m_localBuffer = NULL;
+	      if (++bo.m_next >= m_bridgePorts.size()) // keep in step with other members
+		bo.m_next = 0;
+	    }
 	    break;
 	  case Balanced:
-	    // For now, left be cyclic
+	    next = leastBusy(bo);
 	    break;
 	  case Directed:
 	    next = m_localBuffer->direct();
@@ -466,10 +531,14 @@ namespace OCPI {
 	    break;
 	  case Hashed:
 	    {
-	      size_t length;
-	      const uint8_t *data = bo.m_hashField->getField(m_localBuffer->data(), length);
-	      assert(data);
-	      next = OU::Hash((const char*)data, length) % m_bridgePorts.size();
+	      // Messages without the key (e.g. an EOF) all hash alike
+	      size_t length = 0;
+	      const uint8_t *data = bo.m_hashField ?
+		bo.m_hashField->getField(m_localBuffer->data(), length) : NULL;
+	      if (data && bo.m_hashField->m_offset + length > m_localBuffer->length())
+		data = NULL;
+	      next = OU::Hash(data ? (const char*)data : "", data ? length : 0) %
+		m_bridgePorts.size();
 	      if (next < bo.m_first || next > bo.m_last)
 		m_localBuffer = NULL;
 	    }
@@ -481,11 +550,10 @@ namespace OCPI {
 	  }
 	  if (m_localBuffer) { // have a full output from local port
 	    // Phase 2: see if the identified bridge port has a buffer after all and ship it.
+	    // The buffer can only be lent once: "all" lends it to the last member.
 	    BridgePort *bp = m_bridgePorts[next];
-	    ExternalBuffer *b = bp->getEmptyBuffer();
-	    if (!b)
+	    if (!send2Bridge(*m_localBuffer, *bp, bo.m_mode != All || next == bo.m_last, lent))
 	      return;
-	    send2Bridge(*m_localBuffer, *b);
 	    // Phase 3: do post processing, to compute bo.m_next, etc. "all" is special case
 	    switch (bo.m_mode) { // break to process buffer if b != NULL
 	    case Cyclic:
@@ -503,13 +571,13 @@ namespace OCPI {
 	      // A special case where we loop and replicate the output
 	      while (bo.m_next != bo.m_last) {
 		bo.m_next++;
-		bp = m_bridgePorts[bo.m_next];
-		if (!(b = bp->getEmptyBuffer()))
+		if (!send2Bridge(*m_localBuffer, *m_bridgePorts[bo.m_next],
+				 bo.m_next == bo.m_last, lent))
 		  return;
-		send2Bridge(*m_localBuffer, *b);
 	      }
+	      bo.m_next = bo.m_first;
 	      break;
-	    case Balanced: // do cyclic for now.
+	    case Balanced: // rotate where the search starts
 	      bo.m_next = next == bo.m_last ? bo.m_first : ++next;
 	      break;
 	    case Directed:
@@ -518,7 +586,8 @@ namespace OCPI {
 	    }
 	    m_localBuffer = NULL;
 	  }
-	  lb->release();
+	  if (!lent)
+	    lb->release();
 	} // end of output processing
       } // end of loop through local buffers
     }  // end of method
@@ -49,6 +49,11 @@ namespace OCPI {
 		name().c_str(), ordinal(), worker().name().c_str());
       worker().connectPort(ordinal());
     }
+    // Only our worker need be evaluated after this wakeup
+    void Port::buffersChanged() {
+      worker().notify();
+      LocalPort::buffersChanged();
+    }
 
     // The default behavior is that there is nothing special to do between
     // ports of like containers.
@@ -137,7 +137,8 @@ namespace OCPI {
       : OU::Worker::Worker(),
 	m_artifact(art), m_xml(impl), m_instXml(inst), m_workerMutex(true),
 	m_controlOpPending(false), m_slaves(a_slaves), m_hasMaster(a_hasMaster),
-        m_member(a_member), m_crewSize(a_crewSize), m_connectedPorts(0), m_optionalPorts(0) {
+        m_member(a_member), m_crewSize(a_crewSize), m_connectedPorts(0), m_optionalPorts(0),
+	m_notified(true) {
       if (impl) {
 	const char *err = parse(impl);
 	if (err)
@@ -391,6 +392,14 @@ namespace OCPI {
     Cache *Worker::
     getCache(const OA::PropertyInfo &info, size_t offset, const OU::Member &m, bool *dirty,
 	     OA::PropertyOptionList &options, OA::PropertyAttributes *a_attributes) const {
+      return getCache(info, offset,
+		      m.m_isSequence || m.m_baseType == OA::OCPI_String ? sizeof(uint32_t) :
+		      m.m_nBytes, dirty, options, a_attributes);
+    }
+    // The nBytes at offset are what must have been written for a read to use the cache
+    Cache *Worker::
+    getCache(const OA::PropertyInfo &info, size_t offset, size_t nBytes, bool *dirty,
+	     OA::PropertyOptionList &options, OA::PropertyAttributes *a_attributes) const {
       if (dirty) {
 	*dirty = false;
 	if (info.m_readSync)
@@ -406,8 +415,7 @@ namespace OCPI {
       if (!cache)
 	cache = m_cache[info.m_ordinal] = new Cache(info.m_nBytes);
       else if (dirty) {
-	if (cache->allSet(offset, m.m_isSequence || m.m_baseType == OA::OCPI_String ?
-			  sizeof(uint32_t) : m.m_nBytes)) {
+	if (cache->allSet(offset, nBytes)) {
 	  if (a_attributes)
 	    a_attributes->isCached = true;
 	  *dirty = true;
@@ -490,6 +498,66 @@ namespace OCPI {
       }
       return data;
     }
+    // Scalar-sized, aligned data uses the scalar accessors so it is accessed atomically
+    static size_t
+    dataBits(size_t offset, size_t nBytes) {
+      return (nBytes == 1 || nBytes == 2 || nBytes == 4 || nBytes == 8) && !(offset & (nBytes - 1)) ?
+	nBytes * CHAR_BIT : 0;
+    }
+    void Worker::
+    setPropertyData(const OA::PropertyInfo &info, size_t offset, const uint8_t *data,
+		    size_t nBytes) const {
+      if (!info.m_isWritable)
+	throw OU::Error("The '%s' property of worker '%s' is not writable",
+			info.m_name.c_str(), name().c_str());
+      if (info.m_isInitial && !beforeStart())
+	throw OU::Error("The '%s' property of worker '%s' is initial, and cannot be written after start",
+			info.m_name.c_str(), name().c_str());
+      if (offset + nBytes > info.m_nBytes)
+	throw OU::Error("Access to the '%s' property of worker '%s' is out of range",
+			info.m_name.c_str(), name().c_str());
+      Cache *cache = getCache(info, offset, info);
+      setData(info, cache, offset, data, nBytes, dataBits(offset, nBytes));
+    }
+    void Worker::
+    getPropertyData(const OA::PropertyInfo &info, size_t offset, uint8_t *data, size_t nBytes,
+		    bool uncached) const {
+      if (offset + nBytes > info.m_nBytes)
+	throw OU::Error("Access to the '%s' property of worker '%s' is out of range",
+			info.m_name.c_str(), name().c_str());
+      bool dirty;
+      OA::PropertyOptionList options({ uncached ? OA::UNCACHED : OA::NONE });
+      Cache *cache = getCache(info, offset, nBytes, &dirty, options, NULL);
+      getData(info, cache, dirty, offset, data, nBytes, dataBits(offset, nBytes));
+    }
+    void Worker::
+    accessProperties(const OA::PropertyBatchAccess *accesses, size_t n) const {
+      for (size_t i = 0; i < n; i++) {
+	const OA::PropertyBatchAccess &a = accesses[i];
+	if (!a.m_property || &a.m_property->m_worker != this)
+	  throw OU::Error("A property access in a batch for worker '%s' is not for one of "
+			  "its properties", name().c_str());
+	const OA::PropertyInfo &info = a.m_property->m_info;
+	if (a.m_write && !info.m_isWritable)
+	  throw OU::Error("The '%s' property of worker '%s' is not writable",
+			  info.m_name.c_str(), name().c_str());
+	if (a.m_offset + a.m_nBytes > info.m_nBytes)
+	  throw OU::Error("Access to the '%s' property of worker '%s' is out of range",
+			  info.m_name.c_str(), name().c_str());
+      }
+      accessPropertyData(accesses, n);
+    }
+    void Worker::
+    accessPropertyData(const OA::PropertyBatchAccess *accesses, size_t n) const {
+      for (size_t i = 0; i < n; i++) {
+	const OA::PropertyBatchAccess &a = accesses[i];
+	if (a.m_write)
+	  setPropertyData(a.m_property->m_info, a.m_offset, (const uint8_t *)a.m_data, a.m_nBytes);
+	else
+	  getPropertyData(a.m_property->m_info, a.m_offset, (uint8_t *)a.m_data, a.m_nBytes,
+			  a.m_uncached);
+      }
+    }
     void Worker::
     setProperty(const OA::PropertyInfo &info, const OU::Value &v, const OU::Member &m,
 		size_t mOffset) const {
@@ -69,6 +69,7 @@ namespace OCPI {
 
     public:
       friend class Port;
+      friend class Transport;
 
       /**********************************
        * Constructors
@@ -162,6 +163,7 @@ namespace OCPI {
        * starting any queued requests if possible.
        *********************************/
       uint32_t checkQueuedTransfers();
+      bool hasQueuedTransfers();
 
       /**********************************
        * This method causes the buffer to be transfered to the
@@ -390,6 +392,9 @@ namespace OCPI {
       // Updated flag
       bool m_updated;
 
+      // On the transport's list of circuits with queued transfers
+      bool m_busy;
+
     public: // temporary
       // Circuit is open
       bool m_openCircuit;
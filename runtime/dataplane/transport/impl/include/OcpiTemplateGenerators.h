@@ -78,6 +78,17 @@ namespace OCPI {
           :s_port(sp),s_tid(st),t_port(tp),t_tid(tt){};
       };
 
+      // One copy of a transfer request
+      struct Copy {
+        DtOsDataTypes::Offset               src;
+        DtOsDataTypes::Offset               dst;
+        size_t                              nbytes;
+        DataTransfer::XferRequest::Flags    flags;
+      };
+
+      // Should a port with this many templates use one shared template instead
+      static bool shareTemplates( size_t nTemplates );
+
       // Call appropriate creator
       void create( Transport* t, PortSet* output, PortSet* input, TransferController* cont );
 
@@ -181,6 +192,21 @@ namespace OCPI {
         virtual void createInputTransfers(OCPI::DataTransport::PortSet* output, OCPI::DataTransport::Port* input,
                                            TransferController* cont );
 
+        // Get the copies that move an output buffer to an input buffer of an input port
+        unsigned outputCopies(OCPI::DataTransport::Port* s_port, OCPI::OS::uint32_t s_tid,
+                              OCPI::DataTransport::Port* t_port, OCPI::OS::uint32_t t_tid,
+                              Copy copies[]);
+
+        // Create one template for the output port that is shared by all buffer pairs,
+        // returning false if that is not possible
+        bool createSharedOutputTransfers(OCPI::DataTransport::Port* s_port, OCPI::DataTransport::PortSet* input,
+                                         TransferController* cont );
+
+        // Create one template for the input port that is shared by all its buffers,
+        // returning false if that is not possible
+        bool createSharedInputTransfers(OCPI::DataTransport::PortSet* output, OCPI::DataTransport::Port* input,
+                                        TransferController* cont );
+
     };
 
 
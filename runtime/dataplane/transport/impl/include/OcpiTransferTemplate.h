@@ -42,6 +42,7 @@
 #include <OcpiOsAssert.h>
 
 #include <stdio.h>
+#include <vector>
 
 namespace OCPI {
 
@@ -114,6 +115,28 @@ namespace OCPI {
        *********************************/
       void addZeroCopyTransfer( OutputBuffer* output, InputBuffer* input );
 
+      /**********************************
+       * Add a transfer request to a template that is shared by all the buffers of a
+       * port.  The request has nCopies copies, created with the offsets of source and
+       * target index 0.  src holds the source offsets of the copies for each source
+       * index in turn, dst the target offsets for each target index.
+       *********************************/
+      void addSharedTransfer( DataTransfer::XferRequest* tx_request,
+                              size_t nCopies,
+                              const std::vector<DtOsDataTypes::Offset> &src,
+                              const std::vector<DtOsDataTypes::Offset> &dst );
+
+      /**********************************
+       * Is this template shared by all the buffers of a port
+       *********************************/
+      bool isShared();
+
+      /**********************************
+       * Select the source and target buffers that the next produce or consume
+       * of a shared template is for.  Other templates ignore this.
+       *********************************/
+      void select( OCPI::OS::uint32_t src, OCPI::OS::uint32_t dst );
+
       /**********************************
        * Add a gated transfer, gated transfers are additional transfers that 
        *********************************/
@@ -190,7 +213,8 @@ namespace OCPI {
       // a single output buffer, such is the case for whole to parts when the number of
       // parts exceed the number of buffers+input ports.
       //                                                                           transfer sequence            input port    input buffer
-      OcpiTransferTemplate* m_nextTransfer[MAX_TRANSFERS_PER_BUFFER] [MAX_PCONTRIBS] [MAX_BUFFERS];
+      // This is only allocated for templates that have gated transfers.
+      OcpiTransferTemplate* (*m_nextTransfer) [MAX_PCONTRIBS] [MAX_BUFFERS];
       List m_gatedTransfersPending;
       OCPI::OS::uint32_t m_sequence;
       OCPI::OS::uint32_t m_maxSequence;
@@ -211,6 +235,18 @@ namespace OCPI {
       OCPI::DataTransport::Port* m_nextPort;
       OCPI::OS::uint32_t   m_nextTid;
 
+      // For a shared template, the offsets that the copies of each transfer request
+      // need for each source and target index, and the offsets they have now.
+      struct Shared {
+        size_t nCopies;
+        std::vector<DtOsDataTypes::Offset> src, dst, curSrc, curDst;
+      };
+      std::vector<Shared> m_shared;
+      OCPI::OS::uint32_t m_srcIndex, m_dstIndex;
+
+      // Move the copies of a shared template to the selected buffers
+      void retarget();
+
       // Private initialization
       void init();
 
@@ -245,6 +281,9 @@ namespace OCPI {
         printf("*** Adding a gated transfer to this[%d][%d][%d] \n",
                m_maxSequence,input_port_id, buffer_tid);
 #endif
+        if ( ! m_nextTransfer ) {
+          m_nextTransfer = new OcpiTransferTemplate*[MAX_TRANSFERS_PER_BUFFER][MAX_PCONTRIBS][MAX_BUFFERS];
+        }
         m_nextTransfer[sequence][input_port_id][buffer_tid] = gated_transfer;
       }
 
@@ -261,6 +300,13 @@ namespace OCPI {
      *********************************/
     inline OCPI::OS::uint32_t OcpiTransferTemplate::getMaxGatedSequence(){return m_maxSequence;}
 
+    /**********************************
+     * Shared templates
+     *********************************/
+    inline bool OcpiTransferTemplate::isShared(){return !m_shared.empty();}
+    inline void OcpiTransferTemplate::select( OCPI::OS::uint32_t src,
+                                              OCPI::OS::uint32_t dst){m_srcIndex=src; m_dstIndex=dst;}
+
     /**********************************
      * Get/Set transfer type id
      *********************************/
@@ -35,6 +35,8 @@
 
 #include <vector>
 #include <list>
+#include <deque>
+#include <map>
 #include <OcpiOsTimer.h>
 #include <OcpiOsMutex.h>
 #include <OcpiParentChild.h>
@@ -58,6 +60,7 @@ namespace OCPI {
 
 namespace DataTransfer {
   class EndPoint;
+  class XferRequest;
   struct SMBResources;
 }
 
@@ -181,6 +184,13 @@ namespace OCPI {
        * General house keeping 
        *********************************/
       void dispatch(DataTransfer::EventManager* event_manager=NULL);
+
+      /**********************************
+       * Circuits with queued transfers are retried by dispatch until the queues
+       * are empty, so dispatch does not have to look at idle circuits
+       *********************************/
+      void addBusyCircuit(Circuit &circuit);
+      void removeBusyCircuit(Circuit &circuit);
       //      std::vector<std::string> getListOfSupportedEndpoints();
 
       /**********************************
@@ -250,6 +260,17 @@ namespace OCPI {
       std::list<OCPI::DataTransport::Circuit*> m_circuits;
       typedef std::list<OCPI::DataTransport::Circuit*>::iterator CircuitsIter;
 
+      // Circuits that have queued transfers
+      std::vector<OCPI::DataTransport::Circuit*> m_busyCircuits;
+
+      // Requests in flight, queued by target endpoint since they complete in order,
+      // and deleted by dispatch when they complete
+      typedef std::deque<DataTransfer::XferRequest*> Completions;
+      typedef std::map<DataTransfer::EndPoint*, Completions> CompletionQueues;
+      CompletionQueues m_completions;
+      size_t m_nInFlight;
+      void reclaimCompletions();
+
       // New circuit listener
       NewCircuitRequestListener* m_newCircuitListener;
 
@@ -263,7 +284,6 @@ namespace OCPI {
 
       // Cached transfer list
       static OCPI::Util::VList  m_cached_transfers;
-      static OCPI::Util::VList   active_transfers;
 
     public:
       // Our transport global class
@@ -196,7 +196,10 @@ consume( Buffer* input )
 #endif
 
   // Tell everyone that we are empty
-  return m_templates [0][0][input->getPort()->getPortId()][input->getTid()][0][INPUT]->consume();
+  OcpiTransferTemplate *temp =
+    m_templates [0][0][input->getPort()->getPortId()][input->getTid()][0][INPUT];
+  temp->select( input->getTid(), input->getTid() );
+  return temp->consume();
 
 }
 
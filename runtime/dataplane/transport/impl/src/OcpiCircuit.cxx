@@ -87,7 +87,7 @@ Circuit(
      OU::SelfRefMutex(mutex),
      OCPI::Time::Emit(t, "Circuit"),
      m_transport(t), m_status(Unknown),
-     m_ready(false),m_updated(false),
+     m_ready(false),m_updated(false),m_busy(false),
      m_outputPs(0), m_inputPs(0),  m_metaData(connection) ,m_portsets_init(0),
      m_protocol(NULL), m_protocolSize(0), m_protocolOffset(0)
 {
@@ -305,6 +305,7 @@ OCPI::DataTransport::Circuit::
 ~Circuit()
 {
   ocpiDebug("**** Circuit::~Circuit: %p", this);
+  m_transport->removeBusyCircuit(*this);
 
 #ifdef DD_N_P_SUPPORTED
   // First we will try to tell all of the input ports that we are going away.
@@ -1074,6 +1075,7 @@ QInputToWaitForOutput(
   ocpiAssert( input_buf->m_zCopyPort == NULL );
   input_buf->m_zCopyPort = out_port;
   m_queuedInputOutputTransfers[out_port->getPortId()].insert(input_buf);
+  m_transport->addBusyCircuit(*this);
 
 }
 
@@ -1194,6 +1196,17 @@ checkQueuedTransfers()
   return total;
 }
 
+bool
+OCPI::DataTransport::Circuit::
+hasQueuedTransfers()
+{
+  for ( uint32_t n=0; n<m_maxPortOrd; n++ )
+    if ( m_queuedTransfers[n].getElementCount() ||
+	 m_queuedInputOutputTransfers[n].getElementCount() )
+      return true;
+  return false;
+}
+
 
 
 #ifdef DONE
@@ -1326,6 +1339,7 @@ queTransfer( Buffer* src_buf, bool prepend )
   else {
     m_queuedTransfers[src_buf->getPort()->getPortId()].prepend(src_buf);
   }
+  m_transport->addBusyCircuit(*this);
 
 
 #ifdef QUE_CHECK
@@ -30,6 +30,8 @@
  */
 
 #include <cstddef>
+#include <cstdlib>
+#include <vector>
 #include "OcpiOsAssert.h"
 #include "OcpiUtilMisc.h"
 #include "XferEndPoint.h"
@@ -69,6 +71,19 @@ TransferTemplateGenerator::
 }
 
 
+// A port with at least this many templates uses one shared template instead, whose
+// transfer requests are moved to the right buffers each time it is used.
+// OCPI_SHARED_TEMPLATES changes this threshold, zero never shares templates.
+bool
+TransferTemplateGenerator::
+shareTemplates( size_t nTemplates )
+{
+  const char *env = getenv("OCPI_SHARED_TEMPLATES");
+  size_t threshold = env ? strtoul(env, NULL, 0) : 16;
+  return threshold && nTemplates >= threshold;
+}
+
+
 // Call appropriate creator
 void  
 TransferTemplateGenerator::
@@ -507,6 +522,13 @@ void TransferTemplateGeneratorPattern1::createOutputTransfers( Port* s_port, Por
   int n_t_buffers = input->getBufferCount();
   int n_t_ports = input->getPortCount();
 
+  // With many buffers, one template moved from buffer to buffer is much cheaper
+  // than one for every pair of buffers
+  if ( shareTemplates( (size_t)(n_s_buffers * n_t_buffers) ) &&
+       createSharedOutputTransfers( s_port, input, cont ) ) {
+    return;
+  }
+
   // We need a transfer template to allow a transfer from each output buffer to every
   // input buffer for this pattern.
   for ( int s_buffers=0; s_buffers<n_s_buffers; s_buffers++ ) {
@@ -548,12 +570,6 @@ void TransferTemplateGeneratorPattern1::createOutputTransfers( Port* s_port, Por
         Port* t_port = input->getPort(n);
         t_buf = t_port->getInputBuffer(t_buffers);
 
-        struct PortMetaData::OutputPortBufferControlMap *output_offsets = 
-          &s_port->getMetaData()->m_bufferData[s_tid].outputOffsets;
-
-        struct PortMetaData::InputPortBufferControlMap *input_offsets = 
-          &t_port->getMetaData()->m_bufferData[t_tid].inputOffsets;
-
         // We need to determine if this can be a Zero copy transfer.  If so, 
         // we dont need to create a transfer template
         if ( m_zcopyEnabled && s_port->supportsZeroCopy( t_port ) ) {
@@ -567,42 +583,13 @@ void TransferTemplateGeneratorPattern1::createOutputTransfers( Port* s_port, Por
         // Create the transfer that copys the output data to the input data
         XferRequest* ptransfer =
 	  s_port->getTemplate(s_port->getEndPoint(), t_port->getEndPoint()).createXferRequest();
+        Copy copies[3];
+        unsigned n_copies = outputCopies( s_port, (OS::uint32_t)s_tid, t_port, (OS::uint32_t)t_tid,
+                                          copies );
         try {
-          ptransfer->copy (
-			   output_offsets->bufferOffset,
-			   input_offsets->bufferOffset,
-			   output_offsets->bufferSize,
-			   XferRequest::DataTransfer );
-
-	  DtOsDataTypes::Offset	metaOffset =
-	    output_offsets->metaDataOffset +
-	    s_port->getPortId() * OCPI_SIZEOF(DDT::Offset, BufferMetaData);
-
-	  if (t_port->getMetaData()->m_descriptor.options & (1 << FlagIsMeta))
-	    ptransfer->copy(metaOffset + OCPI_OFFSETOF(DDT::Offset, RplMetaData, xferMetaData),
-			    input_offsets->metaDataOffset +
-			    s_port->getPortId() * OCPI_SIZEOF(DDT::Offset, uint32_t), 
-			    sizeof(OCPI::OS::uint32_t),
-			    XferRequest::FlagTransfer);
-	  else {
-	    // Create the transfer that copys the output meta-data to the input meta-data
-	    ptransfer->copy(metaOffset,
-			    input_offsets->metaDataOffset +
-			    s_port->getPortId() * OCPI_SIZEOF(DDT::Offset, BufferMetaData),
-			    sizeof(OCPI::OS::int64_t),
-			    XferRequest::MetaDataTransfer);
-
-	    // Create the transfer that copys the output state to the remote input state
-	    ptransfer->copy(t_port->getMetaData()->m_descriptor.options & (1 << FlagIsCounting) ?
-			    metaOffset + OCPI_OFFSETOF(DDT::Offset, RplMetaData, timestamp) :
-			    output_offsets->localStateOffset +
-			    OCPI_SIZEOF(DDT::Offset, BufferState) * MAX_PCONTRIBS +
-			    s_port->getPortId() * OCPI_SIZEOF(DDT::Offset, BufferState),
-			    input_offsets->localStateOffset +
-			    s_port->getPortId() * OCPI_SIZEOF(DDT::Offset, BufferState),
-			    sizeof(BufferState),
-			    XferRequest::FlagTransfer);
-	  }
+          for ( unsigned c=0; c<n_copies; c++ ) {
+            ptransfer->copy( copies[c].src, copies[c].dst, copies[c].nbytes, copies[c].flags );
+          }
         }
         catch( ... ) {
           FORMAT_TRANSFER_EC_RETHROW( s_port, t_port );
@@ -620,17 +607,244 @@ void TransferTemplateGeneratorPattern1::createOutputTransfers( Port* s_port, Por
 }
 
 
+// The copies for the pattern w[p] -> w[p]: the data, then the meta-data and the flag
+unsigned TransferTemplateGeneratorPattern1::outputCopies( Port* s_port, OS::uint32_t s_tid,
+                                                          Port* t_port, OS::uint32_t t_tid,
+                                                          Copy copies[] )
+{
+  struct PortMetaData::OutputPortBufferControlMap *output_offsets = 
+    &s_port->getMetaData()->m_bufferData[s_tid].outputOffsets;
+
+  struct PortMetaData::InputPortBufferControlMap *input_offsets = 
+    &t_port->getMetaData()->m_bufferData[t_tid].inputOffsets;
+
+  unsigned n = 0;
+  copies[n].src = output_offsets->bufferOffset;
+  copies[n].dst = input_offsets->bufferOffset;
+  copies[n].nbytes = output_offsets->bufferSize;
+  copies[n++].flags = XferRequest::DataTransfer;
+
+  DtOsDataTypes::Offset	metaOffset =
+    output_offsets->metaDataOffset +
+    s_port->getPortId() * OCPI_SIZEOF(DDT::Offset, BufferMetaData);
+
+  if (t_port->getMetaData()->m_descriptor.options & (1 << FlagIsMeta)) {
+    copies[n].src = metaOffset + OCPI_OFFSETOF(DDT::Offset, RplMetaData, xferMetaData);
+    copies[n].dst = input_offsets->metaDataOffset +
+      s_port->getPortId() * OCPI_SIZEOF(DDT::Offset, uint32_t);
+    copies[n].nbytes = sizeof(OCPI::OS::uint32_t);
+    copies[n++].flags = XferRequest::FlagTransfer;
+  } else {
+    // The copy of the output meta-data to the input meta-data
+    copies[n].src = metaOffset;
+    copies[n].dst = input_offsets->metaDataOffset +
+      s_port->getPortId() * OCPI_SIZEOF(DDT::Offset, BufferMetaData);
+    copies[n].nbytes = sizeof(OCPI::OS::int64_t);
+    copies[n++].flags = XferRequest::MetaDataTransfer;
+
+    // The copy of the output state to the remote input state
+    copies[n].src = t_port->getMetaData()->m_descriptor.options & (1 << FlagIsCounting) ?
+      metaOffset + OCPI_OFFSETOF(DDT::Offset, RplMetaData, timestamp) :
+      output_offsets->localStateOffset +
+      OCPI_SIZEOF(DDT::Offset, BufferState) * MAX_PCONTRIBS +
+      s_port->getPortId() * OCPI_SIZEOF(DDT::Offset, BufferState);
+    copies[n].dst = input_offsets->localStateOffset +
+      s_port->getPortId() * OCPI_SIZEOF(DDT::Offset, BufferState);
+    copies[n].nbytes = sizeof(BufferState);
+    copies[n++].flags = XferRequest::FlagTransfer;
+  }
+  return n;
+}
+
+
+// Create one template for all buffer pairs of the output port.  Each input port gets a
+// request made for buffers 0 that is moved to the selected buffers when it is used.
+bool TransferTemplateGeneratorPattern1::createSharedOutputTransfers( Port* s_port, PortSet* input,
+                                                                     TransferController* cont )
+{
+  PortSet* output = s_port->getPortSet();
+  BufferOrdinal n_s_buffers = output->getBufferCount();
+  BufferOrdinal n_t_buffers = input->getBufferCount();
+  PortOrdinal n_t_ports = input->getPortCount();
+
+  // Zero copy templates refer to particular buffers
+  for ( PortOrdinal n=0; n<n_t_ports; n++ ) {
+    if ( m_zcopyEnabled && s_port->supportsZeroCopy( input->getPort(n) ) ) {
+      return false;
+    }
+  }
+
+  std::vector<XferRequest*> requests;
+  std::vector<std::vector<DDT::Offset> > srcs(n_t_ports), dsts(n_t_ports);
+  Copy copies[3];
+  unsigned n_copies = 0;
+  for ( PortOrdinal n=0; n<n_t_ports; n++ ) {
+    Port* t_port = input->getPort(n);
+
+    // The source offsets for each output buffer, and target offsets for each input buffer
+    for ( BufferOrdinal s=0; s<n_s_buffers; s++ ) {
+      ocpiAssert( s_port->getOutputBuffer(s)->getTid() == s );
+      n_copies = outputCopies( s_port, (OS::uint32_t)s, t_port, 0, copies );
+      for ( unsigned c=0; c<n_copies; c++ ) {
+        srcs[n].push_back( copies[c].src );
+      }
+    }
+    for ( BufferOrdinal t=0; t<n_t_buffers; t++ ) {
+      ocpiAssert( t_port->getInputBuffer(t)->getTid() == t );
+      n_copies = outputCopies( s_port, 0, t_port, (OS::uint32_t)t, copies );
+      for ( unsigned c=0; c<n_copies; c++ ) {
+        dsts[n].push_back( copies[c].dst );
+      }
+    }
+
+    XferRequest* ptransfer =
+      s_port->getTemplate(s_port->getEndPoint(), t_port->getEndPoint()).createXferRequest();
+    requests.push_back( ptransfer );
+    try {
+      for ( unsigned c=0; c<n_copies; c++ ) {
+        ptransfer->copy( srcs[n][c], dsts[n][c], copies[c].nbytes, copies[c].flags );
+      }
+    }
+    catch( ... ) {
+      for ( unsigned r=0; r<requests.size(); r++ ) {
+        delete requests[r];
+      }
+      FORMAT_TRANSFER_EC_RETHROW( s_port, t_port );
+    }
+
+    // Not all drivers can move their requests
+    if ( ! ptransfer->modify( 0, NULL, NULL, NULL, NULL ) ) {
+      for ( unsigned r=0; r<requests.size(); r++ ) {
+        delete requests[r];
+      }
+      return false;
+    }
+  }
+
+  OcpiTransferTemplate* temp = new OcpiTransferTemplate(1);
+  for ( PortOrdinal n=0; n<n_t_ports; n++ ) {
+    temp->addSharedTransfer( requests[n], n_copies, srcs[n], dsts[n] );
+  }
+  ocpiDebug("Shared output template %p for port %d, %zu x %zu buffers",
+            temp, s_port->getPortId(), n_s_buffers, n_t_buffers);
+  for ( BufferOrdinal s=0; s<n_s_buffers; s++ ) {
+    for ( BufferOrdinal t=0; t<n_t_buffers; t++ ) {
+      cont->addTemplate( temp, s_port->getPortId(), (OS::uint32_t)s, 0, (OS::uint32_t)t, false,
+                         TransferController::OUTPUT );
+    }
+  }
+  return true;
+}
+
+
 void TransferTemplateGeneratorPattern1::createInputTransfers(PortSet* output, Port* input,
                                                               TransferController* cont )
 
 {
 
+  if ( shareTemplates( input->getBufferCount() ) &&
+       createSharedInputTransfers( output, input, cont ) ) {
+    return;
+  }
+
   // For this pattern, we can use the base class implementation which broadcasts a
   // input buffers availability
   TransferTemplateGenerator::createInputTransfers( output, input, cont );
 }
 
 
+// Create one template for all buffers of the input port, telling the shadows of the
+// output ports about each buffer as the base class templates do.
+bool TransferTemplateGeneratorPattern1::createSharedInputTransfers(PortSet* output, Port* input,
+                                                                    TransferController* cont )
+{
+  BufferOrdinal n_t_buffers = input->getBufferCount();
+  std::vector<XferRequest*> requests;
+  std::vector<std::vector<DDT::Offset> > srcs, dsts;
+
+  // Since there may be multiple output ports on 1 processs, we need to make sure we dont send
+  // more than 1 time
+  int sent[MAX_PCONTRIBS];
+  memset(sent,0,sizeof(int)*MAX_PCONTRIBS);
+
+  for (PortOrdinal n = 0; n < output->getPortCount(); n++) {
+    Port* s_port = output->getPort(n);
+    int s_pid = s_port->getRealShemServices()->endPoint().mailBox();
+
+    if ( sent[s_pid] ) {
+      continue;
+    }
+
+    // If we are creating a template for whole transfers, we do not recognize anything
+    // but output port 0
+    if ( (s_port->getPortSet()->getDataDistribution()->getMetaData()->distType == DataDistributionMetaData::parallel) &&
+         s_port->getRank() != 0 ) {
+      continue;
+    }
+
+    // Zero copy templates refer to particular buffers
+    if ( m_zcopyEnabled && s_port->supportsZeroCopy( input ) ) {
+      for ( unsigned r=0; r<requests.size(); r++ ) {
+        delete requests[r];
+      }
+      return false;
+    }
+    sent[s_pid] = 1;
+
+    srcs.push_back( std::vector<DDT::Offset>() );
+    dsts.push_back( std::vector<DDT::Offset>() );
+    for ( BufferOrdinal t=0; t<n_t_buffers; t++ ) {
+      ocpiAssert( input->getInputBuffer(t)->getTid() == t );
+      struct PortMetaData::InputPortBufferControlMap *input_offsets = 
+        &input->getMetaData()->m_bufferData[t].inputOffsets;
+      srcs.back().push_back( input_offsets->localStateOffset +
+                             (OCPI_SIZEOF(DDT::Offset, BufferState) * MAX_PCONTRIBS) +
+                             (OCPI_SIZEOF(DDT::Offset, BufferState)* input->getPortId()) );
+      dsts.back().push_back( input_offsets->myShadowsRemoteStateOffsets[s_pid] );
+    }
+
+    XferRequest  *ptransfer =
+      input->getTemplate(input->getEndPoint(), s_port->getEndPoint()).createXferRequest();
+    requests.push_back( ptransfer );
+    try {
+      ptransfer->copy( srcs.back()[0], dsts.back()[0], sizeof(BufferState),
+                       XferRequest::FlagTransfer );
+    }
+    catch( ... ) {
+      for ( unsigned r=0; r<requests.size(); r++ ) {
+        delete requests[r];
+      }
+      FORMAT_TRANSFER_EC_RETHROW( input, s_port );
+    }
+
+    // Not all drivers can move their requests
+    if ( ! ptransfer->modify( 0, NULL, NULL, NULL, NULL ) ) {
+      for ( unsigned r=0; r<requests.size(); r++ ) {
+        delete requests[r];
+      }
+      return false;
+    }
+  }
+
+  // With no requests at all there is nothing to share
+  if ( requests.empty() ) {
+    return false;
+  }
+
+  OcpiTransferTemplate* temp = new OcpiTransferTemplate(0);
+  for ( unsigned r=0; r<requests.size(); r++ ) {
+    temp->addSharedTransfer( requests[r], 1, srcs[r], dsts[r] );
+  }
+  ocpiDebug("Shared input template %p for port %d, %zu buffers",
+            temp, input->getPortId(), n_t_buffers);
+  for ( BufferOrdinal t=0; t<n_t_buffers; t++ ) {
+    cont->addTemplate( temp, 0, 0, input->getPortId(), (OS::uint32_t)t, false,
+                       TransferController::INPUT );
+  }
+  return true;
+}
+
+
 class OcpiTransferTemplateAFC : public OcpiTransferTemplate
 {
 public:
@@ -43,6 +43,7 @@
 #include <OcpiList.h>
 #include <OcpiOsAssert.h>
 #include <OcpiTimeEmitCategories.h>
+#include <set>
 
 using namespace OCPI::DataTransport;
 using namespace DataTransfer;
@@ -79,19 +80,30 @@ TransferController::TransferController()
 TransferController::~TransferController()
 {
 
+  // Shared templates appear for every buffer pair of their port
+  std::set<OcpiTransferTemplate*> shared;
   for ( OCPI::OS::uint32_t x=0; x<MAX_PCONTRIBS; x++ ) {
     for ( OCPI::OS::uint32_t y=0; y<MAX_BUFFERS; y++ ) {
       for ( OCPI::OS::uint32_t z=0; z<MAX_PCONTRIBS; z++ ) {
         for ( OCPI::OS::uint32_t zz=0; zz<MAX_BUFFERS; zz++ ) {
           for ( OCPI::OS::uint32_t bc=0; bc<2; bc++) {
             for ( OCPI::OS::uint32_t ts=0; ts<2; ts++) {
-              delete m_templates[x][y][z][zz][bc][ts];
+              OcpiTransferTemplate *temp = m_templates[x][y][z][zz][bc][ts];
+              if ( temp && temp->isShared() ) {
+                shared.insert( temp );
+              }
+              else {
+                delete temp;
+              }
             }
           }
         }
       }
     }
   }
+  for ( std::set<OcpiTransferTemplate*>::iterator i = shared.begin(); i != shared.end(); i++ ) {
+    delete *i;
+  }
 
 }
 
@@ -500,6 +512,7 @@ void TransferController::modifyOutputOffsets( Buffer* me, Buffer* new_buffer, bo
   int mt = m_nextTid;
   OcpiTransferTemplate *temp = 
     m_templates [me->getPort()->getPortId()][me->getTid()][0][mt][0][OUTPUT];
+  temp->select( me->getTid(), (OCPI::OS::uint32_t)mt );
 
   // If this is already a zero copy from output to the next input we need to deal with that
   if ( temp->m_zCopy ) {
@@ -612,6 +625,7 @@ int TransferController1::produce( Buffer* b, bool bcast )
   OcpiTransferTemplate *temp = 
     m_templates [buffer->getPort()->getPortId()][buffer->getTid()][0][m_nextTid][bcast_idx][OUTPUT];
   OCPI_EMIT_CAT__("Start Data Transfer",OCPI_EMIT_CAT_WORKER_DEV,OCPI_EMIT_CAT_WORKER_DEV_BUFFER_FLOW, buffer );
+  temp->select( buffer->getTid(), (OCPI::OS::uint32_t)m_nextTid );
   temp->produce();
 
   // Add the template to our list
@@ -674,7 +688,10 @@ Buffer* TransferController1::consume( Buffer* input )
 #endif
 
   // Tell everyone that we are empty
-  return m_templates [0][0][input->getPort()->getPortId()][input->getTid()][0][INPUT]->consume();
+  OcpiTransferTemplate *temp =
+    m_templates [0][0][input->getPort()->getPortId()][input->getTid()][0][INPUT];
+  temp->select( input->getTid(), input->getTid() );
+  return temp->consume();
 
 }
 
@@ -34,6 +34,8 @@
 #include <OcpiTransferTemplate.h>
 #include <OcpiPortSet.h>
 #include <OcpiOsAssert.h>
+#include <OcpiOsMisc.h>
+#include <algorithm>
 
 using namespace OCPI::DataTransport;
 using namespace DataTransfer;
@@ -48,7 +50,10 @@ init()
 {
   n_transfers = 0;
   m_zCopy = NULL;
+  m_nextTransfer = NULL;
+  m_sequence = 0;
   m_maxSequence = 0;
+  m_srcIndex = m_dstIndex = 0;
 }
 
 
@@ -72,6 +77,7 @@ OcpiTransferTemplate::
 {
   if ( m_zCopy )
     delete m_zCopy;
+  delete [] m_nextTransfer;
 
 #if 0
   // This isn't done here since the port owns the templates which owns the transfers.
@@ -130,6 +136,59 @@ addZeroCopyTransfer(
 }
 
 
+/**********************************
+ * Add a transfer request to a shared template
+ *********************************/
+void 
+OcpiTransferTemplate::
+addSharedTransfer( XferRequest* tx_request,
+                   size_t nCopies,
+                   const std::vector<DtOsDataTypes::Offset> &src,
+                   const std::vector<DtOsDataTypes::Offset> &dst )
+{
+  ocpiAssert( n_transfers == m_shared.size() );
+  ocpiAssert( nCopies && src.size() >= nCopies && dst.size() >= nCopies );
+  addTransfer( tx_request );
+  m_shared.resize( n_transfers );
+  Shared &sh = m_shared.back();
+  sh.nCopies = nCopies;
+  sh.src = src;
+  sh.dst = dst;
+  sh.curSrc.assign( &src[0], &src[0] + nCopies );
+  sh.curDst.assign( &dst[0], &dst[0] + nCopies );
+}
+
+
+/**********************************
+ * Move the copies of a shared template to the selected buffers
+ *********************************/
+void 
+OcpiTransferTemplate::
+retarget()
+{
+  for ( OCPI::OS::uint32_t n=0; n<m_shared.size(); n++ ) {
+    Shared &sh = m_shared[n];
+    ocpiAssert( (m_srcIndex + 1) * sh.nCopies <= sh.src.size() &&
+                (m_dstIndex + 1) * sh.nCopies <= sh.dst.size() );
+    const DtOsDataTypes::Offset
+      *src = &sh.src[m_srcIndex * sh.nCopies],
+      *dst = &sh.dst[m_dstIndex * sh.nCopies];
+    if ( std::equal( sh.curSrc.begin(), sh.curSrc.end(), src ) &&
+         std::equal( sh.curDst.begin(), sh.curDst.end(), dst ) ) {
+      continue;
+    }
+
+    // The request may still be moving the previous buffers
+    while ( m_xferReq[n]->getStatus() != 0 ) {
+      OCPI::OS::sleep( 0 );
+    }
+    m_xferReq[n]->modify( sh.nCopies, &sh.curSrc[0], &sh.curDst[0], src, dst );
+    std::copy( src, src + sh.nCopies, sh.curSrc.begin() );
+    std::copy( dst, dst + sh.nCopies, sh.curDst.begin() );
+  }
+}
+
+
 /**********************************
  * Is this transfer complete
  *********************************/
@@ -277,6 +336,7 @@ produce()
   }
 
   // Remote transfers
+  retarget();
   for ( OCPI::OS::uint32_t n=0; n<n_transfers; n++ ) {
     m_xferReq[n]->post();
   }
@@ -312,6 +372,7 @@ consume()
   }
 
   // Remote transfers
+  retarget();
   for ( OCPI::OS::uint32_t n=0; n<n_transfers; n++ ) {
     m_xferReq[n]->post();
   }
@@ -325,6 +386,16 @@ consume()
  *********************************/
 void OcpiTransferTemplate::modify(DtOsDataTypes::Offset new_off[], DtOsDataTypes::Offset old_off[] )
 {
+  // A shared template changes the data source offset of the selected source buffer,
+  // the data copy being the first copy of each request.
+  if ( isShared() ) {
+    for ( OCPI::OS::uint32_t n=0; n<m_shared.size(); n++ ) {
+      DtOsDataTypes::Offset &off = m_shared[n].src[m_srcIndex * m_shared[n].nCopies];
+      old_off[0] = off;
+      off = new_off[0];
+    }
+    return;
+  }
   for ( OCPI::OS::uint32_t n=0; n<n_transfers; n++ ) {
     m_xferReq[n]->modify( new_off, old_off );
   }
@@ -55,7 +55,6 @@ namespace OCPI {
 static uint32_t         g_nextCircuitId=0;
 
 OU::VList   Transport::m_cached_transfers;
-OU::VList   Transport::active_transfers;
 
 struct TransferDesc_ {
   XF::XferRequest*  xfer;
@@ -69,7 +68,7 @@ typedef struct TransferDesc_ TransferDesc;
 Transport::
 Transport( TransportGlobal* tpg, bool uses_mailboxes, OCPI::Time::Emit * parent  )
   : OCPI::Time::Emit(parent, "Transport"), m_defEndpoint(NULL),
-    m_uses_mailboxes(uses_mailboxes), m_mutex(*new OS::Mutex(true)),
+    m_uses_mailboxes(uses_mailboxes), m_nInFlight(0), m_mutex(*new OS::Mutex(true)),
     m_nextCircuitId(0), m_CSendpoint(NULL), m_CScomms(NULL), m_transportGlobal(tpg)
 {
   OU::AutoMutex guard ( m_mutex, true ); 
@@ -79,7 +78,7 @@ Transport( TransportGlobal* tpg, bool uses_mailboxes, OCPI::Time::Emit * parent
 Transport::
 Transport( TransportGlobal* tpg, bool uses_mailboxes )
   : OCPI::Time::Emit("Transport"), m_defEndpoint(NULL),
-    m_uses_mailboxes(uses_mailboxes), m_mutex(*new OS::Mutex(true)),
+    m_uses_mailboxes(uses_mailboxes), m_nInFlight(0), m_mutex(*new OS::Mutex(true)),
     m_nextCircuitId(0), m_CSendpoint(NULL), m_CScomms(NULL), m_transportGlobal(tpg)
 {
   OU::AutoMutex guard ( m_mutex, true ); 
@@ -190,11 +189,10 @@ Transport::~Transport()
   }
   m_cached_transfers.destroyList();
 
-  for ( m=0; m<active_transfers.size();  m++ ) {
-    XF::XferRequest* xr = static_cast<XF::XferRequest*>(active_transfers[m]);
-    delete xr;
-  }
-  active_transfers.destroyList();
+  for (CompletionQueues::iterator i = m_completions.begin(); i != m_completions.end(); i++)
+    for (Completions::iterator r = i->second.begin(); r != i->second.end(); r++)
+      delete *r;
+  m_completions.clear();
 
   for ( m=0; m<m_mailbox_locks.size(); m++ ) {
     MailBoxLock* mb = static_cast<MailBoxLock*>(m_mailbox_locks[m]);
@@ -525,16 +523,24 @@ void Transport::dispatch(XF::EventManager*)
 {
   OU::AutoMutex guard ( m_mutex, true ); 
 
-  // move data from queue if possible
-  CircuitsIter cit;
-  for ( cit=m_circuits.begin(); cit!=m_circuits.end(); cit++) {
-    if ( (*cit) == NULL ) continue;
-    if ( (*cit)->ready() ) {
-      // (*cit)->initializeDataTransfers();
-      (*cit)->checkQueuedTransfers();
+  // move data from queue if possible.  Transfers started here can queue more, and
+  // add circuits to the end of the list.
+  for (size_t n = 0; n < m_busyCircuits.size(); ) {
+    Circuit *c = m_busyCircuits[n];
+    if (c->ready())
+      c->checkQueuedTransfers();
+    if (c->hasQueuedTransfers())
+      n++;
+    else {
+      c->m_busy = false;
+      m_busyCircuits[n] = m_busyCircuits.back();
+      m_busyCircuits.pop_back();
     }
   }
 
+  if (m_nInFlight)
+    reclaimCompletions();
+
   // handle mailbox requests
   if ( m_uses_mailboxes )
     checkMailBoxes();
@@ -543,6 +549,42 @@ void Transport::dispatch(XF::EventManager*)
 }
 
 
+void Transport::
+addBusyCircuit(Circuit &circuit) {
+  OU::AutoMutex guard ( m_mutex, true ); 
+  if (!circuit.m_busy) {
+    circuit.m_busy = true;
+    m_busyCircuits.push_back(&circuit);
+  }
+}
+
+void Transport::
+removeBusyCircuit(Circuit &circuit) {
+  OU::AutoMutex guard ( m_mutex, true ); 
+  if (circuit.m_busy) {
+    circuit.m_busy = false;
+    m_busyCircuits.erase(std::find(m_busyCircuits.begin(), m_busyCircuits.end(), &circuit));
+  }
+}
+
+// Delete the requests that have completed, stopping at the first one still in flight to
+// each endpoint
+void Transport::
+reclaimCompletions() {
+  for (CompletionQueues::iterator i = m_completions.begin(); i != m_completions.end(); ) {
+    Completions &q = i->second;
+    while (!q.empty() && q.front()->getStatus() == 0) {
+      delete q.front();
+      q.pop_front();
+      m_nInFlight--;
+    }
+    if (q.empty())
+      m_completions.erase(i++);
+    else
+      i++;
+  }
+}
+
 void Transport::
 clearRemoteMailbox(size_t offset, XF::EndPoint* loc )
 {
@@ -614,17 +656,6 @@ sendOffsets( OU::VList& offsets, XF::EndPoint &remote_ep,
 {
   OU::AutoMutex guard ( m_mutex, true ); 
 
- FORSTART:
-
-  for ( uint32_t m=0; m<active_transfers.getElementCount();  m++ ) {
-    XF::XferRequest* xr = static_cast<XF::XferRequest*>(active_transfers[m]);
-    if ( xr->getStatus() == 0 ) {
-      XF::XferRequest* for_delete = xr;
-      active_transfers.remove( xr );
-      delete for_delete;
-      goto FORSTART;
-    }
-  }
   /* Attempt to get or make a transfer template */
   XF::XferServices* ptemplate = 
     XF::getManager().getService( m_CSendpoint, 
@@ -660,7 +691,8 @@ sendOffsets( OU::VList& offsets, XF::EndPoint &remote_ep,
 
   }
   ptransfer->post();
-  active_transfers.push_back( ptransfer );
+  m_completions[&remote_ep].push_back( ptransfer );
+  m_nInFlight++;
 }
 
 /**********************************
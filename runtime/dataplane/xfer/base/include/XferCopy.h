@@ -0,0 +1,41 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XFER_COPY_H
+#define XFER_COPY_H
+#include <stddef.h>
+
+namespace DataTransfer {
+  // The memory copy engine used for programmed I/O transfers.
+  // The implementation is chosen on first use according to what the CPU supports
+  // (AVX-512, AVX2, SSE2 or generic), or forced by the OCPI_COPY_ENGINE environment
+  // variable.  Copies of at least nonTemporalThreshold() bytes use stores that bypass the
+  // cache so huge buffers do not evict everything else; the OCPI_COPY_NT_THRESHOLD
+  // environment variable overrides the default.  Copies of 8 bytes or less that are
+  // naturally aligned are done with a single store, so flags are written atomically.
+  // The source and destination must not overlap.
+  void copyMemory(void *dst, const void *src, size_t nBytes);
+  void zeroMemory(void *dst, size_t nBytes);
+  const char *copyEngine();
+  size_t nonTemporalThreshold();
+  // For benchmarks: force the engine by name, returning false if it is not supported
+  bool setCopyEngine(const char *name);
+}
+#endif
@@ -22,11 +22,20 @@
 #define XFER_EVENT_H
 
 namespace DataTransfer {
-  enum ReturnStatus { EventTimeout };
+  enum ReturnStatus { EventSuccess, EventTimeout };
+  // A wakeup channel for a thread that would otherwise spin waiting for data plane activity.
+  // Any thread may notify.  A notification that arrives while nobody is waiting is
+  // remembered, so the next wait returns immediately and wakeups are never lost.
+  // Only the first notification of each wait cycle costs a system call.
   class EventManager {
+    int m_readFd, m_writeFd; // the same eventfd on linux, a pipe elsewhere
+    volatile bool m_pending;
   public:
-    EventManager(int /*low_range*/, int /*high_range*/){};
-    ReturnStatus waitForEvent( unsigned /*timeout_us*/ ){ return EventTimeout; };
+    EventManager(int low_range = 0, int high_range = 0);
+    ~EventManager();
+    void notify();
+    // Wait for a notification, for at most timeout_us microseconds
+    ReturnStatus waitForEvent(unsigned timeout_us);
   };
 }
 #endif
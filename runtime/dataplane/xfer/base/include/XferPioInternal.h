@@ -59,5 +59,6 @@ extern int32_t xfer_pio_group(PIO_transfer *, int32_t, PIO_transfer *);
 extern int32_t xfer_pio_release(PIO_transfer);
 extern int32_t xfer_pio_destroy(PIO_template);
 extern void xfer_pio_modify( PIO_transfer, int,  DtOsDataTypes::Offset*,  DtOsDataTypes::Offset* );
+extern void xfer_pio_move(PIO_template, PIO_transfer, DtOsDataTypes::Offset, DtOsDataTypes::Offset);
 
 #endif /* !defined XFER_INTERNAL_H */
@@ -106,6 +106,22 @@ namespace DataTransfer {
     virtual void modify(Offset new_offsets[],
 			Offset old_offsets[] );
 
+    /*
+     * Move copies of this request to other source and destination offsets,
+     * so that one request can serve several buffers.
+     *        Arguments:
+     *     n         - number of copies to move
+     *     old_src[] - current source offset of each copy
+     *     old_dst[] - current destination offset of each copy
+     *     new_src[] - source offset to move each copy to
+     *     new_dst[] - destination offset to move each copy to
+     *
+     *        Returns:
+     *    false if this driver's requests cannot be modified this way
+     */
+    virtual bool modify(size_t n, const Offset old_src[], const Offset old_dst[],
+			const Offset new_src[], const Offset new_dst[]);
+
 
     /*
      * Create a transfer request.
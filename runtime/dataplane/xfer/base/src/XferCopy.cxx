@@ -0,0 +1,270 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The memory copy engine for programmed I/O transfers.
+ *
+ * Each engine copies (or zero-fills) with the widest vector registers it has: the
+ * unaligned first and last vectors are done with unaligned accesses that may overlap the
+ * middle, and the middle is done with destination-aligned stores, streaming around the
+ * cache for large copies.  Copies no wider than a vector are done with at most two
+ * (possibly overlapping) scalar or vector accesses.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+#include "OcpiOsAssert.h"
+#include "XferCopy.h"
+
+namespace DataTransfer {
+  namespace {
+    typedef void Copy(uint8_t *dst, const uint8_t *src, size_t nBytes);
+    struct Engine {
+      const char *name;
+      Copy *copy, *zero;
+      bool (*supported)();
+    };
+    size_t s_ntThreshold;
+    // Published only when fully chosen, since copies may start on other threads meanwhile
+    const Engine *s_engine;
+    pthread_once_t s_once = PTHREAD_ONCE_INIT;
+
+    // Up to 16 bytes with two possibly overlapping accesses.
+    template <bool zero> inline void
+    copySmall(uint8_t *d, const uint8_t *s, size_t n) {
+#define OCPI_COPY_SMALL(type)						\
+      type a = 0, b = 0;						\
+      if (!zero) {							\
+	memcpy(&a, s, sizeof(type));					\
+	memcpy(&b, s + n - sizeof(type), sizeof(type));			\
+      }									\
+      memcpy(d, &a, sizeof(type));					\
+      memcpy(d + n - sizeof(type), &b, sizeof(type))
+      if (n >= 8) {
+	OCPI_COPY_SMALL(uint64_t);
+      } else if (n >= 4) {
+	OCPI_COPY_SMALL(uint32_t);
+      } else if (n >= 2) {
+	OCPI_COPY_SMALL(uint16_t);
+      } else if (n)
+	*d = zero ? 0 : *s;
+#undef OCPI_COPY_SMALL
+    }
+
+    template <bool zero> void
+    copyGeneric(uint8_t *d, const uint8_t *s, size_t n) {
+      if (n <= 16)
+	copySmall<zero>(d, s, n);
+      else if (zero)
+	memset(d, 0, n);
+      else
+	memcpy(d, s, n);
+    }
+    bool always() { return true; }
+
+#ifdef __x86_64__
+    // The engines differ only in vector type and width, so they are generated by this macro.
+    // The vector loop is unrolled four times.
+#define OCPI_COPY_ENGINE(name, width, vec, setzero, loadu, storeu, store, stream) \
+    template <bool zero> inline vec					\
+    load##name(const uint8_t *s) {					\
+      return zero ? setzero() : loadu((const vec *)s);			\
+    }									\
+    template <bool zero> void						\
+    copy##name(uint8_t *d, const uint8_t *s, size_t n) {		\
+      if (n <= width) {							\
+	copy##name##Small<zero>(d, s, n);				\
+	return;								\
+      }									\
+      vec head = load##name<zero>(s), tail = load##name<zero>(s + n - width); \
+      storeu((vec *)d, head);						\
+      storeu((vec *)(d + n - width), tail);				\
+      size_t skip = width - ((uintptr_t)d & (width - 1));		\
+      d += skip, n -= skip;						\
+      if (!zero)							\
+	s += skip;							\
+      /* the last partial or whole vector is already done by the tail */ \
+      n = n > width ? (n - 1) & ~(size_t)(width - 1) : 0;		\
+      if (n >= s_ntThreshold) {						\
+	for (; n >= 4 * width; n -= 4 * width, d += 4 * width, s += zero ? 0 : 4 * width) { \
+	  stream((vec *)d, load##name<zero>(s));			\
+	  stream((vec *)(d + width), load##name<zero>(s + width));	\
+	  stream((vec *)(d + 2 * width), load##name<zero>(s + 2 * width)); \
+	  stream((vec *)(d + 3 * width), load##name<zero>(s + 3 * width)); \
+	}								\
+	for (; n; n -= width, d += width, s += zero ? 0 : width)	\
+	  stream((vec *)d, load##name<zero>(s));			\
+	_mm_sfence();							\
+      } else {								\
+	for (; n >= 4 * width; n -= 4 * width, d += 4 * width, s += zero ? 0 : 4 * width) { \
+	  store((vec *)d, load##name<zero>(s));				\
+	  store((vec *)(d + width), load##name<zero>(s + width));	\
+	  store((vec *)(d + 2 * width), load##name<zero>(s + 2 * width)); \
+	  store((vec *)(d + 3 * width), load##name<zero>(s + 3 * width)); \
+	}								\
+	for (; n; n -= width, d += width, s += zero ? 0 : width)	\
+	  store((vec *)d, load##name<zero>(s));				\
+      }									\
+    }
+
+    template <bool zero> inline void
+    copySSE2Small(uint8_t *d, const uint8_t *s, size_t n) {
+      copySmall<zero>(d, s, n);
+    }
+    OCPI_COPY_ENGINE(SSE2, 16, __m128i, _mm_setzero_si128, _mm_loadu_si128, _mm_storeu_si128,
+		     _mm_store_si128, _mm_stream_si128)
+    bool hasSSE2() { return true; } // always on x86_64
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+    template <bool zero> inline void
+    copyAVX2Small(uint8_t *d, const uint8_t *s, size_t n) {
+      if (n <= 16)
+	copySmall<zero>(d, s, n);
+      else {
+	__m128i
+	  a = zero ? _mm_setzero_si128() : _mm_loadu_si128((const __m128i *)s),
+	  b = zero ? _mm_setzero_si128() : _mm_loadu_si128((const __m128i *)(s + n - 16));
+	_mm_storeu_si128((__m128i *)d, a);
+	_mm_storeu_si128((__m128i *)(d + n - 16), b);
+      }
+    }
+    OCPI_COPY_ENGINE(AVX2, 32, __m256i, _mm256_setzero_si256, _mm256_loadu_si256,
+		     _mm256_storeu_si256, _mm256_store_si256, _mm256_stream_si256)
+#pragma GCC pop_options
+    bool hasAVX2() { return __builtin_cpu_supports("avx2"); }
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+    template <bool zero> inline void
+    copyAVX512Small(uint8_t *d, const uint8_t *s, size_t n) {
+      if (n <= 32)
+	copyAVX2Small<zero>(d, s, n);
+      else {
+	__m256i
+	  a = zero ? _mm256_setzero_si256() : _mm256_loadu_si256((const __m256i *)s),
+	  b = zero ? _mm256_setzero_si256() : _mm256_loadu_si256((const __m256i *)(s + n - 32));
+	_mm256_storeu_si256((__m256i *)d, a);
+	_mm256_storeu_si256((__m256i *)(d + n - 32), b);
+      }
+    }
+    inline __m512i loadu512(const __m512i *p) { return _mm512_loadu_si512(p); }
+    inline void storeu512(__m512i *p, __m512i v) { _mm512_storeu_si512(p, v); }
+    inline void store512(__m512i *p, __m512i v) { _mm512_store_si512(p, v); }
+    OCPI_COPY_ENGINE(AVX512, 64, __m512i, _mm512_setzero_si512, loadu512, storeu512, store512,
+		     _mm512_stream_si512)
+#pragma GCC pop_options
+    bool hasAVX512() { return __builtin_cpu_supports("avx512f"); }
+#undef OCPI_COPY_ENGINE
+#endif
+
+    // In order of preference
+    const Engine engines[] = {
+#ifdef __x86_64__
+      { "avx512", copyAVX512<false>, copyAVX512<true>, hasAVX512 },
+      { "avx2", copyAVX2<false>, copyAVX2<true>, hasAVX2 },
+      { "sse2", copySSE2<false>, copySSE2<true>, hasSSE2 },
+#endif
+      { "generic", copyGeneric<false>, copyGeneric<true>, always },
+      { NULL, NULL, NULL, NULL }
+    };
+
+    const Engine *
+    findEngine(const char *name) {
+      for (const Engine *e = engines; e->name; e++)
+	if (!strcasecmp(name, e->name))
+	  return e->supported() ? e : NULL;
+      return NULL;
+    }
+    void
+    initialize() {
+      const char *env = getenv("OCPI_COPY_NT_THRESHOLD");
+      if (env)
+	s_ntThreshold = strtoul(env, NULL, 0);
+      else {
+	// Half the last level cache: beyond that the copy would evict most of it anyway.
+	long llc = -1;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+	llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+	if (llc <= 0)
+	  llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+	s_ntThreshold = llc > 0 ? (size_t)llc / 2 : 4*1024*1024;
+      }
+      if (!s_ntThreshold)
+	s_ntThreshold = ~(size_t)0;
+#ifdef __x86_64__
+      __builtin_cpu_init();
+#endif
+      const Engine *e = NULL;
+      if ((env = getenv("OCPI_COPY_ENGINE")) && !(e = findEngine(env)))
+	ocpiBad("The copy engine \"%s\" in OCPI_COPY_ENGINE is unknown or unsupported", env);
+      if (!e)
+	for (e = engines; !e->supported(); e++)
+	  ;
+      ocpiInfo("PIO transfers use the %s copy engine, with non-temporal stores from %zu bytes",
+	       e->name, s_ntThreshold);
+      __atomic_store_n(&s_engine, e, __ATOMIC_RELEASE);
+    }
+    inline const Engine *
+    engine() {
+      const Engine *e = __atomic_load_n(&s_engine, __ATOMIC_ACQUIRE);
+      if (!e) {
+	pthread_once(&s_once, initialize);
+	e = __atomic_load_n(&s_engine, __ATOMIC_ACQUIRE);
+      }
+      return e;
+    }
+  }
+
+  bool
+  setCopyEngine(const char *name) {
+    const Engine *e = findEngine(name);
+    if (!e)
+      return false;
+    engine();
+    __atomic_store_n(&s_engine, e, __ATOMIC_RELEASE);
+    return true;
+  }
+  void
+  copyMemory(void *dst, const void *src, size_t nBytes) {
+    engine()->copy((uint8_t *)dst, (const uint8_t *)src, nBytes);
+  }
+  void
+  zeroMemory(void *dst, size_t nBytes) {
+    engine()->zero((uint8_t *)dst, NULL, nBytes);
+  }
+  const char *
+  copyEngine() {
+    return engine()->name;
+  }
+  size_t
+  nonTemporalThreshold() {
+    engine();
+    return s_ntThreshold;
+  }
+}
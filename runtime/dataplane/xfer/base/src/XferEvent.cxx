@@ -0,0 +1,92 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <poll.h>
+#include <errno.h>
+#include "ocpi-config.h"
+#ifndef OCPI_OS_macos
+#include <sys/eventfd.h>
+#endif
+#include "OcpiOsAssert.h"
+#include "OcpiUtilException.h"
+#include "XferEvent.h"
+
+namespace OU = OCPI::Util;
+namespace DataTransfer {
+
+EventManager::
+EventManager(int /*low_range*/, int /*high_range*/)
+  : m_pending(false) {
+#ifdef OCPI_OS_macos
+  int fds[2];
+  if (pipe(fds))
+    throw OU::Error("Can't create pipe for data plane events: %s", strerror(errno));
+  m_readFd = fds[0];
+  m_writeFd = fds[1];
+#else
+  if ((m_readFd = m_writeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    throw OU::Error("Can't create eventfd for data plane events: %s", strerror(errno));
+#endif
+}
+
+EventManager::
+~EventManager() {
+  close(m_readFd);
+  if (m_writeFd != m_readFd)
+    close(m_writeFd);
+}
+
+void EventManager::
+notify() {
+  if (__sync_bool_compare_and_swap(&m_pending, false, true)) {
+    uint64_t one = 1;
+    ocpiCheck(write(m_writeFd, &one, m_writeFd == m_readFd ? sizeof(one) : 1) > 0);
+  }
+}
+
+ReturnStatus EventManager::
+waitForEvent(unsigned timeout_us) {
+  struct pollfd pfd;
+  pfd.fd = m_readFd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+#ifdef OCPI_OS_macos
+  int n = poll(&pfd, 1, (int)((timeout_us + 999) / 1000));
+#else
+  struct timespec ts;
+  ts.tv_sec = timeout_us / 1000000;
+  ts.tv_nsec = (long)(timeout_us % 1000000) * 1000;
+  int n = ppoll(&pfd, 1, &ts, NULL);
+#endif
+  if (n <= 0)
+    return EventTimeout;
+  uint64_t buf;
+  ocpiCheck(read(m_readFd, &buf, m_writeFd == m_readFd ? sizeof(buf) : 1) > 0);
+  // Only now may a notify write again.  One that raced with the read is not lost since the
+  // caller has yet to look at whatever state it was notified about.
+  __sync_synchronize();
+  m_pending = false;
+  return EventSuccess;
+}
+
+}
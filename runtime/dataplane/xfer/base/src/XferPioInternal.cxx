@@ -23,121 +23,19 @@
 #include "OcpiOsDataTypes.h"
 #include "OcpiOsMisc.h"
 #include "XferEndPoint.h"
+#include "XferCopy.h"
 #include "XferPioInternal.h"
 
 using namespace DataTransfer;
 
-#define USE_BYTE_TRANSFERS
-#ifdef USE_BYTE_TRANSFERS
 void
 xfer_pio_action_transfer(PIO_transfer transfer)
 {
-
-  /* Get the alignments */
-  uint32_t src_al = (uint32_t)((uintptr_t)transfer->src_va & 3);
-  uint32_t dst_al = (uint32_t)((uintptr_t)transfer->dst_va & 3);
-
-  /* Check src and dst alignment */
-  if (src_al != dst_al) {
-    /* 
-     * src and dst addresses don't have same alignment
-     * we will need to transfer everything as bytes.
-     */
-    char *src = (char *)transfer->src_va;
-    char *dst = (char *)transfer->dst_va;
-    size_t nbytes = transfer->nbytes;
-
-    if (src == 0) {
-      for (uint32_t i=0; i < nbytes; i++)
-        *dst++ = 0;
-    }
-    else {
-      for (uint32_t i=0; i < nbytes; i++)
-        *dst++ = *src++;
-    }
-  }
-  else if (src_al > 0) {
-    /*
-     * We need to perform 'src_al' number of byte transfers
-     * before we are word aligned, then we can use word
-     * transfers.
-     */
-    char *src_b = (char *)transfer->src_va;
-    char *dst_b = (char *)transfer->dst_va;
-
-    int32_t *src_w;
-    int32_t *dst_w;
-
-    for (uint32_t i=0; i < src_al; i++)
-      *dst_b++ = *src_b++;
-
-    /* Get the word pointers */
-    src_w = (int32_t *)src_b;
-    dst_w = (int32_t *)dst_b;
-
-    /* Get the word count and remainder */
-    size_t nwords = (transfer->nbytes - src_al) / 4;
-    size_t rem_nwords = (transfer->nbytes - src_al) % 4;
-
-    if (src_w == 0) {
-      for (uint32_t i=0; i < nwords; i++)    
-        *dst_w++ = 0;
-    }
-    else {
-      for (uint32_t i=0; i < nwords; i++)    
-        *dst_w++ = *src_w++;
-    }
-    
-    if (rem_nwords) {
-      /* Set the byte pointers */
-      src_b = (char *)src_w;
-      dst_b = (char *)dst_w;
-
-      /* Process remainder in bytes */
-      if (src_w == 0) {
-        for (uint32_t i=0; i < rem_nwords; i++)
-          *dst_b++ = 0;
-      }
-      else {
-        for (uint32_t i=0; i < rem_nwords; i++)
-          *dst_b++ = *src_b++;
-      }
-    }
-  }
-  else {
-    /* Get the word pointers */
-    int32_t *src_w = (int32_t *)transfer->src_va;
-    int32_t *dst_w = (int32_t *)transfer->dst_va;
-
-    size_t nwords = transfer->nbytes / 4;
-    size_t rem_nwords = transfer->nbytes % 4;
-    ocpiDebug("XFER:0x%p->0x%p %zu %zu", src_w, dst_w, nwords, rem_nwords); 
-
-    if (src_w == 0) {
-      for (uint32_t i=0; i < nwords; i++)    
-        *dst_w++ = 0;
-    }
-    else {
-      for (uint32_t i=0; i < nwords; i++)    
-        *dst_w++ = *src_w++;
-    }
-    
-    if (rem_nwords) {
-      /* Set the byte pointers */
-      char *src_b = (char *)src_w;
-      char *dst_b = (char *)dst_w;
-
-      /* Process remainder in bytes */
-      if (src_w == 0) {
-        for (uint32_t i=0; i < rem_nwords; i++)
-          *dst_b++ = 0;
-      }
-      else {
-        for (uint32_t i=0; i < rem_nwords; i++)
-          *dst_b++ = *src_b++;
-      }
-    }
-  }
+  // A null source means the destination is zero-filled
+  if (transfer->src_va)
+    copyMemory(transfer->dst_va, transfer->src_va, transfer->nbytes);
+  else
+    zeroMemory(transfer->dst_va, transfer->nbytes);
 
   //#define TRACE_PIO_XFERS  
 #ifdef TRACE_PIO_XFERS
@@ -149,80 +47,6 @@ xfer_pio_action_transfer(PIO_transfer transfer)
 #endif
 
 }
-#else
-#error unexpected
-void
-xfer_pio_action_transfer(PIO_transfer transfer)
-{
-  uint32_t nwords = ((transfer->nbytes + 5) / 8) ;
-
-#ifdef DEBUG
-  {
-        unsigned int M=50;
-        char* c=(char*)src;
-        printf("\n\nSource Data(0x%x) Target(0x%x):\n", src, dst );
-        for (int n=0; n<M; n++ ) {
-                printf("%d ", c[n]);
-        }
-  }
-#endif
-
-
-
-#ifdef IP_DEBUG_SUPPORT
-  if ( nwords == 1 ) {
-    int32_t *src1 = (int32_t *)transfer->src_va;
-    int32_t *dst1 = (int32_t *)transfer->dst_va;    
-    //    if ( ((src1[0] < 3) && (src1[1] < 3)) || ((src1[0] > 2048) && (src1[1] > 2048)) )  {
-    if ( ((src1[0] < 3) && (src1[1] < 3)) || ((src1[0] > 2048) && (src1[1] > 2048)) )  {
-
-      /*
-      if ( (src1[0] == 1 ) || (src1[1] == 1 ) ) {
-        printf("patching flag 1->0 \n");
-        dst[0] = 1;
-      }
-      else {
-        dst1[0] = 0;
-      }
-      */
-      
-      dst1[0] = 1;
-      //      dst1[1] = 1;
-    }
-    else {
-      dst1[0] = src1[0];
-    }
-  }
-  else {
-    int32_t *src1 = (int32_t *)transfer->src_va;
-    int32_t *dst1 = (int32_t *)transfer->dst_va;    
-    for (int32_t i=0; i < nwords*2; i++) {
-      dst1[i] = src1[i];
-    }
-  }
-#endif
-
-
-
-  int32_t *src1 = (int32_t *)transfer->src_va;
-  int32_t *dst1 = (int32_t *)transfer->dst_va;    
-
-  //#define TRACE_PIO_XFERS  
-#ifdef TRACE_PIO_XFERS
-  printf("^^^^ copying %d bytes from %llx to %llx\n", transfer->nbytes,transfer->src_off,transfer->dst_off);
-  printf("source wrd 1 = %d, %d\n", src1[0], src1[1] );
-  printf("dst va = %p\n", dst1 );
-#endif
-
-
-  for (uint32_t i=0; i < nwords*2; i++) {
-    dst1[i] = src1[i];
-  }
-  
-  
-  
-}
-#endif
 
 
 int32_t
@@ -262,6 +86,22 @@ xfer_pio_modify( PIO_transfer transfer, int,  DtOsDataTypes::Offset *noff,  DtOs
   transfer->src_va = (char*)transfer->src_va + *noff;
 }
 
+// Point an existing transfer at other offsets, mapping them as xfer_pio_copy does
+void
+xfer_pio_move(PIO_template pio_template, PIO_transfer transfer, DtOsDataTypes::Offset src_os,
+	      DtOsDataTypes::Offset dst_os)
+{
+#if CONTIGUOUS_MAP
+  transfer->src_va = ((char *)pio_template->src_va + src_os);
+  transfer->dst_va = ((char *)pio_template->dst_va + dst_os);
+#else
+  transfer->src_va = pio_template->s_smem->mapTx(src_os, transfer->nbytes);
+  transfer->dst_va = pio_template->t_smem->mapRx(dst_os, transfer->nbytes);
+#endif
+  transfer->src_off = src_os;
+  transfer->dst_off = dst_os;
+}
+
 
 
 int32_t
@@ -113,6 +113,28 @@ modify(Offset new_offsets[], Offset old_offsets[]) {
   }
 }
 
+// Copies are found by their current offsets since grouping does not keep them in the
+// order they were added.  Drivers with their own copy() have no PIO transfers here.
+bool XferRequest::
+modify(size_t n, const Offset old_src[], const Offset old_dst[],
+       const Offset new_src[], const Offset new_dst[]) {
+  struct xf_transfer_ *xf_transfer = (struct xf_transfer_ *)m_thandle;
+  if (!xf_transfer || xf_transfer->xf_template->type != PIO)
+    return false;
+  PIO_transfer lists[] = {
+    xf_transfer->first_pio_transfer, xf_transfer->pio_transfer, xf_transfer->last_pio_transfer
+  };
+  for (unsigned l = 0; l < sizeof(lists)/sizeof(lists[0]); l++)
+    for (PIO_transfer t = lists[l]; t; t = t->next)
+      for (size_t i = 0; i < n; i++)
+	if (t->src_off == old_src[i] && t->dst_off == old_dst[i]) {
+	  if (new_src[i] != old_src[i] || new_dst[i] != old_dst[i])
+	    xfer_pio_move(xf_transfer->xf_template->pio_template, t, new_src[i], new_dst[i]);
+	  break;
+	}
+  return true;
+}
+
 void XferRequest::
 action_transfer(PIO_transfer pio_transfer, bool) {
   xfer_pio_action_transfer(pio_transfer);
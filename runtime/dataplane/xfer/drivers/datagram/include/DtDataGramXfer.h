@@ -22,7 +22,7 @@
 #define DataTransfer_DATAGRAMTransfer_H_
 
 
-#include <deque>
+#include <map>
 #include <vector>
 #include "OcpiOsIovec.h"
 #include "OcpiThread.h"
@@ -88,9 +88,68 @@ protected:
   void stop() { m_loop = false; join(); }
 };
 
+// Retransmission timeout estimated from acknowledged frames' round trips as TCP does
+// (RFC 6298): a smoothed RTT plus four times its mean deviation, with exponential backoff
+// while frames keep timing out.  Times are in OCPI::OS::Time units (1/2^32 seconds).
+class RetransmitTimer {
+  uint64_t m_srtt, m_rttvar, m_rto, m_min, m_max;
+  bool     m_sampled;
+public:
+  RetransmitTimer(uint64_t initial, uint64_t min, uint64_t max)
+    : m_srtt(0), m_rttvar(0), m_rto(initial), m_min(min), m_max(max), m_sampled(false) {}
+  // Only sample frames that were sent once, since an ack for a resent frame is ambiguous
+  void sample(uint64_t rtt) {
+    if (m_sampled) {
+      uint64_t err = rtt > m_srtt ? rtt - m_srtt : m_srtt - rtt;
+      m_rttvar = m_rttvar - m_rttvar/4 + err/4;
+      m_srtt = m_srtt - m_srtt/8 + rtt/8;
+    } else {
+      m_srtt = rtt;
+      m_rttvar = rtt/2;
+      m_sampled = true;
+    }
+    m_rto = m_srtt + 4 * m_rttvar;
+    if (m_rto < m_min)
+      m_rto = m_min;
+    else if (m_rto > m_max)
+      m_rto = m_max;
+  }
+  void backoff() { m_rto = m_rto * 2 > m_max ? m_max : m_rto * 2; }
+  uint64_t rto() const { return m_rto; }
+  uint64_t srtt() const { return m_srtt; }
+};
+
+// The number of unacknowledged frames a sender may have outstanding.  It grows by one per
+// ack up to the threshold (slow start), then by one per window's worth of acks, and is
+// halved when frames time out, so a lossy link gets fewer duplicates rather than more.
+class Window {
+  unsigned m_size, m_threshold, m_credit, m_max;
+public:
+  static const unsigned MIN = 2;
+  Window(unsigned initial, unsigned max)
+    : m_size(initial), m_threshold(max), m_credit(0), m_max(max) {}
+  unsigned size() const { return m_size; }
+  void acked() {
+    if (m_size >= m_max)
+      return;
+    if (m_size < m_threshold)
+      m_size++;
+    else if (++m_credit >= m_size) {
+      m_credit = 0;
+      m_size++;
+    }
+  }
+  void lost(unsigned inFlight) {
+    m_threshold = inFlight/2 > MIN ? inFlight/2 : MIN;
+    m_size = m_threshold;
+    m_credit = 0;
+  }
+};
+
 static const int MAX_MSGS = 10;  // FIXME can be calulated
+static const unsigned MAX_BATCH = 32; // most frames passed to sendBatch or receiveBatch
 struct Frame {
-  uint64_t             send_time;
+  uint64_t             send_time;    // OCPI::OS::Time units
   uint16_t             msg_start, msg_count;
   bool                 is_free;
   int                  resends;
@@ -111,12 +170,27 @@ class Socket : public OCPI::Util::Thread {
   DGEndPoint   &m_lep;
   bool          m_run;
   bool          m_joined;
+  unsigned      m_dropPpm;     // received frames to drop per million, for testing
+  uint64_t      m_dropped;
 public:  
-  Socket(DGEndPoint &lep) : m_lep(lep), m_run(true), m_joined(false) {}
+  Socket(DGEndPoint &lep)
+    : m_lep(lep), m_run(true), m_joined(false), m_dropPpm(0), m_dropped(0) {}
   virtual ~Socket();
   virtual void send(Frame &frame) = 0;
+  // Send several frames, which drivers override when they can use fewer system calls
+  virtual void sendBatch(Frame **frames, unsigned nFrames) {
+    for (unsigned n = 0; n < nFrames; n++)
+      send(*frames[n]);
+  }
   // return bytes read and offset in buffer to use.  Returning zero is timeout
   virtual size_t receive(uint8_t *buf, size_t &offset) = 0;
+  // Receive up to nBufs frames into consecutive buffers of bufSize bytes, waiting only for
+  // the first.  Return how many were received, zero on timeout.
+  virtual unsigned receiveBatch(uint8_t *bufs, size_t bufSize, unsigned nBufs,
+				size_t *lengths, size_t *offsets) {
+    (void)bufSize; (void)nBufs;
+    return (lengths[0] = receive(bufs, offsets[0])) ? 1 : 0;
+  }
   virtual uint16_t maxPayloadSize()=0;  // Maximum message size, total bytes
   virtual void start() = 0;
   inline void stop() { m_run = false; }
@@ -162,6 +236,7 @@ public:
   OCPI::OS::int32_t unMap() { return 0;}
   //  Socket *&socketServer() { return m_socket;}
   inline void send(Frame &frame) { m_socket->send(frame); }
+  inline void send(Frame **frames, unsigned nFrames) { m_socket->sendBatch(frames, nFrames); }
   void start() {
     if (m_socket)
       m_socket->start();
@@ -189,13 +264,18 @@ struct Transaction {
   unsigned            m_nMessagesRx;
   uint32_t            m_tid;
   std::vector<Message>   m_messages;
+  // Until it completes, the connection sending it.  While queued there for the window to
+  // open, the next message to put in a frame and the next transaction in the queue.
+  XferServices       *m_sender;
+  bool                m_queued;
+  unsigned            m_nextMsg;
+  Transaction        *m_nextPending;
   inline bool init() {return m_init;}
   unsigned msgCount() {return m_nMessagesTx;}
   Transaction() 
-    : m_init(false), m_nMessagesTx(0), m_nMessagesRx(0) {}
-  ~Transaction(){
-    ///FIXME: *********** free up the frames involved with this transaction      
-  }
+    : m_init(false), m_nMessagesTx(0), m_nMessagesRx(0), m_sender(NULL), m_queued(false),
+      m_nextMsg(0), m_nextPending(NULL) {}
+  ~Transaction();
   // nMessages is the estimated number of messages EXCLUSIVE of the flag transfer
   void init(size_t nMessages);
   void add(uint8_t * src, DtOsDataTypes::Offset dst_offset, size_t length);
@@ -257,11 +337,19 @@ public:
   Frame &getFrame(size_t &bytes_left);
   void releaseFrame(unsigned seq);
   void post(Frame &t);
+  void post(Frame **frames, unsigned nFrames);
+  // Queue a transaction to be sent as the window allows
+  void post(Transaction &t);
+  // Forget a transaction being destroyed, including any of its frames still in flight
+  void cancel(Transaction &t);
   void processFrame(FrameHeader *frame);
-  void checkAcks(uint64_t time, uint64_t timeout);
-  void sendAcks(uint64_t time_now, uint64_t timeout);
+  // Retransmit frames not acknowledged within the retransmission timeout
+  void checkAcks(uint64_t time_now);
+  // Send frames carrying any acknowledgements not yet piggybacked on outgoing frames
+  void sendAcks();
 
 private:
+  void pump();
   struct FrameRecord {
     bool     acked;
     uint32_t id;
@@ -269,20 +357,27 @@ private:
   };
 
   struct MsgTransactionRecord {
-    uint32_t   transactionId;
     uint16_t   numMsgsInTransaction;
     uint16_t   msgsProcessed;
-    bool       in_use;
-    MsgTransactionRecord():in_use(false){}
+    MsgTransactionRecord():numMsgsInTransaction(0),msgsProcessed(0){}
   };
+  // Acks to send are kept in arrival order in a ring, so runs of them can be sent together
+  static const unsigned ACK_RING = 2 * (FRAME_SEQ_MASK + 1);
 
   std::vector<Frame>       m_freeFrames;
-  std::deque<uint16_t>     m_acks;
+  uint16_t                 m_acks[ACK_RING];
+  unsigned                 m_ackHead, m_ackTail;
   uint16_t                 m_frameSeq;
   std::vector<FrameRecord> m_frameSeqRecord;
-  std::vector<MsgTransactionRecord> m_msgTransactionRecord;
-  uint64_t m_last_ack_send;
-  unsigned m_frames_in_play;
+  // Received transactions that are not yet complete, by transaction id
+  std::map<uint32_t, MsgTransactionRecord> m_msgTransactionRecord;
+  Transaction             *m_pendingHead, *m_pendingTail;
+  unsigned                 m_inFlight;   // frames with messages not yet acknowledged
+  Window                   m_window;
+  RetransmitTimer          m_rto;
+  // Statistics
+  uint64_t                 m_framesSent, m_retransmits, m_timeouts, m_framesReceived,
+                           m_duplicates;
 };
   }
 }
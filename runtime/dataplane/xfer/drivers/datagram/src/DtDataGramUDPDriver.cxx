@@ -121,12 +121,6 @@ namespace DataTransfer {
       bool        m_error;
     public:
       Socket(EndPoint &lep) : DG::Socket(lep), m_lep(lep), m_error(false) {
-	m_msghdr.msg_namelen = sizeof(struct sockaddr_in);
-	m_msghdr.msg_iov = 0;
-	m_msghdr.msg_iovlen = 0;
-	m_msghdr.msg_control = 0;
-	m_msghdr.msg_controllen = 0;
-	m_msghdr.msg_flags = 0;    
       }
       uint16_t maxPayloadSize() { return DATAGRAM_PAYLOAD_SIZE; }
     public:
@@ -149,14 +143,34 @@ namespace DataTransfer {
 	OCPI::Util::Thread::start();
       }
 
-      void send(DG::Frame &frame) {
-	// FIXME: multithreaded..
+      // The header is per call since frames are sent from several threads
+      static void setMsgHdr(struct msghdr &msg, DG::Frame &frame) {
 	EndPoint *dep = static_cast<EndPoint *>(frame.endpoint);
-	m_msghdr.msg_name = &dep->sockaddr();
+	msg.msg_name = &dep->sockaddr();
+	msg.msg_namelen = sizeof(struct sockaddr_in);
 	// We are depending on structure compatibility
-	m_msghdr.msg_iov = (struct iovec *)frame.iov;
-	m_msghdr.msg_iovlen = frame.iovlen;
-	m_server.sendmsg(&m_msghdr, 0);
+	msg.msg_iov = (struct iovec *)frame.iov;
+	msg.msg_iovlen = frame.iovlen;
+	msg.msg_control = 0;
+	msg.msg_controllen = 0;
+	msg.msg_flags = 0;
+      }
+      void send(DG::Frame &frame) {
+	struct msghdr msg;
+	setMsgHdr(msg, frame);
+	m_server.sendmsg(&msg, 0);
+      }
+      // Sent from several threads, so the headers are on the stack, not in members
+      void sendBatch(DG::Frame **frames, unsigned nFrames) {
+	struct msghdr msgs[DG::MAX_BATCH];
+	while (nFrames) {
+	  unsigned nMsgs = nFrames < DG::MAX_BATCH ? nFrames : DG::MAX_BATCH;
+	  for (unsigned n = 0; n < nMsgs; n++)
+	    setMsgHdr(msgs[n], *frames[n]);
+	  m_server.sendmmsg(msgs, nMsgs, 0);
+	  frames += nMsgs;
+	  nFrames -= nMsgs;
+	}
       }
       size_t
       receive(uint8_t *buffer, size_t &offset) {
@@ -175,9 +189,26 @@ namespace DataTransfer {
 #endif
 	return n;
       }
+      unsigned
+      receiveBatch(uint8_t *buffers, size_t bufSize, unsigned nBufs, size_t *lengths,
+		   size_t *offsets) {
+	if (nBufs > DG::MAX_BATCH)
+	  nBufs = DG::MAX_BATCH;
+	memset(m_rxMsgs, 0, nBufs * sizeof(*m_rxMsgs));
+	for (unsigned n = 0; n < nBufs; n++) {
+	  m_rxIovs[n].iov_base = buffers + n * bufSize;
+	  m_rxIovs[n].iov_len = DATAGRAM_PAYLOAD_SIZE;
+	  m_rxMsgs[n].msg_iov = &m_rxIovs[n];
+	  m_rxMsgs[n].msg_iovlen = 1;
+	  offsets[n] = 0;
+	}
+	return m_server.recvmmsg(m_rxMsgs, lengths, nBufs, 0, 200);
+      }
     private:
-      struct msghdr                 m_msghdr;
       OCPI::OS::ServerSocket        m_server;
+      // Only our receiving thread uses these
+      struct msghdr                 m_rxMsgs[DG::MAX_BATCH];
+      struct iovec                  m_rxIovs[DG::MAX_BATCH];
     };
 
     class Device;
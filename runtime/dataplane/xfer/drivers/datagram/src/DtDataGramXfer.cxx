@@ -28,29 +28,48 @@
  *
  */
 
-#include "fasttime.h"
+#include <inttypes.h>
+#include <stdlib.h>
 #include "OcpiOsMisc.h"
 #include "OcpiOsAssert.h"
+#include "OcpiOsTimer.h"
+#include "OcpiUtilException.h"
 #include "OcpiUtilMisc.h"
 #include "DtDataGramXfer.h"
 
 namespace XF = DataTransfer;
 namespace OU = OCPI::Util;
+namespace OS = OCPI::OS;
 namespace DataTransfer {
   namespace DDT = DtOsDataTypes;
   namespace Datagram {
 
 const char *datagramsocket = "datagram-socket"; // name passed to inherited template class
-static const unsigned MAX_TRANSACTION_HISTORY = 512;  // Max records per source
 static const unsigned MAX_FRAME_HISTORY = 0xff; 
+// Frames in flight are limited by the window, which leaves some frame slots for acks
+static const unsigned INITIAL_WINDOW = 16;
+static const unsigned MAX_WINDOW = FRAME_SEQ_MASK + 1 - 32;
+// Frames per batched send or receive
+static const unsigned TX_BATCH = MAX_BATCH;
+static const unsigned RX_BATCH = MAX_BATCH;
+// Retransmission timeouts, in OCPI::OS::Time units
+static const uint64_t TICKS_PER_MS = OS::Time::ticksPerSecond / 1000;
+static const uint64_t INITIAL_RTO = 200 * TICKS_PER_MS;
+static const uint64_t MIN_RTO = 2 * TICKS_PER_MS;
+static const uint64_t MAX_RTO = 1000 * TICKS_PER_MS;
+
+static inline uint64_t usecs(uint64_t ticks) {
+  return (ticks * 1000000) >> 32;
+}
 
 XferServices::
 XferServices(XferFactory &driver, EndPoint &source, EndPoint &target)
   : XF::XferServices(driver, source, target),
-    m_freeFrames(FRAME_SEQ_MASK+1), m_frameSeq(1), m_frameSeqRecord(MAX_FRAME_HISTORY+1),
-    m_msgTransactionRecord(MAX_TRANSACTION_HISTORY)
+    m_freeFrames(FRAME_SEQ_MASK+1), m_ackHead(0), m_ackTail(0), m_frameSeq(1),
+    m_frameSeqRecord(MAX_FRAME_HISTORY+1), m_pendingHead(NULL), m_pendingTail(NULL),
+    m_inFlight(0), m_window(INITIAL_WINDOW, MAX_WINDOW), m_rto(INITIAL_RTO, MIN_RTO, MAX_RTO),
+    m_framesSent(0), m_retransmits(0), m_timeouts(0), m_framesReceived(0), m_duplicates(0)
 {
-    m_last_ack_send = fasttime_getticks(); // thanks valgrind...
 }
 
 XferFactory::
@@ -135,81 +154,117 @@ group(XF::XferRequest*xr) {
 XferServices::
 ~XferServices() {
   ocpiDebug("DatagramXferServices::~DatagramXferServices entered");
+  if (m_framesSent || m_framesReceived)
+    ocpiInfo("Datagram connection %s -> %s: frames sent %" PRIu64 ", resent %" PRIu64
+	     " after %" PRIu64 " timeouts, received %" PRIu64 ", duplicates %" PRIu64
+	     ", smoothed RTT %" PRIu64 " usecs, window %u",
+	     m_from.name().c_str(), m_to.name().c_str(), m_framesSent, m_retransmits,
+	     m_timeouts, m_framesReceived, m_duplicates, usecs(m_rto.srtt()),
+	     m_window.size());
   // Note that members are destroyed before base classes,
   // so our frames are destroyed, and then our children (xferrequests and transactions)
   // which makes sense because frames refer to transactions
   lock();
+  // ... but those transactions must then not try to cancel themselves with us
+  for (Transaction *t = m_pendingHead; t; t = t->m_nextPending)
+    t->m_sender = NULL;
+  for (unsigned n = 0; n < m_freeFrames.size(); n++)
+    if (!m_freeFrames[n].is_free && m_freeFrames[n].transaction)
+      m_freeFrames[n].transaction->m_sender = NULL;
 }
 
 void XferServices::
 post(Frame & frame) {
-  frame.send_time = fasttime_getticks();
-  if (frame.msg_count)
-    frame.frameHdr.flags |= FRAME_FLAG_HAS_MESSAGES;
-  static_cast<SmemServices *>(&m_from.sMemServices())->send(frame);
+  Frame *f = &frame;
+  post(&f, 1);
+}
+
+void XferServices::
+post(Frame **frames, unsigned nFrames) {
+  uint64_t now = OS::Time::now().bits();
+  for (unsigned n = 0; n < nFrames; n++) {
+    frames[n]->send_time = now;
+    if (frames[n]->msg_count)
+      frames[n]->frameHdr.flags |= FRAME_FLAG_HAS_MESSAGES;
+  }
+  static_cast<SmemServices *>(&m_from.sMemServices())->send(frames, nFrames);
+  m_framesSent += nFrames;
   // If there is nothing to ack (no messages) in this frame, free it as soon as it is sent.
   // The "send" is required to take it and not queue it (or at least copy it).
-  if (!frame.msg_count)
-    frame.release();
+  for (unsigned n = 0; n < nFrames; n++)
+    if (!frames[n]->msg_count)
+      frames[n]->release();
 }
 
 Frame *XferServices::  
 nextFreeFrame() {
   OCPI::Util::SelfAutoMutex guard ( this );
-  uint16_t seq = m_frameSeq++;
-  uint16_t mseq = seq & FRAME_SEQ_MASK;
-  ocpiAssert( mseq < m_freeFrames.size() );
-  Frame & f = m_freeFrames[mseq];
-  ocpiAssert( f.is_free );
-  f.frameHdr.frameSeq = seq;
-  //printf("**** Our Frame Seq = %d\n", f.frameHdr.frameSeq );
-  f.is_free = false;
-  return &f;
+  // Skip sequence numbers whose frames are still waiting for acks.
+  // The window leaves enough free frames that this does not fail.
+  for (unsigned n = 0; n <= FRAME_SEQ_MASK; n++) {
+    uint16_t seq = m_frameSeq++;
+    Frame & f = m_freeFrames[seq & FRAME_SEQ_MASK];
+    if (f.is_free) {
+      f.frameHdr.frameSeq = seq;
+      f.is_free = false;
+      return &f;
+    }
+  }
+  throw OU::Error("No free frames for datagram transfer to %s", m_to.name().c_str());
 }
 
 // Here are frames that we sent that are being ACK'ed
 void XferServices::
 ack(unsigned count, unsigned start) {
-  for ( unsigned n=start; n<(start+count); n++ ) {
-    //      printf("ACKING frame id = %d\n", n);
-    releaseFrame ( n );
-  }
+  for (unsigned n = 0; n < count; n++)
+    releaseFrame((uint16_t)(start + n));
 }
 
 // This is the list of ACK's that we have to send
 void XferServices::
 addFrameAck(FrameHeader *hdr) {
   OCPI::Util::SelfAutoMutex guard ( this );
-  m_acks.push_back( hdr->frameSeq );
-
-  //#define ACK_NOW
-#ifdef ACK_NOW
-  size_t bytes_left;
-  Frame & frame = getFrame( bytes_left );
-  frame.frameHdr.ackOnly = 1;
-  ss    post( frame );
-#endif
-
+  if (m_ackTail - m_ackHead == ACK_RING)
+    sendAcks();
+  m_acks[m_ackTail++ % ACK_RING] = hdr->frameSeq;
 }
 
 void XferServices::
 releaseFrame (unsigned seq) {	
   unsigned mseq = seq & FRAME_SEQ_MASK;
   Frame &f = m_freeFrames[mseq];
-  if (!f.is_free && f.frameHdr.frameSeq == seq)
-    m_freeFrames[mseq].release();
-  else
+  if (!f.is_free && f.frameHdr.frameSeq == seq) {
+    if (f.msg_count) {
+      if (!f.resends)
+	m_rto.sample(OS::Time::now().bits() - f.send_time);
+      m_inFlight--;
+      m_window.acked();
+    }
+    Transaction *t = f.transaction;
+    f.release();
+    if (t && !t->m_queued && t->complete())
+      t->m_sender = NULL;
+  } else
     ocpiDebug("Received ack 0x%x when frame is %s with num 0x%x",
 	      seq, f.is_free ? "free" : "busy", f.frameHdr.frameSeq);
 }
 
 void XferServices::
-sendAcks(uint64_t time_now, uint64_t timeout) {
-  if (m_acks.size() && ( time_now - m_last_ack_send ) > timeout ) {
+sendAcks() {
+  OCPI::Util::SelfAutoMutex guard ( this );
+  Frame *frames[TX_BATCH];
+  unsigned nFrames = 0;
+  // Each frame takes a run of consecutive acks
+  while (m_ackHead != m_ackTail) {
     size_t bytes_left;
-    Frame & frame = getFrame( bytes_left );
-    post( frame );
+    frames[nFrames++] = &getFrame(bytes_left);
+    if (nFrames == TX_BATCH) {
+      post(frames, nFrames);
+      nFrames = 0;
+    }
   }
+  if (nFrames)
+    post(frames, nFrames);
 }
 
 Frame &XferServices::
@@ -229,22 +284,15 @@ getFrame(size_t & bytes_left) {
   frame.endpoint = &m_to;
   frame.iovlen = 0;
 
-  // We will piggyback any pending acks here
-  if ( m_acks.size() ) {
-    m_last_ack_send = fasttime_getticks();
-    frame.frameHdr.ACKStart = m_acks[0];
-    frame.frameHdr.ACKCount++;
-    m_acks.pop_front();
-    for ( unsigned  y=0; y<m_acks.size(); y++ ) {
-      if ( m_acks[y]  == (unsigned)(frame.frameHdr.ACKStart+1)) {
-	m_acks.pop_front();
-	y = 0;
-	frame.frameHdr.ACKCount++;
-	continue;
-      }
-      else {
-	break;
-      }
+  // We will piggyback the oldest run of consecutive pending acks here
+  if (m_ackHead != m_ackTail) {
+    frame.frameHdr.ACKStart = m_acks[m_ackHead++ % ACK_RING];
+    frame.frameHdr.ACKCount = 1;
+    while (m_ackHead != m_ackTail && frame.frameHdr.ACKCount < 0xff &&
+	   m_acks[m_ackHead % ACK_RING] ==
+	   (uint16_t)(frame.frameHdr.ACKStart + frame.frameHdr.ACKCount)) {
+      m_ackHead++;
+      frame.frameHdr.ACKCount++;
     }
   }
 
@@ -262,31 +310,47 @@ getFrame(size_t & bytes_left) {
 
 void XferRequest::
 post() {
-  size_t bytes_left;
-  uint16_t msg = 0;
-  Transaction & t = *this;
-  t.m_nMessagesRx = 0;
-  while ( msg < t.msgCount() ) {
+  parent().post(*static_cast<Transaction *>(this));
+}
 
-    // calculate the next message size
-    //      if ( (int)(sizeof(DatagramMsgHeader) + t.hdrPtr(msg)->dataLen) > bytes_left ) {
-    //	bytes_left = 0;
-    //      }
+// The transaction's frames are sent as the window allows, here or as acks arrive
+void XferServices::
+post(Transaction &t) {
+  OCPI::Util::SelfAutoMutex guard ( this );
+  t.m_nMessagesRx = 0;
+  t.m_nextMsg = 0;
+  t.m_sender = this;
+  if (!t.m_queued) {
+    t.m_queued = true;
+    t.m_nextPending = NULL;
+    if (m_pendingTail)
+      m_pendingTail->m_nextPending = &t;
+    else
+      m_pendingHead = &t;
+    m_pendingTail = &t;
+  }
+  pump();
+}
 
-    Frame & frame = parent().getFrame( bytes_left );
+// Send frames for queued transactions while the window is open
+void XferServices::
+pump() {
+  Frame *frames[TX_BATCH];
+  unsigned nFrames = 0;
+  while (m_pendingHead && m_inFlight < m_window.size()) {
+    Transaction &t = *m_pendingHead;
+    size_t bytes_left;
+    unsigned &msg = t.m_nextMsg;
+    Frame & frame = getFrame( bytes_left );
     frame.transaction = &t;
-    frame.msg_start = msg;	  
+    frame.msg_start = (uint16_t)msg;
 
     // Stuff as many messages into the frame as we can
-    while (bytes_left > 0 && msg < t.msgCount()) {
+    do {
       size_t need = sizeof(MsgHeader) + ((t.hdrPtr(msg)->dataLen + 7) & ~7);
-      if ( bytes_left < need) {
-	ocpiAssert(msg > 0);
-	// Need a new frame
-	t.hdrPtr(msg-1)->nextMsg = false;
-	break;
-      }
-
+      if (frame.msg_count &&
+	  (bytes_left < need || frame.iovlen + 2 > sizeof(frame.iov)/sizeof(frame.iov[0])))
+	break; // Need a new frame
       frame.iov[frame.iovlen].iov_base = (void*) t.hdrPtr(msg);
       frame.iov[frame.iovlen].iov_len = sizeof(MsgHeader);
       frame.iovlen++;
@@ -300,11 +364,52 @@ post() {
       t.hdrPtr(msg)->nextMsg = true;
       msg++;
       frame.msg_count++;
-    }
+    } while (msg < t.msgCount());
     t.hdrPtr(msg-1)->nextMsg = false;
-    parent().post( frame );
-    //      queFrame( frame );	  
-  }	
+    m_inFlight++;
+    if (msg == t.msgCount()) {
+      t.m_queued = false;
+      if (!(m_pendingHead = t.m_nextPending))
+	m_pendingTail = NULL;
+    }
+    frames[nFrames++] = &frame;
+    if (nFrames == TX_BATCH) {
+      post(frames, nFrames);
+      nFrames = 0;
+    }
+  }
+  if (nFrames)
+    post(frames, nFrames);
+}
+
+void XferServices::
+cancel(Transaction &t) {
+  OCPI::Util::SelfAutoMutex guard ( this );
+  if (t.m_queued) {
+    for (Transaction *p = m_pendingHead, *prev = NULL; p; prev = p, p = p->m_nextPending)
+      if (p == &t) {
+	(prev ? prev->m_nextPending : m_pendingHead) = t.m_nextPending;
+	if (m_pendingTail == &t)
+	  m_pendingTail = prev;
+	break;
+      }
+    t.m_queued = false;
+  }
+  for (unsigned n = 0; n < m_freeFrames.size(); n++) {
+    Frame &f = m_freeFrames[n];
+    if (!f.is_free && f.transaction == &t) {
+      f.msg_count = 0; // nothing to ack in the transaction
+      f.release();
+      m_inFlight--;
+    }
+  }
+  t.m_sender = NULL;
+}
+
+Transaction::
+~Transaction() {
+  if (m_sender)
+    m_sender->cancel(*this);
 }
 
 volatile static uint32_t g_txId;
@@ -360,36 +465,39 @@ XferRequest::getStatus() {
 
 void Socket::
 run() {
+  const char *env = getenv("OCPI_DATAGRAM_DROP");
+  // This causes frame drops for testing: the percentage of received frames to ignore
+  if (env)
+    m_dropPpm = (unsigned)(strtod(env, NULL) * 10000);
   try {
+    size_t size = maxPayloadSize();
+    std::vector<uint8_t> bufs(size * RX_BATCH);
+    size_t lengths[RX_BATCH], offsets[RX_BATCH];
+    XferServices *received[RX_BATCH];
+    unsigned seed = 1;
     while ( m_run ) {
-      unsigned size =	maxPayloadSize();
-      uint8_t buf[size];
-      size_t offset;
-      size_t n = receive(buf, offset);
-      if (n == 0)
-	continue; // zero is timeout
-      // This causes a frame drop for testing
-      //#define DROP_FRAME
-#ifdef DROP_FRAME
-      const char* env = getenv("OCPI_Datagram_DROP_FRAMES");
-      if ( env != NULL ) 
-	{
-	  static int dropit=1;
-	  static int dt = 300;
-	  static int m = 678900;
-	  if ( dt && (((++dropit)%m)==0) ) {
-	    printf("\n\n\n DROP A PACKET FOR TESTING \n\n\n");
-	    dt--;
-	    m = 500000 + rand()%10000;
-	    continue;
-	  }
+      unsigned nFrames = receiveBatch(&bufs[0], size, RX_BATCH, lengths, offsets);
+      unsigned nReceived = 0;
+      for (unsigned n = 0; n < nFrames; n++) {
+	if (m_dropPpm && (unsigned)rand_r(&seed) % 1000000 < m_dropPpm) {
+	  m_dropped++;
+	  continue;
 	}
-#endif
-      // Get the xfer service that handles this conversation
-      FrameHeader *header = reinterpret_cast<FrameHeader*>(&buf[offset + 2]);
-      XferServices *xfs = m_lep.xferServices(header->srcId);
-      if (xfs)
-	xfs->processFrame(header);
+	// Get the xfer service that handles this conversation
+	FrameHeader *header = reinterpret_cast<FrameHeader*>(&bufs[n * size + offsets[n] + 2]);
+	XferServices *xfs = m_lep.xferServices(header->srcId);
+	if (xfs) {
+	  xfs->processFrame(header);
+	  unsigned r;
+	  for (r = 0; r < nReceived && received[r] != xfs; r++)
+	    ;
+	  if (r == nReceived)
+	    received[nReceived++] = xfs;
+	}
+      }
+      // Acknowledge the batch now rather than waiting for frames going back the other way
+      for (unsigned r = 0; r < nReceived; r++)
+	received[r]->sendAcks();
     }
   }
   catch (std::string &s) {
@@ -397,6 +505,8 @@ run() {
   } catch (...) {
     ocpiBad("Unknown exception in socket background thread");
   }
+  if (m_dropped)
+    ocpiInfo("Datagram socket dropped %" PRIu64 " received frames for testing", m_dropped);
   ocpiInfo("Datagram socket receiver thread exiting");
 }
 
@@ -423,58 +533,54 @@ SmemServices::
   }
 }
 
+// Background retransmission of frames whose acks have not arrived, and acknowledgement
+// of received frames that have not been acknowledged already.
 void 
 DGEndPoint::
 run() {
-  const uint64_t timeout = 200 * 1000 * 1000;  // timeout in mSec
-  uint64_t time_now;
-
   while ( m_loop ) {
-    // If we have not received an ACK after (timeout) send the frame again.
     {
       OU::SelfAutoMutex guard(this);
+      uint64_t time_now = OS::Time::now().bits();
       for (unsigned n=0; n < m_xferServices.size(); n++)
 	if (m_xferServices[n] != NULL) {
-	  time_now = fasttime_getticks();
-	  m_xferServices[n]->checkAcks(time_now, timeout);
-	  OCPI::OS::sleep(2);
-	  time_now = fasttime_getticks();
-	  m_xferServices[n]->sendAcks(time_now, timeout/3);
-	  OCPI::OS::sleep(2);
+	  m_xferServices[n]->checkAcks(time_now);
+	  m_xferServices[n]->sendAcks();
 	}
     }
-    OCPI::OS::sleep(2);
+    OCPI::OS::sleep(1);
   }
 };
 
 void XferServices::    
-checkAcks( uint64_t time, uint64_t time_out ) {    
+checkAcks(uint64_t time_now) {
   OCPI::Util::SelfAutoMutex guard ( this );
-  for ( unsigned n=0; n<m_freeFrames.size(); n++ ) {
-    if ( ! m_freeFrames[n].is_free ) {
-      if ( ( time - m_freeFrames[n].send_time ) > time_out ) {
-
-	// We are multi-threaded and this can happen if a post occurs after this
-	// method id called
-	if ( time > m_freeFrames[n].send_time ) {
-
-	  m_freeFrames[n].resends++;	    
-
-#ifdef LIMIT_RETRIES
-	  if ( m_freeFrames[n].resends < 4 ) {
-	    printf("***** &&&&& Found a dropped frame, re-posting \n");
-	    post( m_freeFrames[n] );
-	  }
-	  ss    else {
-	    ocpiAssert("Exceeded resend limit !!\n"==0);
-	  }
-#else
-	  post( m_freeFrames[n] );
-#endif
-	}
+  Frame *frames[TX_BATCH];
+  unsigned nFrames = 0;
+  uint64_t rto = m_rto.rto();
+  bool timedOut = false;
+  for (unsigned n = 0; n < m_freeFrames.size(); n++) {
+    Frame &f = m_freeFrames[n];
+    // We are multi-threaded and a frame may have been sent after time_now was taken
+    if (!f.is_free && f.msg_count && time_now > f.send_time && time_now - f.send_time > rto) {
+      // Back off and shrink the window once per timeout, not once per frame lost in it
+      if (!timedOut) {
+	timedOut = true;
+	m_timeouts++;
+	m_window.lost(m_inFlight);
+	m_rto.backoff();
+      }
+      f.resends++;
+      m_retransmits++;
+      frames[nFrames++] = &f;
+      if (nFrames == TX_BATCH) {
+	post(frames, nFrames);
+	nFrames = 0;
       }
     }
   }
+  if (nFrames)
+    post(frames, nFrames);
 }
 
 void XferServices::  
@@ -482,6 +588,7 @@ processFrame(FrameHeader * header) {
   OCPI::Util::SelfAutoMutex guard(this);
   MsgHeader *msg;
 
+  m_framesReceived++;
   // It is possible for the sender to duplicate frames by being too agressive with re-retries
   // Dont process dups. 
   if (  m_frameSeqRecord[ header->frameSeq & MAX_FRAME_HISTORY ].id == header->frameSeq ) {
@@ -496,6 +603,7 @@ processFrame(FrameHeader * header) {
     }	    
 
     ocpiDebug("********  Found a duplicate frame, Ignoring it !!");
+    m_duplicates++;
     // Need to ACK the dup anyway
     m_frameSeqRecord[ header->frameSeq & MAX_FRAME_HISTORY ].acked = true;
     addFrameAck( header );
@@ -508,6 +616,9 @@ processFrame(FrameHeader * header) {
   if ( header->ACKCount ) {
     //      printf("Acking from %d, count = %d\n", header->ACKStart, header->ACKCount );
     ack(  header->ACKCount, header->ACKStart );
+    // Which may have opened the window for frames waiting to be sent
+    if (m_pendingHead)
+      pump();
   }
   if (!(header->flags & FRAME_FLAG_HAS_MESSAGES))
     return;
@@ -518,18 +629,13 @@ processFrame(FrameHeader * header) {
 
   msg = reinterpret_cast<MsgHeader*>(&header[1]);
   do {
-    MsgTransactionRecord & fr =
-      m_msgTransactionRecord[ (msg->transactionId & MAX_TRANSACTION_HISTORY) ];
-    if ( ! fr.in_use ) {
-      fr.in_use = true;
-      fr.msgsProcessed = 0;
-      m_frames_in_play++;
-      ocpiAssert( m_frames_in_play < MAX_TRANSACTION_HISTORY );
-    }
-    fr.transactionId = msg->transactionId;
-    fr.numMsgsInTransaction = msg->numMsgsInTransaction;	      
-
+    // Transactions with one message are complete when it arrives.  Others are tracked until
+    // all their messages have arrived, which the sender's window keeps to a bounded number.
+    MsgTransactionRecord *fr = NULL;
     if (msg->numMsgsInTransaction != 0) {
+      fr = &m_msgTransactionRecord[msg->transactionId];
+      fr->numMsgsInTransaction = msg->numMsgsInTransaction;
+
       ocpiDebug("Msg info -->  addr=%d len=%d tid=%d",
 		msg->dataAddr, msg->dataLen, msg->transactionId );
       
@@ -562,10 +668,10 @@ processFrame(FrameHeader * header) {
 	ocpiAssert("Unhandled Datagram message type"==0);
       }
 
-      fr.msgsProcessed++;
+      fr->msgsProcessed++;
     }
     // Close the transaction if needed
-    if ( fr.msgsProcessed == fr.numMsgsInTransaction ) {
+    if (!fr || fr->msgsProcessed == fr->numMsgsInTransaction) {
       char* dptr =(char*)m_from.sMemServices().map(msg->flagAddr, 4);	  
 
 #ifdef DEBUG_TxRx_Datagram
@@ -574,8 +680,8 @@ processFrame(FrameHeader * header) {
 #endif
 
       memcpy(dptr, &msg->flagValue, 4);
-      fr.in_use = false;
-      m_frames_in_play--;
+      if (fr)
+	m_msgTransactionRecord.erase(msg->transactionId);
     }
 
     if  ( msg->nextMsg ) {
@@ -35,6 +35,15 @@
 
 namespace DataTransfer {
 
+  // Placement of the memory behind a created mapping.  Only the creator applies these.
+  struct MappingOptions {
+    enum { AnyNode = -1, InheritNode = -2 };
+    bool hugePages; // back with hugetlbfs if mounted, else advise transparent huge pages
+    int  numaNode;  // NUMA node to bind pages to, or any, or those of our CPU affinity
+    bool prefault;  // fault all pages in when the creator first maps them
+    MappingOptions() : hugePages(false), numaNode(AnyNode), prefault(false) {}
+  };
+
   // File mapping services
   class OcpiFileMappingServices
   {
@@ -47,11 +56,13 @@ namespace DataTransfer {
     //                strMapName        - Name of the mapping. Can be null.
     //                eAccess                - The type of access desired.
     //                iMaxSize        - Maximum size of mapping object.
+    //                options        - Page size, NUMA and prefault options.  Can be null.
     //        Returns:
     //                0 for success; platform dependent error code otherwise.
     //        Throws:
     //                DataTransferEx for all other exception conditions
-    virtual int CreateMapping (const char*  strFilePath, const char* strMapName, AccessType eAccess, size_t iMaxSize) = 0;
+    virtual int CreateMapping (const char*  strFilePath, const char* strMapName, AccessType eAccess, size_t iMaxSize,
+                               const MappingOptions *options = NULL) = 0;
 
     // Open an existing mapping to a named file.
     //        Arguments:
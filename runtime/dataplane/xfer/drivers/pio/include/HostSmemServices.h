@@ -23,6 +23,7 @@
 
 #include "XferEndPoint.h"
 namespace DataTransfer {
-  SmemServices& createHostSmemServices(EndPoint& loc);
+  struct MappingOptions;
+  SmemServices& createHostSmemServices(EndPoint& loc, const MappingOptions *options = NULL);
 }
 #endif
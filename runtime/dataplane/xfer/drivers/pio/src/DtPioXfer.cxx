@@ -36,6 +36,7 @@
 #include "XferEndPoint.h"
 #include "XferDriver.h"
 #include "XferPio.h"
+#include "HostFileMappingServices.h"
 #include "HostSmemServices.h"
 // Programmed I/O via named shared memory buffers
 
@@ -47,6 +48,7 @@ namespace OCPI {
 class EndPoint : public XF::EndPoint {
   friend class XferFactory;
   std::string m_smb_name;
+  XF::MappingOptions m_options;
 protected:
   EndPoint(XF::XferFactory &a_factory, const char *protoInfo, const char *eps, const char *other,
 	   bool a_local, size_t a_size, const OU::PValue *params)
@@ -57,11 +59,25 @@ protected:
       m_smb_name = protoInfo;
     } else
       OU::format(m_protoInfo, "pioXfer%d.%d", getpid(), smb_count++);
+    // Placement of the SMB we create: parameters, then environment, then defaults:
+    // normal pages, bound to the NUMA nodes of our CPU affinity, and prefaulted.
+    const char *env;
+    if (!OU::findBool(params, "hugePages", m_options.hugePages))
+      m_options.hugePages = (env = getenv("OCPI_PIO_HUGE_PAGES")) && atoi(env);
+    if (!OU::findBool(params, "prefault", m_options.prefault))
+      m_options.prefault = !(env = getenv("OCPI_PIO_PREFAULT")) || atoi(env);
+    int32_t node;
+    if (OU::findLong(params, "numaNode", node))
+      m_options.numaNode = node;
+    else if ((env = getenv("OCPI_PIO_NUMA_NODE")))
+      m_options.numaNode = !strcasecmp(env, "any") ? XF::MappingOptions::AnyNode : atoi(env);
+    else
+      m_options.numaNode = XF::MappingOptions::InheritNode;
   }
   // This method is used to allocate a transfer compatible SMB
   XF::SmemServices&
   createSmemServices() {
-    return createHostSmemServices(*this);
+    return createHostSmemServices(*this, &m_options);
   }
 };
 
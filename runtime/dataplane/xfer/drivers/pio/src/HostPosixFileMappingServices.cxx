@@ -35,11 +35,17 @@
 #include <inttypes.h>
 #include <string>
 #include <cstdio>
+#include <vector>
+#include <algorithm>
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <sched.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/syscall.h>
 #include "ocpi-config.h"
 #include "OcpiOsAssert.h"
 #include "HostFileMappingServices.h"
@@ -49,8 +55,101 @@
 // This fails on zynq and we have not dug into it yet.
 #define REAL_SHM 1
 #endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23 // linux 5.14, may not be in our headers
+#endif
 namespace DataTransfer {
   namespace OU = OCPI::Util;
+
+  // Where hugetlbfs is mounted, and its page size, or NULL if it is not
+  static const char *
+  hugeMount(size_t &pageSize) {
+    static bool found;
+    static std::string mount;
+    static size_t hugePageSize;
+    if (!found) {
+      found = true;
+      const char *env = getenv("OCPI_HUGETLBFS");
+      if (env)
+	mount = env;
+      else if (FILE *f = fopen("/proc/mounts", "r")) {
+	char dir[256], type[64];
+	while (fscanf(f, "%*s %255s %63s %*[^\n]", dir, type) == 2)
+	  if (!strcmp(type, "hugetlbfs")) {
+	    mount = dir;
+	    break;
+	  }
+	fclose(f);
+      }
+      struct statfs sfs;
+      if (mount.size() && !statfs(mount.c_str(), &sfs))
+	hugePageSize = (size_t)sfs.f_bsize;
+      else
+	mount.clear();
+      ocpiDebug("hugetlbfs mount: \"%s\" page size %zu", mount.c_str(), hugePageSize);
+    }
+    pageSize = hugePageSize;
+    return mount.empty() ? NULL : mount.c_str();
+  }
+
+  // Set the bits of a node mask from a sysfs list like "0-3,8-11"
+  static void
+  parseList(const char *file, std::vector<unsigned long> &bits) {
+    FILE *f = fopen(file, "r");
+    if (!f)
+      return;
+    unsigned first, last;
+    int n;
+    while ((n = fscanf(f, "%u-%u", &first, &last)) > 0) {
+      for (unsigned i = first; i <= (n == 2 ? last : first); i++) {
+	if (i / 64 >= bits.size())
+	  bits.resize(i / 64 + 1);
+	bits[i / 64] |= 1ul << (i % 64);
+      }
+      if (fgetc(f) != ',')
+	break;
+    }
+    fclose(f);
+  }
+
+  // Compute the node mask to bind to.  For InheritNode these are the nodes of the CPUs we
+  // may run on, which only matters when those are not all of the nodes.
+  static bool
+  nodeMask(int node, std::vector<unsigned long> &mask) {
+    if (node >= 0) {
+      mask.resize((size_t)node / 64 + 1);
+      mask[(size_t)node / 64] |= 1ul << (node % 64);
+      return true;
+    }
+    cpu_set_t cpus;
+    if (sched_getaffinity(0, sizeof(cpus), &cpus))
+      return false;
+    std::vector<unsigned long> online;
+    parseList("/sys/devices/system/node/online", online);
+    DIR *d = opendir("/sys/devices/system/node");
+    if (!d)
+      return false;
+    while (struct dirent *ent = readdir(d)) {
+      unsigned n;
+      if (sscanf(ent->d_name, "node%u", &n) != 1)
+	continue;
+      std::string file;
+      OU::format(file, "/sys/devices/system/node/%s/cpulist", ent->d_name);
+      std::vector<unsigned long> nodeCpus;
+      parseList(file.c_str(), nodeCpus);
+      for (unsigned c = 0; c < nodeCpus.size() * 64; c++)
+	if (nodeCpus[c / 64] & (1ul << (c % 64)) && c < CPU_SETSIZE && CPU_ISSET(c, &cpus)) {
+	  if (n / 64 >= mask.size())
+	    mask.resize(n / 64 + 1);
+	  mask[n / 64] |= 1ul << (n % 64);
+	  break;
+	}
+    }
+    closedir(d);
+    mask.resize(std::max(mask.size(), online.size()));
+    online.resize(mask.size());
+    return mask != online && mask != std::vector<unsigned long>(mask.size());
+  }
   // OcpiPosixFileMappingServices implements basic file mapping support on Posix compliant platforms.
   class OcpiPosixFileMappingServices : public OcpiFileMappingServices
   {
@@ -62,8 +161,16 @@ namespace DataTransfer {
     //	eAccess		- The type of access desired.
     //	iMaxSize	- Maximum size of mapping object.
     // Returns 0 for success or a platform specific error number.
-    int CreateMapping (const char*  strFilePath, const char* strMapName, AccessType eAccess, size_t iMaxSize)
+    //	options		- Page size, NUMA and prefault options.  Can be null.
+    int CreateMapping (const char*  strFilePath, const char* strMapName, AccessType eAccess, size_t iMaxSize,
+		       const MappingOptions *options)
     {
+      if (options)
+	m_options = *options;
+#ifdef REAL_SHM
+      if (m_options.hugePages && CreateHugeMapping(strMapName, iMaxSize))
+	return 0;
+#endif
       // Common call to do shm_open
       int rc = InitMapping (strFilePath, strMapName, eAccess, O_CREAT);
       if (rc == 0)
@@ -97,7 +204,21 @@ namespace DataTransfer {
     // Returns 0 for success or a platform specific error number.
     int OpenMapping (const char* strMapName, AccessType eAccess)
     {
-      return InitMapping (NULL, strMapName, eAccess, 0);
+      int rc = InitMapping (NULL, strMapName, eAccess, 0);
+#ifdef REAL_SHM
+      // The creator may have put it on hugetlbfs
+      size_t pageSize;
+      const char *mount;
+      if (rc == ENOENT && (mount = hugeMount(pageSize))) {
+	std::string path = mount + m_name;
+	if ((m_fd = open(path.c_str(), MapAccessTypeToOpen(eAccess))) != -1) {
+	  m_path = path;
+	  ocpiDebug("huge page file open %s fd %d", m_path.c_str(), m_fd);
+	  return 0;
+	}
+      }
+#endif
+      return rc;
     }
 
     // Close an existing mapping.
@@ -137,12 +258,20 @@ namespace DataTransfer {
 #ifdef REAL_SHM
 	  iRet = mmap (NULL, lLength, iProtect, MAP_SHARED, m_fd, iOffset);
 #else
-          iRet = mmap (NULL, lLength, iProtect, MAP_PRIVATE|MAP_ANON, -1, iOffset);
+#ifdef MAP_HUGETLB
+	  if (!m_options.hugePages || !m_created ||
+	      (iRet = mmap (NULL, lLength, iProtect, MAP_PRIVATE|MAP_ANON|MAP_HUGETLB, -1,
+			    iOffset)) == MAP_FAILED)
+#endif
+	    iRet = mmap (NULL, lLength, iProtect, MAP_PRIVATE|MAP_ANON, -1, iOffset);
 #endif
 	  ocpiDebug("mmap on %d at offset %u length %zu returns %p errno %d",
 		    m_fd, iOffset, lLength, iRet, errno);
-	  if (iRet != MAP_FAILED)
+	  if (iRet != MAP_FAILED) {
+	    if (m_created)
+	      PlaceView(iRet, lLength);
 	    ocpiDebug("mmap value at %p is %" PRIx32, iRet, *(uint32_t*)iRet);
+	  }
 	}
       m_length = lLength;
       return iRet;
@@ -179,25 +308,97 @@ namespace DataTransfer {
     int	m_errno;		// Last error.
     size_t m_length;		// Length of last mapping
     bool m_created;             // did we create it?
+    std::string m_path;         // hugetlbfs file when not in POSIX shared memory
+    MappingOptions m_options;
 
   private:
 
-    // Common method to open shared memory
-    int InitMapping (const char* strFilePath, std::string strMapName, AccessType eAccess, int iFlags)
+    // Create the mapping as a file on hugetlbfs.  Return false to fall back to shm_open.
+    bool CreateHugeMapping (std::string strMapName, size_t iMaxSize)
     {
-      ( void ) strFilePath;
-      // Terminate any current mapping
+      size_t pageSize;
+      const char *mount = hugeMount(pageSize);
+      if (!mount) {
+	ocpiInfo("No hugetlbfs mounted for %s: using transparent huge pages if enabled",
+		 strMapName.c_str());
+	return false;
+      }
       TerminateMapping ();
+      SetName (strMapName);
+      std::string path = mount + m_name;
+      size_t size = OU::roundUp(iMaxSize, pageSize);
+      void *va = MAP_FAILED;
+      if ((m_fd = open(path.c_str(), O_RDWR | O_CREAT, 0666)) != -1 &&
+	  ftruncate(m_fd, (off_t)size) == 0 &&
+	  // Mapping it is what reserves huge pages, and the reservation stays with the file
+	  (va = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0)) != MAP_FAILED) {
+	munmap(va, size);
+	m_path = path;
+	m_created = true;
+	m_size = size;
+	ocpiInfo("Shared memory %s is on %zu byte huge pages", m_path.c_str(), pageSize);
+	return true;
+      }
+      m_errno = errno;
+      ocpiInfo("Could not get huge pages for %s (%s): using normal pages",
+	       path.c_str(), strerror(m_errno));
+      if (m_fd != -1) {
+	unlink(path.c_str());
+	close(m_fd);
+	m_fd = -1;
+      }
+      return false;
+    }
 
-      // Convert access type to a Posix flag set.
-      int iOpenFlags = MapAccessTypeToOpen (eAccess);
+    // Apply placement options to the creator's view of new memory, before anything touches it
+    void PlaceView (void *va, size_t length)
+    {
+      size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+      if (m_path.size())
+	hugeMount(pageSize);
+#ifdef MADV_HUGEPAGE
+      else if (m_options.hugePages && madvise(va, length, MADV_HUGEPAGE))
+	ocpiDebug("madvise(MADV_HUGEPAGE) failed: %s", strerror(errno));
+#endif
+#ifdef SYS_mbind
+      std::vector<unsigned long> mask;
+      if (m_options.numaNode != MappingOptions::AnyNode && nodeMask(m_options.numaNode, mask)) {
+	const int mpolBind = 2; // from numaif.h, which may not be installed
+	if (syscall(SYS_mbind, va, length, mpolBind, &mask[0], mask.size() * 64 + 1, 0))
+	  ocpiInfo("Could not bind shared memory %s to NUMA nodes 0x%lx: %s", m_name.c_str(),
+		   mask[0], strerror(errno));
+	else
+	  ocpiDebug("Shared memory %s bound to NUMA nodes 0x%lx", m_name.c_str(), mask[0]);
+      }
+#endif
+      if (m_options.prefault && madvise(va, length, MADV_POPULATE_WRITE))
+	// Older kernels: touch each page, without changing anything already there
+	for (volatile uint8_t *p = (uint8_t *)va; p < (uint8_t *)va + length; p += pageSize)
+	  *p = *p;
+    }
 
+    // Set the POSIX shared memory name, making one up if none is given
+    void SetName (std::string strMapName)
+    {
       if (strMapName.empty()) {
 	static unsigned n = 0;
 	OU::format(strMapName, "/ocpi%u.%u", getpid(), n++);
       }
       // A leading "/" is required.
       m_name = strMapName[0] == '/' ? strMapName : "/" + strMapName;
+    }
+
+    // Common method to open shared memory
+    int InitMapping (const char* strFilePath, std::string strMapName, AccessType eAccess, int iFlags)
+    {
+      ( void ) strFilePath;
+      // Terminate any current mapping
+      TerminateMapping ();
+
+      // Convert access type to a Posix flag set.
+      int iOpenFlags = MapAccessTypeToOpen (eAccess);
+
+      SetName (strMapName);
       // Open a shared memory object
 #ifdef REAL_SHM
       m_fd = shm_open (m_name.c_str (), iOpenFlags | iFlags, 0666);
@@ -224,11 +425,16 @@ namespace DataTransfer {
     {
       if ( m_fd != -1 ) {
       ocpiDebug("shm closing %s fd %d created %d", m_name.c_str(), m_fd, m_created);
-	if (m_created)
-	  shm_unlink(m_name.c_str());
+	if (m_created) {
+	  if (m_path.empty())
+	    shm_unlink(m_name.c_str());
+	  else
+	    unlink(m_path.c_str());
+	}
 	close (m_fd);
       }
       m_fd =  -1;
+      m_path.clear();
       return 0;
     }
 
@@ -91,7 +91,7 @@ namespace DataTransfer {
 
 
     // Create a named shared memory object.
-    void create (EndPoint* loc )
+    void create (EndPoint* loc, const MappingOptions *options)
     {
 
       // Begin exception handler
@@ -123,7 +123,8 @@ namespace DataTransfer {
 	  BaseSmemServices::add(m_pSmem);
           ocpiDebug("Creating mapping of size %zu name %s", loc->size(), m_pSmem->m_name.c_str());
           if ((rc = pMapper->CreateMapping ("", m_pSmem->m_name.c_str(),
-					    OcpiFileMappingServices::ReadWriteAccess, loc->size())))
+					    OcpiFileMappingServices::ReadWriteAccess, loc->size(),
+					    options)))
 	    throw OU::Error("CreatMapping failed: %u", rc);
 #else
           ocpiDebug("Creating mapping of size %zu", loc->size() );
@@ -409,12 +410,12 @@ namespace DataTransfer {
 
   public:
     // Ctor/dtor
-    HostSmemServices (EndPoint& cloc )
+    HostSmemServices (EndPoint& cloc, const MappingOptions *options)
       :BaseSmemServices(cloc)
     {
       EndPoint* loc = &cloc;
       if (cloc.local())
-	create(loc);
+	create(loc, options);
       else
 	attach(loc);
     }
@@ -430,9 +431,9 @@ namespace DataTransfer {
 
 
   // Platform dependent global that creates an instance
-  SmemServices& createHostSmemServices (EndPoint& loc )
+  SmemServices& createHostSmemServices (EndPoint& loc, const MappingOptions *options)
   {
-    return *new HostSmemServices (loc);
+    return *new HostSmemServices (loc, options);
   }
 
 }
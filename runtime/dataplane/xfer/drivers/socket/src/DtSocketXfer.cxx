@@ -20,13 +20,16 @@
 
 #include <inttypes.h>
 #include <unistd.h>  // FIXME for gethostname - use OS::
+#include <sys/uio.h>
 #include <deque>
+#include <vector>
 #include "OcpiOsSocket.h"
 #include "OcpiOsMisc.h"
 #include "OcpiOsAssert.h"
 #include "OcpiOsServerSocket.h"
 #include "OcpiOsEther.h"
 #include "OcpiUtilMisc.h"
+#include "OcpiUtilAutoMutex.h"
 #include "OcpiThread.h"
 #include "XferDriver.h"
 #include "XferEndPoint.h"
@@ -44,7 +47,10 @@ struct DataHeader {
   uint32_t   length;
   uint32_t   count;
 };
-const size_t TCP_BUFSIZE = 4096;
+// Received headers and small payloads are staged through a buffer this big.
+// Larger payloads are read straight into place.
+const size_t TCP_BUFSIZE = 64 * 1024;
+const size_t TCP_DIRECT_MIN = 4096;
 
 class XferFactory;
 class EndPoint: public XF::EndPoint {
@@ -168,47 +174,90 @@ public:
     m_run = false;
   }
 
-  void run() {
-    try {
-      size_t     n;
-      uint8_t    buf[TCP_BUFSIZE];
-      DataHeader header;
-      uint8_t   *current_ptr = NULL;
-      size_t     bytes_left = 0;
-      bool       in_header = true;;
-      while(m_run && (n = m_socket.recv((char*)buf, TCP_BUFSIZE, 500))) {
-	if (n == SIZE_MAX)
-	  continue; // allow timeout so m_run can go away and shut us down
-	size_t copy_len;
-	for (uint8_t *bp = buf; n; n -= copy_len, bp += copy_len) {
-	  if (bytes_left == 0) { //starting the header or starting the payload
-	    if (in_header) {
-	      current_ptr = (uint8_t*)&header;
-	      bytes_left = sizeof(header);
-	    } else {
-	      ocpiDebug("Received Header: %8x: %" PRIx32 " %" PRIx32,
-			header.count, header.length, header.offset);
-	      bytes_left = header.length;
-	      current_ptr =
-		m_sep.receiver() ? NULL : (uint8_t *)m_smem.map(header.offset, header.length);
-	    }
+  // Read more into the staging buffer, returning false at EOF or when stopped
+  bool fill(uint8_t *buf, size_t &start, size_t &end) {
+    if (start) {
+      memmove(buf, buf + start, end - start);
+      end -= start;
+      start = 0;
+    }
+    while (m_run) {
+      size_t n = m_socket.recv((char*)buf + end, TCP_BUFSIZE - end, 500);
+      if (n == SIZE_MAX)
+	continue; // allow timeout so m_run can go away and shut us down
+      if (n == 0) {
+	ocpiInfo("Got a socket EOF for endpoint, terminating connection");
+	return false;
+      }
+      end += n;
+      return true;
+    }
+    return false;
+  }
+
+  // Deliver the payload described by the header, first from what is already staged, and
+  // then, if it is big enough and has a mapped destination, by reading the rest of it
+  // straight into place, along with whatever follows it into the staging buffer.
+  bool payload(DataHeader &header, uint8_t *buf, size_t &start, size_t &end) {
+    uint8_t *dst =
+      m_sep.receiver() ? NULL : (uint8_t *)m_smem.map(header.offset, header.length);
+    for (size_t n, left = header.length; left; left -= n) {
+      if (start == end) {
+	if (dst && left >= TCP_DIRECT_MIN) {
+	  struct iovec iov[2];
+	  iov[0].iov_base = dst;
+	  iov[0].iov_len = left;
+	  iov[1].iov_base = buf;
+	  iov[1].iov_len = TCP_BUFSIZE;
+	  start = end = 0;
+	  while ((n = m_socket.recvv(iov, 2, 500)) == SIZE_MAX)
+	    if (!m_run)
+	      return false;
+	  if (n == 0) {
+	    ocpiInfo("Got a socket EOF for endpoint, terminating connection");
+	    return false;
 	  }
-	  copy_len = std::min(n, bytes_left);
-	  ocpiDebug("Copying socket data to %p, size = %zu, in header %d, left %zu, first %x",
-		    current_ptr, copy_len, in_header, bytes_left, *(uint32_t *)bp);
-	  if (current_ptr) {
-	    memcpy(current_ptr, bp, copy_len );
-	    current_ptr += copy_len;
-	  } else {
-	    m_sep.receiver()->receive(header.offset, bp, copy_len);
-	    header.offset += OCPI_UTRUNCATE(DtOsDataTypes::Offset, copy_len);
+	  if (n > left) {
+	    end = n - left;
+	    n = left;
 	  }
-	  if (!(bytes_left -= copy_len))
-	    in_header = !in_header;
+	  dst += n;
+	  continue;
 	}
+	if (!fill(buf, start, end))
+	  return false;
       }
-      if (n == 0)
-	ocpiInfo("Got a socket EOF for endpoint, terminating connection");
+      n = std::min(left, end - start);
+      if (dst) {
+	memcpy(dst, buf + start, n);
+	dst += n;
+      } else {
+	m_sep.receiver()->receive(header.offset, buf + start, n);
+	header.offset += OCPI_UTRUNCATE(DtOsDataTypes::Offset, n);
+      }
+      start += n;
+    }
+    return true;
+  }
+
+  void run() {
+    try {
+      std::vector<uint8_t> stage(TCP_BUFSIZE);
+      uint8_t   *buf = &stage[0];
+      size_t     start = 0, end = 0; // what is staged but not yet consumed
+      DataHeader header;
+      while (m_run) {
+	while (end - start < sizeof(header))
+	  if (!fill(buf, start, end))
+	    goto done;
+	memcpy(&header, buf + start, sizeof(header));
+	start += sizeof(header);
+	ocpiDebug("Received Header: %8x: %" PRIx32 " %" PRIx32,
+		  header.count, header.length, header.offset);
+	if (!payload(header, buf, start, end))
+	  break;
+      }
+    done:;
     } catch (std::string &s) {
       ocpiBad("Exception in endpoint socket receiver background thread: %s", s.c_str());
     } catch (...) {
@@ -321,10 +370,20 @@ class XferServices
   // The handle returned by xfer_create
   XF_template        m_xftemplate;
   OS::Socket         m_socket;
+  // When batching, the headers and payloads of all the transfers of a request are
+  // gathered and then sent with one system call.
+  bool                      m_batch;
+  unsigned                  m_batchDepth;
+  std::vector<DataHeader>   m_headers;
+  std::vector<struct iovec> m_iov;
+  OS::Mutex                 m_mutex;    // requests may be posted by different threads
 public:
   XferServices(XF::EndPoint &source, XF::EndPoint &target)
     : ConnectionBase<XferFactory,XferServices,XferRequest>
-      (*this, source, target) {
+      (*this, source, target), m_batch(true), m_batchDepth(0), m_mutex(true) {
+    const char *env = getenv("OCPI_SOCKET_BATCH");
+    if (env && env[0])
+      m_batch = atoi(env) != 0;
     xfer_create (source, target, 0, &m_xftemplate);
     EndPoint &rsep = *static_cast<EndPoint *>(&target);
     m_socket.connect(rsep.m_ipAddress, rsep.m_portNum);
@@ -346,9 +405,47 @@ protected:
     hdr.count = count++;
     ocpiDebug("Sending IP header %zu %" PRIu32 " %" DTOSDATATYPES_OFFSET_PRIx" %" PRIx32,
 	      sizeof(DataHeader), hdr.length, hdr.offset, hdr.count);
+    OU::AutoMutex guard(m_mutex);
+    if (m_batchDepth) {
+      m_headers.push_back(hdr);
+      struct iovec iov;
+      iov.iov_base = NULL; // the header's address is filled in when flushing
+      iov.iov_len = sizeof(DataHeader);
+      m_iov.push_back(iov);
+      iov.iov_base = data;
+      iov.iov_len = nbytes;
+      m_iov.push_back(iov);
+      return;
+    }
     m_socket.send((char*)&hdr, sizeof(DataHeader));
     m_socket.send((char *)data, nbytes);
   }
+  // Start gathering the transfers of a request, if batching
+  void beginBatch() {
+    if (m_batch) {
+      m_mutex.lock();
+      if (!m_batchDepth++) {
+	m_headers.clear();
+	m_iov.clear();
+      }
+    }
+  }
+  // Send what was gathered, in order, with one sendmsg for the whole request
+  void endBatch() {
+    if (m_batch) {
+      if (!--m_batchDepth && m_iov.size()) {
+	for (unsigned n = 0; n < m_headers.size(); n++)
+	  m_iov[n * 2].iov_base = &m_headers[n];
+	try {
+	  m_socket.sendv(&m_iov[0], (unsigned)m_iov.size());
+	} catch (...) {
+	  m_mutex.unlock();
+	  throw;
+	}
+      }
+      m_mutex.unlock();
+    }
+  }
 };
 
 XF::XferServices &XferFactory::
@@ -370,6 +467,19 @@ public:
       DataTransfer::XferRequest::CompleteSuccess : DataTransfer::XferRequest::Pending;
   }
 
+  // Gather the header and payload of all our transfers, including the trailing flag
+  // transfers, into one send.
+  void post() {
+    parent().beginBatch();
+    try {
+      XF::XferRequest::post();
+    } catch (...) {
+      parent().endBatch();
+      throw;
+    }
+    parent().endBatch();
+  }
+
   // Data members accessible from this/derived class
 private:
   void action_transfer(PIO_transfer transfer, bool /*last*/) {
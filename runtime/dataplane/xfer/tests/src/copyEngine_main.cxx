@@ -0,0 +1,150 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmark of the PIO copy engines: GB/sec for copies from 64 bytes to 64MB, with the
+ * source and destination aligned alike and differently, for the byte/word loops PIO
+ * transfers used to use and each copy engine this CPU supports.  Each copy is also
+ * checked, including that no byte outside the destination is touched.
+ *
+ * usage: copyEngine [max-bytes [bytes-per-measurement]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+#include "XferCopy.h"
+
+namespace DT = DataTransfer;
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// What xfer_pio_action_transfer used to do
+static void
+oldCopy(void *dst, const void *src, size_t nBytes)
+{
+  uint8_t *d = (uint8_t *)dst;
+  const uint8_t *s = (const uint8_t *)src;
+  size_t al = (uintptr_t)s & 3;
+  if (al != ((uintptr_t)d & 3)) {
+    for (size_t i = 0; i < nBytes; i++)
+      *d++ = *s++;
+    return;
+  }
+  for (; al && nBytes; al--, nBytes--)
+    *d++ = *s++;
+  int32_t *dw = (int32_t *)d;
+  const int32_t *sw = (const int32_t *)s;
+  for (size_t i = nBytes / 4; i; i--)
+    *dw++ = *sw++;
+  d = (uint8_t *)dw;
+  s = (const uint8_t *)sw;
+  for (size_t i = nBytes % 4; i; i--)
+    *d++ = *s++;
+}
+
+static bool
+check(const char *name, const uint8_t *dst, const uint8_t *src, size_t nBytes, size_t guard)
+{
+  for (size_t n = 0; n < guard; n++)
+    if (dst[-1 - (ssize_t)n] != 0xee || dst[nBytes + n] != 0xee) {
+      fprintf(stderr, "%s: wrote outside the %zu byte destination\n", name, nBytes);
+      return false;
+    }
+  if (src ? memcmp(dst, src, nBytes) : (nBytes && (dst[0] || memcmp(dst, dst + 1, nBytes - 1)))) {
+    fprintf(stderr, "%s: wrong data for %zu bytes\n", name, nBytes);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  size_t maxBytes = argc > 1 ? strtoul(argv[1], NULL, 0) : 64 * 1024 * 1024;
+  double perMeasurement = argc > 2 ? strtod(argv[2], NULL) : 512 * 1024 * 1024.;
+  const size_t guard = 64;
+  std::vector<uint8_t> srcBuf(maxBytes + 256), dstBuf(maxBytes + 256 + 2 * guard);
+  for (size_t n = 0; n < srcBuf.size(); n++)
+    srcBuf[n] = (uint8_t)(n * 7 + 1);
+  uint8_t *srcBase = &srcBuf[0] + (64 - ((uintptr_t)&srcBuf[0] & 63));
+  uint8_t *dstBase = &dstBuf[0] + guard + (64 - ((uintptr_t)&dstBuf[0] & 63));
+  const char *engines[] = { "old", "generic", "sse2", "avx2", "avx512" };
+  printf("default engine: %s, non-temporal stores from %zu bytes\n", DT::copyEngine(),
+	 DT::nonTemporalThreshold());
+  printf("%-8s %-8s", "engine", "layout");
+  for (size_t size = 64; size <= maxBytes; size *= 4)
+    if (size < 1024)
+      printf(" %6zuB", size);
+    else if (size < 1024 * 1024)
+      printf(" %5zuKB", size / 1024);
+    else
+      printf(" %5zuMB", size / (1024 * 1024));
+  printf("   (GB/sec)\n");
+  for (unsigned e = 0; e < sizeof(engines)/sizeof(*engines); e++) {
+    bool old = e == 0;
+    if (!old && !DT::setCopyEngine(engines[e]))
+      continue;
+    for (unsigned layout = 0; layout < 3; layout++) {
+      static const char *layouts[] = { "aligned", "skewed", "zero" };
+      uint8_t *dst = dstBase + (layout == 1 ? 3 : 0);
+      const uint8_t *src = layout == 2 ? NULL : srcBase + (layout == 1 ? 1 : 0);
+      if (old && !src)
+	continue;
+      printf("%-8s %-8s", engines[e], layouts[layout]);
+      for (size_t size = 64; size <= maxBytes; size *= 4) {
+	// Check some sizes around this one, then time it
+	for (size_t n = size - 3; n <= size + 3; n++) {
+	  memset(dst - guard, 0xee, n + 2 * guard);
+	  if (old)
+	    oldCopy(dst, src, n);
+	  else if (src)
+	    DT::copyMemory(dst, src, n);
+	  else
+	    DT::zeroMemory(dst, n);
+	  if (!check(engines[e], dst, src, n, guard))
+	    return 1;
+	}
+	unsigned long iterations = (unsigned long)(perMeasurement / (double)size) + 1;
+	double start = now();
+	for (unsigned long i = 0; i < iterations; i++)
+	  if (old)
+	    oldCopy(dst, src, size);
+	  else if (src)
+	    DT::copyMemory(dst, src, size);
+	  else
+	    DT::zeroMemory(dst, size);
+	double elapsed = now() - start;
+	printf(" %7.2f", (double)size * (double)iterations / elapsed / 1e9);
+	fflush(stdout);
+      }
+      printf("\n");
+    }
+  }
+  return 0;
+}
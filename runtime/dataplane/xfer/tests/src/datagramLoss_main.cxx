@@ -0,0 +1,257 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Loopback benchmark of the datagram transfer driver's reliability scheme under injected
+ * packet loss: a stream of frames over UDP, each acknowledged by the receiver and resent
+ * by the sender when its ack does not arrive in time.  The receiver drops the given
+ * percentage of frames.  The "fixed" mode works as the driver used to: one system call
+ * per frame, a fixed retransmit timeout, acks flushed periodically, and as many frames in
+ * flight as there are frame slots.  The "adaptive" mode works as the driver now does:
+ * sendmmsg/recvmmsg batches, acks for each received batch, and the driver's
+ * RetransmitTimer and Window classes.
+ *
+ * usage: datagramLoss [loss-percent [frames]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <vector>
+#include <OcpiOsTimer.h>
+#include <OcpiOsServerSocket.h>
+#include <OcpiOsThreadManager.h>
+#include <DtDataGramXfer.h>
+
+namespace OS = OCPI::OS;
+namespace DG = DataTransfer::Datagram;
+
+static const size_t PAYLOAD = 512;
+static const unsigned BATCH = 32, MAX_ACKS = 120, SLOTS = 255;
+static const uint64_t MS = OS::Time::ticksPerSecond / 1000;
+// The old fixed timeout was 200M cpu ticks, and acks were sent after a third of that
+static const uint64_t FIXED_RTO = 100 * MS, FIXED_ACK_DELAY = FIXED_RTO / 3;
+
+struct Frame {
+  uint32_t seq;
+  uint8_t  data[PAYLOAD - sizeof(uint32_t)];
+};
+struct Ack {
+  uint32_t count;
+  uint32_t seqs[MAX_ACKS];
+};
+
+static bool adaptive;
+static unsigned lossPpm, nFrames;
+static OS::ServerSocket *txSocket, *rxSocket;
+static struct sockaddr_in txAddr, rxAddr;
+static volatile bool done;
+static unsigned long nReceived, nDuplicates, nDropped;
+
+static uint64_t now() { return OS::Time::now().bits(); }
+
+static void
+sendAcks(Ack &ack) {
+  if (ack.count) {
+    rxSocket->sendto((char *)&ack, sizeof(uint32_t) * (ack.count + 1), 0, (char *)&txAddr,
+		     sizeof(txAddr));
+    ack.count = 0;
+  }
+}
+
+static void
+receiver(void *) {
+  std::vector<Frame> frames(BATCH);
+  std::vector<bool> seen(nFrames);
+  Ack ack;
+  ack.count = 0;
+  uint64_t lastAck = now();
+  unsigned seed = 1;
+  while (!done) {
+    size_t lengths[BATCH];
+    unsigned n;
+    if (adaptive) {
+      struct msghdr msgs[BATCH];
+      struct iovec iovs[BATCH];
+      memset(msgs, 0, sizeof(msgs));
+      for (unsigned i = 0; i < BATCH; i++) {
+	iovs[i].iov_base = &frames[i];
+	iovs[i].iov_len = sizeof(Frame);
+	msgs[i].msg_iov = &iovs[i];
+	msgs[i].msg_iovlen = 1;
+      }
+      n = rxSocket->recvmmsg(msgs, lengths, BATCH, 0, 2);
+    } else {
+      size_t alen = sizeof(txAddr);
+      struct sockaddr_in from;
+      n = rxSocket->recvfrom((char *)&frames[0], sizeof(Frame), 0, (char *)&from, &alen, 2) ?
+	1 : 0;
+    }
+    for (unsigned i = 0; i < n; i++) {
+      if ((unsigned)rand_r(&seed) % 1000000 < lossPpm) {
+	nDropped++;
+	continue;
+      }
+      uint32_t seq = frames[i].seq;
+      if (seen[seq])
+	nDuplicates++;
+      else {
+	seen[seq] = true;
+	nReceived++;
+      }
+      if (ack.count == MAX_ACKS)
+	sendAcks(ack);
+      ack.seqs[ack.count++] = seq;
+    }
+    if (adaptive || now() - lastAck > FIXED_ACK_DELAY) {
+      sendAcks(ack);
+      lastAck = now();
+    }
+  }
+}
+
+struct Sent {
+  uint64_t time;
+  unsigned resends;
+  bool     acked;
+};
+
+static void
+run(const char *name, bool a_adaptive) {
+  adaptive = a_adaptive;
+  done = false;
+  nReceived = nDuplicates = nDropped = 0;
+  OS::ThreadManager thread(receiver, NULL);
+  std::vector<Sent> sent(nFrames);
+  std::vector<Frame> frames(nFrames);
+  DG::RetransmitTimer timer(adaptive ? 200 * MS : FIXED_RTO, adaptive ? 2 * MS : FIXED_RTO,
+			    adaptive ? 1000 * MS : FIXED_RTO);
+  DG::Window window(adaptive ? 16 : SLOTS, SLOTS);
+  unsigned next = 0, nAcked = 0, inFlight = 0, oldest = 0;
+  unsigned long nSent = 0, nResent = 0, nTimeouts = 0;
+  uint64_t start = now(), lastCheck = start;
+  while (nAcked < nFrames) {
+    // Send new frames while the window is open.  The old driver's limit was the frame slot
+    // of the oldest unacknowledged frame being reused.
+    std::vector<unsigned> toSend;
+    while (next < nFrames && inFlight < window.size() && next - oldest < SLOTS &&
+	   toSend.size() < BATCH) {
+      frames[next].seq = next;
+      toSend.push_back(next++);
+      inFlight++;
+    }
+    // Resend frames not acknowledged in time, checked every millisecond like the driver
+    uint64_t t = now();
+    if (t - lastCheck > MS) {
+      lastCheck = t;
+      bool timedOut = false;
+      for (unsigned n = oldest; n < next; n++)
+	if (!sent[n].acked && sent[n].time && t - sent[n].time > timer.rto()) {
+	  if (!timedOut) {
+	    timedOut = true;
+	    nTimeouts++;
+	    if (adaptive) {
+	      window.lost(inFlight);
+	      timer.backoff();
+	    }
+	  }
+	  sent[n].resends++;
+	  nResent++;
+	  toSend.push_back(n);
+	}
+    }
+    if (toSend.size()) {
+      t = now();
+      std::vector<struct msghdr> msgs(toSend.size());
+      std::vector<struct iovec> iovs(toSend.size());
+      for (unsigned i = 0; i < toSend.size(); i++) {
+	sent[toSend[i]].time = t;
+	iovs[i].iov_base = &frames[toSend[i]];
+	iovs[i].iov_len = sizeof(Frame);
+	memset(&msgs[i], 0, sizeof(msgs[i]));
+	msgs[i].msg_name = &rxAddr;
+	msgs[i].msg_namelen = sizeof(rxAddr);
+	msgs[i].msg_iov = &iovs[i];
+	msgs[i].msg_iovlen = 1;
+	if (!adaptive)
+	  txSocket->sendmsg(&msgs[i], 0);
+      }
+      if (adaptive)
+	txSocket->sendmmsg(&msgs[0], (unsigned)msgs.size(), 0);
+      nSent += toSend.size();
+    }
+    // Take acks, waiting a little if the window is closed
+    Ack ack;
+    size_t alen = sizeof(rxAddr);
+    struct sockaddr_in from;
+    bool blocked = next == nFrames || inFlight >= window.size() || next - oldest >= SLOTS;
+    while (txSocket->recvfrom((char *)&ack, sizeof(ack), blocked ? 0 : MSG_DONTWAIT,
+			      (char *)&from, &alen, 1)) {
+      t = now();
+      for (unsigned i = 0; i < ack.count; i++) {
+	Sent &s = sent[ack.seqs[i]];
+	if (s.acked)
+	  continue;
+	s.acked = true;
+	nAcked++;
+	inFlight--;
+	if (adaptive) {
+	  if (!s.resends)
+	    timer.sample(t - s.time);
+	  window.acked();
+	}
+      }
+      while (oldest < next && sent[oldest].acked)
+	oldest++;
+      blocked = false;
+    }
+  }
+  double elapsed = (double)(now() - start) / (double)OS::Time::ticksPerSecond;
+  done = true;
+  thread.join();
+  printf("%-9s %8.1f MB/sec  %8.3f secs  sent %7lu  resent %6lu  timeouts %5lu  "
+	 "dropped %5lu  duplicates %6lu\n",
+	 name, (double)nFrames * PAYLOAD / elapsed / 1e6, elapsed, nSent, nResent, nTimeouts,
+	 nDropped, nDuplicates);
+}
+
+int main(int argc, char **argv) {
+  double loss = argc > 1 ? strtod(argv[1], NULL) : 1;
+  nFrames = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 0) : 20000;
+  lossPpm = (unsigned)(loss * 10000);
+  OS::ServerSocket tx, rx;
+  tx.bind(0, false, true, true);
+  rx.bind(0, false, true, true);
+  txSocket = &tx;
+  rxSocket = &rx;
+  memset(&txAddr, 0, sizeof(txAddr));
+  txAddr.sin_family = AF_INET;
+  txAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  rxAddr = txAddr;
+  txAddr.sin_port = htons(tx.getPortNo());
+  rxAddr.sin_port = htons(rx.getPortNo());
+  printf("frames: %u of %zu bytes, loss: %g%%\n", nFrames, PAYLOAD, loss);
+  run("fixed", false);
+  run("adaptive", true);
+  return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compare an idle dispatch thread that yields and spins (the polled container loop)
+ * with one that blocks on an EventManager: the CPU it burns while idle, and how long
+ * it takes to notice that work has arrived.
+ *
+ * usage: eventWakeup [idle-msecs [wakeups]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <OcpiOsMisc.h>
+#include <OcpiOsThreadManager.h>
+#include <XferEvent.h>
+
+namespace OS = OCPI::OS;
+
+static DataTransfer::EventManager *em;
+static volatile bool useEvents, done;
+static volatile double posted;
+static volatile unsigned long nPosted, nSeen;
+static double latencySum, latencyMax;
+static double threadCpu;
+
+static double
+now(clockid_t clock = CLOCK_MONOTONIC)
+{
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// A stand-in for a dispatch thread with nothing runnable but a posted work counter
+static void
+dispatchThread(void *)
+{
+  double cpuStart = now(CLOCK_THREAD_CPUTIME_ID);
+  while (!done) {
+    if (nSeen != nPosted) {
+      double latency = now() - posted;
+      latencySum += latency;
+      if (latency > latencyMax)
+	latencyMax = latency;
+      nSeen = nPosted;
+    } else if (useEvents)
+      em->waitForEvent(100000);
+    else
+      OS::sleep(0);
+  }
+  threadCpu = now(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+}
+
+static void
+run(const char *name, bool events, unsigned idleMs, unsigned nWakeups)
+{
+  useEvents = events;
+  done = false;
+  nPosted = nSeen = 0;
+  latencySum = latencyMax = 0;
+  OS::ThreadManager thread(dispatchThread, NULL);
+  double start = now();
+  // Idle period, then a series of widely spaced wakeups
+  OS::sleep(idleMs);
+  for (unsigned n = 0; n < nWakeups; n++) {
+    posted = now();
+    __sync_synchronize();
+    nPosted = nPosted + 1;
+    if (events)
+      em->notify();
+    while (nSeen != nPosted)
+      OS::sleep(0);
+    OS::sleep(1);
+  }
+  done = true;
+  if (events)
+    em->notify();
+  thread.join();
+  double elapsed = now() - start;
+  printf("%-8s cpu: %6.3f of %6.3f secs (%5.1f%%)  wakeup latency avg: %8.2f usecs  max: %8.2f usecs\n",
+	 name, threadCpu, elapsed, threadCpu * 100 / elapsed,
+	 nWakeups ? latencySum * 1e6 / nWakeups : 0., latencyMax * 1e6);
+}
+
+int main( int argc, char** argv )
+{
+  unsigned idleMs = argc > 1 ? (unsigned)atoi(argv[1]) : 1000;
+  unsigned nWakeups = argc > 2 ? (unsigned)atoi(argv[2]) : 1000;
+  em = new DataTransfer::EventManager;
+  run("spin", false, idleMs, nWakeups);
+  run("event", true, idleMs, nWakeups);
+  delete em;
+  return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmark of transfer templates for ports with many buffers, over the PIO driver between
+ * two local endpoints.  Each transfer is a data copy, a metadata copy and a flag copy.  The
+ * "per-pair" mode creates a request for every output/input buffer pair, as the transport
+ * used to.  The "shared" mode creates one request and moves its copies to the selected
+ * buffers before each post, as the transport now does for large buffer counts.  Setup time,
+ * heap used and time per post are reported for each buffer count.
+ *
+ * usage: sharedTemplates [max-buffers [posts]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <malloc.h>
+#include <vector>
+#include "XferManager.h"
+#include "XferFactory.h"
+#include "XferEndPoint.h"
+#include "XferServices.h"
+
+namespace DT = DataTransfer;
+typedef DtOsDataTypes::Offset Offset;
+
+static const size_t DATA = 1024, META = 16, FLAG = 8, COPIES = 3;
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static size_t
+heapUsed()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  return mallinfo2().uordblks;
+#else
+  return (size_t)mallinfo().uordblks;
+#endif
+}
+
+// The offsets of the copies for a buffer, the same on both sides
+static void
+offsets(unsigned nBuffers, unsigned n, Offset offs[COPIES])
+{
+  offs[0] = (Offset)(n * DATA);
+  offs[1] = (Offset)(nBuffers * DATA + n * META);
+  offs[2] = (Offset)(nBuffers * (DATA + META) + n * FLAG);
+}
+
+static DT::XferRequest *
+request(DT::XferServices &xfs, const Offset src[COPIES], const Offset dst[COPIES])
+{
+  static const DT::XferRequest::Flags flags[COPIES] = {
+    DT::XferRequest::DataTransfer, DT::XferRequest::MetaDataTransfer,
+    DT::XferRequest::FlagTransfer
+  };
+  static const size_t sizes[COPIES] = { DATA, META, FLAG };
+  DT::XferRequest *req = xfs.createXferRequest();
+  for (unsigned c = 0; c < COPIES; c++)
+    if (!req->copy(src[c], dst[c], sizes[c], flags[c])) {
+      fprintf(stderr, "Copy could not be added to the request\n");
+      exit(1);
+    }
+  return req;
+}
+
+static void
+post(DT::XferRequest &req)
+{
+  req.post();
+  while (req.getStatus())
+    ;
+}
+
+static bool
+run(DT::XferServices &xfs, unsigned nBuffers, unsigned long nPosts)
+{
+  // per-pair
+  size_t heap = heapUsed();
+  double start = now();
+  std::vector<DT::XferRequest *> reqs(nBuffers * nBuffers);
+  for (unsigned s = 0; s < nBuffers; s++)
+    for (unsigned t = 0; t < nBuffers; t++) {
+      Offset src[COPIES], dst[COPIES];
+      offsets(nBuffers, s, src);
+      offsets(nBuffers, t, dst);
+      reqs[s * nBuffers + t] = request(xfs, src, dst);
+    }
+  double setup = now() - start;
+  heap = heapUsed() - heap;
+  start = now();
+  for (unsigned long n = 0; n < nPosts; n++)
+    post(*reqs[(n % nBuffers) * nBuffers + (n * 7 + 1) % nBuffers]);
+  double elapsed = now() - start;
+  printf("%4u buffers  per-pair  setup: %9.1f usecs  heap: %9zu bytes  post: %7.1f nsecs\n",
+	 nBuffers, setup * 1e6, heap, elapsed * 1e9 / (double)nPosts);
+  for (unsigned n = 0; n < reqs.size(); n++)
+    delete reqs[n];
+
+  // shared
+  heap = heapUsed();
+  start = now();
+  std::vector<Offset> table(nBuffers * COPIES);
+  for (unsigned n = 0; n < nBuffers; n++)
+    offsets(nBuffers, n, &table[n * COPIES]);
+  Offset curSrc[COPIES], curDst[COPIES];
+  offsets(nBuffers, 0, curSrc);
+  offsets(nBuffers, 0, curDst);
+  DT::XferRequest *req = request(xfs, curSrc, curDst);
+  if (!req->modify(0, NULL, NULL, NULL, NULL)) {
+    fprintf(stderr, "This driver's requests cannot be shared\n");
+    delete req;
+    return false;
+  }
+  setup = now() - start;
+  heap = heapUsed() - heap;
+  start = now();
+  for (unsigned long n = 0; n < nPosts; n++) {
+    const Offset
+      *src = &table[(n % nBuffers) * COPIES],
+      *dst = &table[((n * 7 + 1) % nBuffers) * COPIES];
+    req->modify(COPIES, curSrc, curDst, src, dst);
+    for (unsigned c = 0; c < COPIES; c++)
+      curSrc[c] = src[c], curDst[c] = dst[c];
+    post(*req);
+  }
+  elapsed = now() - start;
+  printf("%4u buffers  shared    setup: %9.1f usecs  heap: %9zu bytes  post: %7.1f nsecs\n",
+	 nBuffers, setup * 1e6, heap, elapsed * 1e9 / (double)nPosts);
+  delete req;
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned maxBuffers = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 0) : 64;
+  unsigned long nPosts = argc > 2 ? strtoul(argv[2], NULL, 0) : 100000;
+  DT::XferFactory *factory = DT::XferManager::getFactoryManager().find("ocpi-smb-pio");
+  if (!factory) {
+    fprintf(stderr, "The PIO transfer driver is not available\n");
+    return 1;
+  }
+  try {
+    size_t size = maxBuffers * (DATA + META + FLAG);
+    DT::EndPoint
+      &from = factory->getEndPoint("ocpi-smb-pio", true, false, size),
+      &to = factory->getEndPoint("ocpi-smb-pio", true, false, size);
+    DT::XferServices &xfs = factory->getTemplate(from, to);
+    for (unsigned n = 4; n <= maxBuffers; n *= 2)
+      if (!run(xfs, n, nPosts))
+	return 1;
+  } catch (std::string &e) {
+    fprintf(stderr, "Exception: %s\n", e.c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmark of PIO shared memory placement: a producer process creates a ring of buffers
+ * in shared memory with the given mapping options and streams into it, while a consumer
+ * process attaches by name and reads each buffer as it fills.  The "normal" mode is how
+ * SMBs used to be created: 4KB pages, placed and faulted in by whoever first touches
+ * them.  The other modes add prefaulting at creation, huge pages (hugetlbfs if mounted,
+ * otherwise transparent huge pages if enabled for shared memory), and binding to a NUMA
+ * node.  The first lap around the ring is timed separately since that is where page
+ * faults land.  dTLB load misses are counted in each process when perf events are
+ * available.
+ *
+ * usage: smemPlacement [buffer-bytes [buffers [laps [numa-node]]]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "OcpiUtilMisc.h"
+#include "HostFileMappingServices.h"
+
+namespace OU = OCPI::Util;
+namespace XF = DataTransfer;
+
+static const size_t FLAG_STRIDE = 64; // a cache line per flag
+struct Control {
+  volatile uint64_t consumerMisses, consumerSum;
+  volatile int consumerReady;
+};
+
+static size_t bufferSize, nBuffers, flagsSize;
+static unsigned nLaps;
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// A counter of this process's dTLB load misses, or -1 if perf events are unavailable
+static int
+tlbCounter()
+{
+  struct perf_event_attr pe;
+  memset(&pe, 0, sizeof(pe));
+  pe.type = PERF_TYPE_HW_CACHE;
+  pe.size = sizeof(pe);
+  pe.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  pe.disabled = 1;
+  pe.exclude_kernel = 1;
+  pe.exclude_hv = 1;
+  int fd = (int)syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+  if (fd >= 0)
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  return fd;
+}
+
+static uint64_t
+tlbMisses(int fd)
+{
+  uint64_t count = 0;
+  if (fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count))
+    return UINT64_MAX;
+  return count;
+}
+
+static volatile uint32_t &
+flag(uint8_t *base, size_t n)
+{
+  return *(volatile uint32_t *)(base + sizeof(Control) + n * FLAG_STRIDE);
+}
+
+static uint8_t *
+buffer(uint8_t *base, size_t n)
+{
+  return base + flagsSize + n * bufferSize;
+}
+
+static void
+consumer(const char *name)
+{
+  XF::OcpiFileMappingServices *mapper = XF::CreateFileMappingServices();
+  if (mapper->OpenMapping(name, XF::OcpiFileMappingServices::AllAccess)) {
+    fprintf(stderr, "Consumer could not open %s\n", name);
+    _exit(1);
+  }
+  uint8_t *base = (uint8_t *)mapper->MapView(0, 0, XF::OcpiFileMappingServices::AllAccess);
+  Control &c = *(Control *)base;
+  int fd = tlbCounter();
+  uint64_t sum = 0;
+  c.consumerReady = 1;
+  for (size_t n = 0; n < nLaps * nBuffers; n++) {
+    size_t b = n % nBuffers;
+    while (!flag(base, b))
+      ;
+    __sync_synchronize();
+    const uint64_t *p = (const uint64_t *)buffer(base, b);
+    for (size_t i = 0; i < bufferSize / sizeof(uint64_t); i++)
+      sum += p[i];
+    __sync_synchronize();
+    flag(base, b) = 0;
+  }
+  c.consumerMisses = tlbMisses(fd);
+  c.consumerSum = sum;
+  mapper->UnMapView(base);
+  delete mapper;
+  _exit(0);
+}
+
+static void
+printMisses(uint64_t misses)
+{
+  if (misses == UINT64_MAX)
+    printf("  %12s", "n/a");
+  else
+    printf("  %12llu", (unsigned long long)misses);
+}
+
+static void
+run(const char *mode, bool hugePages, bool prefault, int numaNode)
+{
+  XF::MappingOptions options;
+  options.hugePages = hugePages;
+  options.prefault = prefault;
+  options.numaNode = numaNode;
+  std::string name;
+  OU::format(name, "/smemPlacement%u", (unsigned)getpid());
+  size_t size = flagsSize + nBuffers * bufferSize;
+  XF::OcpiFileMappingServices *mapper = XF::CreateFileMappingServices();
+  double start = now();
+  if (mapper->CreateMapping("", name.c_str(), XF::OcpiFileMappingServices::ReadWriteAccess,
+			    size, &options)) {
+    fprintf(stderr, "Could not create %s\n", name.c_str());
+    exit(1);
+  }
+  uint8_t *base = (uint8_t *)mapper->MapView(0, 0, XF::OcpiFileMappingServices::AllAccess);
+  double setup = now() - start;
+  Control &c = *(Control *)base;
+  c.consumerReady = 0;
+  fflush(stdout);
+  pid_t pid = fork();
+  if (!pid)
+    consumer(name.c_str());
+  while (!c.consumerReady)
+    ;
+  int fd = tlbCounter();
+  double lapStart = now(), firstLap = 0;
+  for (size_t n = 0; n < nLaps * nBuffers; n++) {
+    size_t b = n % nBuffers;
+    if (n == nBuffers)
+      firstLap = now() - lapStart;
+    while (flag(base, b))
+      ;
+    memset(buffer(base, b), (int)(n & 0xff), bufferSize);
+    __sync_synchronize();
+    flag(base, b) = 1;
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  double elapsed = now() - lapStart;
+  if (nLaps == 1)
+    firstLap = elapsed;
+  printf("%-12s %8.2f %9.2f %10.1f", mode, setup * 1e3, firstLap * 1e3,
+	 (double)nLaps * (double)(nBuffers * bufferSize) / elapsed / 1e6);
+  printMisses(tlbMisses(fd));
+  printMisses(c.consumerMisses);
+  printf("\n");
+  if (fd >= 0)
+    close(fd);
+  mapper->UnMapView(base);
+  delete mapper;
+}
+
+int main(int argc, char **argv)
+{
+  bufferSize = argc > 1 ? strtoul(argv[1], NULL, 0) : 64 * 1024;
+  nBuffers = argc > 2 ? strtoul(argv[2], NULL, 0) : 1024;
+  nLaps = argc > 3 ? (unsigned)atoi(argv[3]) : 20;
+  int node = argc > 4 ? atoi(argv[4]) : XF::MappingOptions::InheritNode;
+  if (bufferSize < sizeof(uint64_t) || bufferSize % sizeof(uint64_t) || !nBuffers || !nLaps) {
+    fprintf(stderr, "Buffers must be a multiple of 8 bytes, and there must be some\n");
+    return 1;
+  }
+  flagsSize = OU::roundUp(sizeof(Control) + nBuffers * FLAG_STRIDE, 4096);
+  printf("ring: %zu buffers of %zu bytes (%.1f MB), %u laps\n", nBuffers, bufferSize,
+	 (double)(nBuffers * bufferSize) / (1024 * 1024), nLaps);
+  printf("%-12s %8s %9s %10s  %12s  %12s\n", "mode", "setup ms", "lap 1 ms", "MB/sec",
+	 "prod dTLB", "cons dTLB");
+  run("normal", false, false, XF::MappingOptions::AnyNode);
+  run("prefault", false, true, XF::MappingOptions::AnyNode);
+  run("huge", true, true, XF::MappingOptions::AnyNode);
+  run("huge+numa", true, true, node);
+  return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Loopback benchmark of the socket transfer driver's wire protocol: each transfer is a
+ * header and payload for a data buffer followed by a header and payload for its 4 byte
+ * flag.  The "separate" mode sends each piece with its own send and receives by staging
+ * through a 4KB buffer, as the driver used to.  The "gather" mode sends the whole
+ * transfer with one sendmsg and receives large payloads straight into place with readv,
+ * as the driver now does.  Throughput is measured by streaming, latency by ping-pong.
+ *
+ * usage: socketXfer [payload-bytes [transfers]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <vector>
+#include <algorithm>
+#include <OcpiOsSocket.h>
+#include <OcpiOsServerSocket.h>
+#include <OcpiOsThreadManager.h>
+
+namespace OS = OCPI::OS;
+
+struct DataHeader {
+  uint64_t offset;
+  uint32_t length;
+  uint32_t count;
+};
+static const size_t STAGE = 4096, BIG_STAGE = 64 * 1024, DIRECT_MIN = 4096;
+
+static bool gather, pingPong;
+static size_t payloadSize;
+static unsigned long nTransfers;
+static std::vector<uint8_t> smb; // the receiver's memory: buffer then flag
+static OS::Socket *serverSide;
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Receiver using 4KB staging, like the driver used to
+static void
+receiveSeparate(OS::Socket &s)
+{
+  uint8_t buf[STAGE], *current = NULL;
+  DataHeader header;
+  size_t left = 0, n;
+  bool inHeader = true;
+  unsigned long nFlags = 0;
+  while (nFlags < nTransfers && (n = s.recv((char *)buf, STAGE))) {
+    for (uint8_t *bp = buf; n; ) {
+      if (!left) {
+	if (inHeader) {
+	  current = (uint8_t *)&header;
+	  left = sizeof(header);
+	} else {
+	  current = &smb[header.offset];
+	  left = header.length;
+	}
+      }
+      size_t len = std::min(n, left);
+      memcpy(current, bp, len);
+      current += len, bp += len, n -= len;
+      if (!(left -= len)) {
+	if (!inHeader && header.length == 4 && ++nFlags && pingPong)
+	  s.send("a", 1);
+	inHeader = !inHeader;
+      }
+    }
+  }
+}
+
+// Receiver that stages small things and reads large payloads straight into place
+static void
+receiveGather(OS::Socket &s)
+{
+  std::vector<uint8_t> stage(BIG_STAGE);
+  uint8_t *buf = &stage[0];
+  size_t start = 0, end = 0, n;
+  DataHeader header;
+  for (unsigned long nFlags = 0; nFlags < nTransfers; ) {
+    while (end - start < sizeof(header)) {
+      memmove(buf, buf + start, end - start);
+      end -= start, start = 0;
+      if (!(n = s.recv((char *)buf + end, BIG_STAGE - end)))
+	return;
+      end += n;
+    }
+    memcpy(&header, buf + start, sizeof(header));
+    start += sizeof(header);
+    uint8_t *dst = &smb[header.offset];
+    for (size_t left = header.length; left; left -= n) {
+      if (start == end) {
+	start = end = 0;
+	if (left >= DIRECT_MIN) {
+	  struct iovec iov[2] = { { dst, left }, { buf, BIG_STAGE } };
+	  if (!(n = s.recvv(iov, 2)))
+	    return;
+	  if (n > left)
+	    end = n - left, n = left;
+	  dst += n;
+	  continue;
+	}
+	if (!(end = s.recv((char *)buf, BIG_STAGE)))
+	  return;
+      }
+      n = std::min(left, end - start);
+      memcpy(dst, buf + start, n);
+      dst += n, start += n;
+    }
+    if (header.length == 4 && ++nFlags && pingPong)
+      s.send("a", 1);
+  }
+}
+
+static void
+receiver(void *)
+{
+  if (gather)
+    receiveGather(*serverSide);
+  else
+    receiveSeparate(*serverSide);
+}
+
+static void
+run(const char *name, bool a_gather, bool a_pingPong, uint16_t port, OS::ServerSocket &server)
+{
+  gather = a_gather;
+  pingPong = a_pingPong;
+  OS::Socket client, server_side;
+  client.connect("127.0.0.1", port);
+  server.accept(server_side);
+  serverSide = &server_side;
+  std::vector<uint8_t> data(payloadSize);
+  uint32_t flag = 1;
+  DataHeader hdrs[2];
+  hdrs[0].offset = 0;
+  hdrs[0].length = (uint32_t)payloadSize;
+  hdrs[1].offset = payloadSize;
+  hdrs[1].length = sizeof(flag);
+  OS::ThreadManager thread(receiver, NULL);
+  double start = now();
+  for (unsigned long n = 0; n < nTransfers; n++) {
+    if (gather) {
+      struct iovec iov[4] = {
+	{ &hdrs[0], sizeof(DataHeader) }, { &data[0], payloadSize },
+	{ &hdrs[1], sizeof(DataHeader) }, { &flag, sizeof(flag) } };
+      client.sendv(iov, 4);
+    } else {
+      client.send((char *)&hdrs[0], sizeof(DataHeader));
+      client.send((char *)&data[0], payloadSize);
+      client.send((char *)&hdrs[1], sizeof(DataHeader));
+      client.send((char *)&flag, sizeof(flag));
+    }
+    if (pingPong) {
+      char ack;
+      client.recv(&ack, 1);
+    }
+  }
+  thread.join();
+  double elapsed = now() - start;
+  if (pingPong)
+    printf("%-9s latency:    %10.2f usecs per transfer round trip\n", name,
+	   elapsed * 1e6 / (double)nTransfers);
+  else
+    printf("%-9s throughput: %10.1f MB/sec  %10.0f transfers/sec\n", name,
+	   (double)nTransfers * (double)payloadSize / elapsed / 1e6,
+	   (double)nTransfers / elapsed);
+  client.close();
+  server_side.close();
+}
+
+int main(int argc, char **argv)
+{
+  payloadSize = argc > 1 ? strtoul(argv[1], NULL, 0) : 64 * 1024;
+  nTransfers = argc > 2 ? strtoul(argv[2], NULL, 0) : 20000;
+  if (payloadSize < 8) {
+    fprintf(stderr, "Payload must be at least 8 bytes\n");
+    return 1;
+  }
+  smb.resize(payloadSize + 4);
+  OS::ServerSocket server;
+  server.bind(0, false, false, true);
+  uint16_t port = server.getPortNo();
+  printf("payload: %zu bytes\n", payloadSize);
+  run("separate", false, false, port, server);
+  run("gather", true, false, port, server);
+  // Round trips can suffer from Nagle/delayed-ack stalls, so do fewer
+  nTransfers = std::min(nTransfers, 1000ul);
+  run("separate", false, true, port, server);
+  run("gather", true, true, port, server);
+  return 0;
+}
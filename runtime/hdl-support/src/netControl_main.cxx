@@ -0,0 +1,199 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Loopback benchmark of the network control protocol: a forked emulator answers register
+ * reads and writes over UDP using the Net::Responder, as a device that coalesces would.
+ * The "stop-wait" mode does one access per frame and waits for each response, as the
+ * driver always used to.  The "pipelined" mode keeps several single access frames
+ * outstanding, and the "coalesced" mode also packs as many accesses as allowed into each
+ * frame, as the driver now does for bulk property and sequence accesses.
+ *
+ * usage: netControl [accesses [rounds]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/wait.h>
+#include <vector>
+#include "HdlNetDriver.h"
+
+namespace OE = OCPI::OS::Ether;
+namespace HN = OCPI::HDL::Net;
+
+static const uint16_t PORT = 18099;
+static const uint32_t REGISTERS = 64 * 1024;
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+class Emulator : public HN::Responder {
+  std::vector<uint32_t> m_registers;
+public:
+  Emulator() : HN::Responder(HN::Pipeline::maxPossible()), m_registers(REGISTERS / 4) {}
+  HN::EtherControlResponse read(uint32_t offset, unsigned, uint32_t &data) {
+    if (offset >= REGISTERS)
+      return HN::ERROR;
+    data = m_registers[offset / 4];
+    return HN::OK;
+  }
+  HN::EtherControlResponse write(uint32_t offset, unsigned byteEnables, uint32_t data) {
+    if (offset >= REGISTERS)
+      return HN::ERROR;
+    uint32_t mask = 0;
+    for (unsigned n = 0; n < 4; n++)
+      if (byteEnables & (1u << n))
+	mask |= 0xffu << (n * 8);
+    m_registers[offset / 4] = (m_registers[offset / 4] & ~mask) | (data & mask);
+    return HN::OK;
+  }
+  void identify(HN::EtherControlNopResponse &response) {
+    memset(response.mac, 0, sizeof(response.mac));
+    response.pid = (uint32_t)getpid();
+  }
+};
+
+static void
+emulate(OE::Interface &ifc) {
+  std::string error;
+  OE::Socket s(ifc, ocpi_slave, NULL, PORT, error);
+  if (error.size()) {
+    fprintf(stderr, "Emulator socket failed: %s\n", error.c_str());
+    exit(1);
+  }
+  Emulator emulator;
+  OE::Packet in, out;
+  for (;;) {
+    size_t length, outLength;
+    OE::Address from;
+    if (s.receive(in, length, 0, from, error) &&
+	emulator.respond(in.payload, length, out.payload, outLength))
+      s.send(out, outLength, from, 0, NULL, error);
+  }
+}
+
+// What the driver does when it opens a device
+static unsigned
+negotiate(OE::Socket &s, OE::Address &addr, uint8_t &tag) {
+  OE::Packet frame;
+  HN::EtherControlNop &nop = *(HN::EtherControlNop *)frame.payload;
+  memset(&nop, 0, sizeof(nop));
+  nop.header.length = htons((uint16_t)(sizeof(nop) - 2));
+  nop.header.tag = ++tag;
+  nop.header.typeEtc = OCCP_ETHER_TYPE_ETC(HN::OCCP_NOP, 0xf, 0, 0);
+  nop.mbx80 = 0x80;
+  nop.mbz1 = 1;
+  nop.maxCoalesced = (uint8_t)HN::Pipeline::maxPossible();
+  std::string error;
+  for (unsigned n = 0; n < 10; n++) {
+    size_t length;
+    OE::Address from;
+    if (s.send(frame, sizeof(nop), addr, 0, NULL, error) &&
+	s.receive(frame, length, 500, from, error))
+      return ((HN::EtherControlNopResponse *)frame.payload)->maxCoalesced;
+  }
+  fprintf(stderr, "No response from emulator: %s\n", error.c_str());
+  exit(1);
+}
+
+static void
+run(const char *name, HN::Pipeline &pipeline, uint8_t &tag, size_t nAccesses,
+    unsigned rounds) {
+  std::vector<HN::Pipeline::Access> writes(nAccesses), reads(nAccesses);
+  for (size_t n = 0; n < nAccesses; n++) {
+    HN::Pipeline::Access a = { (uint32_t)(n * 4), 4, true, (uint32_t)(n * 7 + rounds) };
+    writes[n] = a;
+    a.write = false;
+    a.data = 0;
+    reads[n] = a;
+  }
+  std::string error;
+  size_t failed;
+  double start = now();
+  for (unsigned r = 0; r < rounds; r++)
+    if (pipeline.run(&writes[0], nAccesses, tag, 500, failed, error) != HN::OK ||
+	pipeline.run(&reads[0], nAccesses, tag, 500, failed, error) != HN::OK) {
+      fprintf(stderr, "%s: access %zu failed: %s\n", name, failed, error.c_str());
+      exit(1);
+    }
+  double elapsed = now() - start;
+  for (size_t n = 0; n < nAccesses; n++)
+    if (reads[n].data != writes[n].data) {
+      fprintf(stderr, "%s: register %zu read back 0x%x, not 0x%x\n", name, n, reads[n].data,
+	      writes[n].data);
+      exit(1);
+    }
+  double total = 2. * (double)nAccesses * rounds;
+  printf("%-10s %10.0f accesses/sec  %8.2f usecs per access  %8.1f usecs per round\n",
+	 name, total / elapsed, elapsed * 1e6 / total, elapsed * 1e6 / rounds);
+}
+
+int main(int argc, char **argv) {
+  size_t nAccesses = argc > 1 ? strtoul(argv[1], NULL, 0) : 512;
+  unsigned rounds = argc > 2 ? (unsigned)atoi(argv[2]) : 50;
+  if (!nAccesses || nAccesses > REGISTERS / 4) {
+    fprintf(stderr, "Accesses must be between 1 and %u\n", REGISTERS / 4);
+    return 1;
+  }
+  std::string error;
+  OE::IfScanner ifs(error);
+  OE::Interface ifc;
+  if (error.size() || !ifs.getNext(ifc, error, "udplocal")) {
+    fprintf(stderr, "No local UDP interface: %s\n", error.c_str());
+    return 1;
+  }
+  pid_t child = fork();
+  if (!child) {
+    emulate(ifc);
+    return 0;
+  }
+  OE::Address addr;
+  addr.set(PORT, htonl(INADDR_LOOPBACK));
+  OE::Socket s(ifc, ocpi_master, &addr, 0, error);
+  if (error.size()) {
+    fprintf(stderr, "Master socket failed: %s\n", error.c_str());
+    kill(child, SIGTERM);
+    return 1;
+  }
+  uint8_t tag = 0;
+  unsigned granted = negotiate(s, addr, tag);
+  printf("accesses: %zu writes then reads, rounds: %u, coalescing up to %u per frame\n",
+	 nAccesses, rounds, granted);
+  HN::Pipeline pipeline(s, addr);
+  pipeline.setLimits(1, 1);
+  run("stop-wait", pipeline, tag, nAccesses, rounds);
+  pipeline.setLimits(1, OCCP_ETHER_MAX_OUTSTANDING);
+  run("pipelined", pipeline, tag, nAccesses, rounds);
+  pipeline.setLimits(granted, OCCP_ETHER_MAX_OUTSTANDING);
+  run("coalesced", pipeline, tag, nAccesses, rounds);
+  kill(child, SIGTERM);
+  waitpid(child, NULL, 0);
+  return 0;
+}
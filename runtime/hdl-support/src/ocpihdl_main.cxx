@@ -434,6 +434,79 @@ static void probe(const char **) {
 static const char *ops[] =
   { "initialize", "start", "stop", "release", "test", "before", "after", "reserved7", 0};
 
+static char cadmin[sizeof(OH::OccpSpace)];
+// The emulation of a device's control plane for one host, with the host's tags,
+// coalescing and pipelining handled by the Responder
+class Emulator : public HE::Responder {
+public:
+  Emulator() : HE::Responder(HE::Pipeline::maxPossible()) {}
+  HE::EtherControlResponse read(uint32_t offset, unsigned /*byteEnables*/, uint32_t &data) {
+    if (offset > sizeof(cadmin)) {
+      ocpiBad("Read offset out of range: 0x%" PRIx32 ", returning 0\n", offset);
+      data = 0;
+      return HE::OK;
+    }
+    data = *(uint32_t *)&cadmin[offset];
+    if (offset >= offsetof(OH::OccpSpace, config)) {
+      size_t
+	wkr = (offset - offsetof(OH::OccpSpace, config)) / OCCP_WORKER_CONFIG_SIZE,
+	woffset = (offset - offsetof(OH::OccpSpace, config)) % OCCP_WORKER_CONFIG_SIZE;
+      printf("Worker %2zd config read 0x%zx\n", wkr, woffset);
+      if (wkr == 13 && woffset == 0x4c)
+	data = 0x8000;
+    } else if (offset >= offsetof(OH::OccpSpace, worker)) {
+      size_t
+	wkr = (offset - offsetof(OH::OccpSpace, worker)) / sizeof(OH::OccpWorker),
+	woffset = (offset - offsetof(OH::OccpSpace, worker)) % sizeof(OH::OccpWorker);
+      if (woffset < offsetof(OH::OccpWorkerRegisters, control)) {
+	printf("Worker %2zd control operation read: %s\n", wkr,
+	       ops[woffset/sizeof(uint32_t)]);
+	data = OCCP_SUCCESS_RESULT;
+      } else
+	printf("Worker %2zd register read: %s\n", wkr,
+	       woffset == offsetof(OH::OccpWorkerRegisters, control) ? "control" :
+	       woffset == offsetof(OH::OccpWorkerRegisters, window) ? "window" :
+	       woffset == offsetof(OH::OccpWorkerRegisters, clearError) ? "clearError" :
+	       woffset == offsetof(OH::OccpWorkerRegisters, lastConfig) ? "lastConfig" :
+	       "unknown");
+    }
+    return HE::OK;
+  }
+  HE::EtherControlResponse write(uint32_t offset, unsigned /*byteEnables*/, uint32_t data) {
+    if (offset > sizeof(cadmin)) {
+      ocpiDebug("Write offset out of range: 0x%" PRIx32 "\n", offset);
+    } else if (offset > offsetof(OH::OccpSpace, config)) {
+      size_t
+	wkr = (offset - offsetof(OH::OccpSpace, config)) / OCCP_WORKER_CONFIG_SIZE,
+	woffset = (offset - offsetof(OH::OccpSpace, config)) % OCCP_WORKER_CONFIG_SIZE;
+      printf("Worker %2zd config write 0x%zx: 0x%" PRIx32 "\n", wkr, woffset, data);
+      *(uint32_t *)&cadmin[offset] = data;
+    } else if (offset > offsetof(OH::OccpSpace, worker)) {
+      size_t
+	wkr = (offset - offsetof(OH::OccpSpace, worker)) / sizeof(OH::OccpWorker),
+	woffset = (offset - offsetof(OH::OccpSpace, worker)) % sizeof(OH::OccpWorker);
+      if (woffset < offsetof(OH::OccpWorkerRegisters, control)) {
+	printf("Worker %2zd control operation write???: %s\n",
+	       wkr, ops[woffset/sizeof(uint32_t)]);
+      } else {
+	printf("Worker %2zd register write of 0x%" PRIx32 " to %s\n", wkr, data,
+	       woffset == offsetof(OH::OccpWorkerRegisters, control) ? "control" :
+	       woffset == offsetof(OH::OccpWorkerRegisters, window) ? "window" :
+	       woffset == offsetof(OH::OccpWorkerRegisters, clearError) ? "clearError" :
+	       woffset == offsetof(OH::OccpWorkerRegisters, lastConfig) ? "lastConfig" :
+	       "unknown");
+	*(uint32_t *)&cadmin[offset] = data;
+      }
+    } else
+      *(uint32_t *)&cadmin[offset] = data;
+    return HE::OK;
+  }
+  void identify(HE::EtherControlNopResponse &response) {
+    memcpy(response.mac, OU::getSystemAddr().addr(), OS::Ether::Address::s_size);
+    response.pid = getpid();
+  }
+};
+
 static void emulate(const char **) {
   OE::IfScanner ifs(error);
   if (error.size())
@@ -446,146 +519,32 @@ static void emulate(const char **) {
 	bad("Failed to open slave socket");
       printf("Using interface %s with address %s\n", eif.name.c_str(), s.ifAddr().pretty());
       OE::Packet rFrame, sFrame;
-      static char cadmin[sizeof(OH::OccpSpace)];
       memset(cadmin, 0, sizeof(cadmin));
       OU::UuidString uuid;
       getDriver().initAdmin(*(OH::OccpAdminRegisters *)cadmin, "emulator",
 			*(OH::HdlUUID *)(cadmin + offsetof(OH::OccpSpace, config)), &uuid);
-      HE::EtherControlHeader &ech_out =  *(HE::EtherControlHeader *)(sFrame.payload);
-      bool haveTag = false;
-      OE::Address to;
+      std::map<OE::Address, Emulator, OE::Address::Compare> hosts;
       do {
 	size_t length;
 	OE::Address from;
 	if (s.receive(rFrame, length, 0, from, error)) {
 	  if (from == eif.addr)
 	    continue;
-	  bool sent;
 	  HE::EtherControlHeader &ech_in =  *(HE::EtherControlHeader *)(rFrame.payload);
-	  HE::EtherControlMessageType type = OCCP_ETHER_MESSAGE_TYPE(ech_in.typeEtc);
-	  unsigned uncache = OCCP_ETHER_UNCACHED(ech_in.typeEtc) ? 1 : 0;
-	  OE::Packet &out = uncache ? rFrame : sFrame;
-	  HE::EtherControlHeader *echp = (HE::EtherControlHeader *)out.payload;
-	  HE::EtherControlRead &ecr =  *(HE::EtherControlRead *)(rFrame.payload);
-	  uint32_t offset = ntohl(ecr.address); // for read or write
-	  HE::EtherControlWrite &ecw =  *(HE::EtherControlWrite *)(rFrame.payload);
-	  ocpiDebug("Received type %u, length 0x%x ntohs 0x%x tag %3d from %s, offset 0x%8" PRIx32
-		 ", data 0x%8" PRIx32 "\n",
-		 type, ech_in.length, ntohs(ech_in.length), ech_in.tag, from.pretty(), offset,
-		 ntohl(ecw.data));
-	  switch (type) {
-	  case HE::OCCP_READ:
-	  case HE::OCCP_WRITE:
-	    if (uncache || !haveTag || ech_in.tag != ech_out.tag || from != to) {
-	      if (!uncache) {
-		to = from;
-		haveTag = true;
-		echp->tag = ech_in.tag;
-	      }
-	      if (type == HE::OCCP_READ) {
-		ocpiAssert(ntohs(ech_in.length) == sizeof(ecr)-2);
-		HE::EtherControlReadResponse &ecrr =  *(HE::EtherControlReadResponse *)(echp);
-		ecrr.data = htonl(*(uint32_t *)&cadmin[offset]);
-		if (offset > sizeof(cadmin)) {
-		  ocpiBad("Read offset out of range: 0x%" PRIx32 ", returning 0\n", offset);
-		  ecrr.data = 0;
-		} else if (offset >= offsetof(OH::OccpSpace, config)) {
-		  size_t
-		    wkr = (offset - offsetof(OH::OccpSpace, config)) / OCCP_WORKER_CONFIG_SIZE,
-		    woffset = (offset - offsetof(OH::OccpSpace, config)) % OCCP_WORKER_CONFIG_SIZE;
-		  printf("Worker %2zd config read 0x%zx\n", wkr, woffset);
-		  if (wkr == 13 && woffset == 0x4c)
-		    ecrr.data = htonl(0x8000);
-		} else if (offset >= offsetof(OH::OccpSpace, worker)) {
-		  size_t
-		    wkr = (offset - offsetof(OH::OccpSpace, worker)) / sizeof(OH::OccpWorker),
-		    woffset = (offset - offsetof(OH::OccpSpace, worker)) % sizeof(OH::OccpWorker);
-		  if (woffset < offsetof(OH::OccpWorkerRegisters, control)) {
-		    printf("Worker %2zd control operation read: %s\n", wkr,
-			   ops[woffset/sizeof(uint32_t)]);
-		    ecrr.data = htonl(OCCP_SUCCESS_RESULT);
-		  } else
-		    printf("Worker %2zd register read: %s\n", wkr,
-			   woffset == offsetof(OH::OccpWorkerRegisters, control) ? "control" :
-			   woffset == offsetof(OH::OccpWorkerRegisters, window) ? "window" :
-			   woffset == offsetof(OH::OccpWorkerRegisters, clearError) ? "clearError" :
-			   woffset == offsetof(OH::OccpWorkerRegisters, lastConfig) ? "lastConfig" :
-			   "unknown");
-		}
-		echp->length = htons((short)(sizeof(ecrr)-2));
-	      } else {
-		HE::EtherControlWrite &ew =  *(HE::EtherControlWrite *)(rFrame.payload);
-		ocpiAssert(ntohs(ech_in.length) == sizeof(ew)-2);
-		uint32_t data = ntohl(ew.data);
-		if (offset > sizeof(cadmin)) {
-		  ocpiDebug("Write offset out of range: 0x%" PRIx32 "\n", offset);
-		} else if (offset > offsetof(OH::OccpSpace, config)) {
-		  size_t
-		    wkr = (offset - offsetof(OH::OccpSpace, config)) / OCCP_WORKER_CONFIG_SIZE,
-		    woffset = (offset - offsetof(OH::OccpSpace, config)) % OCCP_WORKER_CONFIG_SIZE;
-		  printf("Worker %2zd config write 0x%zx: 0x%" PRIx32 "\n", wkr, woffset, data);
-		  *(uint32_t *)&cadmin[offset] = data;
-		} else if (offset > offsetof(OH::OccpSpace, worker)) {
-		  size_t
-		    wkr = (offset - offsetof(OH::OccpSpace, worker)) / sizeof(OH::OccpWorker),
-		    woffset = (offset - offsetof(OH::OccpSpace, worker)) % sizeof(OH::OccpWorker);
-		  if (woffset < offsetof(OH::OccpWorkerRegisters, control)) {
-		    printf("Worker %2zd control operation write???: %s\n",
-			   wkr, ops[woffset/sizeof(uint32_t)]);
-		  } else {
-		    printf("Worker %2zd register write of 0x%" PRIx32 " to %s\n", wkr, data,
-			   woffset == offsetof(OH::OccpWorkerRegisters, control) ? "control" :
-			   woffset == offsetof(OH::OccpWorkerRegisters, window) ? "window" :
-			   woffset == offsetof(OH::OccpWorkerRegisters, clearError) ? "clearError" :
-			   woffset == offsetof(OH::OccpWorkerRegisters, lastConfig) ? "lastConfig" :
-			   "unknown");
-		    *(uint32_t *)&cadmin[offset] = data;
-		  }
-		} else
-		  *(uint32_t *)&cadmin[offset] = data;
-		HE::EtherControlWriteResponse &ecwr =  *(HE::EtherControlWriteResponse *)(echp);
-		echp->length = htons((short)(sizeof(ecwr)-2));
-	      }
-	      // Modify the outgoing packet last since we might be doing it in the
-	      // received buffer (for uncached mode).
-	      echp->typeEtc = OCCP_ETHER_TYPE_ETC(HE::OCCP_RESPONSE, HE::OK, uncache, 0);
-	      ocpiDebug("Sending read/write response packet: length is htons %x, ntohs %u tag %u",
-			echp->length, ntohs(echp->length), echp->tag);
-	    }
-	    sent = s.send(out, ntohs(echp->length) + 2, from, 0, NULL, error);
-	    break;
-	  case HE::OCCP_NOP:
-	    if (OCCP_ETHER_RESERVED(ech_in.typeEtc)) {
-	      ocpiInfo("Received reserved command with lenth: %zu",
-		       ntohs(ech_in.length) - sizeof(HE::EtherControlHeader));
-	      ech_in.length = htons((short)(sizeof(HE::EtherControlHeader)-2));
-	      ech_in.typeEtc = OCCP_ETHER_TYPE_ETC(HE::OCCP_RESPONSE, HE::OK, 1, 0);
-	    } else {
-	      HE::EtherControlNop &ecn =  *(HE::EtherControlNop *)(rFrame.payload);
-	      ocpiDebug("Received NOP: sizeof h %zd sizeof nop %zd offset %zd from %s\n",
-			sizeof(HE::EtherControlHeader), sizeof(HE::EtherControlNop),
-			offsetof(HE::EtherControlNop, mbx80), from.pretty());
-	      ocpiAssert(ntohs(ech_in.length) == sizeof(ecn)-2);
-	      HE::EtherControlNopResponse &ecnr =  *(HE::EtherControlNopResponse *)(rFrame.payload);
-	      // Tag is the same
-	      ech_in.length = htons((short)(sizeof(ecnr)-2));
-	      ech_in.typeEtc = OCCP_ETHER_TYPE_ETC(HE::OCCP_RESPONSE, HE::OK, uncache, 0);
-	      ecnr.mbx40 = 0x40;
-	      ecnr.mbz0 = 0;
-	      memcpy(ecnr.mac, OU::getSystemAddr().addr(), OS::Ether::Address::s_size);
-	      ecnr.pid = getpid();
-	      ocpiDebug("Sending nop response packet: length is sizeof %zu, htons %u, ntohs %u",
-			sizeof(HE::EtherControlNopResponse), ech_in.length, ntohs(ech_in.length));
-	    }
-	    sent = s.send(rFrame, ntohs(ech_in.length)+2, from, 0, NULL, error);
-	    break;
-	  default:
-	    sent = false; // warning
-	    bad("Invalid control packet type: typeEtc = 0x%x", ech_in.typeEtc);
+	  ocpiDebug("Received type %u, length 0x%x ntohs 0x%x tag %3d from %s\n",
+		    OCCP_ETHER_MESSAGE_TYPE(ech_in.typeEtc), ech_in.length, ntohs(ech_in.length),
+		    ech_in.tag, from.pretty());
+	  if (OCCP_ETHER_MESSAGE_TYPE(ech_in.typeEtc) == HE::OCCP_NOP &&
+	      OCCP_ETHER_RESERVED(ech_in.typeEtc))
+	    ocpiInfo("Received reserved command with lenth: %zu",
+		     ntohs(ech_in.length) - sizeof(HE::EtherControlHeader));
+	  size_t outLength;
+	  if (!hosts[from].respond(rFrame.payload, length, sFrame.payload, outLength)) {
+	    ocpiDebug("No response for tag %u from %s", ech_in.tag, from.pretty());
+	    continue;
 	  }
-	  if (sent)
-	    ocpiDebug("response sent ok to %s %x %x %x\n",
-		   from.pretty(), echp->length, echp->typeEtc, echp->tag);
+	  if (s.send(sFrame, outLength, from, 0, NULL, error))
+	    ocpiDebug("response sent ok to %s, %zu bytes\n", from.pretty(), outLength);
 	  else
 	    ocpiDebug("response send error: %s\n", error.c_str());
 	} else
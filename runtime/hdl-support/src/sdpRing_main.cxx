@@ -0,0 +1,258 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmark of the SDP transports between the HDL simulation server and a simulator:
+ * the four fifos against the shared memory ring.  A forked "simulator" stands in for
+ * the SDP stub: it takes DCP credits from the control channel, reads the SDP messages
+ * they cover from the request channel, echoes writes back as writes (like DMA output)
+ * and answers reads.  The server side sends as the device's send2sdp does and receives
+ * in a separate thread as the container thread does.  Throughput is measured by
+ * streaming writes, latency by single register reads.
+ *
+ * usage: sdpRing [payload-bytes [messages]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <vector>
+#include "OcpiOsMutex.h"
+#include "OcpiOsSemaphore.h"
+#include "OcpiOsThreadManager.h"
+#include "OcpiUtilAutoMutex.h"
+#include "HdlSdpRing.h"
+
+namespace OS = OCPI::OS;
+namespace OU = OCPI::Util;
+namespace SDP = OCPI::HDL::SDP;
+
+// As in HdlLSimDevice.cxx
+enum Action { SPIN_CREDIT = 0, DCP_CREDIT = 1, TERMINATE = 255 };
+
+static size_t payloadSize;
+static unsigned long nWrites, nReads;
+static SDP::Stream *req, *resp, *ctl, *ack;
+static OS::Mutex sendMutex;
+static OS::Semaphore writesDone(0), readDone(0);
+static SDP::Header *pendingRead;
+static uint8_t readData[8];
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void
+check(bool bad, const std::string &error)
+{
+  if (bad) {
+    fprintf(stderr, "Error: %s\n", error.c_str());
+    exit(1);
+  }
+}
+
+// The simulator's SDP stub
+static void
+simulator(SDP::Ring *ring)
+{
+  std::vector<uint8_t> buf(SDP::Header::max_message_bytes);
+  std::string error;
+  for (;;) {
+    uint8_t msg[3];
+    if (ctl->read(msg, 2, error))
+      _exit(ring && ring->terminating() ? 0 : 1);
+    switch (msg[0]) {
+    case SPIN_CREDIT:
+      msg[0] = '1';
+      check(ack->write(msg, 1, error), error);
+      break;
+    case DCP_CREDIT:
+      {
+	check(ctl->read(msg + 2, 1, error), error);
+	size_t owed = (size_t)(msg[1] | msg[2] << 8) * SDP::Header::dword_bytes;
+	while (owed) {
+	  SDP::Header h;
+	  bool request;
+	  size_t length;
+	  check(h.getHeader(*req, request, error), error);
+	  owed -= SDP::Header::header_ndws * SDP::Header::dword_bytes;
+	  if (h.get_op() == SDP::Header::WriteOp) {
+	    owed -= (h.get_count() + 1) * SDP::Header::dword_bytes;
+	    check(h.endRequest(h, *req, &buf[0], error) ||
+		  h.startRequest(*resp, &buf[0], length, error), error);
+	  } else {
+	    memset(&buf[0], 0x5a, h.getLength());
+	    check(h.sendResponse(*resp, &buf[0], length, error), error);
+	  }
+	}
+      }
+      break;
+    case TERMINATE:
+      _exit(0);
+    }
+  }
+}
+
+// The server side's container thread
+static void
+receiver(void *)
+{
+  std::vector<uint8_t> buf(SDP::Header::max_message_bytes);
+  std::string error;
+  for (unsigned long nWritten = 0, nRead = 0; nWritten < nWrites || nRead < nReads; ) {
+    SDP::Header h;
+    bool request;
+    check(h.getHeader(*resp, request, error), error);
+    if (request) {
+      check(h.endRequest(h, *resp, &buf[0], error), error);
+      if (++nWritten == nWrites)
+	writesDone.post();
+    } else {
+      check(pendingRead->endRequest(h, *resp, readData, error), error);
+      nRead++;
+      readDone.post();
+    }
+  }
+}
+
+static void
+send2sdp(SDP::Header &h, uint8_t *data)
+{
+  std::string error;
+  size_t length;
+  {
+    OU::AutoMutex m(sendMutex);
+    check(h.startRequest(*req, data, length, error), error);
+  }
+  uint8_t msg[3];
+  length /= SDP::Header::dword_bytes;
+  msg[0] = DCP_CREDIT;
+  msg[1] = (uint8_t)(length & 0xff);
+  msg[2] = (uint8_t)(length >> 8);
+  check(ctl->write(msg, 3, error), error);
+}
+
+static void
+run(const char *name, SDP::Ring *ring)
+{
+  fflush(stdout);
+  pid_t pid = fork();
+  if (!pid) {
+    std::string error;
+    if (ring) {
+      // Attach as a simulator would, given the plusarg
+      SDP::Ring sim(ring->plusarg().c_str(), error);
+      check(!error.empty(), error);
+      req = &sim.channel(SDP::Ring::Request);
+      resp = &sim.channel(SDP::Ring::Response);
+      ctl = &sim.channel(SDP::Ring::Control);
+      ack = &sim.channel(SDP::Ring::Ack);
+      simulator(&sim);
+    }
+    simulator(NULL);
+  }
+  std::string error;
+  uint8_t msg[2] = { SPIN_CREDIT, 20 };
+  check(ctl->write(msg, 2, error) || ack->read(msg, 1, error), error);
+  if (ring && !ring->attached()) {
+    fprintf(stderr, "Simulator did not attach to the ring\n");
+    exit(1);
+  }
+  OS::ThreadManager thread(receiver, NULL);
+  std::vector<uint8_t> data(payloadSize, 0xa5);
+  double start = now();
+  for (unsigned long n = 0; n < nWrites; n++) {
+    SDP::Header h(false, (n * payloadSize) % (1024 * 1024), payloadSize);
+    send2sdp(h, &data[0]);
+  }
+  writesDone.wait();
+  double writeTime = now() - start;
+  start = now();
+  for (unsigned long n = 0; n < nReads; n++) {
+    SDP::Header h(true, 0x100, 4);
+    pendingRead = &h;
+    send2sdp(h, NULL);
+    readDone.wait();
+  }
+  double readTime = now() - start;
+  thread.join();
+  msg[0] = TERMINATE;
+  msg[1] = 0;
+  check(ctl->write(msg, 2, error), error);
+  int status;
+  waitpid(pid, &status, 0);
+  printf("%-5s throughput: %8.1f MB/sec each way %10.0f messages/sec   "
+	 "read latency: %7.2f usecs\n", name,
+	 (double)nWrites * (double)payloadSize / writeTime / 1e6, (double)nWrites / writeTime,
+	 readTime * 1e6 / (double)nReads);
+}
+
+int main(int argc, char **argv)
+{
+  payloadSize = argc > 1 ? strtoul(argv[1], NULL, 0) : 4096;
+  nWrites = argc > 2 ? strtoul(argv[2], NULL, 0) : 100000;
+  nReads = nWrites < 20000 ? nWrites : 20000;
+  if (payloadSize < 4 || payloadSize > SDP::Header::max_message_bytes || payloadSize & 3) {
+    fprintf(stderr, "Payload must be a multiple of 4 bytes from 4 to %u\n",
+	    SDP::Header::max_message_bytes);
+    return 1;
+  }
+  char dir[] = "/tmp/sdpRingXXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  printf("payload: %zu bytes, messages: %lu\n", payloadSize, nWrites);
+  // The fifos, opened both ways as the device does
+  const char *names[] = { "request", "response", "control", "ack" };
+  SDP::FdStream fifos[4];
+  for (unsigned n = 0; n < 4; n++) {
+    std::string path = std::string(dir) + "/" + names[n];
+    if (mkfifo(path.c_str(), 0666)) {
+      perror("mkfifo");
+      return 1;
+    }
+    fifos[n].setFd(open(path.c_str(), O_RDWR));
+    unlink(path.c_str());
+  }
+  req = &fifos[0], resp = &fifos[1], ctl = &fifos[2], ack = &fifos[3];
+  run("fifo", NULL);
+  {
+    std::string error;
+    SDP::Ring ring(std::string(dir) + "/ring", error);
+    check(!error.empty(), error);
+    req = &ring.channel(SDP::Ring::Request);
+    resp = &ring.channel(SDP::Ring::Response);
+    ctl = &ring.channel(SDP::Ring::Control);
+    ack = &ring.channel(SDP::Ring::Ack);
+    run("ring", &ring);
+  }
+  rmdir(dir);
+  return 0;
+}
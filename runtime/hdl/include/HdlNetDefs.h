@@ -70,7 +70,7 @@ typedef struct {
   uint32_t pid;
   uint8_t mac[6];
   uint8_t mbx40;
-  uint8_t mbz0;
+  uint8_t maxCoalesced; // zero from devices that do not coalesce
 } EtherControlNopResponse;
 typedef struct {
   EtherControlHeader header;
@@ -110,6 +110,21 @@ typedef enum {
 #define OCCP_ETHER_TYPE_ETC(type, be, uncache, rsvd) \
   (uint8_t)(((type) << 4) | ((be) & 0xf) | ((uncache) << 6) | ((rsvd) << 7))
 #define OCCP_ETHER_RESERVED(t_and_be) ((t_and_be) & 0x80)
+/*
+  Coalescing and pipelining, which are optional and negotiated.
+  A host that can coalesce sends a NOP (not uncached) with its limit in maxCoalesced.
+  A device that can coalesce answers with the smaller of that and its own limit in the NOP
+  response's maxCoalesced, which other devices leave zero.  After such an exchange:
+  - A frame may carry up to maxCoalesced read and write messages back to back, each with
+    its own header and the frame's tag.  The response frame carries their responses in the
+    same order.  The device stops executing a frame's messages after one that fails.
+  - Up to OCCP_ETHER_MAX_OUTSTANDING frames may be outstanding, with consecutive tags
+    starting after the NOP's tag.  The device executes frames in tag order.  It answers a
+    tag it has already executed from its saved responses, and ignores tags ahead of the
+    next one it expects.  So the host recovers from a loss by resending everything
+    outstanding, starting with the oldest.
+*/
+#define OCCP_ETHER_MAX_OUTSTANDING 8
 
 #ifdef __cplusplus
     }
@@ -40,6 +40,71 @@ namespace OCPI {
       const unsigned DELAYMS = 500;
       const unsigned MAX_INTERFACES = 10;
 
+      // The host side of pipelined, coalesced control access (see HdlNetDefs.h)
+      class Pipeline {
+      public:
+	struct Access {
+	  uint32_t offset;
+	  unsigned bytes;  // 1 to 4, within one word
+	  bool write;
+	  uint32_t data;   // right justified: to write, or what was read
+	};
+      private:
+	struct Frame {
+	  uint8_t tag;
+	  bool answered;
+	  size_t first, count, length;
+	  OCPI::OS::Ether::Packet packet;
+	};
+	OCPI::OS::Ether::Socket &m_socket;
+	OCPI::OS::Ether::Address &m_addr;
+	unsigned m_maxCoalesced, m_window;
+	Frame m_frames[OCCP_ETHER_MAX_OUTSTANDING];
+	OCPI::OS::Ether::Packet m_recv;
+	size_t build(Frame &f, Access *accesses, size_t first, size_t n, uint8_t tag);
+	bool parse(Frame &f, Access *accesses, size_t length, EtherControlResponse &response,
+		   size_t &failed);
+      public:
+	Pipeline(OCPI::OS::Ether::Socket &socket, OCPI::OS::Ether::Address &addr);
+	// Coalescing limit and frames outstanding: 0 and 1 means stop-and-wait
+	void setLimits(unsigned maxCoalesced, unsigned window);
+	unsigned maxCoalesced() const { return m_maxCoalesced; }
+	// The most messages our frames can hold
+	static unsigned maxPossible();
+	// Perform the accesses in order, using and advancing the tag.  Return OK, or the
+	// response that stopped it and the index of the access that got it.
+	EtherControlResponse run(Access *accesses, size_t n, uint8_t &tag, unsigned delayms,
+				 size_t &failed, std::string &error);
+      };
+      // The device side, for software emulators of devices: ordering and replay of
+      // tagged frames and coalesced messages.  Derived classes do the accesses.
+      // One of these is needed for each host talking to the device.
+      class Responder {
+	struct Saved {
+	  bool valid;
+	  uint8_t tag;
+	  size_t length;
+	  uint8_t data[OCPI::OS::Ether::MaxPacketSize];
+	};
+	unsigned m_maxCoalesced, m_granted; // ours, and what we agreed to with the host
+	uint8_t m_expected;                 // the next tag when pipelining
+	Saved m_saved[OCCP_ETHER_MAX_OUTSTANDING];
+	size_t execute(const uint8_t *in, size_t inLength, uint8_t *out, unsigned max);
+      public:
+	Responder(unsigned maxCoalesced);
+	virtual ~Responder();
+	// Process a received payload and put any response payload in "out".
+	// Return false if there is nothing to send.
+	bool respond(const uint8_t *in, size_t inLength, uint8_t *out, size_t &outLength);
+      protected:
+	// Accesses to the aligned word at offset, with byte enables
+	virtual EtherControlResponse read(uint32_t offset, unsigned byteEnables,
+					  uint32_t &data) = 0;
+	virtual EtherControlResponse write(uint32_t offset, unsigned byteEnables,
+					   uint32_t data) = 0;
+	// Fill in the identifying parts of a NOP response
+	virtual void identify(EtherControlNopResponse &response) = 0;
+      };
       class Device;
       class Driver {
 	friend class Device;
@@ -97,6 +162,9 @@ namespace OCPI {
 	std::string m_error;
 	bool m_discovery;
 	unsigned m_delayms;
+	Pipeline *m_pipeline; // when the device can pipeline and coalesce
+	void negotiate(const OCPI::Util::PValue *params);
+	void pipeline(Pipeline::Access *accesses, size_t n, uint32_t *status);
       protected:
 	Device(Driver &driver, OCPI::OS::Ether::Interface &ifc, std::string &name,
 	       OCPI::OS::Ether::Address &devAddr, bool discovery, const char *data_proto,
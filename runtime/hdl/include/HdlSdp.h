@@ -64,6 +64,23 @@
 namespace OCPI {
   namespace HDL {
     namespace SDP {
+      // The byte stream that SDP messages travel on: a fifo or socket, or a channel of a
+      // shared memory ring (see HdlSdpRing.h).  Both calls return true on error.
+      class Stream {
+      public:
+	virtual ~Stream() {}
+	virtual bool read(uint8_t *buf, size_t length, std::string &error) = 0;
+	virtual bool write(const uint8_t *data, size_t length, std::string &error) = 0;
+      };
+      class FdStream : public Stream {
+	int m_fd;
+      public:
+	FdStream(int fd = -1) : m_fd(fd) {}
+	void setFd(int fd) { m_fd = fd; }
+	int fd() const { return m_fd; }
+	bool read(uint8_t *buf, size_t length, std::string &error);
+	bool write(const uint8_t *data, size_t length, std::string &error);
+      };
       class Header {
       public:
 	static const unsigned
@@ -148,14 +165,15 @@ namespace OCPI {
 	}
 	inline bool doRequest(OCPI::OS::Socket &s, uint8_t *data, std::string &error) {
 	  size_t length;
-	  return startRequest(s.fd(), data, length, error) ? true :
-	    endRequest(s.fd(), data, error);
+	  FdStream stream(s.fd());
+	  return startRequest(stream, data, length, error) ? true :
+	    endRequest(stream, data, error);
 	}
-	bool startRequest(int sendFd, uint8_t *data, size_t &length, std::string &error);
-	bool sendResponse(int sendFd, uint8_t *data, size_t &length, std::string &error);
-	bool endRequest(int recvFd, uint8_t *data, std::string &error);
-	bool getHeader(int recvFd, bool &request, std::string &error);
-	bool endRequest(Header &h, int recvFd, uint8_t *data, std::string &error);
+	bool startRequest(Stream &send, const uint8_t *data, size_t &length, std::string &error);
+	bool sendResponse(Stream &send, const uint8_t *data, size_t &length, std::string &error);
+	bool endRequest(Stream &recv, uint8_t *data, std::string &error);
+	bool getHeader(Stream &recv, bool &request, std::string &error);
+	bool endRequest(Header &h, Stream &recv, uint8_t *data, std::string &error);
         void respond();
       };
       bool read(int fd, uint8_t *buf, size_t nRequested, std::string &error);
@@ -0,0 +1,109 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Shared memory rings between the HDL simulation server and the simulator-side SDP stub.
+ *
+ * These replace the four fifos (request, response, control and ack) with four
+ * single-producer, single-consumer byte rings in one shared file, so SDP headers and
+ * payloads move with memcpy rather than several small reads and writes per message.
+ * Each side has an eventfd doorbell which the other side rings after writing, but only
+ * when the first side has said it is about to sleep waiting for that channel, so steady
+ * traffic makes no system calls.  A writer that finds a ring full (a stalled reader) backs off with short sleeps.
+ *
+ * The server creates the ring and passes its "plusarg" (path and doorbell descriptors,
+ * which are inherited by the simulator) to the simulator, whose stub attaches to it.
+ * A stub that does not understand the ring just uses the fifos.
+ */
+
+#ifndef HDL_SDP_RING_H
+#define HDL_SDP_RING_H
+#include <string>
+#include "OcpiOsMutex.h"
+#include "HdlSdp.h"
+
+namespace OCPI {
+  namespace HDL {
+    namespace SDP {
+      class Ring {
+      public:
+	enum ChannelId {
+	  Request,   // SDP traffic from the server to the simulator
+	  Response,  // SDP traffic from the simulator to the server
+	  Control,   // spin and DCP credits from the server
+	  Ack,       // spin credit acks from the simulator
+	  NChannels
+	};
+	enum Side { Server, Simulator };
+	struct Shared;
+	struct Queue;
+	class Channel : public Stream {
+	  friend class Ring;
+	  Ring &m_ring;
+	  ChannelId m_id;
+	  Queue &m_queue;
+	  uint8_t *m_data;
+	  uint64_t m_mask;
+	  OCPI::OS::Mutex m_mutex; // for several threads writing on one side
+	  Channel(Ring &ring, ChannelId id);
+	public:
+	  // Bytes that can be read now
+	  size_t available() const;
+	  // Read (blocking) or write (blocking while the ring is full) exactly "length" bytes
+	  bool read(uint8_t *buf, size_t length, std::string &error);
+	  bool write(const uint8_t *data, size_t length, std::string &error);
+	  // Discard anything not yet read, when neither side is using the channel
+	  void flush();
+	};
+      private:
+	Side m_side;
+	std::string m_path, m_plusarg;
+	Shared *m_shared;
+	size_t m_size;
+	int m_bells[2]; // doorbells, indexed by side
+	bool m_owner;   // we created the file and the doorbells
+	unsigned m_spins;
+	Channel *m_channels[NChannels];
+	bool init(std::string &error);
+	bool ready(unsigned mask) const;
+      public:
+	// Server side: create the ring file and the doorbells
+	Ring(const std::string &path, std::string &error);
+	// Simulator side: attach to the ring described by the server's plusarg
+	Ring(const char *plusarg, std::string &error);
+	~Ring();
+	// "path,simulator-doorbell-fd,server-doorbell-fd"
+	const std::string &plusarg() const { return m_plusarg; }
+	Channel &channel(ChannelId id) { return *m_channels[id]; }
+	// The simulator side has attached
+	bool attached() const;
+	// Ask the simulator to stop.  Safe to call from a signal handler.
+	void terminate();
+	bool terminating() const;
+	// Wait up to "usecs" until any of the channels in "mask" (bits by ChannelId), which
+	// this side reads, has something to read.  Return true if something does.
+	bool wait(unsigned usecs, unsigned mask);
+	// Ring the other side's doorbell if it is waiting for this channel
+	void notify(ChannelId id);
+      };
+    }
+  }
+}
+#endif
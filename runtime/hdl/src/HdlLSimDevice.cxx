@@ -36,6 +36,7 @@
 #include "OcpiTransport.h"
 #include "LibrarySimple.h"
 #include "HdlSdp.h"
+#include "HdlSdpRing.h"
 #include "HdlLSimDriver.h"
 #include "HdlDriver.h"
 #include "HdlContainer.h"
@@ -148,6 +149,12 @@ class Device
   // This fifo is for control responses from the sim to us.
   // Currently this is simply an "ack" for spincredits.
   Fifo m_ack;
+  // The shared memory alternative to the fifos, offered to the simulator at startup and
+  // used if its SDP stub attaches to it and acks the first spin credit through it.
+  SDP::Ring *m_ring;
+  bool m_useRing, m_ringActive;
+  SDP::FdStream m_reqFifo, m_respFifo;
+  SDP::Stream *m_reqStream, *m_respStream; // the fifos or the ring's channels
   int m_maxFd;
   fd_set m_alwaysSet;
   pid_t m_pid;
@@ -213,6 +220,8 @@ protected:
       m_resp(simDir + "/response", true),
       m_ctl(simDir + "/control", false),
       m_ack(simDir + "/ack", false),
+      m_ring(NULL), m_useRing(false), m_ringActive(false),
+      m_reqStream(&m_reqFifo), m_respStream(&m_respFifo),
       m_maxFd(-1), m_pid(0), m_exited(false), m_stopped(false), m_dcp(0), m_respLeft(0),
       m_simDir(simDir), m_platform(a_platform), m_script(script), m_dump(dump), m_spinning(false),
       m_sleepUsecs(sleepUsecs), m_simTicks(simTicks), m_spinCount(spinCount),
@@ -220,6 +229,9 @@ protected:
     if (error.length())
       return;
     FD_ZERO(&m_alwaysSet);
+    const char *env = getenv("OCPI_HDL_SIM_RING");
+    m_useRing = env && env[0] == '1';
+    OU::findBool(params, "sdpRing", m_useRing);
     initAdmin(*(OH::OccpAdminRegisters *)m_admin, m_platform.c_str(), m_uuid, &m_textUUID);
     if (m_verbose) {
       fprintf(stderr, "Simulation HDL device %s for %s (UUID %s, dir %s, ticks %u)\n",
@@ -257,6 +269,8 @@ protected:
       return true;
     }
     ocpiDebug("initFifos resp %d ack %d nfds %d", m_resp.m_rfd, m_ack.m_rfd, m_maxFd);
+    m_reqFifo.setFd(m_req.m_wfd);
+    m_respFifo.setFd(m_resp.m_rfd);
     addFd(m_resp.m_rfd, true);
     addFd(m_ack.m_rfd, false);
     return false;
@@ -349,12 +363,22 @@ protected:
     std::string dir = m_simDir[0] == '/' ? m_simDir : "../../";
 
     std::string cwd = OS::FileSystem::cwd();
+    if (m_useRing) {
+      std::string ringError;
+      m_ring = new SDP::Ring(m_simDir + "/ring", ringError);
+      if (ringError.size()) {
+	ocpiInfo("Not offering a shared memory SDP ring to the simulator: %s", ringError.c_str());
+	dropRing();
+      }
+    }
     OU::format(cmd,
 	       "D=\"%s\" && exec %s %s %s "
 	       "\"sw2sim=${D}%s\" \"sim2sw=${D}%s\" \"ctl=${D}%s\" \"ack=${D}%s\" \"cwd=%s\"",
 	       dir.c_str(), m_script.c_str(), OS::logGetLevel() >= 8 ? "-v" : "", m_file.c_str(),
 	       m_req.m_name.c_str(), m_resp.m_name.c_str(), m_ctl.m_name.c_str(),
 	       m_ack.m_name.c_str(), cwd.c_str());
+    if (m_ring)
+      OU::formatAdd(cmd, " \"sdpring=${D}%s\"", m_ring->plusarg().c_str());
     if (m_dump)
       cmd += " bscvcd";
     if (m_verbose)
@@ -410,8 +434,13 @@ protected:
     for (unsigned n = 0; n < 1; n++)
       if (spin(err) || mywait(false, err) || ack(err))
 	return true;
+    if (m_ring && !m_ringActive) {
+      ocpiInfo("Simulator did not attach to the shared memory SDP ring, using fifos");
+      dropRing();
+    }
     if (m_verbose)
-      fprintf(stderr, "Simulator process is running.\n");
+      fprintf(stderr, "Simulator process is running%s.\n",
+	      m_ringActive ? " (using a shared memory SDP ring)" : "");
     err.clear();
     return false;
   }
@@ -444,7 +473,10 @@ protected:
       msg[0] = TERMINATE;
       msg[1] = 0;
       ocpiInfo("Telling the simulator process (%u) to stop", m_pid);
-      ocpiCheck(write(m_ctl.m_wfd, msg, 2) == 2);
+      if (ctlWrite(msg, 2, error)) {
+	ocpiBad("Error telling the simulator to stop: %s", error.c_str());
+	error.clear();
+      }
       ocpiInfo("Waiting for simulator process to exit");
       mywait(true, error);
       if (m_pid && killpg(m_pid, SIGTERM) == 0) {
@@ -459,6 +491,7 @@ protected:
     }
     m_exited = false;
     flush();
+    dropRing();
     m_isAlive = false;
   }
   bool
@@ -467,11 +500,8 @@ protected:
       uint8_t msg[2];
       msg[0] = SPIN_CREDIT;
       msg[1] = m_spinCount;
-      ssize_t w = write(m_ctl.m_wfd, msg, 2);
-      if (w != 2) {
-	OU::format(error, "spin control write to sim failed. w %zd", w);
+      if (ctlWrite(msg, 2, error))
 	return true;
-      }
       ocpiDebug("Sent spin for %u", m_spinCount);
       m_cumTicks += m_spinCount;
       m_spinTimer.restart();
@@ -479,10 +509,29 @@ protected:
     }
     return false;
   }
+  // Control messages go on the ring once it is in use, on the fifo if there is no ring,
+  // and on both while the simulator has not yet said which one it uses.
+  bool
+  ctlWrite(const uint8_t *msg, size_t len, std::string &error) {
+    if (m_ring && m_ring->channel(SDP::Ring::Control).write(msg, len, error))
+      return true;
+    if (!m_ringActive && write(m_ctl.m_wfd, msg, len) != (ssize_t)len)
+      return OU::eformat(error, "write error to control fifo: %s", strerror(errno));
+    return false;
+  }
+  void
+  dropRing() {
+    delete m_ring;
+    m_ring = NULL;
+    m_ringActive = false;
+    m_reqStream = &m_reqFifo;
+    m_respStream = &m_respFifo;
+  }
   // Read a single character '1' from the sim process
   //   Return failure (true) if sim process exits
   //   Use select (with timeout) to probe for readiness
   //   On select timeout, try again
+  //   The first ack through the ring means the simulator is using the ring
   bool
   ack(std::string &error) {
     // setup file descriptors for select
@@ -493,11 +542,36 @@ protected:
     timeout.tv_usec =  timeoutUsecs % 1000000;
     // Continue to try select/read until we read 1 byte, a non-eintr error occurs or sim process exits
     while (true) {
+      if (mywait(false, error))
+        return true; // process ended
+      if (m_ring && m_ring->attached()) {
+	SDP::Ring::Channel &c = m_ring->channel(SDP::Ring::Ack);
+	if (c.available()) {
+	  uint8_t a;
+	  if (c.read(&a, 1, error))
+	    return true;
+	  if (a != '1')
+	    return OU::eformat(error, "Unexpected: ack read from sim failed. c %d", a);
+	  if (!m_ringActive) {
+	    ocpiInfo("Simulator is using the shared memory SDP ring");
+	    m_ringActive = true;
+	    m_reqStream = &m_ring->channel(SDP::Ring::Request);
+	    m_respStream = &m_ring->channel(SDP::Ring::Response);
+	  }
+	  ocpiDebug("Sim sent ACK. Tick count at %" PRIu64, m_cumTicks);
+	  m_spinning = false;
+	  return false;
+	}
+	if (m_ringActive) {
+	  m_ring->wait(timeoutUsecs, 1u << SDP::Ring::Ack);
+	  continue;
+	}
+      }
       FD_ZERO(&fds);
       FD_SET(m_ack.m_rfd, &fds);
       struct timeval tmpTimeout = timeout; // cleared by select attempt
-      if (mywait(false, error))
-        return true; // process ended
+      if (m_ring) // waiting to see which way the simulator acks
+	tmpTimeout.tv_sec = 0, tmpTimeout.tv_usec = 10000;
       switch (::select(m_ack.m_rfd + 1, &fds, NULL, NULL, &tmpTimeout)) {
         case 0:
           continue; // timeout try again
@@ -507,6 +581,10 @@ protected:
             case 1: // one byte read as expected
               if (c != '1')
                 return OU::eformat(error, "Unexpected: ack read from sim failed. c %d", c);
+              if (m_ring) {
+                ocpiInfo("Simulator acked through the fifo, not using the SDP ring");
+                dropRing();
+              }
               ocpiDebug("Sim sent ACK. Tick count at %" PRIu64, m_cumTicks);
               m_spinning = false;
               return false; // successful ack read
@@ -533,10 +611,8 @@ protected:
     msg[0] = DCP_CREDIT;
     msg[1] = OCPI_UTRUNCATE(uint8_t, credit & 0xff);
     msg[2] = OCPI_UTRUNCATE(uint8_t, credit >> 8);
-    if (write(m_ctl.m_wfd, msg, 3) != 3) {
-      error = "write error to control fifo";
+    if (ctlWrite(msg, 3, error))
       return true;
-    }
     if (!m_dcp && spin(error))
       return true;
     m_dcp += credit;
@@ -554,6 +630,8 @@ protected:
   doit(std::string &error) {
     if (m_pid && mywait(false, error))
       return true;
+    if (m_ringActive)
+      return doitRing(error);
     fd_set fds[1];
     *fds = m_alwaysSet;
     if (m_dcp)                    // only do this after SOME control op
@@ -589,6 +667,29 @@ protected:
     }
     return false;
   }
+  // The same for the shared memory ring, taking all the responses that are already there
+  // in one pass
+  bool
+  doitRing(std::string &error) {
+    SDP::Ring::Channel
+      &resp = m_ring->channel(SDP::Ring::Response),
+      &ackChannel = m_ring->channel(SDP::Ring::Ack);
+    if (!resp.available() && !(m_dcp && ackChannel.available()) &&
+	!m_ring->wait(m_sleepUsecs, (1u << SDP::Ring::Response) |
+		      (m_dcp ? 1u << SDP::Ring::Ack : 0))) {
+      printTime("ring wait timeout");
+      return false;
+    }
+    while (resp.available())
+      if (doResponse(error))
+	return true;
+    if (m_dcp && ackChannel.available()) {
+      printTime("Received ACK indication");
+      if (ack(error) || spin(error))
+	return true;
+    }
+    return false;
+  }
   void
   printTime(const char *msg) {
     OS::ElapsedTime et = m_spinTimer.getElapsed();
@@ -604,7 +705,7 @@ protected:
     if (m_respLeft == 0) {
       OH::SDP::Header h;
       bool request;
-      if (h.getHeader(m_resp.m_rfd, request, error))
+      if (h.getHeader(*m_respStream, request, error))
 	return true;
       if (request) {
 	bool writing = h.get_op() == OH::SDP::Header::WriteOp;
@@ -615,7 +716,7 @@ protected:
 	myassert(mbox < xfs.size() && xfs[mbox]);
 	if (writing) {
 	  myassert(h.getLength() <= sizeof(m_sdpDataBuf));
-	  if (h.endRequest(h, m_resp.m_rfd, m_sdpDataBuf, error))
+	  if (h.endRequest(h, *m_respStream, m_sdpDataBuf, error))
 	    return true;
 	  xfs[mbox]->send(OCPI_UTRUNCATE(DtOsDataTypes::Offset, whole_addr),
 			  m_sdpDataBuf, h.getLength());
@@ -635,7 +736,7 @@ protected:
 	  r = m_respQueue.front();
 	  m_respQueue.pop();
 	}
-	if (r->header.endRequest(h, m_resp.m_rfd, r->data, error))
+	if (r->header.endRequest(h, *m_respStream, r->data, error))
 	  return true;
 	r->sem.post();
       }
@@ -656,7 +757,11 @@ protected:
     msg[0] = TERMINATE;
     msg[1] = 0;
     w2("Telling the simulator process (pid %u) to exit.\n", m_pid);
-    (void)write(m_ctl.m_wfd, msg, 2);
+    // The ring's control channel takes a lock, so just set its terminate flag
+    if (m_ring)
+      m_ring->terminate();
+    if (!m_ringActive)
+      (void)write(m_ctl.m_wfd, msg, 2);
   }
 
   // FIXME: signal safety even if we are just terminating anyway...
@@ -908,8 +1013,8 @@ public:
     {
       OU::AutoMutex m(m_sdpSendMutex);
       bad = response ?
-	h.sendResponse(m_req.m_wfd, data, rlen, error) :
-	h.startRequest(m_req.m_wfd, data, rlen, error);
+	h.sendResponse(*m_reqStream, data, rlen, error) :
+	h.startRequest(*m_reqStream, data, rlen, error);
     }
     // FIXME: is this a dead lock?  should we send the credit first?
     if (bad || sendCredit(rlen, error)) {
@@ -25,7 +25,10 @@
 #include <assert.h>
 #include <arpa/inet.h>
 #include <set>
+#include <vector>
+#include <algorithm>
 #include "OcpiOsMisc.h"
+#include "OcpiUtilMisc.h"
 #include "HdlNetDriver.h"
 
 namespace OCPI {
@@ -40,13 +43,257 @@ namespace OCPI {
 	sizeof(EtherControlNop), sizeof(EtherControlWrite),
 	sizeof(EtherControlRead), sizeof(EtherControlResponse)
       };
+
+      Pipeline::
+      Pipeline(OE::Socket &socket, OE::Address &addr)
+	: m_socket(socket), m_addr(addr), m_maxCoalesced(1), m_window(1) {
+      }
+      unsigned Pipeline::
+      maxPossible() {
+	return std::min(255u, (unsigned)(OE::MaxPacketSize / sizeof(EtherControlWrite)));
+      }
+      void Pipeline::
+      setLimits(unsigned maxCoalesced, unsigned window) {
+	m_maxCoalesced = std::max(1u, std::min(maxCoalesced, maxPossible()));
+	m_window = std::max(1u, std::min(window, (unsigned)OCCP_ETHER_MAX_OUTSTANDING));
+      }
+      // Put as many accesses as allowed into a frame, returning how many
+      size_t Pipeline::
+      build(Frame &f, Access *accesses, size_t first, size_t n, uint8_t tag) {
+	f.tag = tag;
+	f.answered = false;
+	f.first = first;
+	f.length = 0;
+	for (f.count = 0; f.count < m_maxCoalesced && first + f.count < n; f.count++) {
+	  Access &a = accesses[first + f.count];
+	  size_t size = a.write ? sizeof(EtherControlWrite) : sizeof(EtherControlRead);
+	  if (f.length + size > OE::MaxPacketSize)
+	    break;
+	  EtherControlHeader &h = *(EtherControlHeader *)(f.packet.payload + f.length);
+	  h.etherTypeOverlay = 0;
+	  h.length = htons((uint16_t)(size - 2));
+	  h.pad = 0;
+	  h.tag = tag;
+	  h.typeEtc = OCCP_ETHER_TYPE_ETC(a.write ? OCCP_WRITE : OCCP_READ,
+					  ((1u << a.bytes) - 1) << (a.offset & 3), 0, 0);
+	  EtherControlWrite &w = *(EtherControlWrite *)&h; // address is the same for reads
+	  w.address = htonl((a.offset & 0xffffff) & ~3u);
+	  if (a.write)
+	    w.data = htonl(a.data << ((a.offset & 3) * 8));
+	  f.length += size;
+	}
+	return f.count;
+      }
+      // Parse the responses to a frame, returning false if the frame is malformed
+      bool Pipeline::
+      parse(Frame &f, Access *accesses, size_t length, EtherControlResponse &response,
+	    size_t &failed) {
+	size_t p = 0;
+	for (size_t i = f.first; i < f.first + f.count; i++) {
+	  Access &a = accesses[i];
+	  size_t size = a.write ? sizeof(EtherControlWriteResponse) :
+	    sizeof(EtherControlReadResponse);
+	  EtherControlHeader &h = *(EtherControlHeader *)(m_recv.payload + p);
+	  if (p + size > length || OCCP_ETHER_MESSAGE_TYPE(h.typeEtc) != OCCP_RESPONSE ||
+	      h.tag != f.tag) {
+	    ocpiBad("Malformed coalesced Ethernet control response from %s: message %zu of %zu",
+		    m_addr.pretty(), i - f.first, f.count);
+	    return false;
+	  }
+	  if ((response = OCCP_ETHER_RESPONSE(h.typeEtc)) != OK) {
+	    failed = i;
+	    return true;
+	  }
+	  if (!a.write) {
+	    uint32_t data = ntohl(((EtherControlReadResponse *)&h)->data);
+	    a.data = a.bytes == 4 ? data :
+	      (data >> ((a.offset & 3) * 8)) & ~(UINT32_MAX << (a.bytes * 8));
+	  }
+	  p += size;
+	}
+	return true;
+      }
+      EtherControlResponse Pipeline::
+      run(Access *accesses, size_t n, uint8_t &tag, unsigned delayms, size_t &failed,
+	  std::string &error) {
+	const unsigned max = OCCP_ETHER_MAX_OUTSTANDING;
+	size_t next = 0;                  // the next access to put in a frame
+	unsigned oldest = 0, nOut = 0, tries = 0;
+	while (next < n || nOut) {
+	  while (nOut < m_window && next < n) {
+	    Frame &f = m_frames[(oldest + nOut) % max];
+	    next += build(f, accesses, next, n, ++tag);
+	    if (!m_socket.send(f.packet, f.length, m_addr, 0, NULL, error)) {
+	      failed = f.first;
+	      return ETHER_TIMEOUT;
+	    }
+	    nOut++;
+	  }
+	  size_t length;
+	  OE::Address from;
+	  if (!m_socket.receive(m_recv, length, delayms, from, error)) {
+	    failed = m_frames[oldest].first;
+	    if (error.size() || ++tries >= RETRIES)
+	      return ETHER_TIMEOUT;
+	    ocpiInfo("Timeout on pipelined control to %s, resending %u frames",
+		     m_addr.pretty(), nOut);
+	    for (unsigned i = 0; i < nOut; i++) {
+	      Frame &f = m_frames[(oldest + i) % max];
+	      if (!f.answered && !m_socket.send(f.packet, f.length, m_addr, 0, NULL, error))
+		return ETHER_TIMEOUT;
+	    }
+	    continue;
+	  }
+	  EtherControlHeader &h = *(EtherControlHeader *)m_recv.payload;
+	  unsigned i;
+	  for (i = 0; i < nOut; i++)
+	    if (m_frames[(oldest + i) % max].tag == h.tag)
+	      break;
+	  if (i == nOut || m_frames[(oldest + i) % max].answered) {
+	    ocpiDebug("Ethernet control packet from %s has extraneous tag %u, ignored",
+		      from.pretty(), h.tag);
+	    continue;
+	  }
+	  Frame &f = m_frames[(oldest + i) % max];
+	  EtherControlResponse response = OK;
+	  if (!parse(f, accesses, length, response, failed))
+	    continue;
+	  if (response != OK)
+	    return response;
+	  f.answered = true;
+	  // The device executes in order, so an answer to a later frame means the answers to
+	  // earlier ones were lost: ask for them again
+	  for (unsigned j = 0; j < i; j++) {
+	    Frame &lost = m_frames[(oldest + j) % max];
+	    if (!lost.answered && !m_socket.send(lost.packet, lost.length, m_addr, 0, NULL, error))
+	      return ETHER_TIMEOUT;
+	  }
+	  for (; nOut && m_frames[oldest].answered; nOut--, oldest = (oldest + 1) % max)
+	    tries = 0;
+	}
+	return OK;
+      }
+
+      Responder::
+      Responder(unsigned maxCoalesced)
+	: m_maxCoalesced(std::min(maxCoalesced, Pipeline::maxPossible())), m_granted(0),
+	  m_expected(0) {
+	for (unsigned n = 0; n < OCCP_ETHER_MAX_OUTSTANDING; n++)
+	  m_saved[n].valid = false;
+      }
+      Responder::
+      ~Responder() {
+      }
+      // Perform up to "max" messages in a frame, returning the length of the responses
+      size_t Responder::
+      execute(const uint8_t *in, size_t inLength, uint8_t *out, unsigned max) {
+	size_t p = 0, q = 0;
+	for (unsigned n = 0; n < max && p + sizeof(EtherControlHeader) <= inLength; n++) {
+	  const EtherControlHeader &h = *(const EtherControlHeader *)(in + p);
+	  size_t size = ntohs(h.length) + 2u;
+	  if (size < sizeof(h) || p + size > inLength)
+	    break;
+	  EtherControlHeader &rh = *(EtherControlHeader *)(out + q);
+	  EtherControlResponse response = OK;
+	  unsigned uncache = OCCP_ETHER_UNCACHED(h.typeEtc) ? 1 : 0;
+	  size_t rsize;
+	  switch (OCCP_ETHER_MESSAGE_TYPE(h.typeEtc)) {
+	  case OCCP_READ:
+	    {
+	      if (size < sizeof(EtherControlRead))
+		return q;
+	      uint32_t data = 0;
+	      response = read(ntohl(((const EtherControlRead *)&h)->address),
+			      OCCP_ETHER_BYTE_ENABLES(h.typeEtc), data);
+	      ((EtherControlReadResponse *)&rh)->data = htonl(data);
+	      rsize = sizeof(EtherControlReadResponse);
+	    }
+	    break;
+	  case OCCP_WRITE:
+	    {
+	      if (size < sizeof(EtherControlWrite))
+		return q;
+	      const EtherControlWrite &w = *(const EtherControlWrite *)&h;
+	      response = write(ntohl(w.address), OCCP_ETHER_BYTE_ENABLES(h.typeEtc),
+			       ntohl(w.data));
+	      rsize = sizeof(EtherControlWriteResponse);
+	    }
+	    break;
+	  case OCCP_NOP: // a reserved command: just acknowledged
+	    uncache = 1;
+	    rsize = sizeof(EtherControlHeader);
+	    break;
+	  default:
+	    return q;
+	  }
+	  rh.etherTypeOverlay = 0;
+	  rh.pad = 0;
+	  rh.tag = h.tag;
+	  rh.length = htons((uint16_t)(rsize - 2));
+	  rh.typeEtc = OCCP_ETHER_TYPE_ETC(OCCP_RESPONSE, response, uncache, 0);
+	  p += size;
+	  q += rsize;
+	  if (response != OK)
+	    break;
+	}
+	return q;
+      }
+      bool Responder::
+      respond(const uint8_t *in, size_t inLength, uint8_t *out, size_t &outLength) {
+	if (inLength < sizeof(EtherControlHeader))
+	  return false;
+	const EtherControlHeader &h = *(const EtherControlHeader *)in;
+	bool uncache = OCCP_ETHER_UNCACHED(h.typeEtc);
+	if (OCCP_ETHER_MESSAGE_TYPE(h.typeEtc) == OCCP_NOP && !OCCP_ETHER_RESERVED(h.typeEtc)) {
+	  if (inLength < sizeof(EtherControlNop))
+	    return false;
+	  EtherControlNopResponse &r = *(EtherControlNopResponse *)out;
+	  memset(&r, 0, sizeof(r));
+	  r.header.tag = h.tag;
+	  r.header.length = htons((uint16_t)(sizeof(r) - 2));
+	  r.header.typeEtc = OCCP_ETHER_TYPE_ETC(OCCP_RESPONSE, OK, uncache ? 1 : 0, 0);
+	  r.mbx40 = 0x40;
+	  identify(r);
+	  if (!uncache) {
+	    // A host starting a session, perhaps asking to pipeline and coalesce
+	    m_granted = std::min((unsigned)((const EtherControlNop *)in)->maxCoalesced,
+				 m_maxCoalesced);
+	    m_expected = (uint8_t)(h.tag + 1);
+	    for (unsigned n = 0; n < OCCP_ETHER_MAX_OUTSTANDING; n++)
+	      m_saved[n].valid = false;
+	    r.maxCoalesced = OCPI_UTRUNCATE(uint8_t, m_granted);
+	  }
+	  outLength = sizeof(r);
+	  return true;
+	}
+	if (uncache) {
+	  outLength = execute(in, inLength, out, 1);
+	  return outLength != 0;
+	}
+	Saved &s = m_saved[m_granted ? h.tag % OCCP_ETHER_MAX_OUTSTANDING : 0];
+	if (m_granted ? h.tag == m_expected : !s.valid || s.tag != h.tag) {
+	  s.length = execute(in, inLength, s.data, m_granted ? m_granted : 1);
+	  s.tag = h.tag;
+	  s.valid = true;
+	  m_expected++;
+	} else if (!s.valid || s.tag != h.tag ||
+		   (uint8_t)(m_expected - h.tag) > OCCP_ETHER_MAX_OUTSTANDING)
+	  return false; // ahead of what we expect, or too old to have been saved
+	if (!s.length)
+	  return false;
+	memcpy(out, s.data, s.length);
+	outLength = s.length;
+	return true;
+      }
+
       Device::
       Device(Driver &driver, OE::Interface &ifc, std::string &a_name,
 	     OS::Ether::Address &devAddr, bool discovery, const char *data_proto,
 	     unsigned delayms, uint64_t ep_size, uint64_t controlOffset, uint64_t dataOffset,
 	     const OU::PValue *params, std::string &error)
 	: OCPI::HDL::Device(a_name, data_proto, params),
-	  m_socket(NULL), m_devAddr(devAddr), m_discovery(discovery), m_delayms(delayms) {
+	  m_socket(NULL), m_devAddr(devAddr), m_discovery(discovery), m_delayms(delayms),
+	  m_pipeline(NULL) {
 	// We need to get a socket to talk to this device.
 	// If we are at the ethernet level AND we don't a driver,
 	// we must share the socket for all devices on the same interface
@@ -62,10 +309,13 @@ namespace OCPI {
 	m_endpointSize = ep_size;
 	cAccess().setAccess(NULL, this, OCPI_UTRUNCATE(RegisterOffset, controlOffset));
 	dAccess().setAccess(NULL, this, OCPI_UTRUNCATE(RegisterOffset, dataOffset));
+	if (!discovery)
+	  negotiate(params);
 	init(error);
       }
       Device::
       ~Device() {
+	delete m_pipeline;
 	if (!m_devAddr.isEther() || OE::haveDriver())
 	  delete m_socket;
       }
@@ -160,6 +410,64 @@ namespace OCPI {
 	}
       }
 
+      // Offer to coalesce and pipeline, which devices that cannot do it will decline
+      void Device::
+      negotiate(const OU::PValue *params) {
+	uint32_t maxCoalesced = Pipeline::maxPossible();
+	OU::findULong(params, "maxCoalesced", maxCoalesced);
+	if (!maxCoalesced)
+	  return;
+	EtherControlNop &nop = *(EtherControlNop *)(m_request.payload);
+	nop.header.length = htons((short)(sizeof(nop)-2));
+	nop.mbx80 = 0x80;
+	nop.mbz0 = 0;
+	nop.mbz1 = 1;
+	nop.maxCoalesced = OCPI_UTRUNCATE(uint8_t, std::min(maxCoalesced, 255u));
+	OS::Ether::Packet recvFrame;
+	uint32_t status;
+	request(OCCP_NOP, 0, sizeof(uint32_t), recvFrame, &status);
+	EtherControlNopResponse &r = *(EtherControlNopResponse *)(recvFrame.payload);
+	if (status || !r.maxCoalesced) {
+	  ocpiInfo("Net device %s does not coalesce control accesses", m_devAddr.pretty());
+	  return;
+	}
+	m_pipeline = new Pipeline(*m_socket, m_devAddr);
+	m_pipeline->setLimits(r.maxCoalesced, OCCP_ETHER_MAX_OUTSTANDING);
+	ocpiInfo("Net device %s coalesces up to %u control accesses per frame",
+		 m_devAddr.pretty(), m_pipeline->maxCoalesced());
+      }
+      // Perform a sequence of accesses in coalesced, pipelined frames
+      void Device::
+      pipeline(Pipeline::Access *accesses, size_t n, uint32_t *status) {
+	if (m_isFailed)
+	  throw OU::Error("HDL::Net::Device::request after previous failure");
+	EtherControlHeader &ech_out = *(EtherControlHeader *)(m_request.payload);
+	size_t failed = 0;
+	EtherControlResponse response =
+	  m_pipeline->run(accesses, n, ech_out.tag, m_delayms ? m_delayms : DELAYMS, failed,
+			  m_error);
+	if (status)
+	  *status = 0;
+	if (response == OK)
+	  return;
+	ocpiInfo("Pipelined control access %zu of %zu to %s failed: %u %s", failed, n,
+		 m_devAddr.pretty(), response, m_error.c_str());
+	if (status)
+	  *status =
+	    response == WORKER_TIMEOUT ? OCCP_STATUS_READ_TIMEOUT :
+	    response == WORKER_BUSY ? OCCP_STATUS_READ_FAIL :
+	    response == ERROR ? OCCP_STATUS_READ_ERROR :
+	    OCCP_STATUS_ACCESS_ERROR;
+	else {
+	  m_isFailed = true;
+	  throw OU::Error("HDL network %s error: %s", accesses[failed].write ? "write" : "read",
+			  response == WORKER_TIMEOUT ? "worker timeout" :
+			  response == WORKER_BUSY ? "worker busy" :
+			  response == ERROR ? "worker error" :
+			  "ethernet timeout - no valid response");
+	}
+      }
+
       // Shared "get" that returns value, and *status if status != NULL
       uint32_t Device::
       get(RegisterOffset offset, size_t bytes, uint32_t *status) {
@@ -205,6 +513,15 @@ namespace OCPI {
 	  uint64_t u64;
 	  uint32_t u32[sizeof(uint64_t) / sizeof(uint32_t)];
 	} u;
+	if (m_pipeline) {
+	  Pipeline::Access a[2] = {
+	    { OCPI_UTRUNCATE(uint32_t, offset), 4, false, 0 },
+	    { OCPI_UTRUNCATE(uint32_t, offset + sizeof(uint32_t)), 4, false, 0 } };
+	  pipeline(a, 2, status);
+	  u.u32[0] = a[0].data;
+	  u.u32[1] = a[1].data;
+	  return u.u64;
+	}
 	u.u32[0] = get(offset, sizeof(uint32_t), status);
 	if (!status || !*status)
 	  u.u32[1] = get(offset + sizeof(uint32_t), sizeof(uint32_t), status);
@@ -213,6 +530,25 @@ namespace OCPI {
       void Device::
       getBytes(RegisterOffset offset, uint8_t *buf, size_t length, size_t elementBytes,
 	       uint32_t *status, bool string) {
+	if (m_pipeline && length > sizeof(uint32_t) && !string) {
+	  std::vector<Pipeline::Access> accesses;
+	  for (RegisterOffset o = offset; o < offset + length; ) {
+	    size_t bytes = std::min(std::min(sizeof(uint32_t) - (o & 3), offset + length - o),
+				    elementBytes);
+	    Pipeline::Access a = { OCPI_UTRUNCATE(uint32_t, o), (unsigned)bytes, false, 0 };
+	    accesses.push_back(a);
+	    o += bytes;
+	  }
+	  pipeline(&accesses[0], accesses.size(), status);
+	  if (status && *status)
+	    return;
+	  for (size_t n = 0; n < accesses.size(); n++) {
+	    Pipeline::Access &a = accesses[n];
+	    memcpy(buf, &a.data, a.bytes); // the data was shifted down into the low bytes
+	    buf += a.bytes;
+	  }
+	  return;
+	}
 	while (length) {
 	  size_t bytes = sizeof(uint32_t) - (offset & 3); // bytes in word
 	  if (bytes > length)
@@ -233,6 +569,14 @@ namespace OCPI {
       }
       void Device::
       set64(RegisterOffset offset, uint64_t val, uint32_t *status) {
+	if (m_pipeline) {
+	  Pipeline::Access a[2] = {
+	    { OCPI_UTRUNCATE(uint32_t, offset), 4, true, (uint32_t)val },
+	    { OCPI_UTRUNCATE(uint32_t, offset + sizeof(uint32_t)), 4, true,
+	      (uint32_t)(val >> 32) } };
+	  pipeline(a, 2, status);
+	  return;
+	}
 	set(offset, sizeof(uint32_t), (uint32_t)val, status);
 	if (!status || !*status)
 	  set(offset + sizeof(uint32_t), sizeof(uint32_t), (uint32_t)(val >> 32), status);
@@ -240,6 +584,20 @@ namespace OCPI {
       void Device::
       setBytes(RegisterOffset offset, const uint8_t *buf, size_t length, size_t elementBytes,
 	       uint32_t *status)  {
+	if (m_pipeline && length > sizeof(uint32_t)) {
+	  std::vector<Pipeline::Access> accesses;
+	  for (RegisterOffset o = offset; o < offset + length; ) {
+	    size_t bytes = std::min(std::min(sizeof(uint32_t) - (o & 3), offset + length - o),
+				    elementBytes);
+	    Pipeline::Access a = { OCPI_UTRUNCATE(uint32_t, o), (unsigned)bytes, true, 0 };
+	    memcpy(&a.data, buf, bytes);
+	    accesses.push_back(a);
+	    buf += bytes;
+	    o += bytes;
+	  }
+	  pipeline(&accesses[0], accesses.size(), status);
+	  return;
+	}
 	while (length) {
 	  size_t bytes = sizeof(uint32_t) - (offset & 3); // bytes in word
 	  if (bytes > length)
@@ -274,7 +632,7 @@ namespace OCPI {
 	if (response.header.length == htons((short)(sizeof(response)-2)) &&
 	    response.header.typeEtc == OCCP_ETHER_TYPE_ETC(OCCP_RESPONSE, OK, 1, 0) &&
 	    response.mbx40 == 0x40 &&
-	    response.mbz0 == 0)
+	    response.maxCoalesced == 0)
 	  return true;
 	ocpiBad("Bad network discovery response:");
 	for (unsigned i = 0; i < sizeof(response); i++)
@@ -0,0 +1,315 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include "OcpiOsMisc.h"
+#include "OcpiOsDebug.h"
+#include "OcpiUtilMisc.h"
+#include "OcpiUtilAutoMutex.h"
+#include "HdlSdpRing.h"
+
+namespace OCPI {
+  namespace HDL {
+    namespace SDP {
+      namespace OS = OCPI::OS;
+      namespace OU = OCPI::Util;
+
+      static const uint32_t c_magic = 0x53445052, c_version = 1; // "SDPR"
+      static const size_t
+	c_dataBytes = 1024 * 1024, // room for 64 maximal SDP messages
+	c_ctlBytes = 4096;
+      static const unsigned c_spins = 2000; // times to look before sleeping, a few usecs
+      // The head is only written by the producer, the tail only by the consumer, each
+      // counting bytes since the start, so they stay on separate cache lines.
+      struct Ring::Queue {
+	volatile uint64_t head;
+	char pad0[56];
+	volatile uint64_t tail;
+	char pad1[56];
+      };
+      struct Ring::Shared {
+	uint32_t magic, version;
+	uint64_t offsets[NChannels], sizes[NChannels];
+	volatile uint32_t attached;   // the simulator side is using the ring
+	volatile uint32_t terminate;  // the simulator should stop
+	volatile uint32_t waiting[2]; // channels that side is, or is about to be, asleep for
+	char pad[64];
+	Queue queues[NChannels];
+      };
+
+      static size_t channelBytes(unsigned id) {
+	return id == Ring::Request || id == Ring::Response ? c_dataBytes : c_ctlBytes;
+      }
+
+      Ring::Channel::
+      Channel(Ring &ring, ChannelId id)
+	: m_ring(ring), m_id(id), m_queue(ring.m_shared->queues[id]),
+	  m_data((uint8_t *)ring.m_shared + ring.m_shared->offsets[id]),
+	  m_mask(ring.m_shared->sizes[id] - 1) {
+      }
+      size_t Ring::Channel::
+      available() const {
+	return OCPI_UTRUNCATE(size_t, m_queue.head - m_queue.tail);
+      }
+      bool Ring::Channel::
+      read(uint8_t *buf, size_t length, std::string &error) {
+	while (length) {
+	  uint64_t tail = m_queue.tail, head = m_queue.head;
+	  if (head == tail) {
+	    if (m_ring.m_shared->terminate)
+	      return OU::eformat(error, "SDP ring was terminated");
+	    m_ring.wait(1000000, 1u << m_id);
+	    continue;
+	  }
+	  __sync_synchronize(); // data is not read before the head that covers it
+	  size_t
+	    n = std::min(length, OCPI_UTRUNCATE(size_t, head - tail)),
+	    offset = OCPI_UTRUNCATE(size_t, tail & m_mask),
+	    first = std::min(n, OCPI_UTRUNCATE(size_t, m_mask + 1 - offset));
+	  memcpy(buf, m_data + offset, first);
+	  memcpy(buf + first, m_data, n - first);
+	  __sync_synchronize(); // data is read before the space is given back
+	  m_queue.tail = tail + n;
+	  buf += n;
+	  length -= n;
+	}
+	return false;
+      }
+      bool Ring::Channel::
+      write(const uint8_t *data, size_t length, std::string &error) {
+	OU::AutoMutex guard(m_mutex);
+	for (unsigned backoff = 0; length; ) {
+	  uint64_t head = m_queue.head, tail = m_queue.tail;
+	  size_t space = OCPI_UTRUNCATE(size_t, m_mask + 1 - (head - tail));
+	  if (!space) {
+	    if (m_ring.m_shared->terminate)
+	      return OU::eformat(error, "SDP ring was terminated");
+	    if (++backoff < 100)
+	      OS::sleep(0);
+	    else
+	      OS::sleep(1);
+	    continue;
+	  }
+	  backoff = 0;
+	  size_t
+	    n = std::min(length, space),
+	    offset = OCPI_UTRUNCATE(size_t, head & m_mask),
+	    first = std::min(n, OCPI_UTRUNCATE(size_t, m_mask + 1 - offset));
+	  memcpy(m_data + offset, data, first);
+	  memcpy(m_data, data + first, n - first);
+	  __sync_synchronize(); // data is written before the head that covers it
+	  m_queue.head = head + n;
+	  data += n;
+	  length -= n;
+	  m_ring.notify(m_id);
+	}
+	return false;
+      }
+      void Ring::Channel::
+      flush() {
+	m_queue.tail = m_queue.head;
+      }
+
+      Ring::
+      Ring(const std::string &path, std::string &error)
+	: m_side(Server), m_path(path), m_shared(NULL), m_size(0), m_owner(true), m_spins(0) {
+	m_bells[0] = m_bells[1] = -1;
+	for (unsigned n = 0; n < NChannels; n++)
+	  m_channels[n] = NULL;
+	size_t offsets[NChannels];
+	m_size = (sizeof(Shared) + 4095) & ~(size_t)4095;
+	for (unsigned n = 0; n < NChannels; n++) {
+	  offsets[n] = m_size;
+	  m_size += channelBytes(n);
+	}
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd < 0) {
+	  OU::format(error, "can't create SDP ring file %s: %s", path.c_str(), strerror(errno));
+	  return;
+	}
+	void *vp;
+	if (ftruncate(fd, (off_t)m_size) ||
+	    (vp = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+	  OU::format(error, "can't size or map SDP ring file %s: %s", path.c_str(),
+		     strerror(errno));
+	  ::close(fd);
+	  return;
+	}
+	::close(fd);
+	m_shared = (Shared *)vp;
+	for (unsigned n = 0; n < NChannels; n++) {
+	  m_shared->offsets[n] = offsets[n];
+	  m_shared->sizes[n] = channelBytes(n);
+	}
+	// The doorbells are inherited by the simulator, so no close-on-exec
+	if ((m_bells[Server] = eventfd(0, EFD_NONBLOCK)) < 0 ||
+	    (m_bells[Simulator] = eventfd(0, EFD_NONBLOCK)) < 0) {
+	  OU::format(error, "can't create SDP ring doorbells: %s", strerror(errno));
+	  return;
+	}
+	OU::format(m_plusarg, "%s,%d,%d", path.c_str(), m_bells[Simulator], m_bells[Server]);
+	m_shared->version = c_version;
+	__sync_synchronize();
+	m_shared->magic = c_magic;
+	init(error);
+      }
+
+      Ring::
+      Ring(const char *plusarg, std::string &error)
+	: m_side(Simulator), m_shared(NULL), m_size(0), m_owner(false), m_spins(0) {
+	m_bells[0] = m_bells[1] = -1;
+	for (unsigned n = 0; n < NChannels; n++)
+	  m_channels[n] = NULL;
+	// Parse from the right since the path could have commas
+	const char *serverBell = strrchr(plusarg, ','), *simBell;
+	if (!serverBell || serverBell == plusarg ||
+	    !(simBell = (const char *)memrchr(plusarg, ',', OCPI_SIZE_T_DIFF(serverBell, plusarg)))) {
+	  OU::format(error, "invalid SDP ring argument: \"%s\"", plusarg);
+	  return;
+	}
+	m_path.assign(plusarg, OCPI_SIZE_T_DIFF(simBell, plusarg));
+	m_bells[Simulator] = atoi(simBell + 1);
+	m_bells[Server] = atoi(serverBell + 1);
+	int fd = ::open(m_path.c_str(), O_RDWR | O_CLOEXEC);
+	struct stat st;
+	void *vp;
+	if (fd < 0 || fstat(fd, &st) ||
+	    (vp = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) ==
+	    MAP_FAILED) {
+	  OU::format(error, "can't open or map SDP ring file %s: %s", m_path.c_str(),
+		     strerror(errno));
+	  if (fd >= 0)
+	    ::close(fd);
+	  return;
+	}
+	::close(fd);
+	m_size = (size_t)st.st_size;
+	m_shared = (Shared *)vp;
+	if (m_size < sizeof(Shared) || m_shared->magic != c_magic ||
+	    m_shared->version != c_version) {
+	  OU::format(error, "SDP ring file %s is not a valid ring", m_path.c_str());
+	  return;
+	}
+	m_plusarg = plusarg;
+	if (!init(error))
+	  m_shared->attached = 1;
+      }
+
+      bool Ring::
+      init(std::string &error) {
+	for (unsigned n = 0; n < NChannels; n++) {
+	  uint64_t size = m_shared->sizes[n];
+	  if (!size || (size & (size - 1)) || m_shared->offsets[n] + size > m_size)
+	    return OU::eformat(error, "SDP ring channel %u is invalid", n);
+	}
+	for (unsigned n = 0; n < NChannels; n++)
+	  m_channels[n] = new Channel(*this, (ChannelId)n);
+	// Looking before sleeping only helps when the other side can run meanwhile
+	m_spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? c_spins : 0;
+	ocpiDebug("SDP ring %s ready on the %s side", m_path.c_str(),
+		  m_side == Server ? "server" : "simulator");
+	return false;
+      }
+
+      Ring::
+      ~Ring() {
+	for (unsigned n = 0; n < NChannels; n++)
+	  delete m_channels[n];
+	if (m_shared)
+	  munmap((void *)m_shared, m_size);
+	if (m_owner) {
+	  for (unsigned n = 0; n < 2; n++)
+	    if (m_bells[n] >= 0)
+	      ::close(m_bells[n]);
+	  unlink(m_path.c_str());
+	}
+      }
+
+      bool Ring::
+      attached() const {
+	return m_shared->attached != 0;
+      }
+
+      void Ring::
+      terminate() {
+	static const uint64_t one = 1;
+	m_shared->terminate = 1;
+	__sync_synchronize();
+	(void)::write(m_bells[Simulator], &one, sizeof(one));
+      }
+
+      bool Ring::
+      terminating() const {
+	return m_shared->terminate != 0;
+      }
+
+      void Ring::
+      notify(ChannelId id) {
+	Side peer = m_side == Server ? Simulator : Server;
+	__sync_synchronize(); // our head is visible before we look at their flag
+	if (m_shared->waiting[peer] & (1u << id)) {
+	  static const uint64_t one = 1;
+	  (void)::write(m_bells[peer], &one, sizeof(one));
+	}
+      }
+
+      bool Ring::
+      ready(unsigned mask) const {
+	for (unsigned n = 0; n < NChannels; n++)
+	  if ((mask & (1u << n)) && m_channels[n]->available())
+	    return true;
+	return false;
+      }
+
+      bool Ring::
+      wait(unsigned usecs, unsigned mask) {
+	// A message and the credit that covers it arrive back to back, and a response
+	// usually follows a request quickly, so look for a while before going to sleep.
+	for (unsigned n = 0; n < m_spins; n++)
+	  if (ready(mask))
+	    return true;
+	volatile uint32_t &waiting = m_shared->waiting[m_side];
+	waiting = mask;
+	__sync_synchronize(); // our flag is visible before we look at their heads
+	bool isReady = ready(mask);
+	if (!isReady && !m_shared->terminate) {
+	  struct pollfd pfd;
+	  pfd.fd = m_bells[m_side];
+	  pfd.events = POLLIN;
+	  int r = poll(&pfd, 1, (int)((usecs + 999) / 1000));
+	  uint64_t count;
+	  if (r > 0)
+	    (void)::read(m_bells[m_side], &count, sizeof(count));
+	  isReady = ready(mask);
+	}
+	waiting = 0;
+	return isReady;
+      }
+    }
+  }
+}
@@ -28,6 +28,8 @@
  */
 #include <map>
 #include <set>
+#include <vector>
+#include <unordered_map>
 #include "ezxml.h"
 #include "OcpiUtilMisc.h"
 #include "OcpiUtilEzxml.h"
@@ -97,14 +99,23 @@ namespace OCPI {
     typedef std::pair< const char*, Implementation *> WorkerMapPair;
     typedef WorkerMap::const_iterator WorkerIter;
     typedef std::pair<WorkerIter,WorkerIter> WorkerRange;
+    // Hashed by spec name, with implementations in the order they were found
+    typedef std::unordered_map<const char *, std::vector<Implementation *>,
+			       OCPI::Util::ConstCharHash, OCPI::Util::ConstCharEqual> SpecMap;
     class Library;
     class Artifact : public OCPI::Util::Attributes {
     protected:
-      const char *m_metadata;
+      char *m_metadata;    // new[], parsed in place
       std::time_t m_mtime; // modification time associated with when we read the metadata
       uint64_t m_length;   // the length of the artifact file without the metadata
       size_t m_metaLength; // the length of the stuff appended to the file
-      ezxml_t m_xml;
+      ezxml_t m_xml;       // NULL until the metadata is parsed
+      // When set up from a summary (see summarize), the metadata is not parsed until the
+      // artifact is searched for one of the specs in the summary.
+      std::string m_summary;
+      bool m_summarized;   // set up from m_summary and not loaded yet
+      unsigned m_sequence; // order of creation, which is the order implementations are found
+      static unsigned s_nArtifacts;
       // A count and array of implementations found in the artifact, *not* static instances.
       unsigned m_nImplementations;
       OCPI::Util::Worker *m_metaImplementations; // this array 
@@ -123,8 +134,15 @@ namespace OCPI {
       void getFileMetadata(const char *name);
       const char *setFileMetadata(const char *name, char *metadata, std::time_t mtime,
 				  uint64_t length, size_t metaLength);
+      const char *setFileSummary(const char *name, char *metadata, std::time_t mtime,
+				 uint64_t length, size_t metaLength, const std::string &summary);
     public:
       void configure(ezxml_t x = NULL);
+      // Parse and configure an artifact that was set up from a summary, if not done yet
+      void load();
+      // Describe the attributes and specs used to search for this (configured) artifact
+      void summarize(std::string &summary) const;
+      unsigned sequence() const { return m_sequence; }
       // Can this artifact run on something with these capabilities?
       bool meetsCapabilities(const Capabilities &caps);
       bool meetsRequirements (const Capabilities &caps,
@@ -162,8 +180,14 @@ namespace OCPI {
     extern const char *library;
     class Manager : public OCPI::Driver::ManagerBase<Manager, Driver, library> {
       std::string m_libraryPath;
-      WorkerMap m_implementations;
+      SpecMap m_implementations;
+      // Artifacts not loaded yet, by the spec names in their summaries
+      typedef std::unordered_map<std::string, std::vector<Artifact *> > PendingMap;
+      PendingMap m_pending;
+      OCPI::OS::Mutex m_loadMutex; // recursive: loading while searching
       friend class OCPI::API::LibraryManager;
+      friend class Artifact;
+      void loadPending(const char *specName);
       Artifact &getArtifactX(const char *url, const OCPI::API::PValue *props);
       Artifact &findArtifactX(const Capabilities &caps,
 			      const char *impl,
@@ -199,6 +223,8 @@ namespace OCPI {
       void doWorkers(void (*func)(OCPI::Util::Worker &));
       // Inform the manager about an implementation
       void addImplementation(Implementation &imp);
+      // Inform the manager about an artifact to load when specName is searched for
+      void addPending(const char *specName, Artifact &art);
     private:
       // Find (and callback with) implementations for specName and selectCriteria
       // Return true if any were found
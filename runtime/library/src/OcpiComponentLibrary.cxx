@@ -19,21 +19,29 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <set>
+#include <unordered_map>
+#include <algorithm>
 #include "ocpi-config.h"
+#include "md5.h"
 #include "OcpiOsAssert.h"
 #include "OcpiOsFileIterator.h"
 #include "OcpiOsFileSystem.h"
+#include "OcpiOsMisc.h"
 #include "OcpiUtilException.h"
 #include "OcpiUtilEzxml.h"
+#include "OcpiUtilTaskPool.h"
 #include "OcpiLibraryManager.h"
 #include "OcpiComponentLibrary.h"
 
 // This file is the (loadable) driver for ocpi component libraries, each of which is
-// rooted in a file system directory, which becomes its name
+// rooted in a file system directory, which becomes its name.
+// The metadata found in the files of each library is kept in an index file so that
+// unchanged files do not need to be opened again the next time the library is searched.
 
 namespace OL = OCPI::Library;
 namespace OA = OCPI::API;
@@ -70,10 +78,220 @@ namespace OCPI {
 	  if (err)
 	    throw OU::Error("Error processing metadata from artifact file: %s: %s", a_name, err);
 	}
+	// Set up from an index summary: the metadata is parsed when first searched for
+	Artifact(Library &lib, const char *a_name, char *metadata, std::time_t a_mtime,
+		 uint64_t a_length, size_t metaLength, const std::string &summary)
+	  : ArtifactBase<Library,Artifact>(lib, *this, a_name) {
+	  const char *err =
+	    setFileSummary(a_name, metadata, a_mtime, a_length, metaLength, summary);
+	  if (err)
+	    throw OU::Error("Error processing metadata from artifact file: %s: %s", a_name, err);
+	}
       };
 
       class Driver;
 
+      // The persistent index of the files under one library path element.
+      // For each file, by pathname, it records the modification time and length the
+      // file had when it was read, and the artifact metadata it had, if any, with the
+      // artifact's summary (OL::Artifact::summarize), so unchanged artifacts can be set up
+      // without parsing their metadata until they are searched for.
+      // The file format is native binary since it is a cache private to this machine:
+      //   magic, count, then per file:
+      //     path length (4), metadata length (4, ~0 if none), summary length (4),
+      //     mtime (8), length (8), metaLength (8), path, metadata, summary
+      class Index {
+      public:
+	struct Entry {
+	  std::time_t m_mtime;
+	  uint64_t m_length;
+	  uint64_t m_metaLength;
+	  bool m_isArtifact;
+	  std::string m_metadata;
+	  std::string m_summary; // empty if the artifact could not be configured
+	  bool m_used;         // seen during this search
+	};
+	typedef std::unordered_map<std::string, Entry> Entries;
+	static const char c_magic[8];
+	static const uint32_t c_none = ~0u;
+      private:
+	Entries m_entries;
+	std::string m_file;    // empty if the index is not in use
+	bool m_dirty;
+      public:
+	explicit Index(const std::string &libDir)
+	  : m_dirty(false) {
+	  const char
+	    *dir = getenv("OCPI_LIBRARY_INDEX_DIR"),
+	    *home = getenv("HOME");
+	  if ((dir && !*dir) || (!dir && !home))
+	    return;
+	  // The index file name is a hash of the absolute pathname of the library
+	  std::string abs(OS::FileSystem::absoluteName(libDir));
+	  md5_state_t md5;
+	  md5_byte_t digest[16];
+	  md5_init(&md5);
+	  md5_append(&md5, (const md5_byte_t *)abs.c_str(), (unsigned)abs.size());
+	  md5_finish(&md5, digest);
+	  m_file = dir ? dir : home;
+	  if (!dir)
+	    m_file += "/.cache/opencpi/library-index";
+	  m_file += "/";
+	  for (unsigned n = 0; n < sizeof(digest); n++)
+	    OU::formatAdd(m_file, "%02x", digest[n]);
+	  m_file += ".idx";
+	  if (!read())
+	    m_entries.clear();
+	  ocpiInfo("Library index \"%s\" for \"%s\" has %zu entries", m_file.c_str(),
+		   libDir.c_str(), m_entries.size());
+	}
+	// Find the entry for a file, if the file has not changed since it was recorded.
+	const Entry *find(const std::string &path, std::time_t mtime, uint64_t length) {
+	  Entries::iterator ei = m_entries.find(path);
+	  if (ei == m_entries.end() || ei->second.m_mtime != mtime ||
+	      ei->second.m_length != length)
+	    return NULL;
+	  ei->second.m_used = true;
+	  return &ei->second;
+	}
+	// The returned entry's summary can be set once the artifact is configured
+	Entry *set(const std::string &path, std::time_t mtime, uint64_t length, size_t metaLength,
+		   const char *metadata) {
+	  if (m_file.empty())
+	    return NULL;
+	  Entry &e = m_entries[path];
+	  e.m_mtime = mtime;
+	  e.m_length = length;
+	  e.m_metaLength = metaLength;
+	  e.m_isArtifact = metadata != NULL;
+	  e.m_metadata = metadata ? metadata : "";
+	  e.m_summary.clear();
+	  e.m_used = true;
+	  m_dirty = true;
+	  return &e;
+	}
+	// Write the index if it changed, dropping entries for files no longer present.
+	// Failure just means the next search is slower.
+	void save() {
+	  if (m_file.empty())
+	    return;
+	  for (Entries::iterator ei = m_entries.begin(); ei != m_entries.end(); )
+	    if (ei->second.m_used)
+	      ++ei;
+	    else {
+	      ei = m_entries.erase(ei);
+	      m_dirty = true;
+	    }
+	  if (!m_dirty)
+	    return;
+	  std::string tmp;
+	  OU::format(tmp, "%s.%lu.tmp", m_file.c_str(), OS::getProcessId());
+	  try {
+	    std::string dir(OS::FileSystem::directoryName(m_file));
+	    for (size_t slash = 1; slash != std::string::npos; ) {
+	      slash = dir.find('/', slash + 1);
+	      std::string sub(dir, 0, slash);
+	      if (!OS::FileSystem::exists(sub))
+		OS::FileSystem::mkdir(sub, true);
+	    }
+	  } catch (...) {}
+	  FILE *f = fopen(tmp.c_str(), "wb");
+	  if (!f) {
+	    ocpiInfo("Could not write library index \"%s\"", tmp.c_str());
+	    return;
+	  }
+	  uint32_t count = (uint32_t)m_entries.size();
+	  bool ok =
+	    fwrite(c_magic, sizeof(c_magic), 1, f) == 1 && fwrite(&count, sizeof(count), 1, f) == 1;
+	  for (Entries::const_iterator ei = m_entries.begin(); ok && ei != m_entries.end(); ++ei) {
+	    const Entry &e = ei->second;
+	    uint32_t sizes[3] = {
+	      (uint32_t)ei->first.size(), e.m_isArtifact ? (uint32_t)e.m_metadata.size() : c_none,
+	      (uint32_t)e.m_summary.size()
+	    };
+	    uint64_t values[3] = { (uint64_t)e.m_mtime, e.m_length, e.m_metaLength };
+	    ok = fwrite(sizes, sizeof(sizes), 1, f) == 1 && fwrite(values, sizeof(values), 1, f) == 1 &&
+	      fwrite(ei->first.data(), ei->first.size(), 1, f) == 1 &&
+	      (e.m_metadata.empty() || fwrite(e.m_metadata.data(), e.m_metadata.size(), 1, f) == 1) &&
+	      (e.m_summary.empty() || fwrite(e.m_summary.data(), e.m_summary.size(), 1, f) == 1);
+	  }
+	  if (fclose(f) || !ok || rename(tmp.c_str(), m_file.c_str())) {
+	    ocpiInfo("Could not write library index \"%s\"", m_file.c_str());
+	    unlink(tmp.c_str());
+	  }
+	}
+      private:
+	bool read() {
+	  FILE *f = fopen(m_file.c_str(), "rb");
+	  if (!f)
+	    return true; // not an error: no index yet
+	  std::vector<char> buf;
+	  char chunk[64*1024];
+	  for (size_t n; (n = fread(chunk, 1, sizeof(chunk), f)); )
+	    buf.insert(buf.end(), chunk, chunk + n);
+	  fclose(f);
+	  const char *cp = buf.data(), *end = cp + buf.size();
+	  uint32_t count;
+	  if (buf.size() < sizeof(c_magic) + sizeof(count) || memcmp(cp, c_magic, sizeof(c_magic)))
+	    return false;
+	  cp += sizeof(c_magic);
+	  memcpy(&count, cp, sizeof(count));
+	  cp += sizeof(count);
+	  for (uint32_t n = 0; n < count; n++) {
+	    uint32_t sizes[3];
+	    uint64_t values[3];
+	    if ((size_t)(end - cp) < sizeof(sizes) + sizeof(values))
+	      return false;
+	    memcpy(sizes, cp, sizeof(sizes));
+	    memcpy(values, cp + sizeof(sizes), sizeof(values));
+	    cp += sizeof(sizes) + sizeof(values);
+	    size_t metaSize = sizes[1] == c_none ? 0 : sizes[1];
+	    if ((size_t)(end - cp) < (size_t)sizes[0] + metaSize + sizes[2])
+	      return false;
+	    Entry &e = m_entries[std::string(cp, sizes[0])];
+	    cp += sizes[0];
+	    e.m_mtime = (std::time_t)values[0];
+	    e.m_length = values[1];
+	    e.m_metaLength = values[2];
+	    e.m_isArtifact = sizes[1] != c_none;
+	    e.m_metadata.assign(cp, metaSize);
+	    cp += metaSize;
+	    e.m_summary.assign(cp, sizes[2]);
+	    cp += sizes[2];
+	    e.m_used = false;
+	  }
+	  return cp == end;
+	}
+      };
+      const char Index::c_magic[8] = { 'O', 'C', 'P', 'I', 'L', 'I', 'X', '2' };
+
+      // A file found while walking a library, and its metadata once read
+      struct FoundFile {
+	std::string m_path;
+	std::time_t m_mtime;
+	uint64_t m_length;
+	size_t m_metaLength;
+	char *m_metadata;  // new[], ownership passes to the artifact
+	std::string m_summary; // from the index
+	bool m_cold;       // not in the index: must be read
+      };
+      // Read the metadata of a slice of the cold files: called in parallel.
+      static void
+      readMetadata(void *arg, size_t begin, size_t end) {
+	FoundFile **files = (FoundFile **)arg;
+	for (size_t n = begin; n < end; n++) {
+	  FoundFile &f = *files[n];
+	  try {
+	    f.m_metadata =
+	      OL::Artifact::getMetadata(f.m_path.c_str(), f.m_mtime, f.m_length, f.m_metaLength);
+	  } catch (...) {
+	    f.m_metadata = NULL;
+	  }
+	}
+      }
+      // Below this many cold files, reading them in parallel is not worth the threads
+      static const size_t c_parallelFiles = 8;
+
       typedef std::set<OS::FileSystem::FileId> FileIds; // unordered set cxx11 is better
       // Our concrete library class
       class Library : public OL::LibraryBase<Driver, Library, Artifact> {
@@ -84,13 +302,62 @@ namespace OCPI {
 	}
 
 	public:
-	// Do a recursive directory search for all files.
+	// Do a recursive directory search for all files, and then add the artifacts among
+	// them, in the order found.  Metadata comes from the index when the file is
+	// unchanged, and is otherwise read from the files, in parallel when there are many.
+	// Indexed artifacts are set up from their summaries and parsed only when used.
 	void configure(ezxml_t) {
 	  std::string globbedName;
 	  if (OU::globPath(name().c_str(), globbedName))
 	    ocpiInfo("Library path pathname \"%s\" is invalid or nonexistent, and ignored",
 		     name().c_str());
-	  doPath(globbedName);
+	  std::vector<FoundFile> files;
+	  doPath(globbedName, files);
+	  Index index(globbedName);
+	  std::vector<FoundFile *> cold;
+	  for (unsigned n = 0; n < files.size(); n++) {
+	    FoundFile &f = files[n];
+	    f.m_metadata = NULL;
+	    f.m_cold = false;
+	    const Index::Entry *e = index.find(f.m_path, f.m_mtime, f.m_length);
+	    if (!e) {
+	      f.m_cold = true;
+	      cold.push_back(&f);
+	    } else if (e->m_isArtifact) {
+	      f.m_metaLength = (size_t)e->m_metaLength;
+	      f.m_metadata = new char[e->m_metadata.size() + 1];
+	      memcpy(f.m_metadata, e->m_metadata.c_str(), e->m_metadata.size() + 1);
+	      f.m_summary = e->m_summary;
+	    }
+	  }
+	  ocpiInfo("Library \"%s\" has %zu files, %zu of them not already indexed",
+		   globbedName.c_str(), files.size(), cold.size());
+	  if (cold.size() >= c_parallelFiles) {
+	    OU::TaskPool pool;
+	    pool.forkJoin(readMetadata, cold.data(), cold.size(),
+			  (unsigned)std::min(cold.size(), (size_t)OU::TaskPool::c_maxSlices));
+	  } else if (cold.size())
+	    readMetadata(cold.data(), 0, cold.size());
+	  for (unsigned n = 0; n < files.size(); n++) {
+	    FoundFile &f = files[n];
+	    Index::Entry *e = f.m_cold ?
+	      index.set(f.m_path, f.m_mtime, f.m_length, f.m_metaLength, f.m_metadata) : NULL;
+	    if (f.m_metadata)
+	      try {
+		// FIXME: supply library level xml for the artifact
+		// The log will show which files are not any good.
+		if (f.m_summary.empty()) {
+		  Artifact *a = new Artifact(*this, f.m_path.c_str(), f.m_metadata, f.m_mtime,
+					     f.m_length, f.m_metaLength, NULL);
+		  a->configure();
+		  if (e)
+		    a->summarize(e->m_summary);
+		} else
+		  new Artifact(*this, f.m_path.c_str(), f.m_metadata, f.m_mtime, f.m_length,
+			       f.m_metaLength, f.m_summary);
+	      } catch (...) {}
+	  }
+	  index.save();
 	}
 	OCPI::Library::Artifact *
 	addArtifact(const char *url, const OCPI::API::PValue *params) {
@@ -106,14 +373,17 @@ namespace OCPI {
 	  return a;
 	}
       private:
-	void doPath(const std::string &a_libName) {
+	// Collect the candidate artifact files under a path, with their times and lengths
+	void doPath(const std::string &a_libName, std::vector<FoundFile> &files) {
 	  //	  ocpiDebug("Processing library path: %s", libName.c_str());
 	  bool isDir;
+	  uint64_t size;
+	  std::time_t mtime;
 	  OS::FileSystem::FileId file_id;
 	  if (isProjectImports(a_libName))
 	    ocpiDebug("Ignoring project registry imports link: %s in OCPI_LIBRARY_PATH search.",
 		      a_libName.c_str());
-	  else if (!OS::FileSystem::exists(a_libName, &isDir, NULL, NULL, &file_id))
+	  else if (!OS::FileSystem::exists(a_libName, &isDir, &size, &mtime, &file_id))
 	    ocpiDebug("Path name found in OCPI_LIBRARY_PATH, \"%s\", "
 		     "is nonexistent, not a normal file, or a broken link.  It will be ignored",
 		     a_libName.c_str());
@@ -125,7 +395,7 @@ namespace OCPI {
 	      try { // this is really checking the constructor
 		OS::FileIterator dir(a_libName, "*");
 		for (; !dir.end(); dir.next())
-		  doPath(OS::FileSystem::joinNames(a_libName, dir.relativeName()));
+		  doPath(OS::FileSystem::joinNames(a_libName, dir.relativeName()), files);
 	      } catch(...) {
 		ocpiBad("For OCPI_LIBRARY_PATH: failed to enter directory \"%s\".  Permissions?",
 			a_libName.c_str());
@@ -136,11 +406,12 @@ namespace OCPI {
 	      size_t len = strlen(l_name), xlen = strlen(".xml");
 
 	      if (len < xlen || strcasecmp(l_name + len - xlen, ".xml")) {
-		// FIXME: supply library level xml for the artifact
-		// The log will show which files are not any good.
-		try {
-		  addArtifact(l_name, NULL);
-		} catch (...) {}
+		files.resize(files.size() + 1);
+		FoundFile &f = files.back();
+		f.m_path = a_libName;
+		f.m_mtime = mtime;
+		f.m_length = size;
+		f.m_metaLength = 0;
 	      }
 	    }
           }
@@ -27,6 +27,7 @@
 #include <set>
 #include "ocpi-config.h"
 #include "OcpiUtilException.h"
+#include "OcpiUtilAutoMutex.h"
 #include "OcpiLibraryManager.h"
 #include "LibrarySimple.h"
 #include "OcpiComponentLibrary.h"
@@ -46,7 +47,8 @@ namespace OCPI {
     const char **complib OCPI_USED = &CompLib::component;
     static OCPI::Driver::Registration<Manager> lm;
     // The Library Driver Manager class
-    Manager::Manager() {
+    Manager::Manager()
+      : m_loadMutex(true) {
     }
     void Manager::setPath(const char *path) {
       parent().configureOnce();
@@ -73,6 +75,10 @@ namespace OCPI {
 		  const OCPI::API::Connection *conns,
 		  const char *&artInst) {
       parent().configureOnce();
+      {
+	OU::AutoMutex guard(m_loadMutex);
+	loadPending(specName);
+      }
       // If some driver already has it in one of its libraries, return it.
       Artifact *a;
       for (Driver *d = firstDriver(); d; d = d->nextDriver())
@@ -92,8 +98,10 @@ namespace OCPI {
       Artifact *a;
       // If some driver already has it in one of its libraries, return it.
       for (d = firstDriver(); d; d = d->nextDriver())
-	if ((a = d->findArtifact(url)))
+	if ((a = d->findArtifact(url))) {
+	  a->load();
 	  return *a;
+	}
 #if 0
       // The artifact was not found in any driver's libraries
       // Now we need to find a library driver that can deal with this
@@ -115,8 +123,33 @@ namespace OCPI {
     }
 
     // Inform the manager about an implementation
+    // Artifacts loaded late are put back in the order they were found
     void Manager::addImplementation(Implementation &impl) {
-      m_implementations.insert(WorkerMapPair(impl.m_metadataImpl.specName().c_str(), &impl));
+      std::vector<Implementation *> &impls =
+	m_implementations[impl.m_metadataImpl.specName().c_str()];
+      std::vector<Implementation *>::iterator it = impls.end();
+      while (it != impls.begin() && (*(it - 1))->m_artifact.sequence() > impl.m_artifact.sequence())
+	--it;
+      impls.insert(it, &impl);
+    }
+    void Manager::addPending(const char *specName, Artifact &art) {
+      m_pending[specName].push_back(&art);
+    }
+    // Load the artifacts that might have implementations of specName.
+    // Like artifacts found while configuring, bad ones are just logged.
+    void Manager::loadPending(const char *specName) {
+      PendingMap::iterator pi = m_pending.find(specName);
+      if (pi == m_pending.end())
+	return;
+      std::vector<Artifact *> arts;
+      arts.swap(pi->second);
+      m_pending.erase(pi);
+      for (unsigned n = 0; n < arts.size(); n++)
+	try {
+	  arts[n]->load();
+	} catch (...) {
+	  ocpiInfo("Artifact \"%s\" could not be loaded", arts[n]->name().c_str());
+	}
     }
     static bool
     satisfiesSelection(const char *selection, unsigned *score, OU::Worker &impl) {
@@ -136,13 +169,14 @@ namespace OCPI {
     // Return true if any were found
     bool Manager::findImplementationsX(ImplementationCallback &icb, const char *specName) {
       parent().configureOnce();
+      OU::AutoMutex guard(m_loadMutex);
+      loadPending(specName);
       bool found = false;
-      WorkerRange range = m_implementations.equal_range(specName);
-      for (WorkerIter wi = range.first; wi != range.second; wi++) {
-	Implementation &impl = *wi->second;
-	if (icb.foundImplementation(impl, found))
-	  break;
-      }
+      SpecMap::const_iterator si = m_implementations.find(specName);
+      if (si != m_implementations.end())
+	for (unsigned n = 0; n < si->second.size(); n++)
+	  if (icb.foundImplementation(*si->second[n], found))
+	    break;
       return found;
     }
     void Manager::printArtifactsX(const Capabilities &caps, bool dospecs) {
@@ -165,6 +199,11 @@ namespace OCPI {
       for (Driver *d = firstDriver(); d; d = d->nextDriver())
 	for (Library *l = d->firstLibrary(); l; l = l->nextLibrary())
 	  for (Artifact *a = l->firstArtifact(); a; a = a->nextArtifact()) {
+	    try {
+	      a->load();
+	    } catch (...) {
+	      continue;
+	    }
 	    const Implementation *i;
 	    for (unsigned n = 0; (i = a->getImplementation(n)); n++)
 	      func(i->m_metadataImpl);
@@ -285,14 +324,19 @@ namespace OCPI {
     Artifact * Library::
     findArtifact(const char *uuid) {
       ArtifactsIter ai = m_artifacts.find(uuid);
-      return ai == m_artifacts.end() ? NULL : ai->second;
+      if (ai == m_artifacts.end())
+	return NULL;
+      ai->second->load();
+      return ai->second;
     }
 
     // The artifact base class
+    unsigned Artifact::s_nArtifacts;
     Artifact::
     Artifact()
-      : m_metadata(NULL), m_mtime(0), m_length(0), m_xml(NULL), m_nImplementations(0),
-	m_metaImplementations(NULL), m_nWorkers(0) {}
+      : m_metadata(NULL), m_mtime(0), m_length(0), m_xml(NULL), m_summarized(false),
+	m_sequence(s_nArtifacts++), m_nImplementations(0), m_metaImplementations(NULL),
+	m_nWorkers(0) {}
     Artifact::~Artifact() {
       for (WorkerIter wi = m_workers.begin(); wi != m_workers.end(); wi++)
 	delete (*wi).second;
@@ -384,6 +428,68 @@ namespace OCPI {
       ocpiDebug("Artifact file %s has artifact metadata", a_name);
       return NULL;
     }
+    // The summary is NUL-terminated strings: the uuid, then the attributes in the order
+    // below, then "1" or "0" for dynamic, then the distinct spec names of the workers.
+    // The metadata is kept, but only parsed by load().
+    static const unsigned c_summaryFields = 11; // the strings before the spec names
+    const char *Artifact::
+    setFileSummary(const char *a_name, char *metadata, std::time_t a_mtime, uint64_t a_length,
+		   size_t metaLength, const std::string &summary) {
+      m_metadata = metadata; // take ownership in all cases
+      m_summary = summary;
+      std::string *fields[] = {
+	&m_uuid, &m_os, &m_osVersion, &m_arch, &m_platform, &m_runtime, &m_runtimeVersion,
+	&m_tool, &m_toolVersion, &m_opencpiVersion
+      };
+      const char *cp = m_summary.c_str(), *end = cp + m_summary.size();
+      for (unsigned n = 0; n < sizeof(fields)/sizeof(*fields); n++, cp += strlen(cp) + 1)
+	if (cp >= end)
+	  return OU::esprintf("invalid library index summary for \"%s\"", a_name);
+	else
+	  *fields[n] = cp;
+      if (cp >= end || m_uuid.empty())
+	return OU::esprintf("invalid library index summary for \"%s\"", a_name);
+      m_dynamic = *cp == '1';
+      m_mtime = a_mtime;
+      m_length = a_length;
+      m_metaLength = metaLength;
+      m_summarized = true;
+      for (cp += strlen(cp) + 1; cp < end; cp += strlen(cp) + 1)
+	getManager().addPending(cp, *this);
+      // The key must persist, and m_uuid is assigned again when loaded
+      library().registerUuid(m_summary.c_str(), this);
+      ocpiDebug("Artifact file %s has artifact metadata (from its summary)", a_name);
+      return NULL;
+    }
+    void Artifact::
+    summarize(std::string &summary) const {
+      const std::string *fields[] = {
+	&m_uuid, &m_os, &m_osVersion, &m_arch, &m_platform, &m_runtime, &m_runtimeVersion,
+	&m_tool, &m_toolVersion, &m_opencpiVersion
+      };
+      summary.clear();
+      for (unsigned n = 0; n < sizeof(fields)/sizeof(*fields); n++)
+	summary.append(fields[n]->c_str(), fields[n]->size() + 1);
+      summary.append(m_dynamic ? "1" : "0", 2);
+      const char *last = NULL; // m_workers is ordered by spec name
+      for (WorkerIter wi = m_workers.begin(); wi != m_workers.end(); ++wi)
+	if (!last || strcmp(last, wi->first)) {
+	  last = wi->first;
+	  summary.append(last, strlen(last) + 1);
+	}
+    }
+    void Artifact::
+    load() {
+      OU::AutoMutex guard(getManager().m_loadMutex);
+      if (!m_summarized)
+	return;
+      m_summarized = false;
+      const char *err = OE::ezxml_parse_str(m_metadata, strlen(m_metadata), m_xml);
+      if (err)
+	throw OU::Error("Error parsing artifact metadata from \"%s\": %s", name().c_str(), err);
+      ocpiDebug("Artifact file %s is loaded from its metadata", name().c_str());
+      configure();
+    }
     void Artifact::
     getFileMetadata(const char *a_name) {
       std::time_t l_mtime;
@@ -559,6 +665,15 @@ namespace OCPI {
     }
     void Artifact::
     printSpecs(std::set<const char *, OCPI::Util::ConstCharComp> &specs) const {
+      if (m_summarized) {
+	const char *cp = m_summary.c_str(), *end = cp + m_summary.size();
+	for (unsigned n = 0; n < c_summaryFields && cp < end; n++)
+	  cp += strlen(cp) + 1;
+	for (; cp < end; cp += strlen(cp) + 1)
+	  if (specs.insert(cp).second)
+	    printf("%s\n", cp);
+	return;
+      }
       for (WorkerIter wi = m_workers.begin(); wi != m_workers.end(); wi++)
 	if (specs.insert((*wi).second->m_metadataImpl.specName().c_str()).second)
 	  printf("%s\n", (*wi).second->m_metadataImpl.specName().c_str());
@@ -415,6 +415,10 @@ typedef struct {
    void addTask(RCCUserTask *task);
    void waitTasks();
    bool checkTasks();
+   // Split the items [0, nItems) into nSlices (default: one per task thread), call
+   // func(arg, begin, end) for each slice in parallel, and return when all are done.
+   void runSlices(void (*func)(void *arg, size_t begin, size_t end), void *arg,
+		  size_t nItems, unsigned nSlices = 0);
    // Simple distribution calculation of now many items a given member will be responsible
    // for given a total, and a limit on message sizes.  Return is total for member,
    // optional output arg is max per message for this member.
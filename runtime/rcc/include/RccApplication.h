@@ -53,6 +53,7 @@ namespace OCPI {
 
       class Worker;
       class Container;
+      class Scheduler;
 
       class Artifact : public OCPI::Container::ArtifactBase<Container,Artifact> {
 	friend class Container;
@@ -85,6 +86,8 @@ namespace OCPI {
         friend class Controller;
       protected:
 	void run(DataTransfer::EventManager* event_manager, bool &more_to_do);
+	uint32_t idleUsecs(uint32_t maxUsecs);
+	void schedule(Scheduler &scheduler, unsigned &position);
       public:
 	OCPI::Container::Worker &
 	createWorker(OCPI::Container::Artifact *art, const char *appInstName, ezxml_t impl,
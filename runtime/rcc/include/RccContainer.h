@@ -35,10 +35,11 @@
 #ifndef RCC_CONTAINER_H_
 #define RCC_CONTAINER_H_
 
-#include "pthread_workqueue.h"
 #include "OcpiOsSemaphore.h"
+#include "OcpiUtilTaskPool.h"
 #include "RccApplication.h"
 #include "RccDriver.h"
+#include "RccScheduler.h"
 
 namespace OCPI {
 
@@ -66,12 +67,9 @@ namespace OCPI {
     class Container
       : public OCPI::Container::ContainerBase<Driver,Container,Application,Artifact> {
     private:
-      // FIXME:  someday this thread pool will be private to the container
-      static bool m_wqInit;
-      static const int WORKQUEUE_COUNT = 2;
-      static const int LOW_PRI_Q = 0;
-      static const int HIGH_PRI_Q = 1;
-      static pthread_workqueue_t m_workqueues[WORKQUEUE_COUNT]; 
+      // The pool for worker tasks is shared by all RCC containers and created on first use
+      static OCPI::Util::TaskPool *s_taskPool;
+      Scheduler *m_scheduler; // when workers are run by more than one thread
 
     public:
       friend class Port;
@@ -84,7 +82,7 @@ namespace OCPI {
 	throw (OCPI::Util::EmbeddedException);
       virtual ~Container()
 	throw ();
-      void initWorkQueues();
+      static OCPI::Util::TaskPool &taskPool();
       bool portsInProcess() { return true; }
       OCPI::Container::Container::DispatchRetCode
       dispatch(DataTransfer::EventManager *event_manager = NULL);
@@ -95,14 +93,16 @@ namespace OCPI {
       createArtifact(OCPI::Library::Artifact &lart, const OCPI::API::PValue *artifactParams);
 
       // worker task management
-      void addTask( void (*workitem_func)(void *), void * args );
-      void addTask( RCCUserTask * task );
-      bool join( bool block, OCPI::OS::Semaphore & sem );
+      void addTask(OCPI::Util::TaskGroup &group, void (*workitem_func)(void *), void *args);
+      void addTask(OCPI::Util::TaskGroup &group, RCCUserTask *task);
+      bool join(bool block, OCPI::Util::TaskGroup &group);
 
       //      void start(DataTransfer::EventManager* event_manager) throw();
       //      void stop(DataTransfer::EventManager* event_manager) throw();
       DataTransfer::EventManager*  getEventManager();
       bool needThread() { return true; }
+    protected:
+      uint32_t idleUsecs();
     };
   }
 }
@@ -0,0 +1,89 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Abstract:
+ *   Work-stealing scheduler for running the workers of one RCC container on
+ *   several threads.
+ *
+ *   Each dispatch pass, the container adds the workers it wants evaluated, with
+ *   their position among all of its workers.  Consecutive positions (usually
+ *   workers connected to each other) share a "home" thread, so buffers passed
+ *   along a pipeline tend to stay in one core's cache.  Threads run the workers
+ *   from their own queue in order and, when that is empty, steal from the tail
+ *   of the others' queues.  A worker is queued at most once per pass and the pass
+ *   completes before the next one starts, so no worker ever runs concurrently
+ *   with itself.  The dispatch thread itself is thread 0 of the pool.
+ */
+
+#ifndef RCC_SCHEDULER_H_
+#define RCC_SCHEDULER_H_
+
+#include <deque>
+#include <vector>
+#include <exception>
+#include "OcpiOsMutex.h"
+#include "OcpiOsSemaphore.h"
+#include "OcpiOsThreadManager.h"
+
+namespace OCPI {
+  namespace RCC {
+    class Worker;
+    class Scheduler {
+      struct Queue {
+	OCPI::OS::Mutex m_mutex;
+	std::deque<Worker *> m_workers;
+	char m_pad[64];   // keep queues that are hammered by different threads apart
+      };
+      struct Thread {
+	Scheduler &m_scheduler;
+	unsigned m_index;
+	OCPI::OS::Semaphore m_start;
+	OCPI::OS::ThreadManager *m_thread;
+	Thread(Scheduler &s, unsigned index);
+      };
+      std::vector<Queue *> m_queues;
+      std::vector<Thread *> m_threads;                          // not including thread 0
+      std::vector<std::pair<Worker *, unsigned> > m_added; // workers and positions
+      volatile unsigned m_outstanding; // workers not yet run in this pass
+      OCPI::OS::Semaphore m_done;      // posted when the last worker of a pass has run
+      volatile bool m_anyRun, m_exiting;
+      OCPI::OS::Mutex m_errorMutex;
+      std::exception_ptr m_error;      // first exception thrown by a worker in this pass
+    public:
+      Scheduler(unsigned nThreads);
+      ~Scheduler();
+      unsigned nThreads() const { return (unsigned)m_queues.size(); }
+      // Add a worker to be evaluated in the next pass
+      void add(Worker &w, unsigned position) {
+	m_added.push_back(std::make_pair(&w, position));
+      }
+      // Run the added workers using all threads and return when all have been evaluated.
+      // nPositions is the number of positions that workers were added at.
+      // Returns whether any worker actually ran.
+      bool run(unsigned nPositions);
+    private:
+      static void poolThread(void *arg);
+      void work(unsigned self);
+      Worker *next(unsigned self);
+    };
+  }
+}
+#endif
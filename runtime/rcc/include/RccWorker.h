@@ -37,6 +37,7 @@
 
 #include <cstdarg>
 #include "OcpiOsSemaphore.h"
+#include "OcpiUtilTaskPool.h"
 
 #ifndef WORKER_INTERNAL
 #define WORKER_INTERNAL
@@ -63,7 +64,9 @@ namespace OCPI {
       friend class Port;
       friend class RCCUserPort;
       friend class RCCUserSlave;
+      friend class RCCUserTask;
       friend class RCCUserWorker;
+      friend class Scheduler;
       void run(bool &anyRun);
       void advanceAll();
       void portError(std::string&error);
@@ -84,6 +87,10 @@ namespace OCPI {
 	     size_t crewSize, const OCPI::Util::PValue *wParams);
       OCPI::Container::Port& createPort(const OCPI::Util::Port&, const OCPI::Util::PValue *props);
       void controlOperation(OCPI::Util::Worker::ControlOperation);
+      // For event-driven dispatch: should this worker be evaluated on a selective pass,
+      // and how long can the container block before its run condition timer expires
+      bool needsEvaluation();
+      uint32_t idleUsecs(uint32_t maxUsecs);
 
       // These property access methods are called when the fast path
       // is not enabled, either due to no MMIO or that the property can
@@ -211,8 +218,8 @@ namespace OCPI {
       // Pointer into actual RCC worker binary for its dispatch struct
       OCPI::DataTransport::Transport &m_transport;
 
-      // Task semaphore
-      OCPI::OS::Semaphore m_taskSem;
+      // Tasks added by this worker
+      OCPI::Util::TaskGroup m_taskGroup;
 
       // Update a ports information (as a result of a connection)
       void portIsConnected(unsigned ordinal);
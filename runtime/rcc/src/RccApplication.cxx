@@ -142,12 +142,33 @@ createWorker(OC::Artifact *art, const char *appInstName, ezxml_t impl, ezxml_t i
 
 void Application::
 run(DataTransfer::EventManager* event_manager, bool &more_to_do) {
+  // After a wakeup for particular workers, only look at them
+  bool selective = parent().m_selective;
   for (Worker *w = OU::Parent<Worker>::firstChild(); w; w = w->nextChild()) {
+    if (selective && !w->needsEvaluation())
+      continue;
     // Give our transport some time
     parent().getTransport().dispatch( event_manager );
     w->run(more_to_do);
   }
 }
 
+// Add our workers to a multi-threaded pass.  The position of each worker among all of the
+// container's workers determines which thread it prefers.
+void Application::
+schedule(Scheduler &scheduler, unsigned &position) {
+  bool selective = parent().m_selective;
+  for (Worker *w = OU::Parent<Worker>::firstChild(); w; w = w->nextChild(), position++)
+    if (w->enabled && (!selective || w->needsEvaluation()))
+      scheduler.add(*w, position);
+}
+
+uint32_t Application::
+idleUsecs(uint32_t maxUsecs) {
+  for (Worker *w = OU::Parent<Worker>::firstChild(); w && maxUsecs; w = w->nextChild())
+    maxUsecs = w->idleUsecs(maxUsecs);
+  return maxUsecs;
+}
+
   }
 }
@@ -32,6 +32,7 @@
  *
  ************************************************************************/
 
+#include <stdlib.h>
 #include "ocpi-config.h"
 #include "OcpiOsMisc.h"
 #include "RccContainer.h"
@@ -45,21 +46,33 @@ namespace OR = OCPI::RDT;
 namespace OCPI {
   namespace RCC {
 
-    bool Container::m_wqInit = false;
-    pthread_workqueue_t Container::m_workqueues[2];
+    OU::TaskPool *Container::s_taskPool;
 
 DataTransfer::EventManager*  
 Container::
 getEventManager()
 {
-  return getTransport().m_transportGlobal->getEventManager();
+  return m_eventManager ? m_eventManager : getTransport().m_transportGlobal->getEventManager();
+}
+
+// Block no longer than the earliest run condition timeout of any enabled worker
+uint32_t
+Container::
+idleUsecs()
+{
+  OU::SelfAutoMutex guard(this);
+  uint32_t usecs = m_maxBlockUsecs;
+  for (Application *a = OU::Parent<Application>::firstChild(); a && usecs; a = a->nextChild())
+    usecs = a->idleUsecs(usecs);
+  return usecs;
 }
 
 class Driver;
 Container::
-Container(const char *a_name, const OA::PValue* /* params */)
+Container(const char *a_name, const OA::PValue* params)
   throw ( OU::EmbeddedException )
-  : OC::ContainerBase<Driver,Container,Application,Artifact>(*this, a_name)
+  : OC::ContainerBase<Driver,Container,Application,Artifact>(*this, a_name),
+    m_scheduler(NULL)
 {
   const char *system = OU::getSystemId().c_str();
   m_model = "rcc";
@@ -83,40 +96,39 @@ Container(const char *a_name, const OA::PValue* /* params */)
   m_dynamic = OC::Manager::dynamic();
   if (parent().m_platform.size())
     m_platform = parent().m_platform;
-  initWorkQueues();
+  // Event-driven dispatch is requested by the "polled" parameter being false, or by the
+  // OCPI_EVENT_DISPATCH environment variable, whose value is the longest time in
+  // microseconds to block when no worker can run, since shared memory buffer flags
+  // written by other processes cannot wake us up.
+  bool polled = true;
+  OU::findBool(params, "polled", polled);
+  const char *env = getenv("OCPI_EVENT_DISPATCH");
+  if (!polled || env) {
+    long usecs = env ? atol(env) : 0;
+    enableEvents(usecs > 1 ? (uint32_t)usecs : 1000);
+  }
+  // Workers may be run by a pool of threads, set by the "threads" parameter or the
+  // OCPI_RCC_THREADS environment variable.
+  uint32_t nThreads = 1;
+  if (!OU::findULong(params, "threads", nThreads) && (env = getenv("OCPI_RCC_THREADS")))
+    nThreads = (uint32_t)atoi(env);
+  if (nThreads > 1)
+    m_scheduler = new Scheduler(nThreads);
 }
 
-void Container::
-initWorkQueues() {
-#ifdef OCPI_OS_macos
-  return;
-#endif
-  OU::SelfAutoMutex guard(this);
-  if (m_wqInit == false ) {
-    m_wqInit = true;
-    pthread_workqueue_attr_t attr;
-    memset(&m_workqueues, 0, sizeof(m_workqueues));     
-
-    // Create the worker queues
-    if (pthread_workqueue_attr_init_np(&attr) != 0)
-      throw  OU::Error("Worker static initialization: Could not init workqueue attributes");
-    //     if (pthread_attr_setinheritsched( &attr, 0) != 0 ) 
-    //       throw  OU::Error("Worker static initialization: Could not set scheduler in  workqueue attributes");
-    if (pthread_workqueue_attr_setqueuepriority_np(&attr, WORKQ_HIGH_PRIOQUEUE) != 0) 
-      throw  OU::Error("Worker static initialization: Could not set workqueue priorities");        
-    if (pthread_workqueue_create_np(&m_workqueues[HIGH_PRI_Q], &attr) != 0)
-       throw  OU::Error("Worker static initialization: Could not create workqueue ");
-
-#ifdef NEEDED
-    if (pthread_workqueue_attr_init_np(&attr) != 0)
-      throw  OU::Error("Worker static initialization: Could not init workqueue attributes");
-    if (pthread_workqueue_attr_setqueuepriority_np(&attr, WORKQ_LOW_PRIOQUEUE) != 0) 
-      throw  OU::Error("Worker static initialization: Could not set workqueue priorities");        
-    if (pthread_workqueue_create_np(&m_workqueues[LOW_PRI_Q], &attr) != 0)
-      throw  OU::Error("Worker static initialization: Could not create workqueue ");
-#endif
-
-   }
+// Task pool threads default to one per processor, and can be pinned to processors
+OU::TaskPool &Container::
+taskPool() {
+  static OCPI::OS::Mutex m;
+  OU::AutoMutex guard(m);
+  if (!s_taskPool) {
+    const char
+      *threads = getenv("OCPI_RCC_TASK_THREADS"),
+      *pin = getenv("OCPI_RCC_TASK_PIN");
+    s_taskPool = new OU::TaskPool(threads ? (unsigned)atoi(threads) : 0, 256,
+				  pin && atoi(pin) > 0);
+  }
+  return *s_taskPool;
 }
 
 OC::Artifact & Container::
@@ -139,88 +151,28 @@ Container::
   // We need to shut down the apps and workers since they
   // depend on artifacts and transport.
   OU::Parent<Application>::deleteChildren();
+  delete m_scheduler;
 }
 
 
-struct Wargs {
-  RCCUserTask *taskc;
-  void (*task)(void *);
-  void * args;
-};
-
-static volatile int task_count = 0;
-void wait_join(void *args) {
-  OCPI::OS::Semaphore *sem = (OCPI::OS::Semaphore *)args;
-  while (task_count > 0) {
-    OCPI::OS::sleep(0);
-  }
-  sem->post();  
+static void
+runUserTask(void *arg) {
+  ((RCCUserTask *)arg)->run();
 }
 
 bool Container::
-join( bool block, OCPI::OS::Semaphore & sem ) {
-  if (task_count == 0)
-    return true;
-  if (!block)
-    return false;
-  pthread_workqueue_additem_np(m_workqueues[LOW_PRI_Q], wait_join, (void*)&sem, NULL, NULL);    
-
-  ocpiDebug("IN Con join about to wait for sem");
-  sem.wait();
-  ocpiDebug("IN Con join, joined");
-  return true;
-}
-
-static OCPI::OS::Mutex mutex;
-static void 
-taskWrapper(void *args) {
-  Wargs *wargs = (Wargs*)args;
-
-  if (wargs->taskc == NULL)
-    wargs->task(wargs->args);
-  else
-    wargs->taskc->run();
-  mutex.lock();
-  task_count--;
-  mutex.unlock();
-  delete wargs;
+join(bool block, OU::TaskGroup &group) {
+  return taskPool().join(group, block);
 }
 
 void Container::
-addTask(void (*task)(void *), void *args) {
-#ifdef OCPI_OS_macos
-  assert("RCC task support not available"==0);
-#endif
-  if (!m_wqInit)
-    initWorkQueues();
-  mutex.lock();
-  task_count++;
-  mutex.unlock();
-
-  Wargs *wargs = new Wargs();
-  wargs->taskc = NULL;  
-  wargs->task = task;
-  wargs->args = args;
-  pthread_workqueue_additem_np(m_workqueues[HIGH_PRI_Q], taskWrapper, wargs, NULL, NULL);    
+addTask(OU::TaskGroup &group, void (*task)(void *), void *args) {
+  taskPool().add(group, task, args);
 }
 
-
-
 void Container::
-addTask(OCPI::RCC::RCCUserTask * task) {
-#ifdef OCPI_OS_macos
-  assert("RCC task support not available"==0);
-#endif
-  if (!m_wqInit)
-    initWorkQueues();
-  mutex.lock();
-  task_count++;
-  mutex.unlock();
-
-  Wargs *wargs = new Wargs();
-  wargs->taskc = task;
-  wargs->args = NULL;
-  pthread_workqueue_additem_np(m_workqueues[HIGH_PRI_Q], taskWrapper, wargs, NULL, NULL);    
+addTask(OU::TaskGroup &group, OCPI::RCC::RCCUserTask *task) {
+  taskPool().add(group, runUserTask, task);
 }
 
 volatile int ocpi_dbg_run=0;
@@ -262,8 +214,15 @@ dispatch(DataTransfer::EventManager* event_manager)
   }
 #endif
   // Process the workers
-  for (Application *a = OU::Parent<Application>::firstChild(); a; a = a->nextChild())
-    a->run(event_manager, more_to_do);
+  if (m_scheduler) {
+    unsigned nPositions = 0;
+    for (Application *a = OU::Parent<Application>::firstChild(); a; a = a->nextChild())
+      a->schedule(*m_scheduler, nPositions);
+    if (m_scheduler->run(nPositions))
+      more_to_do = true;
+  } else
+    for (Application *a = OU::Parent<Application>::firstChild(); a; a = a->nextChild())
+      a->run(event_manager, more_to_do);
 
   return more_to_do ? MoreWorkNeeded : Spin;
 }
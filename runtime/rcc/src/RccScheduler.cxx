@@ -0,0 +1,149 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "OcpiUtilAutoMutex.h"
+#include "OcpiOsAssert.h"
+#include "RccWorker.h"
+#include "RccScheduler.h"
+
+namespace OCPI {
+  namespace RCC {
+    namespace OS = OCPI::OS;
+    namespace OU = OCPI::Util;
+
+Scheduler::Thread::
+Thread(Scheduler &s, unsigned index)
+  : m_scheduler(s), m_index(index), m_start(0), m_thread(NULL) {
+}
+
+Scheduler::
+Scheduler(unsigned nThreads)
+  : m_outstanding(0), m_done(0), m_anyRun(false), m_exiting(false) {
+  ocpiAssert(nThreads);
+  for (unsigned n = 0; n < nThreads; n++)
+    m_queues.push_back(new Queue);
+  for (unsigned n = 1; n < nThreads; n++) {
+    Thread *t = new Thread(*this, n);
+    m_threads.push_back(t);
+    t->m_thread = new OS::ThreadManager(poolThread, t);
+  }
+  ocpiInfo("RCC scheduler started with %u threads", nThreads);
+}
+
+Scheduler::
+~Scheduler() {
+  m_exiting = true;
+  for (unsigned n = 0; n < m_threads.size(); n++)
+    m_threads[n]->m_start.post();
+  for (unsigned n = 0; n < m_threads.size(); n++) {
+    m_threads[n]->m_thread->join();
+    delete m_threads[n]->m_thread;
+    delete m_threads[n];
+  }
+  for (unsigned n = 0; n < m_queues.size(); n++)
+    delete m_queues[n];
+}
+
+void Scheduler::
+poolThread(void *arg) {
+  Thread &t = *(Thread *)arg;
+  while (true) {
+    t.m_start.wait();
+    if (t.m_scheduler.m_exiting)
+      break;
+    t.m_scheduler.work(t.m_index);
+  }
+}
+
+// Our own queue is consumed from the front, in pipeline order, while thieves take
+// from the back, which is the work the owner would get to last.
+Worker *Scheduler::
+next(unsigned self) {
+  unsigned nQueues = nThreads();
+  for (unsigned n = 0; n < nQueues; n++) {
+    Queue &q = *m_queues[(self + n) % nQueues];
+    if (q.m_workers.empty()) // unlocked peek: worst case we miss work someone else will do
+      continue;
+    OU::AutoMutex guard(q.m_mutex);
+    if (!q.m_workers.empty()) {
+      Worker *w;
+      if (n == 0) {
+	w = q.m_workers.front();
+	q.m_workers.pop_front();
+      } else {
+	w = q.m_workers.back();
+	q.m_workers.pop_back();
+      }
+      return w;
+    }
+  }
+  return NULL;
+}
+
+// Everything a worker's run reports must be recorded before its count is released,
+// since the thread that releases the last one wakes the dispatch thread.
+void Scheduler::
+work(unsigned self) {
+  for (Worker *w; (w = next(self)); ) {
+    bool anyRun = false;
+    try {
+      w->run(anyRun);
+    } catch (...) {
+      OU::AutoMutex guard(m_errorMutex);
+      if (!m_error)
+	m_error = std::current_exception();
+    }
+    if (anyRun)
+      m_anyRun = true;
+    if (!__sync_sub_and_fetch(&m_outstanding, 1))
+      m_done.post();
+  }
+}
+
+bool Scheduler::
+run(unsigned nPositions) {
+  unsigned nQueues = nThreads(), nAdded = (unsigned)m_added.size();
+  if (!nAdded)
+    return false;
+  m_anyRun = false;
+  m_outstanding = nAdded;
+  for (unsigned n = 0; n < nAdded; n++) {
+    unsigned home = (unsigned)((uint64_t)m_added[n].second * nQueues / nPositions);
+    Queue &q = *m_queues[home < nQueues ? home : nQueues - 1];
+    OU::AutoMutex guard(q.m_mutex);
+    q.m_workers.push_back(m_added[n].first);
+  }
+  m_added.clear();
+  // Wake the threads that have work of their own, and enough others to steal the rest
+  for (unsigned n = 0; n < m_threads.size(); n++)
+    if (n + 1 < nAdded || !m_queues[n + 1]->m_workers.empty())
+      m_threads[n]->m_start.post();
+  work(0);
+  // Exactly one post per pass, possibly already made by this thread
+  m_done.wait();
+  if (m_error) {
+    std::exception_ptr e = m_error;
+    m_error = std::exception_ptr();
+    std::rethrow_exception(e);
+  }
+  return m_anyRun;
+}
+  }
+}
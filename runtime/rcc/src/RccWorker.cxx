@@ -43,7 +43,7 @@ Worker(Application & app, Artifact *art, const char *a_name, ezxml_t impl, ezxml
     m_dispatch(NULL), m_portInit(0), m_context(NULL), m_firstInput(NULL), m_eofSent(RCC_NO_PORTS),
     m_mutex(app.container()), m_runCondition(NULL), m_errorString(NULL), enabled(false),
     hasRun(false), sourcePortCount(0), targetPortCount(0), m_nPorts(nPorts()), worker_run_count(0),
-    m_transport(app.parent().getTransport()), m_taskSem(0)
+    m_transport(app.parent().getTransport())
 {
    memset(&m_info, 0, sizeof(m_info));
    if (art)
@@ -536,6 +536,23 @@ doEOF() {
   return false;
 }
 
+bool Worker::
+needsEvaluation() {
+  return takeNotified() ||
+    (m_runCondition && m_runCondition->m_timeout && m_runTimer.expired());
+}
+
+uint32_t Worker::
+idleUsecs(uint32_t maxUsecs) {
+  if (!enabled || !m_runCondition || !m_runCondition->m_timeout)
+    return maxUsecs;
+  if (m_runTimer.expired())
+    return 0;
+  OS::ElapsedTime remaining = m_runTimer.getRemaining();
+  uint64_t usecs = (uint64_t)remaining.seconds() * 1000000 + remaining.nanoseconds() / 1000;
+  return usecs < maxUsecs ? (uint32_t)usecs : maxUsecs;
+}
+
 void Worker::
 run(bool &anyone_run) {
   checkControl();
@@ -749,6 +766,9 @@ OCPI_CONTROL_OPS
   case OU::Worker::OpsLimit:
     break;
   }
+  // Make sure an idle, event-driven container looks at us after the state change
+  notify();
+  parent().container().wakeup(false);
   const char *err = m_context->errorString ? m_context->errorString : m_errorString;
   std::string serr;
   if (err || rc != RCC_OK) {
@@ -1080,37 +1100,32 @@ OCPI_CONTROL_OPS
    void
    RCCUserTask::
    spawn() {
-     m_worker.parent().parent().addTask(this);
+     m_worker.parent().parent().addTask(m_worker.m_taskGroup, this);
    }
 
    void RCCUserWorker::
    addTask( RCCUserTask * task ) {
-     printf("^^^^^^ In RCCTaskHandle RCCUserWorker::addTask\n");
-     //     Container * c = static_cast<Container*>(&m_worker.parent().parent());
-     //     c->addTask( task  );
-     m_worker.parent().parent().addTask(task);
+     m_worker.parent().parent().addTask(m_worker.m_taskGroup, task);
    }
 
 
    void RCCUserWorker::
    addTask(  RCCTask task, RCCTaskArgs * args ) {
-     printf("^^^^^^ In RCCTaskHandle RCCUserWorker::addTask\n");
-     //     Container * c = static_cast<Container*>(&m_worker.parent().parent());
-     //     c->addTask(  (Witem)task, args );
-     m_worker.parent().parent().addTask((Witem)task, args);
+     m_worker.parent().parent().addTask(m_worker.m_taskGroup, (Witem)task, args);
    }
 
    void RCCUserWorker::
    waitTasks() {
-     m_worker.parent().parent().join(true, m_worker.m_taskSem);
-     //     Container * c = static_cast<Container*>(&m_worker.parent().parent());
-     //     return c->join( block, m_worker.m_taskSem );
+     m_worker.parent().parent().join(true, m_worker.m_taskGroup);
    }
    bool RCCUserWorker::
    checkTasks() {
-     return m_worker.parent().parent().join(false, m_worker.m_taskSem);
-     //     Container * c = static_cast<Container*>(&m_worker.parent().parent());
-     //     return c->join( block, m_worker.m_taskSem );
+     return m_worker.parent().parent().join(false, m_worker.m_taskGroup);
+   }
+   void RCCUserWorker::
+   runSlices(void (*func)(void *arg, size_t begin, size_t end), void *arg, size_t nItems,
+	     unsigned nSlices) {
+     Container::taskPool().forkJoin(func, arg, nItems, nSlices);
    }
 
    // Default worker methods
@@ -52,6 +52,8 @@ namespace OCPI {
       OCPI::Container::Launcher::Connections m_connections;
       std::string &m_discoveryInfo;       // what to tell clients about our containers, etc.
       std::vector<bool> &m_needsBridging; // per container, does it need bridging to sockets
+      std::vector<uint8_t> m_propRequest, m_propResponse; // binary property access frames
+      std::string m_propError;            // error from a property frame not yet answered
     public:
       Server(OCPI::Library::Library &l, OCPI::OS::ServerSocket &svrSock,
 	     std::string &discoveryInfo, std::vector<bool> &needsBridging, std::string &error);
@@ -78,6 +80,7 @@ namespace OCPI {
 	discover(std::string &error),
 	doConnection(ezxml_t cx, OCPI::Container::Launcher::Connection &c, std::string &error),
 	appShutDown(std::string &error),
+	property(uint32_t length, std::string &error),
 	doLaunch(std::string &error);
     };
   }
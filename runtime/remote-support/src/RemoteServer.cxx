@@ -31,6 +31,7 @@
 #include "ContainerManager.h"
 #include "ContainerLauncher.h"
 #include "RemoteLauncher.h"
+#include "RemoteProperty.h"
 #include "RemoteServer.h"
 
 namespace OX = OCPI::Util::EzXml;
@@ -67,6 +68,11 @@ namespace OCPI {
     receive(bool &eof, std::string &error) {
       if (m_downloading)
 	return download(error);
+      // Binary property frames are distinguished from XML by their length word
+      uint32_t length;
+      ssize_t n = ::recv(fd(), &length, sizeof(length), MSG_PEEK | MSG_WAITALL);
+      if (n == sizeof(length) && (length & c_binaryFrame))
+	return property(length & ~c_binaryFrame, error);
       if (OX::receiveXml(fd(), m_rx, m_buf, eof, error))
 	return true;
       const char *tag = OX::ezxml_tag(m_rx);
@@ -539,6 +545,88 @@ namespace OCPI {
       }
       return OX::sendXml(fd(), m_response, "responding from server", error);
     }
+    // Perform a batch of binary property accesses (see RemoteProperty.h)
+    bool Server::
+    property(uint32_t length, std::string &error) {
+      PropertyFrame frame;
+      if (length > c_maxBinaryFrame || length < sizeof(frame.m_flags))
+	return OU::eformat(error, "Bad property access frame length: %" PRIu32, length);
+      m_propRequest.resize(sizeof(uint32_t) + length);
+      if (propertyRead(fd(), &m_propRequest[0], m_propRequest.size()))
+	return OU::eformat(error, "Error reading property access frame: %s", strerror(errno));
+      frame.m_flags = ((PropertyFrame *)&m_propRequest[0])->m_flags;
+      bool answer = (frame.m_flags & c_propertySync) != 0;
+      m_propResponse.clear();
+      // First check the whole frame so that a bad one does not have partial effect, and
+      // reads are not larger than their properties
+      const uint8_t *end = &m_propRequest[0] + m_propRequest.size();
+      for (const uint8_t *p = &m_propRequest[sizeof(frame)]; p < end; ) {
+	const PropertyOp &op = *(const PropertyOp *)p;
+	OC::Worker *w;
+	if (p + sizeof(op) > end || op.m_instance >= m_members.size() ||
+	    !(w = m_members[op.m_instance].m_worker) || op.m_ordinal >= w->nProperties() ||
+	    (op.m_code != PropertyWrite && op.m_code != PropertyRead) ||
+	    (op.m_code == PropertyWrite && p + sizeof(op) + propertyPad(op.m_nBytes) > end))
+	  return OU::eformat(error, "Bad property access frame");
+	// Access errors are reported to the client like those found when doing the access
+	OU::Property &prop = w->properties()[op.m_ordinal];
+	if (m_propError.empty() &&
+	    ((size_t)op.m_offset + op.m_nBytes > prop.m_nBytes ||
+	     (op.m_code == PropertyWrite &&
+	      (!prop.m_isWritable ||
+	       (prop.m_isInitial && w->getControlState() != OU::Worker::INITIALIZED)))))
+	  OU::format(m_propError, "Invalid access to the '%s' property of worker '%s'",
+		     prop.cname(), w->name().c_str());
+	p += sizeof(op);
+	if (op.m_code == PropertyWrite)
+	  p += propertyPad(op.m_nBytes);
+	else
+	  answer = true;
+      }
+      // After an error that the client has not seen yet, nothing more is done until it has
+      if (m_propError.empty())
+	try {
+	  for (const uint8_t *p = &m_propRequest[sizeof(frame)]; p < end; ) {
+	    const PropertyOp &op = *(const PropertyOp *)p;
+	    OC::Worker &w = *m_members[op.m_instance].m_worker;
+	    OU::Property &prop = w.properties()[op.m_ordinal];
+	    p += sizeof(op);
+	    if (op.m_code == PropertyWrite) {
+	      w.setPropertyData(prop, op.m_offset, p, op.m_nBytes);
+	      p += propertyPad(op.m_nBytes);
+	    } else {
+	      size_t offset = m_propResponse.size();
+	      m_propResponse.resize(offset + op.m_nBytes);
+	      w.getPropertyData(prop, op.m_offset, &m_propResponse[offset], op.m_nBytes,
+				(op.m_flags & c_propertyUncached) != 0);
+	    }
+	  }
+	} catch (const std::string &e) {
+	  m_propError = e;
+	} catch (...) {
+	  m_propError = "Unknown Exception";
+	}
+      if (!answer)
+	return false;
+      uint8_t pad[8] = { 0 };
+      if (m_propError.size()) {
+	m_propResponse.clear();
+	ocpiInfo("Property access error reported to client: %s", m_propError.c_str());
+      }
+      frame.m_flags = OCPI_UTRUNCATE(uint32_t, m_propError.size());
+      frame.m_length = c_binaryFrame |
+	OCPI_UTRUNCATE(uint32_t, sizeof(frame.m_flags) + propertyPad(frame.m_flags) +
+		       m_propResponse.size());
+      struct iovec iov[4] = {
+	{ &frame, sizeof(frame) },
+	{ (void *)m_propError.c_str(), m_propError.size() },
+	{ pad, propertyPad(m_propError.size()) - m_propError.size() },
+	{ m_propResponse.empty() ? NULL : &m_propResponse[0], m_propResponse.size() } };
+      bool failed = propertyWrite(fd(), iov, 4);
+      m_propError.clear();
+      return failed ? OU::eformat(error, "Error sending property values: %s", strerror(errno)) :
+	false;
+    }
     // Clear out all the state and resources so that this server can be (serially) reused for another app.
     bool Server::
     appShutDown(std::string &error) {
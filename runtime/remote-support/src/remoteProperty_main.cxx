@@ -0,0 +1,214 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Loopback benchmark of remote property access: an application polling a worker in the
+ * container of an ocpiserve on this host, through the remote launcher and the server's
+ * property handling.  Each poll accesses the 32 bit p7 property of ocpi.ptest as many times
+ * as there are "properties".
+ * The "xml" mode uses the string property API, which is a <control> message round trip per
+ * access.  The "binary" mode uses the scalar API, which is one binary frame round trip per
+ * read, and the "batched" mode does a poll's reads with one Application::accessProperties.
+ * Writes are compared the same way: one XML round trip per write, against scalar writes that
+ * are deferred until a synchronizing batch at the end of each poll.
+ *
+ * usage: remoteProperty [properties [polls [ocpiserve]]]
+ * The ocpi.ptest rcc artifact must be found in OCPI_LIBRARY_PATH.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include "OcpiOsServerSocket.h"
+#include "OcpiContainerApi.h"
+#include "OcpiApplicationApi.h"
+
+namespace OA = OCPI::API;
+namespace OS = OCPI::OS;
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void
+report(const char *name, const char *what, double elapsed, unsigned long nPolls, unsigned nProps)
+{
+  double perPoll = elapsed / (double)nPolls;
+  printf("%-8s %-6s %10.1f usecs per %u properties  %10.0f max Hz  %5.1f%% busy at 100 Hz\n",
+	 name, what, perPoll * 1e6, nProps, 1 / perPoll, perPoll * 100 * 100);
+}
+
+// Wait for the server to accept connections on its port
+static bool
+serverReady(uint16_t port)
+{
+  for (unsigned n = 0; n < 1000; n++) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+      return false;
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bool ok = connect(fd, (struct sockaddr *)&sin, sizeof(sin)) == 0;
+    close(fd);
+    if (ok)
+      return true;
+    usleep(10000);
+  }
+  return false;
+}
+
+static int
+run(uint16_t port, unsigned nProps, unsigned long nPolls)
+{
+  std::string container, xml, value;
+  char buf[32];
+  snprintf(buf, sizeof(buf), "127.0.0.1:%u", port);
+  setenv("OCPI_SERVER_ADDRESSES", buf, 1);
+  container = buf;
+  container += "/rcc0";
+  xml = "<application><instance component='ocpi.ptest' container='" + container +
+    "'/></application>";
+  OA::Application app(xml);
+  app.initialize();
+  OA::Property p7(app, "ptest.p7");
+  uint32_t val = 0;
+  std::vector<uint32_t> values(nProps);
+  std::vector<OA::PropertyBatchAccess> batch(nProps);
+  for (unsigned n = 0; n < nProps; n++) {
+    OA::PropertyBatchAccess &a = batch[n];
+    a.m_property = &p7;
+    a.m_offset = 0;
+    a.m_nBytes = sizeof(uint32_t);
+    a.m_data = &values[n];
+    a.m_write = false;
+    a.m_uncached = true;
+  }
+
+  // Reads, each in its own XML round trip
+  double start = now();
+  for (unsigned long poll = 0; poll < nPolls; poll++)
+    for (unsigned n = 0; n < nProps; n++)
+      app.getProperty("ptest.p7", value);
+  report("xml", "read", now() - start, nPolls, nProps);
+
+  // Reads, each in its own binary frame
+  start = now();
+  for (unsigned long poll = 0; poll < nPolls; poll++)
+    for (unsigned n = 0; n < nProps; n++)
+      values[n] = p7.getULongValue(true);
+  report("binary", "read", now() - start, nPolls, nProps);
+
+  // Reads, all in one batch
+  start = now();
+  for (unsigned long poll = 0; poll < nPolls; poll++)
+    app.accessProperties(&batch[0], nProps);
+  report("batched", "read", now() - start, nPolls, nProps);
+
+  // Writes, each in its own XML round trip
+  start = now();
+  for (unsigned long poll = 0; poll < nPolls; poll++)
+    for (unsigned n = 0; n < nProps; n++) {
+      snprintf(buf, sizeof(buf), "%lu", poll);
+      app.setProperty("ptest.p7", buf);
+    }
+  report("xml", "write", now() - start, nPolls, nProps);
+
+  // Writes, deferred and sent together when the poll synchronizes
+  start = now();
+  for (unsigned long poll = 0; poll < nPolls; poll++) {
+    for (unsigned n = 0; n < nProps; n++)
+      p7.setULongValue(val = (uint32_t)(poll * nProps + n), true);
+    app.accessProperties(NULL, 0);
+  }
+  report("deferred", "write", now() - start, nPolls, nProps);
+  if (p7.getULongValue(true) != val) {
+    fprintf(stderr, "Wrong value read back after deferred writes\n");
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned nProps = argc > 1 ? (unsigned)atoi(argv[1]) : 50;
+  unsigned long nPolls = argc > 2 ? strtoul(argv[2], NULL, 0) : 200;
+  const char *server = argc > 3 ? argv[3] : "ocpiserve";
+  if (!nProps || !nPolls) {
+    fprintf(stderr, "usage: remoteProperty [properties [polls [ocpiserve]]]\n");
+    return 1;
+  }
+  char dir[] = "/tmp/remotePropertyXXXXXX", portArg[8];
+  if (!mkdtemp(dir)) {
+    perror("Creating the server's artifact directory");
+    return 1;
+  }
+  uint16_t port;
+  try {
+    // Find a free loopback port for the server
+    OS::ServerSocket probe;
+    probe.bind(0, false, false, true);
+    port = probe.getPortNo();
+    probe.close();
+  } catch (std::string &e) {
+    fprintf(stderr, "Finding a port for the server: %s\n", e.c_str());
+    return 1;
+  }
+  snprintf(portArg, sizeof(portArg), "%u", port);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("Starting the server");
+    return 1;
+  }
+  if (pid == 0) {
+    execlp(server, server, "-p", portArg, "-D", dir, "-r", (char *)NULL);
+    perror(server);
+    _exit(1);
+  }
+  int rv = 1;
+  if (!serverReady(port))
+    fprintf(stderr, "The server \"%s\" did not start on port %u\n", server, port);
+  else
+    try {
+      rv = run(port, nProps, nPolls);
+    } catch (std::string &e) {
+      fprintf(stderr, "Remote property access error: %s\n", e.c_str());
+    }
+  // The server removes its artifact directory when interrupted
+  kill(pid, SIGINT);
+  int status;
+  waitpid(pid, &status, 0);
+  return rv;
+}
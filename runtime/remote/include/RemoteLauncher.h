@@ -46,6 +46,11 @@ namespace OCPI {
       // launching XML we sent them
       std::vector<OCPI::Container::Launcher::Connection *> m_connections;
       std::vector<OCPI::Library::Artifact *> m_artifacts;
+      // Binary property access state (see RemoteProperty.h)
+      std::vector<uint8_t> m_propRequest; // frame being constructed
+      std::vector<std::pair<uint8_t *, size_t> > m_propReads; // where read data goes
+      std::vector<uint8_t> m_propResponse;
+      bool m_propUnsynced;                // writes sent whose errors are not known yet
     protected:
       Launcher(OCPI::OS::Socket &socket);
       virtual ~Launcher();
@@ -64,6 +69,8 @@ namespace OCPI {
       void emitConnectionUpdate(unsigned nConn, const char *iname, std::string &sinfo);
       void loadArtifact(ezxml_t ax); // Just push the bytes down the pipe, getting a response for each.
       void updateConnection(ezxml_t cx);
+      uint8_t *addPropertyOp(unsigned code, unsigned flags, unsigned remoteInstance,
+			     size_t propN, size_t offset, size_t nBytes);
     public:
       bool
 	wait(unsigned remoteInstance, OCPI::OS::ElapsedTime timeout),
@@ -79,6 +86,18 @@ namespace OCPI {
 			 const std::vector<uint8_t> &path, size_t offset, size_t dimension,
 			 OCPI::API::PropertyOptionList &options,
 			 OCPI::API::PropertyAttributes *a_attributes = NULL);
+      // Binary access to bytes of a property.  Operations are batched until
+      // flushProperties is called, which sends them in one frame, or until the frame is full.
+      // If there are any reads, it waits for them, otherwise it returns without waiting for
+      // the writes to be done.  syncProperties sends any operations and waits until all
+      // earlier ones are done, reporting their errors.  It does nothing if there are none.
+      void
+	queuePropertyWrite(unsigned remoteInstance, size_t propN, size_t offset,
+			   const uint8_t *data, size_t nBytes),
+	queuePropertyRead(unsigned remoteInstance, size_t propN, size_t offset,
+			  uint8_t *data, size_t nBytes, bool uncached),
+	flushProperties(),
+	syncProperties();
     };
   }
 }
@@ -0,0 +1,91 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The binary property access protocol used between the remote launcher (client) and
+// the container server.
+//
+// Property reads and writes are carried in binary frames on the same connection as the
+// XML messages.  XML messages are preceded by their 32 bit length, which is never more
+// than 256KB, so a length word with the top bit set introduces a binary frame instead.
+// A frame holds a batch of operations, each a PropertyOp followed, for writes, by the
+// data.  Only frames with reads or with the c_propertySync flag are answered, so writes
+// can be pipelined without waiting for the server.  The answer is a frame with the length
+// of an error message, the message, and then the data for all the reads, in order.  An
+// error in a frame that was not answered is reported in the next answer.
+// Like the XML framing, everything is in the byte order of the client and server, which
+// are assumed to be the same.
+#ifndef REMOTE_PROPERTY_H
+#define REMOTE_PROPERTY_H
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+namespace OCPI {
+  namespace Remote {
+    const uint32_t
+      c_binaryFrame = 0x80000000,       // set in the length word of binary frames
+      c_maxBinaryFrame = 4*1024*1024,   // limit on what follows the length word
+      c_propertySync = 1;               // frame flag: answer even if there are no reads
+    enum PropertyOpCode { PropertyWrite, PropertyRead };
+    const uint8_t c_propertyUncached = 1; // read flag: read the worker, not the cache
+    struct PropertyFrame {
+      uint32_t m_length;  // c_binaryFrame | number of bytes after this word
+      uint32_t m_flags;   // in requests: c_propertySync; in answers: error message length
+    };
+    struct PropertyOp {
+      uint8_t  m_code;     // PropertyOpCode
+      uint8_t  m_flags;
+      uint16_t m_instance; // remote instance
+      uint32_t m_ordinal;  // property ordinal in the worker
+      uint32_t m_offset;   // byte offset within the property
+      uint32_t m_nBytes;   // bytes written, following this, or bytes to read
+    };
+    // Writes and error messages are padded so that operations stay aligned
+    inline size_t propertyPad(size_t n) { return (n + 7) & ~(size_t)7; }
+    // Complete reads and writes on a socket, returning true on EOF or error
+    inline bool propertyRead(int fd, void *buf, size_t n) {
+      for (ssize_t r; n; n -= (size_t)r, buf = (uint8_t *)buf + r)
+	if ((r = ::read(fd, buf, n)) <= 0 && (r == 0 || errno != EINTR))
+	  return true;
+	else if (r < 0)
+	  r = 0;
+      return false;
+    }
+    inline bool propertyWrite(int fd, struct iovec *iov, int iovcnt) {
+      while (iovcnt) {
+	ssize_t r = ::writev(fd, iov, iovcnt);
+	if (r < 0) {
+	  if (errno == EINTR)
+	    continue;
+	  return true;
+	}
+	for (; iovcnt && (size_t)r >= iov->iov_len; iovcnt--, iov++)
+	  r -= (ssize_t)iov->iov_len;
+	if (iovcnt) {
+	  iov->iov_base = (uint8_t *)iov->iov_base + r;
+	  iov->iov_len -= (size_t)r;
+	}
+      }
+      return false;
+    }
+  }
+}
+#endif
@@ -86,9 +86,13 @@ class Worker
     ocpiAssert("This method is not expected to ever be called" == 0);
     return *(OC::Port*)this;
   }
+  // Deferred property writes are done before the control operation, even when the
+  // worker does not implement it
   void controlOperation(OU::Worker::ControlOperation op) {
     if (getControlMask() & (1 << op))
       m_launcher.controlOp(m_remoteInstance, op);
+    else
+      m_launcher.syncProperties();
   }
   void setProperty(const OCPI::API::PropertyInfo &info, const char *val, const OU::Member &m,
 		   size_t offset, size_t dimension) const {
@@ -111,42 +115,75 @@ class Worker
 
   void read(size_t /*offset*/, size_t /*nBytes*/, void */*p_data*/) {}
   void write(size_t /*offset*/, size_t /*nBytes*/, const void */*p_data*/ ) {}
-  void setPropertyBytes(const OA::PropertyInfo &/*info*/, size_t /*offset*/,
-			const uint8_t */*data*/, size_t /*nBytes*/, unsigned /*idx*/) const {};
-  void setProperty8(const OA::PropertyInfo &/*info*/, size_t /*offset*/, uint8_t /*data*/,
-		    unsigned /*idx*/) const {}
-  void setProperty16(const OA::PropertyInfo &/*info*/, size_t /*offset*/, uint16_t /*data*/,
-		     unsigned /*idx*/) const {}
-  void setProperty32(const OA::PropertyInfo &/*info*/, size_t /*offset*/, uint32_t /*data*/,
-		     unsigned /*idx*/) const {}
-  void setProperty64(const OA::PropertyInfo &/*info*/, size_t /*offset*/, uint64_t /*data*/,
-		     unsigned /*idx*/) const {}
-  void getPropertyBytes(const OA::PropertyInfo &/*info*/, size_t /*offset*/,
-			uint8_t */*data*/, size_t /*nBytes*/, unsigned /*idx*/, bool /*string*/)
-    const {}
-  uint8_t getProperty8(const OA::PropertyInfo &/*info*/, size_t /*offset*/, unsigned /*idx*/) const { return 0; }
-  uint16_t getProperty16(const OA::PropertyInfo &/*info*/, size_t /*offset*/, unsigned /*idx*/) const { return 0; }
-  uint32_t getProperty32(const OA::PropertyInfo &/*info*/, size_t /*offset*/, unsigned /*idx*/) const  { return 0; }
-  uint64_t getProperty64(const OA::PropertyInfo &/*info*/, size_t /*offset*/, unsigned /*idx*/) const  { return 0; }
+  // Raw property data is accessed using the launcher's binary property protocol.
+  // Writes are deferred, and sent with the next read, batch, control operation or
+  // XML message.  Reads wait for the data.
+  void writeData(const OA::PropertyInfo &info, size_t offset, const void *data,
+		 size_t nBytes) const {
+    m_launcher.queuePropertyWrite(m_remoteInstance, info.m_ordinal, offset,
+				  (const uint8_t *)data, nBytes);
+  }
+  void readData(const OA::PropertyInfo &info, size_t offset, void *data, size_t nBytes,
+		bool uncached) const {
+    m_launcher.queuePropertyRead(m_remoteInstance, info.m_ordinal, offset, (uint8_t *)data,
+				 nBytes, uncached);
+    m_launcher.flushProperties();
+  }
+  // A batch goes to the server in one frame, which is answered when everything is done
+  void accessPropertyData(const OA::PropertyBatchAccess *accesses, size_t n) const {
+    for (size_t i = 0; i < n; i++) {
+      const OA::PropertyBatchAccess &a = accesses[i];
+      if (a.m_write)
+	writeData(a.m_property->m_info, a.m_offset, a.m_data, a.m_nBytes);
+      else
+	m_launcher.queuePropertyRead(m_remoteInstance, a.m_property->m_info.m_ordinal,
+				     a.m_offset, (uint8_t *)a.m_data, a.m_nBytes, a.m_uncached);
+    }
+    m_launcher.syncProperties();
+  }
+  void setPropertyBytes(const OA::PropertyInfo &info, size_t offset, const uint8_t *data,
+			size_t nBytes, unsigned idx) const {
+    writeData(info, offset + idx * info.m_elementBytes, data, nBytes);
+  }
+#define OCPI_REMOTE_PROPERTY(bits)						\
+  void setProperty##bits(const OA::PropertyInfo &info, size_t offset, uint##bits##_t data, \
+			 unsigned idx) const {					\
+    writeData(info, offset + idx * sizeof(data), &data, sizeof(data));		\
+  }										\
+  uint##bits##_t getProperty##bits(const OA::PropertyInfo &info, size_t offset,	\
+				   unsigned idx) const {			\
+    uint##bits##_t data;							\
+    readData(info, offset + idx * sizeof(data), &data, sizeof(data), true);	\
+    return data;								\
+  }
+  OCPI_REMOTE_PROPERTY(8)
+  OCPI_REMOTE_PROPERTY(16)
+  OCPI_REMOTE_PROPERTY(32)
+  OCPI_REMOTE_PROPERTY(64)
+#undef OCPI_REMOTE_PROPERTY
+  void getPropertyBytes(const OA::PropertyInfo &info, size_t offset, uint8_t *data,
+			size_t nBytes, unsigned idx, bool string) const {
+    readData(info, offset + idx * info.m_elementBytes, data, nBytes, true);
+    if (string && nBytes)
+      data[nBytes - 1] = '\0';
+  }
 
-      
   void propertyWritten(unsigned /*ordinal*/) const {};
   void propertyRead(unsigned /*ordinal*/) const {};
   void prepareProperty(OU::Property &,
 		       volatile uint8_t *&/*writeVaddr*/,
 		       const volatile uint8_t *&/*readVaddr*/) const {}
 
-  // These scalar and binary accessors must convert to a string value in the remote
-  // case, since the RPC is string-based anyway.
+  // Scalar and string accessors use the binary property protocol, and the server
+  // does any caching.  Sequences are converted to string values and use the XML protocol.
 #undef OCPI_DATA_TYPE_S
 #define OCPI_DATA_TYPE(sca,corba,letter,bits,run,pretty,store)		\
   void set##pretty##Property(const OCPI::API::PropertyInfo &info, const OCPI::Util::Member &m, \
 			     size_t offset, const run val, unsigned idx) const { \
-    OU::Unparser up;							\
-    std::string s;							\
-    up.unparse##pretty(s, val, true);					\
-    setProperty(info, s.c_str(), m, offset + idx * m.m_elementBytes,	\
-		m.m_isSequence || m.m_arrayRank ? 1 : 0);		\
+    union { run r; store s; } u;					\
+    u.s = 0;								\
+    u.r = val;								\
+    writeData(info, offset + idx * m.m_elementBytes, &u.s, sizeof(store)); \
   }									\
   void set##pretty##Cached(const OCPI::API::PropertyInfo &info, const OCPI::Util::Member &m, \
 			     size_t offset, const run val, unsigned idx) const { \
@@ -167,11 +204,11 @@ class Worker
 #define OCPI_DATA_TYPE_S(sca,corba,letter,bits,run,pretty,store)      \
   void set##pretty##Property(const OCPI::API::PropertyInfo &info, const OCPI::Util::Member &m, \
 			     size_t offset, const run val, unsigned idx) const { \
-    OU::Unparser up;							\
-    std::string s;							\
-    up.unparse##pretty(s, val, true);					\
-    setProperty(info, s.c_str(), m, offset + idx * m.m_elementBytes,	\
-		m.m_isSequence || m.m_arrayRank ? 1 : 0);		\
+    size_t len = strlen(val);						\
+    if (len > m.m_stringLength)						\
+      throw OU::Error("String value for %s property too long (%zu vs. %zu)", \
+		      m.cname(), len, m.m_stringLength);		\
+    writeData(info, offset + idx * m.m_elementBytes, val, len + 1);	\
   }									\
   void set##pretty##Cached(const OCPI::API::PropertyInfo &info, const OCPI::Util::Member &m, \
 			   size_t offset, const run val, unsigned idx) const { \
@@ -182,24 +219,20 @@ class Worker
   OCPI_PROPERTY_DATA_TYPES
 #undef OCPI_DATA_TYPE_S
 #undef OCPI_DATA_TYPE
-  // Get Scalar Property by in fact getting the string and parsing it
-  // We get the string because that is the natural remote operation
 #define OCPI_DATA_TYPE(sca,corba,letter,bits,run,pretty,store)		             \
+  run get##pretty##Value(const OCPI::API::PropertyInfo &info, const Util::Member &m, \
+			 size_t offset, unsigned idx, bool uncached) const {	\
+    union { run r; store s; } u;					\
+    readData(info, offset + idx * m.m_elementBytes, &u.s, sizeof(store), uncached); \
+    return u.r;								\
+  }									\
   run get##pretty##Property(const OCPI::API::PropertyInfo &info, const Util::Member &m, \
 			    size_t offset, unsigned idx) const {	             \
-    std::string uValue; /* unparsed value */                                         \
-    getProperty(info, uValue, m, offset + idx * info.m_elementBytes, \
-		m.m_isSequence || m.m_arrayRank ? 1 : 0, OA::PropertyOptionList({ OA::HEX })); \
-    OU::ValueType vt(m);						\
-    vt.m_isSequence = false;						\
-    vt.m_arrayRank = 0;							\
-    OU::Value v(vt);							\
-    (void)v.parse(uValue.c_str());					\
-    return v.m_##pretty;						\
+    return get##pretty##Value(info, m, offset, idx, true);		\
   }									\
   run get##pretty##Cached(const OCPI::API::PropertyInfo &info, const Util::Member &m, \
 			  size_t offset, unsigned idx) const {		\
-    return get##pretty##Property(info, m, offset, idx);			\
+    return get##pretty##Value(info, m, offset, idx, false);		\
   }									\
   unsigned get##pretty##SequenceProperty(const OA::PropertyInfo &info, run *vals, \
 					 size_t length) const {		\
@@ -221,16 +254,18 @@ class Worker
   void get##pretty##Property(const OCPI::API::PropertyInfo &info, const Util::Member &m, \
 			     size_t offset, char *cp, size_t length, unsigned idx) const { \
     assert(m.m_stringLength < length); /* sb checked elsewhere */	\
-    std::string uValue; /* unparsed value */				\
-    getProperty(info, uValue, m, offset + idx * info.m_elementBytes,	\
-		m.m_isSequence || m.m_arrayRank ? 1 : 0, OA::PropertyOptionList({ OA::HEX }));	\
-    strncpy(cp, uValue.c_str(), length); \
+    readData(info, offset + idx * m.m_elementBytes, cp, m.m_stringLength + 1, true); \
+    cp[m.m_stringLength] = '\0';					\
   }									\
   run get##pretty##Cached(const OCPI::API::PropertyInfo &info, const Util::Member &m, \
 			   size_t offset, char *cp, size_t length, unsigned idx) const { \
-    get##pretty##Property(info, m, offset, cp, length, idx); \
-    return cp; \
-  } \
+    if (length < m.m_stringLength + 1)					\
+      throw OU::Error("String value for %s property too long for buffer (%zu vs. %zu)", \
+		      m.cname(), length, m.m_stringLength + 1);		\
+    readData(info, offset + idx * m.m_elementBytes, cp, m.m_stringLength + 1, false); \
+    cp[m.m_stringLength] = '\0';					\
+    return cp;								\
+  }									\
   unsigned get##pretty##SequenceProperty				\
   (const OA::PropertyInfo &/*p*/, char **/*vals*/, size_t /*length*/, char */*buf*/, \
    size_t /*space*/) const { return 0; }
@@ -23,6 +23,8 @@
 #include <errno.h>
 #include <sys/uio.h>
 #include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <cstring>
 #include <set>
 #include "OcpiOsSocket.h"
@@ -31,6 +33,7 @@
 #include "Container.h"
 #include "ContainerApplication.h"
 #include "RemoteLauncher.h"
+#include "RemoteProperty.h"
 namespace OA = OCPI::API;
 namespace OC = OCPI::Container;
 namespace OX = OCPI::Util::EzXml;
@@ -42,7 +45,11 @@ namespace OCPI {
 
 Launcher::
 Launcher(OS::Socket &socket)
-  : m_fd(socket.fd()), m_sending(false), m_rx(NULL) {
+  : m_fd(socket.fd()), m_sending(false), m_rx(NULL), m_propUnsynced(false) {
+  // Pipelined property writes are not answered, so they must not wait for acknowledgements
+  int one = 1;
+  if (setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)))
+    ocpiInfo("Could not disable delays on container server socket: %s", strerror(errno));
 }
 
 Launcher::
@@ -63,6 +70,9 @@ receive() {
 void Launcher::
 send() {
   std::string error;
+  // Make sure that pipelined property writes are done, and their errors reported, before
+  // anything else happens.
+  syncProperties();
   if (OX::sendXml(m_fd, m_request, "container server", error))
     throw OU::Error("%s", error.c_str());
   m_request.clear();
@@ -518,5 +528,105 @@ appShutdown() {
     throw OU::Error("Error in control operation: %s", err);
 }
 
+uint8_t *Launcher::
+addPropertyOp(unsigned code, unsigned flags, unsigned remoteInstance, size_t propN,
+	      size_t offset, size_t nBytes) {
+  size_t opBytes = sizeof(PropertyOp) + (code == PropertyWrite ? propertyPad(nBytes) : 0);
+  if (sizeof(PropertyFrame) + opBytes - sizeof(uint32_t) > c_maxBinaryFrame)
+    throw OU::Error("Remote property access of %zu bytes is too large", nBytes);
+  if (m_propRequest.size() + opBytes - sizeof(uint32_t) > c_maxBinaryFrame)
+    flushProperties();
+  if (m_propRequest.empty())
+    m_propRequest.resize(sizeof(PropertyFrame));
+  size_t
+    opOffset = m_propRequest.size(),
+    length = opOffset + opBytes;
+  m_propRequest.resize(length);
+  PropertyOp &op = *(PropertyOp *)&m_propRequest[opOffset];
+  op.m_code = OCPI_UTRUNCATE(uint8_t, code);
+  op.m_flags = OCPI_UTRUNCATE(uint8_t, flags);
+  op.m_instance = OCPI_UTRUNCATE(uint16_t, remoteInstance);
+  op.m_ordinal = OCPI_UTRUNCATE(uint32_t, propN);
+  op.m_offset = OCPI_UTRUNCATE(uint32_t, offset);
+  op.m_nBytes = OCPI_UTRUNCATE(uint32_t, nBytes);
+  return &m_propRequest[opOffset + sizeof(PropertyOp)];
+}
+
+void Launcher::
+queuePropertyWrite(unsigned remoteInstance, size_t propN, size_t offset, const uint8_t *data,
+		   size_t nBytes) {
+  OU::SelfAutoMutex guard(this);
+  memcpy(addPropertyOp(PropertyWrite, 0, remoteInstance, propN, offset, nBytes), data, nBytes);
+}
+
+void Launcher::
+queuePropertyRead(unsigned remoteInstance, size_t propN, size_t offset, uint8_t *data,
+		  size_t nBytes, bool uncached) {
+  OU::SelfAutoMutex guard(this);
+  addPropertyOp(PropertyRead, uncached ? c_propertyUncached : 0, remoteInstance, propN, offset,
+		nBytes);
+  m_propReads.push_back(std::make_pair(data, nBytes));
+}
+
+// Make sure all writes are done and any errors from them are reported
+void Launcher::
+syncProperties() {
+  OU::SelfAutoMutex guard(this);
+  if (m_propRequest.empty() && !m_propUnsynced)
+    return;
+  if (m_propRequest.empty())
+    m_propRequest.resize(sizeof(PropertyFrame));
+  ((PropertyFrame *)&m_propRequest[0])->m_flags = c_propertySync;
+  flushProperties();
+}
+
+void Launcher::
+flushProperties() {
+  OU::SelfAutoMutex guard(this);
+  if (m_propRequest.empty())
+    return;
+  PropertyFrame &frame = *(PropertyFrame *)&m_propRequest[0];
+  frame.m_length = c_binaryFrame | OCPI_UTRUNCATE(uint32_t, m_propRequest.size() - sizeof(uint32_t));
+  std::vector<std::pair<uint8_t *, size_t> > reads;
+  reads.swap(m_propReads);
+  bool answered = reads.size() || frame.m_flags & c_propertySync;
+  struct iovec iov = { &m_propRequest[0], m_propRequest.size() };
+  bool failed = propertyWrite(m_fd, &iov, 1);
+  m_propRequest.clear();
+  if (failed)
+    throw OU::Error("Error sending property access to container server \"%s\": %s",
+		    name().c_str(), strerror(errno));
+  if (!answered) {
+    m_propUnsynced = true;
+    return;
+  }
+  m_propUnsynced = false;
+  PropertyFrame answer;
+  if (propertyRead(m_fd, &answer, sizeof(answer)) || !(answer.m_length & c_binaryFrame) ||
+      (answer.m_length &= ~c_binaryFrame) > c_maxBinaryFrame ||
+      answer.m_length < sizeof(answer.m_flags) + propertyPad(answer.m_flags))
+    throw OU::Error("Error receiving property values from container server \"%s\"",
+		    name().c_str());
+  m_propResponse.resize(answer.m_length - sizeof(answer.m_flags));
+  if (m_propResponse.size() &&
+      propertyRead(m_fd, &m_propResponse[0], m_propResponse.size()))
+    throw OU::Error("Error receiving property values from container server \"%s\"",
+		    name().c_str());
+  if (answer.m_flags)
+    throw OU::Error("Error accessing property: %.*s", (int)answer.m_flags,
+		    (const char *)&m_propResponse[0]);
+  size_t total = 0;
+  for (unsigned n = 0; n < reads.size(); n++)
+    total += reads[n].second;
+  if (m_propResponse.size() != total)
+    throw OU::Error("Wrong amount of property data from container server \"%s\": %zu vs %zu",
+		    name().c_str(), m_propResponse.size(), total);
+  const uint8_t *data = total ? &m_propResponse[0] : NULL;
+  for (unsigned n = 0; n < reads.size(); n++) {
+    memcpy(reads[n].first, data, reads[n].second);
+    data += reads[n].second;
+  }
+}
+
   }
 }
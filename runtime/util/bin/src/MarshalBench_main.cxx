@@ -0,0 +1,213 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmark of message marshalling with randomly generated protocols
+ * (Protocol::generate), and with a message that is a timestamp and a long sequence of
+ * I/Q structs of two shorts.  Each message is unmarshalled from its buffer into a copy of the
+ * buffer by a writer that takes each piece of data at its offset: once when the writer
+ * refuses blocks, so that the marshalling plan describes every member, element and
+ * string with its own call as the recursive walk did, and once when it takes blocks, so
+ * that fixed runs of data are single copies.  The cost of marshalling into and out of
+ * Values with ValueReader and ValueWriter is shown for comparison.
+ *
+ * usage: MarshalBench [protocols [repetitions [iq-elements]]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+#include "OcpiUtilProtocol.h"
+#include "OcpiUtilValue.h"
+#include "OcpiUtilMarshal.h"
+#include "ValueReader.h"
+#include "ValueWriter.h"
+
+namespace OU = OCPI::Util;
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Copy each piece of data to the same offset in another buffer
+class Copier : public OU::Writer {
+  const uint8_t *m_from;
+  uint8_t *m_to;
+  bool m_blocks;
+public:
+  size_t m_nCalls;
+  Copier(const uint8_t *from, uint8_t *to, bool blocks)
+    : m_from(from), m_to(to), m_blocks(blocks), m_nCalls(0) {}
+  void copy(const uint8_t *p, size_t nBytes) {
+    memcpy(m_to + (p - m_from), p, nBytes);
+    m_nCalls++;
+  }
+  void beginSequence(const OU::Member &, size_t) { m_nCalls++; }
+  void writeString(const OU::Member &, OU::WriteDataPtr p, size_t strLen, bool, bool) {
+    copy(p.data, strLen + 1);
+  }
+  void writeData(const OU::Member &, OU::WriteDataPtr p, size_t nBytes, size_t) {
+    copy(p.data, nBytes);
+  }
+  bool writeBlock(OU::WriteDataPtr p, size_t nBytes) {
+    if (!m_blocks)
+      return false;
+    copy(p.data, nBytes);
+    return true;
+  }
+};
+
+// Supply the I/Q message, in blocks when they are offered
+class IQReader : public OU::Reader {
+  size_t m_nElements;
+public:
+  IQReader(size_t nElements) : m_nElements(nElements) {}
+  size_t beginSequence(const OU::Member &) { return m_nElements; }
+  size_t beginString(const OU::Member &, const char *&chars, bool) { chars = ""; return 0; }
+  void readData(const OU::Member &, OU::ReadDataPtr p, size_t nBytes, size_t, bool fake) {
+    if (!fake)
+      memset(p.data, 1, nBytes);
+  }
+  bool readBlock(OU::ReadDataPtr p, size_t nBytes, bool fake) {
+    if (!fake)
+      memset(p.data, 1, nBytes);
+    return true;
+  }
+};
+
+static void
+report(const char *what, double secs, size_t nMessages, size_t nBytes, size_t nCalls) {
+  printf("%-18s %10.0f ns/msg %8.1f MB/s", what, secs * 1e9 / (double)nMessages,
+	 (double)nBytes / secs / 1e6);
+  if (nCalls)
+    printf(" %8.1f calls/msg", (double)nCalls / (double)nMessages);
+  printf("\n");
+}
+
+// Time copying the message in the buffer both ways
+static void
+copies(OU::Protocol &p, uint8_t opcode, std::vector<uint8_t> &buf, unsigned nReps,
+       double &tCalls, double &tBlocks, size_t &nCalls, size_t &nBlockCalls) {
+  std::vector<uint8_t> copy(buf.size());
+  for (unsigned b = 0; b < 2; b++) {
+    double t = now();
+    for (unsigned r = 0; r < nReps; r++) {
+      Copier copier(&buf[0], &copy[0], b != 0);
+      p.write(copier, &buf[0], buf.size(), opcode);
+      (b ? nBlockCalls : nCalls) += copier.m_nCalls;
+    }
+    (b ? tBlocks : tCalls) += now() - t;
+  }
+}
+
+int
+main(int argc, char **argv)
+{
+  unsigned nProtocols = argc > 1 ? (unsigned)atoi(argv[1]) : 2000;
+  unsigned nReps = argc > 2 ? (unsigned)atoi(argv[2]) : 200;
+  size_t nIQ = argc > 3 ? strtoul(argv[3], NULL, 0) : 4092;
+  double tRead = 0, tWrite = 0, tCalls = 0, tBlocks = 0;
+  size_t nBytes = 0, nMessages = 0, nCalls = 0, nBlockCalls = 0, nSteps = 0, nBlocks = 0;
+  for (unsigned n = 0; n < nProtocols; n++) {
+    OU::Protocol p;
+    p.generate("bench");
+    OU::Value **v;
+    uint8_t opcode;
+    p.generateOperation(opcode, v);
+    OU::Operation &op = p.m_operations[opcode];
+    size_t length;
+    {
+      OU::ValueReader r((const OU::Value **)v);
+      length = p.read(r, NULL, SIZE_MAX, opcode);
+    }
+    if (length) {
+      std::vector<uint8_t> buf(length);
+      double t = now();
+      for (unsigned r = 0; r < nReps; r++) {
+	OU::ValueReader reader((const OU::Value **)v);
+	p.read(reader, &buf[0], length, opcode);
+      }
+      tRead += now() - t;
+      t = now();
+      for (unsigned r = 0; r < nReps; r++) {
+	std::vector<OU::Value *> v1(op.m_nArgs);
+	OU::ValueWriter writer(&v1[0], op.m_nArgs);
+	p.write(writer, &buf[0], length, opcode);
+	for (unsigned a = 0; a < op.m_nArgs; a++)
+	  delete v1[a];
+      }
+      tWrite += now() - t;
+      copies(p, opcode, buf, nReps, tCalls, tBlocks, nCalls, nBlockCalls);
+      nBytes += length * nReps;
+      nMessages += nReps;
+      nSteps += op.marshalPlan().nSteps();
+      nBlocks += op.marshalPlan().nBlocks();
+    }
+    for (unsigned a = 0; a < op.m_nArgs; a++)
+      delete v[a];
+    delete [] v;
+  }
+  printf("Random protocols: %zu messages of %zu bytes average, "
+	 "plans of %.1f steps with %.1f blocks average\n",
+	 nMessages, nBytes / (nMessages ? nMessages : 1),
+	 (double)nSteps / nProtocols, (double)nBlocks / nProtocols);
+  if (!nMessages)
+    return 0;
+  report("values to buffer", tRead, nMessages, nBytes, 0);
+  report("buffer to values", tWrite, nMessages, nBytes, 0);
+  report("copy, per member", tCalls, nMessages, nBytes, nCalls);
+  report("copy, blocks", tBlocks, nMessages, nBytes, nBlockCalls);
+
+  char iq[] =
+    "<protocol>"
+    "  <operation name='iq'>"
+    "    <argument name='time' type='ulonglong'/>"
+    "    <argument name='iq' type='struct' sequencelength='4092'>"
+    "      <member name='I' type='short'/>"
+    "      <member name='Q' type='short'/>"
+    "    </argument>"
+    "  </operation>"
+    "</protocol>";
+  OU::Protocol p;
+  const char *err;
+  if ((err = p.parse(iq))) {
+    fprintf(stderr, "Error parsing protocol: %s\n", err);
+    return 1;
+  }
+  nIQ = std::min(nIQ, (size_t)4092);
+  IQReader reader(nIQ);
+  std::vector<uint8_t> buf(p.read(reader, NULL, SIZE_MAX, 0));
+  p.read(reader, &buf[0], buf.size(), 0);
+  tCalls = tBlocks = 0;
+  nCalls = nBlockCalls = 0;
+  copies(p, 0, buf, nReps, tCalls, tBlocks, nCalls, nBlockCalls);
+  nBytes = buf.size() * nReps;
+  printf("Timestamp and %zu I/Q elements:\n", nIQ);
+  report("copy, per member", tCalls, nReps, nBytes, nCalls);
+  report("copy, blocks", tBlocks, nReps, nBytes, nBlockCalls);
+  return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmark of task spawn/join overhead: the pthread_workqueue path that RCC
+ * tasks used to take (a wrapper allocated per task and a shared counter to join on),
+ * against OCPI::Util::TaskPool, both for individual tasks and for forkJoin slices.
+ *
+ * usage: TaskPoolBench [rounds [tasks-per-round [threads]]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "pthread_workqueue.h"
+#include "OcpiOsMisc.h"
+#include "OcpiUtilTaskPool.h"
+
+namespace OS = OCPI::OS;
+namespace OU = OCPI::Util;
+
+static volatile unsigned long sink;
+
+static void
+task(void *arg)
+{
+  __sync_fetch_and_add(&sink, (unsigned long)arg);
+}
+
+static void
+slice(void *, size_t begin, size_t end)
+{
+  __sync_fetch_and_add(&sink, end - begin);
+}
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// What RCC::Container::addTask used to do
+struct Wargs {
+  void (*task)(void *);
+  void *args;
+};
+static volatile int task_count;
+static void
+taskWrapper(void *args)
+{
+  Wargs *wargs = (Wargs *)args;
+  wargs->task(wargs->args);
+  __sync_fetch_and_sub(&task_count, 1);
+  delete wargs;
+}
+
+static void
+report(const char *name, double elapsed, unsigned long rounds, unsigned nTasks)
+{
+  double total = (double)rounds * nTasks;
+  printf("%-10s tasks: %10.0f  tasks/sec: %12.0f  ns/task: %8.1f  us/round: %8.2f\n",
+	 name, total, total / elapsed, elapsed * 1e9 / total, elapsed * 1e6 / (double)rounds);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long rounds = argc > 1 ? strtoul(argv[1], NULL, 0) : 20000;
+  unsigned nTasks = argc > 2 ? (unsigned)atoi(argv[2]) : 16;
+  unsigned nThreads = argc > 3 ? (unsigned)atoi(argv[3]) : 0;
+
+  pthread_workqueue_t wq;
+  pthread_workqueue_attr_t attr;
+  if (pthread_workqueue_init_np() ||
+      pthread_workqueue_attr_init_np(&attr) ||
+      pthread_workqueue_attr_setqueuepriority_np(&attr, WORKQ_HIGH_PRIOQUEUE) ||
+      pthread_workqueue_create_np(&wq, &attr)) {
+    fprintf(stderr, "Could not create workqueue\n");
+    return 1;
+  }
+  double start = now();
+  for (unsigned long r = 0; r < rounds; r++) {
+    for (unsigned n = 0; n < nTasks; n++) {
+      Wargs *wargs = new Wargs;
+      wargs->task = task;
+      wargs->args = (void *)1;
+      __sync_fetch_and_add(&task_count, 1);
+      pthread_workqueue_additem_np(wq, taskWrapper, wargs, NULL, NULL);
+    }
+    while (task_count)
+      OS::sleep(0);
+  }
+  report("pwq", now() - start, rounds, nTasks);
+
+  OU::TaskPool pool(nThreads);
+  start = now();
+  for (unsigned long r = 0; r < rounds; r++) {
+    OU::TaskGroup group;
+    for (unsigned n = 0; n < nTasks; n++)
+      pool.add(group, task, (void *)1);
+    pool.join(group);
+  }
+  report("pool", now() - start, rounds, nTasks);
+
+  start = now();
+  for (unsigned long r = 0; r < rounds; r++)
+    pool.forkJoin(slice, NULL, 1024 * 1024, nTasks);
+  report("forkJoin", now() - start, rounds, nTasks);
+  return 0;
+}
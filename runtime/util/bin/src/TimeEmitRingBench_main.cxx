@@ -0,0 +1,115 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmark comparing the mutex protected Time::Emit event path with the
+ * per-thread ring path.  All threads emit through one shared Emit object, which is
+ * how the global OCPI_EMIT macros and a busy container's workers use it.
+ * Events dropped because a ring was full cost less than recorded ones, so they are
+ * reported, and the ring rate counts only the events that were recorded.
+ *
+ * usage: TimeEmitRingBench [threads [events-per-thread [ring-entries]]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <inttypes.h>
+#include <vector>
+#include <OcpiOsThreadManager.h>
+#include <OcpiTimeEmit.h>
+
+namespace OT = OCPI::Time;
+
+static OT::Emit *emitter;
+static OT::Emit::EventId eventId;
+static unsigned long nEvents;
+static volatile unsigned ready, go;
+static OCPI::OS::uint64_t s_dropped;
+
+static void
+emitThread(void *)
+{
+  __sync_fetch_and_add(&ready, 1);
+  while (!go)
+    ;
+  for (unsigned long n = 0; n < nEvents; n++)
+    emitter->emit(eventId, (OCPI::OS::uint64_t)n);
+}
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void
+run(const char *name, unsigned nThreads)
+{
+  std::vector<OCPI::OS::ThreadManager *> threads(nThreads);
+  ready = go = 0;
+  for (unsigned n = 0; n < nThreads; n++)
+    threads[n] = new OCPI::OS::ThreadManager(emitThread, NULL);
+  while (ready != nThreads)
+    ;
+  double start = now();
+  go = 1;
+  for (unsigned n = 0; n < nThreads; n++) {
+    threads[n]->join();
+    delete threads[n];
+  }
+  double elapsed = now() - start;
+  OT::Emit::drainThreadRings();
+  OCPI::OS::uint64_t dropped = OT::Emit::threadRingsDropped() - s_dropped;
+  s_dropped += dropped;
+  double total = (double)nEvents * nThreads - (double)dropped;
+  printf("%-8s threads: %2u  events: %10.0f  dropped: %10" PRIu64 "  events/sec: %12.0f  "
+	 "ns/event/thread: %8.2f\n", name, nThreads, total, dropped, total / elapsed,
+	 elapsed * 1e9 * nThreads / total);
+}
+
+int main( int argc, char** argv )
+{
+  unsigned nThreads = argc > 1 ? (unsigned)atoi(argv[1]) : 4;
+  nEvents = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000000;
+  // By default the rings hold all of each thread's events, so none are dropped
+  unsigned ringEntries = 1024;
+  while (ringEntries < nEvents && ringEntries < (1u << 31))
+    ringEntries *= 2;
+  if (argc > 3)
+    ringEntries = (unsigned)atoi(argv[3]);
+
+  // Keep the event queue small since only the emit cost is being measured
+  OT::Emit::QConfig config;
+  config.size = 64 * 1024;
+  config.stopWhenFull = false;
+  emitter = new OT::Emit("RingBench", NULL, &config);
+  eventId = OT::Emit::RegisterEvent::registerEvent("bench value", 64, OT::Emit::Value);
+
+  for (unsigned t = 1; t <= nThreads; t *= 2)
+    run("mutex", t);
+  OT::Emit::enableThreadRings(ringEntries);
+  for (unsigned t = 1; t <= nThreads; t *= 2)
+    run("ring", t);
+  delete emitter;
+  return 0;
+}
@@ -20,12 +20,99 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
+#include <map>
+#include <vector>
 #include <OcpiRes.h>
 
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void
+printStats(const char *when, OCPI::Util::MemBlockMgr &mgr)
+{
+  OCPI::Util::MemBlockStats s;
+  mgr.stats(s);
+  printf("%-10s size %llu used %llu high water %llu allocated %u free blocks %u "
+	 "largest free %llu fragmentation %.1f%%\n", when, (unsigned long long)s.size,
+	 (unsigned long long)s.used, (unsigned long long)s.highWater, s.nAllocated, s.nFree,
+	 (unsigned long long)s.largestFree, s.fragmentation() * 100);
+}
+
+// Set up and tear down circuits' worth of buffers in random order, checking that
+// allocations are aligned and never overlap, and that freeing everything coalesces
+// the pool back into one block.
+static int
+churn(unsigned rounds)
+{
+  const size_t poolSize = 256 * 1024 * 1024;
+  OCPI::Util::MemBlockMgr mgr(0, poolSize);
+  std::map<OCPI::Util::ResAddr, size_t> live;
+  std::vector<OCPI::Util::ResAddr> addrs;
+  unsigned seed = 1;
+  unsigned long nOps = 0;
+  double start = now();
+  for (unsigned r = 0; r < rounds; r++) {
+    // A circuit: some buffers of one size plus their flags and metadata
+    unsigned nBuffers = 1 + (unsigned)(rand_r(&seed) % 200);
+    size_t bufferSize = 64 + (size_t)(rand_r(&seed) % (64 * 1024));
+    for (unsigned n = 0; n < nBuffers * 3; n++) {
+      size_t size = n % 3 == 0 ? bufferSize : n % 3 == 1 ? 4 : 48;
+      unsigned alignment = n % 3 == 0 ? 1u << (unsigned)(rand_r(&seed) % 13) : 8;
+      OCPI::Util::ResAddr addr;
+      nOps++;
+      if (mgr.alloc(size, alignment, addr))
+	break;
+      if (addr & (alignment - 1)) {
+	printf("Error: address %llx is not aligned to %u\n", (unsigned long long)addr,
+	       alignment);
+	return -1;
+      }
+      std::map<OCPI::Util::ResAddr, size_t>::iterator it = live.lower_bound(addr);
+      if ((it != live.end() && it->first < addr + size) ||
+	  (it != live.begin() && (--it)->first + it->second > addr)) {
+	printf("Error: allocation at %llx overlaps another\n", (unsigned long long)addr);
+	return -1;
+      }
+      live[addr] = size;
+      addrs.push_back(addr);
+    }
+    // Tear down about half of what is there, in random order
+    for (size_t n = addrs.size() / 2; n; n--) {
+      size_t i = (size_t)rand_r(&seed) % addrs.size();
+      nOps++;
+      if (mgr.free(addrs[i])) {
+	printf("Error: could not free %llx\n", (unsigned long long)addrs[i]);
+	return -1;
+      }
+      live.erase(addrs[i]);
+      addrs[i] = addrs.back();
+      addrs.pop_back();
+    }
+  }
+  double elapsed = now() - start;
+  printStats("churned", mgr);
+  for (size_t n = 0; n < addrs.size(); n++)
+    mgr.free(addrs[n]);
+  OCPI::Util::MemBlockStats s;
+  mgr.stats(s);
+  printStats("emptied", mgr);
+  if (s.used || s.nFree != 1 || s.largestFree != poolSize) {
+    printf("Error: pool did not coalesce when emptied\n");
+    return -1;
+  }
+  printf("%lu allocs and frees in %.3f secs: %.0f ns each\n", nOps, elapsed,
+	 elapsed * 1e9 / (double)nOps);
+  return 0;
+}
+
 int main( int argc, char** argv )
 {
-  ( void ) argc;
-  ( void ) argv;
   OCPI::Util::ResAddrType addr[10];
   OCPI::Util::MemBlockMgr mMgr(0,2048);
 
@@ -76,5 +163,7 @@ int main( int argc, char** argv )
     return -1;
   }
   printf("Got address %lld from pool\n", (long long)addr[3] );
+  printStats("small", mMgr);
 
+  return churn(argc > 1 ? (unsigned)atoi(argv[1]) : 2000);
 }
@@ -117,6 +117,11 @@ const char **ezxml_pi(ezxml_t xml, const char *target);
 // frees the memory allocated for an ezxml structure
 void ezxml_free(ezxml_t xml);
     
+// Returns a copy of a parsed document that shares its strings, which must
+// therefore outlive the copy.  Returns NULL for documents with a DTD or
+// processing instructions, which are not copied.
+ezxml_t ezxml_dup(ezxml_t xml);
+
 // returns parser error message or empty string if none
 const char *ezxml_error(ezxml_t xml);
 
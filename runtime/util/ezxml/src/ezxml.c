@@ -884,6 +884,40 @@ void ezxml_free(ezxml_t xml)
     free(xml);
 }
 
+// copies a tag and its subtags under the given parent, sharing all strings
+static ezxml_t ezxml_dup_r(ezxml_t xml, ezxml_t dest)
+{
+    ezxml_t dup = dest ? ezxml_add_child(dest, xml->name, xml->off) : ezxml_new(xml->name);
+    ezxml_t child;
+    int n;
+
+    for (n = 0; xml->attr[n]; n += 2);
+    if (n) { // none of the names and values are malloced in the copy
+        dup->attr = memcpy(malloc((n + 2) * sizeof(char *)), xml->attr,
+                           n * sizeof(char *));
+        dup->attr[n] = NULL;
+        dup->attr[n + 1] = memset(malloc(n / 2 + 1), ' ', n / 2);
+        dup->attr[n + 1][n / 2] = '\0';
+    }
+    dup->txt = xml->txt;
+    for (child = xml->child; child; child = child->ordered)
+        ezxml_dup_r(child, dup);
+    return dup;
+}
+
+// Returns a copy of a parsed document that shares its strings, which must
+// therefore outlive the copy.  Returns NULL for documents with a DTD or
+// processing instructions, which are not copied.
+ezxml_t ezxml_dup(ezxml_t xml)
+{
+    ezxml_root_t root = (ezxml_root_t)xml;
+
+    if (! xml || xml->parent || ! xml->name || root->err[0] || root->attr[0] ||
+        root->pi[0] || root->ent[10])
+        return NULL;
+    return ezxml_dup_r(xml, NULL);
+}
+
 // return parser error message or empty string if none
 const char *ezxml_error(ezxml_t xml)
 {
@@ -404,36 +404,22 @@ namespace OCPI {
           return strcasecmp(lhs.c_str(), rhs.c_str()) < 0;
         }
       };
-      /* DO NOT USE THESE - they are invalid in containers like "map" which
-       * want a "less" compare and assume equal when !(a<b) and !(b<a).
-       * See also: http://www.cplusplus.com/reference/map/map/ (Compare)
+      // These are hash and equality objects for the unordered (hashed) STL classes.
+      // Note the equality objects are NOT valid for "map" and other ordered classes
+      // which want a "less" compare.
       struct ConstCharEqual {
 	inline bool operator() (const char *lhs, const char *rhs) const {
 	  return strcmp(lhs, rhs) == 0;
 	}
       };
-      struct ConstCharCaseEqual {
-	inline bool operator() (const char *lhs, const char *rhs) const {
-	  return strcasecmp(lhs, rhs) == 0;
-	}
-      };
-      */
-      /* These need to be replaced if needed because they are poorly implemented ("abc" == "cba"):
-      struct ConstCharHash {
-	inline size_t operator() (const char *s) const {
-	  size_t h = 0;
-	  while (*s) h += (unsigned char)*s++;
-	  return h;
-	}
-      };
-      struct ConstCharCaseHash {
+      struct ConstCharHash { // FNV-1a
 	inline size_t operator() (const char *s) const {
-	  size_t h = 0;
-	  while (*s) h += (unsigned char)tolower(*s++);
-	  return h;
+	  uint64_t h = 0xcbf29ce484222325ull;
+	  while (*s)
+	    h = (h ^ (unsigned char)*s++) * 0x100000001b3ull;
+	  return (size_t)h;
 	}
       };
-      */
       inline size_t roundUp (size_t value, size_t align) {
 	return ((value + (align - 1)) / align) * align;
       }
@@ -0,0 +1,106 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// This file implements a pool of threads that run short tasks on behalf of
+// other threads, usually to spread one computation over several cores.
+// Each pool thread has its own queue of preallocated task descriptors, and
+// pool threads that run out of work steal from the others.  Tasks are
+// added to a TaskGroup so that the adder can wait for just its own tasks,
+// and a thread waiting for a group runs queued tasks rather than blocking.
+// A full queue is not an error: the task is just run by the adding thread.
+
+#ifndef OCPIUTILTASKPOOL_H__
+#define OCPIUTILTASKPOOL_H__
+
+#include <cstddef>
+#include <vector>
+#include <pthread.h>
+#include "OcpiOsMutex.h"
+#include "OcpiOsSemaphore.h"
+#include "OcpiOsThreadManager.h"
+
+namespace OCPI {
+  namespace Util {
+    // A set of tasks that can be waited for together
+    class TaskGroup {
+      friend class TaskPool;
+      // Tasks not finished, and a flag set by a joiner about to block on m_done
+      static const size_t c_joining = ~(~(size_t)0 >> 1);
+      volatile size_t m_outstanding;
+      OCPI::OS::Semaphore m_done;       // posted when the last task finishes with c_joining set
+    public:
+      TaskGroup() : m_outstanding(0), m_done(0) {}
+      bool done() const { return (m_outstanding & ~c_joining) == 0; }
+    };
+    class TaskPool {
+    public:
+      typedef void Function(void *arg);
+      // Function for one slice of a range of items: [begin, end)
+      typedef void SliceFunction(void *arg, size_t begin, size_t end);
+      static const unsigned c_maxSlices = 64;
+    private:
+      struct Task {
+	Function *m_function;
+	void *m_arg;
+	TaskGroup *m_group;
+      };
+      struct Queue {
+	OCPI::OS::Mutex m_mutex;
+	Task *m_tasks;            // ring of preallocated descriptors
+	unsigned m_head, m_count; // under m_mutex
+	char m_pad[64];           // keep queues used by different threads apart
+      };
+      struct Thread {
+	TaskPool &m_pool;
+	unsigned m_index;
+	OCPI::OS::ThreadManager *m_thread;
+	Thread(TaskPool &pool, unsigned index) : m_pool(pool), m_index(index), m_thread(NULL) {}
+      };
+      unsigned m_depth;                 // power of 2
+      bool m_pin;
+      std::vector<Queue *> m_queues;
+      std::vector<Thread *> m_threads;
+      OCPI::OS::Semaphore m_work;       // posted when work is added and threads are asleep
+      volatile unsigned m_sleepers, m_next;
+      volatile bool m_exiting;
+      pthread_key_t m_key;              // which pool thread we are, if any
+    public:
+      // nThreads == 0 means one per online processor.  depth is per thread.
+      TaskPool(unsigned nThreads = 0, unsigned depth = 256, bool pin = false);
+      ~TaskPool();
+      unsigned nThreads() const { return (unsigned)m_threads.size(); }
+      // Queue a task in the group
+      void add(TaskGroup &group, Function *function, void *arg);
+      // Wait for all tasks in the group to finish, helping out meanwhile, and blocking
+      // when there is nothing left to help with.
+      // If not blocking, just report whether they are done.
+      bool join(TaskGroup &group, bool block = true);
+      // Split the range [0, nItems) into nSlices (default: one per thread), run the
+      // function on them in parallel, including in this thread, and return when all are done.
+      void forkJoin(SliceFunction *function, void *arg, size_t nItems, unsigned nSlices = 0);
+    private:
+      static void poolThread(void *arg);
+      bool take(unsigned self, Task &task);
+      void execute(Task &task);
+      unsigned self();
+    };
+  }
+}
+#endif
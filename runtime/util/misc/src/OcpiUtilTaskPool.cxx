@@ -0,0 +1,226 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h>
+#include <sched.h>
+#include "ocpi-config.h"
+#include "OcpiOsAssert.h"
+#include "OcpiUtilAutoMutex.h"
+#include "OcpiUtilTaskPool.h"
+
+namespace OCPI {
+  namespace Util {
+    namespace OS = OCPI::OS;
+
+    TaskPool::
+    TaskPool(unsigned nThreads, unsigned depth, bool pin)
+      : m_depth(1), m_pin(pin), m_work(0), m_sleepers(0), m_next(0), m_exiting(false) {
+      if (!nThreads) {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	nThreads = n > 0 ? (unsigned)n : 1;
+      }
+      while (m_depth < depth)
+	m_depth <<= 1;
+      ocpiCheck(pthread_key_create(&m_key, NULL) == 0);
+      for (unsigned n = 0; n < nThreads; n++) {
+	Queue *q = new Queue;
+	q->m_tasks = new Task[m_depth];
+	q->m_head = q->m_count = 0;
+	m_queues.push_back(q);
+      }
+      for (unsigned n = 0; n < nThreads; n++) {
+	Thread *t = new Thread(*this, n);
+	m_threads.push_back(t);
+	t->m_thread = new OS::ThreadManager(poolThread, t);
+      }
+      ocpiInfo("Task pool started with %u threads, %u tasks per queue%s", nThreads, m_depth,
+	       pin ? ", pinned to processors" : "");
+    }
+
+    TaskPool::
+    ~TaskPool() {
+      m_exiting = true;
+      for (unsigned n = 0; n < m_threads.size(); n++)
+	m_work.post();
+      for (unsigned n = 0; n < m_threads.size(); n++) {
+	m_threads[n]->m_thread->join();
+	delete m_threads[n]->m_thread;
+	delete m_threads[n];
+      }
+      for (unsigned n = 0; n < m_queues.size(); n++) {
+	delete [] m_queues[n]->m_tasks;
+	delete m_queues[n];
+      }
+      pthread_key_delete(m_key);
+    }
+
+    // Our pool thread index, or, for other threads, a queue to spread their work over
+    unsigned TaskPool::
+    self() {
+      uintptr_t index = (uintptr_t)pthread_getspecific(m_key);
+      return index ? (unsigned)(index - 1) :
+	__sync_fetch_and_add(&m_next, 1) % (unsigned)m_queues.size();
+    }
+
+    void TaskPool::
+    poolThread(void *arg) {
+      Thread &t = *(Thread *)arg;
+      TaskPool &p = t.m_pool;
+      pthread_setspecific(p.m_key, (void *)(uintptr_t)(t.m_index + 1));
+#ifdef OCPI_OS_linux
+      if (p.m_pin) {
+	long nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(t.m_index % (unsigned)(nCpus > 0 ? nCpus : 1), &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+	  ocpiInfo("Task pool thread %u could not be pinned", t.m_index);
+      }
+#endif
+      Task task;
+      while (!p.m_exiting) {
+	if (p.take(t.m_index, task)) {
+	  p.execute(task);
+	  continue;
+	}
+	// Announce that we will sleep, then look again, since an adder only posts
+	// when it sees sleepers.
+	__sync_fetch_and_add(&p.m_sleepers, 1);
+	if (p.take(t.m_index, task)) {
+	  __sync_fetch_and_sub(&p.m_sleepers, 1);
+	  p.execute(task);
+	  continue;
+	}
+	p.m_work.wait();
+	__sync_fetch_and_sub(&p.m_sleepers, 1);
+      }
+    }
+
+    // Take from the head of our own queue, or steal from the tail of another
+    bool TaskPool::
+    take(unsigned me, Task &task) {
+      unsigned nQueues = (unsigned)m_queues.size();
+      for (unsigned n = 0; n < nQueues; n++) {
+	Queue &q = *m_queues[(me + n) % nQueues];
+	if (!q.m_count) // unlocked peek, rechecked below
+	  continue;
+	AutoMutex guard(q.m_mutex);
+	if (q.m_count) {
+	  if (n == 0) {
+	    task = q.m_tasks[q.m_head];
+	    q.m_head = (q.m_head + 1) & (m_depth - 1);
+	  } else
+	    task = q.m_tasks[(q.m_head + q.m_count - 1) & (m_depth - 1)];
+	  q.m_count--;
+	  return true;
+	}
+      }
+      return false;
+    }
+
+    void TaskPool::
+    execute(Task &task) {
+      task.m_function(task.m_arg);
+      TaskGroup &g = *task.m_group;
+      // Once the count is zero, g may be gone unless its joiner is blocked waiting for us
+      if (__sync_sub_and_fetch(&g.m_outstanding, 1) == TaskGroup::c_joining)
+	g.m_done.post();
+    }
+
+    void TaskPool::
+    add(TaskGroup &group, Function *function, void *arg) {
+      __sync_fetch_and_add(&group.m_outstanding, 1);
+      Task task = { function, arg, &group };
+      Queue &q = *m_queues[self()];
+      {
+	AutoMutex guard(q.m_mutex);
+	if (q.m_count < m_depth) {
+	  q.m_tasks[(q.m_head + q.m_count++) & (m_depth - 1)] = task;
+	  function = NULL;
+	}
+      }
+      if (function)
+	execute(task);
+      else {
+	__sync_synchronize();
+	if (m_sleepers)
+	  m_work.post();
+      }
+    }
+
+    bool TaskPool::
+    join(TaskGroup &group, bool block) {
+      if (!block || group.done())
+	return group.done();
+      unsigned me = self();
+      Task task;
+      while (!group.done())
+	if (take(me, task))
+	  execute(task);
+	else {
+	  // Nothing to help with: the rest are running elsewhere, so block until the
+	  // last one finishes, unless it just did.
+	  size_t n = group.m_outstanding;
+	  if (n && __sync_bool_compare_and_swap(&group.m_outstanding, n, n | TaskGroup::c_joining)) {
+	    group.m_done.wait();
+	    group.m_outstanding = 0;
+	  }
+	}
+      __sync_synchronize();
+      return true;
+    }
+
+    namespace {
+      struct Slice {
+	TaskPool::SliceFunction *m_function;
+	void *m_arg;
+	size_t m_begin, m_end;
+      };
+      void runSlice(void *arg) {
+	Slice &s = *(Slice *)arg;
+	s.m_function(s.m_arg, s.m_begin, s.m_end);
+      }
+    }
+
+    void TaskPool::
+    forkJoin(SliceFunction *function, void *arg, size_t nItems, unsigned nSlices) {
+      if (!nSlices)
+	nSlices = nThreads();
+      if (nSlices > c_maxSlices)
+	nSlices = c_maxSlices;
+      if (nSlices > nItems)
+	nSlices = nItems ? (unsigned)nItems : 1;
+      Slice slices[c_maxSlices];
+      TaskGroup group;
+      size_t perSlice = nItems / nSlices, extra = nItems % nSlices, begin = 0;
+      for (unsigned n = 0; n < nSlices; n++) {
+	Slice &s = slices[n];
+	s.m_function = function;
+	s.m_arg = arg;
+	s.m_begin = begin;
+	s.m_end = begin = begin + perSlice + (n < extra ? 1 : 0);
+	if (n)
+	  add(group, runSlice, &s);
+      }
+      runSlice(&slices[0]);
+      join(group);
+    }
+  }
+}
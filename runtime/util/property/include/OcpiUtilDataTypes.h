@@ -76,6 +76,7 @@ namespace OCPI {
       ValueTypeInternal(OCPI::API::BaseType bt, bool isSequence);
     };
     class Reader;
+    class MarshalPlan;
     // The ValueType class (which could be DataType) represents the data type of something, and
     // not its value.  It is not named.  It has the base scalar type (from the list in
     // *DataTypesApi.h) or also extended types:  enum, struct, and recursively "type".  This
@@ -168,6 +169,9 @@ namespace OCPI {
 	writeString(const Member &m, WriteDataPtr p, size_t strLen, bool start, bool top) = 0,
 	writeData(const Member &m, WriteDataPtr p, size_t nBytes, size_t nElements) = 0,
 	end();
+      // Take a run of data with a fixed layout in place of the calls that describe it.
+      // Return false to get those calls instead.  Sequences and strings are always described.
+      virtual bool writeBlock(WriteDataPtr p, size_t nBytes);
     };
 
     class Reader {
@@ -190,6 +194,9 @@ namespace OCPI {
 	readData(const Member &m, ReadDataPtr p, size_t nBytes, size_t nElements,
 		 bool fake = false) = 0,
 	end();
+      // Fill a run of data with a fixed layout in place of the calls that describe it.
+      // Return false to get those calls instead.
+      virtual bool readBlock(ReadDataPtr p, size_t nBytes, bool fake);
     };
     // There are the data type attributes allowed for members
 #define OCPI_UTIL_MEMBER_ATTRS						\
@@ -214,6 +221,9 @@ namespace OCPI {
       Value *m_default;              // A default value, if one is appropriate and there is one
       std::string m_defaultExpr;
       unsigned m_ordinal;            // ordinal within group
+    private:
+      mutable MarshalPlan *m_plan;   // compiled on first use by read or write
+    public:
       Member();
       Member(const char *name, const char *abbrev, const char *description,
 	     OCPI::API::BaseType type, bool isSequence, const char *defaultValue);
@@ -225,6 +235,8 @@ namespace OCPI {
       void printAttrs(std::string &out, const char *tag, unsigned indent = 0, bool suppressDefault = false);
       void printChildren(std::string &out, const char *tag, unsigned indent = 0);
       void printXML(std::string &out, const char *tag, unsigned indent);
+      // The plan for reading and writing this member, which must not change after this is used
+      const MarshalPlan &marshalPlan() const;
       void write(Writer &writer, const uint8_t *&data, size_t &length, bool topSeq = false) const;
       void generate(const char *name, unsigned ordinal = 0, unsigned depth = 0);
       // Fake means don't actually touch the message.
@@ -241,6 +253,7 @@ namespace OCPI {
 		 size_t *dimensionp = NULL) const,
 	*offset(size_t &maxAlign, size_t &argOffset, size_t &minSize, bool &diverseSizes,
 		bool &sub32, bool &unBounded, bool &isVariable, bool isTop = false);
+      // Where this argument is in a message, if it is at a fixed offset
       uint8_t *getField(uint8_t *data, size_t &length) const;
       static const char
 	*parseMembers(ezxml_t prop, size_t &nMembers, Member *&members, bool isFixed,
@@ -0,0 +1,81 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Marshalling plans: the type tree of a set of members compiled into a flat list of steps
+
+#ifndef OCPI_UTIL_MARSHAL_H
+#define OCPI_UTIL_MARSHAL_H
+
+#include <vector>
+#include "OcpiUtilDataTypes.h"
+
+namespace OCPI {
+  namespace Util {
+    // A marshalling plan does what the recursive walk of the type tree would do when data is
+    // given to a Writer or taken from a Reader, but from a flat list of steps compiled once.
+    // Runs of members whose size and layout are fixed are single "block" steps, with the
+    // offsets of everything inside them precomputed.  A block is offered whole to the
+    // reader or writer (readBlock/writeBlock), and only described member by member if it
+    // is refused.  Sequences, strings and recursive types are explicit steps, with their
+    // elements described by a nested list of steps.
+    class MarshalPlan {
+      // The calls that describe the contents of a block, at offsets from its start
+      struct Event {
+	enum Type { Data, BeginStruct, EndStruct, BeginArray, EndArray } m_type;
+	const Member *m_member;
+	size_t m_offset, m_nBytes, m_nElements;
+      };
+      struct Step {
+	const Member *m_member; // NULL for a block
+	size_t m_align;         // block: alignment of its start
+	size_t m_nBytes;        // block: size
+	size_t m_first, m_count;// block: range of events, member: range of element steps
+	size_t m_stride;        // member: when each element is one block, the element size
+      };
+      std::vector<Event> m_events;
+      std::vector<Step> m_steps;
+      size_t m_first, m_count; // the top level steps
+      size_t m_nBlocks;
+    public:
+      MarshalPlan(const Member *members, size_t nMembers);
+      // Equivalent to calling Member::write or Member::read on each of the members in turn
+      void write(Writer &writer, const uint8_t *&data, size_t &length, bool topSeq) const;
+      void read(Reader &reader, uint8_t *&data, size_t &length, bool fake, bool top) const;
+      size_t nSteps() const { return m_steps.size(); }
+      size_t nBlocks() const { return m_nBlocks; }
+    private:
+      void compile(const Member *members, size_t nMembers, size_t &first, size_t &count);
+      void compileFixed(const Member &m, size_t &offset);
+      void addEvent(Event::Type type, const Member &m, size_t offset = 0, size_t nBytes = 0,
+		    size_t nElements = 0);
+      void writeSteps(size_t first, size_t count, Writer &writer, const uint8_t *&data,
+		      size_t &length, bool topSeq) const;
+      void writeMember(const Step &s, Writer &writer, const uint8_t *&data, size_t &length,
+		       bool topSeq) const;
+      void writeEvents(const Step &s, Writer &writer, const uint8_t *data) const;
+      void readSteps(size_t first, size_t count, Reader &reader, uint8_t *&data,
+		     size_t &length, bool fake, bool top) const;
+      void readMember(const Step &s, Reader &reader, uint8_t *&data, size_t &length,
+		      bool fake, bool top) const;
+      void readEvents(const Step &s, Reader &reader, uint8_t *data, bool fake) const;
+    };
+  }
+}
+#endif
@@ -49,6 +49,9 @@ namespace OCPI  {
       Operation *m_exceptions;  // if twoway
       size_t m_myOffset;      // for determining message sizes
       bool m_topFixedSequence;  // is this operation a single top level sequence of fixed size elements?
+    private:
+      mutable MarshalPlan *m_plan; // for all the args, compiled on first use by read or write
+    public:
       Operation();
       Operation(const Operation & p );
       ~Operation();
@@ -62,6 +65,7 @@ namespace OCPI  {
       virtual const char *cname() const { return m_name.c_str(); }
       inline bool isTopFixedSequence() const { return m_topFixedSequence; }
       size_t defaultLength() const;
+      const MarshalPlan &marshalPlan() const;
       void printXML(std::string &out, unsigned indent = 0) const;
       void write(Writer &writer, const uint8_t *data, size_t length);
       size_t read(Reader &reader, uint8_t *data, size_t maxLength);
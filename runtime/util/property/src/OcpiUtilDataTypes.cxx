@@ -29,6 +29,7 @@
 #include "OcpiUtilException.h"
 #include "OcpiUtilDataTypes.h"
 #include "OcpiUtilValue.h"
+#include "OcpiUtilMarshal.h"
 
 namespace OCPI {
   namespace Util {
@@ -103,7 +104,8 @@ namespace OCPI {
     }
 
     Member::
-    Member() : m_offset(0), m_isIn(false), m_isOut(false), m_isKey(false), m_default(NULL), m_ordinal(0)
+    Member() : m_offset(0), m_isIn(false), m_isOut(false), m_isKey(false), m_default(NULL), m_ordinal(0),
+	       m_plan(NULL)
     {
     }
     Member::
@@ -111,7 +113,7 @@ namespace OCPI {
       : ValueType(other), m_name(other.m_name), m_abbrev(other.m_abbrev), m_pretty(other.m_pretty),
 	m_description(other.m_description), m_offset(other.m_offset), m_isIn(other.m_isIn),
 	m_isOut(other.m_isOut), m_isKey(other.m_isKey), m_default(NULL),
-        m_defaultExpr(other.m_defaultExpr), m_ordinal(other.m_ordinal) {
+        m_defaultExpr(other.m_defaultExpr), m_ordinal(other.m_ordinal), m_plan(NULL) {
       if (other.m_default)
 	m_default = new Value(*other.m_default);
     }
@@ -121,7 +123,7 @@ namespace OCPI {
 	   bool a_isSequence, const char *defaultValue)
       : ValueType(type, a_isSequence), m_name(name), m_abbrev(abbrev ? abbrev : ""),
 	m_description(description ? description : ""),
-	m_offset(0), m_isIn(false), m_isOut(false), m_isKey(false), m_default(NULL) {
+	m_offset(0), m_isIn(false), m_isOut(false), m_isKey(false), m_default(NULL), m_plan(NULL) {
       if (defaultValue) {
 	m_default = new Value(*this);
 	ocpiCheck(m_default->parse(defaultValue) == 0);
@@ -146,10 +148,12 @@ namespace OCPI {
       swap(f.m_default, s.m_default);
       swap(f.m_defaultExpr, s.m_defaultExpr);
       swap(f.m_ordinal, s.m_ordinal);
+      swap(f.m_plan, s.m_plan);
     }
     Member::~Member() {
       if (m_default)
 	delete m_default;
+      delete m_plan;
     }
     // Return a type object that is a sequence of this type
     // This is not a member function of ValueType because hierarchical types
@@ -456,196 +460,26 @@ namespace OCPI {
       printAttrs(out, tag, indent);
       printChildren(out, tag, indent);
     }
-    inline void advance(const uint8_t *&p, size_t nBytes, size_t &length) {
-      if (nBytes > length)
-	throw Error("Aligning data exceeds buffer when writing: length %zu advance %zu",
-		    length, nBytes);
-      // Cannot enforce this because a "fake" mode is used to prepass and determine buffer size:
-      // ocpiAssert(p != nullptr);
-      length -= nBytes;
-      p += nBytes;
-    }
-    inline void radvance(uint8_t *&p, size_t nBytes, size_t &length) {
-      advance(*(const uint8_t **)&p, nBytes, length);
-    }
-    inline void align(const uint8_t *&p, size_t n, size_t &length) {
-      uint8_t *tmp = (uint8_t *)(((uintptr_t)p + (n - 1)) & ~((uintptr_t)(n)-1));
-      advance(p, OCPI_SIZE_T_DIFF(tmp, p), length);
-    }
-    // We clear bytes we skip
-    inline void ralign(uint8_t *&p, size_t n, size_t &length) {
-      align(*(const uint8_t **)&p, n, length);
+    const MarshalPlan &Member::
+    marshalPlan() const {
+      if (!m_plan) {
+	// Several threads may get here first: only one plan is kept
+	MarshalPlan *plan = new MarshalPlan(this, 1);
+	if (!__sync_bool_compare_and_swap(&m_plan, NULL, plan))
+	  delete plan;
+      }
+      return *m_plan;
     }
     // Push the data in the linear buffer into a writer object
     void Member::
     write(Writer &writer, const uint8_t *&data, size_t &length, bool topSeq) const {
-      size_t nElements = 1;
-      const uint8_t *startData = NULL; // quiet warning
-      size_t startLength = 0; // quiet warning
-      if (m_isSequence) {
-	if (topSeq && !m_fixedLayout) {
-	  ocpiAssert(((uintptr_t)data & ~(m_align - 1u)) == 0);
-	  ocpiAssert(length % m_nBytes == 0);
-	  nElements = length / m_nBytes;
-	} else {
-	  align(data, m_align, length);
-	  nElements = *(uint32_t *)data;
-	}
-	startData = data;
-	startLength = length;
-	if (m_sequenceLength != 0 && nElements > m_sequenceLength)
-	  throw Error("Sequence in buffer (%zu) exceeds maximum length (%zu)", nElements,
-		      m_sequenceLength);
-	writer.beginSequence(*this, nElements);
-	if (!nElements) {
-	  advance(data, m_fixedLayout && !topSeq ? m_nBytes : m_align, length);
-	  return;
-	}
-	advance(data, m_align, length);
-      }
-      nElements *= m_nItems;
-      if (m_arrayRank)
-	writer.beginArray(*this, m_nItems);
-      align(data, m_dataAlign, length);
-      switch (m_baseType) {
-      case OA::OCPI_Struct:
-	writer.beginStruct(*this);
-	for (unsigned n = 0; n < nElements; n++) {
-	  align(data, m_dataAlign, length);
-	  for (unsigned nn = 0; nn < m_nMembers; nn++)
-	    m_members[nn].write(writer, data, length);
-        }
-	writer.endStruct(*this);
-	break;
-      case OA::OCPI_Type:
-	writer.beginType(*this);
-	for (unsigned n = 0; n < nElements; n++)
-	  m_type->write(writer, data, length);
-	writer.endType(*this);
-	break;
-      case OA::OCPI_String:
-	for (unsigned n = 0; n < nElements; n++) {
-	  align(data, 4, length);
-	  WriteDataPtr p = {data};
-	  size_t nBytes = strlen((const char *)data) + 1;
-	  advance(data, m_fixedLayout ?  (m_stringLength + 4) & ~3u : nBytes, length);
-	  writer.writeString(*this, p, nBytes - 1, n == 0, topSeq);
-	}
-	break;
-      default:
-	{ // Scalar - write them all at once
-	  align(data, m_align, length);
-	  WriteDataPtr p = {data};
-	  size_t nBytes = nElements * m_elementBytes;
-	  advance(data, nBytes, length);
-	  writer.writeData(*this, p, nBytes, nElements);
-	  break;
-	}
-      case OA::OCPI_none:
-      case OA::OCPI_scalar_type_limit:
-	ocpiAssert(0);
-      }
-      if (m_arrayRank )
-	writer.endArray(*this);
-      if (m_isSequence) {
-	writer.endSequence(*this);
-	if (m_fixedLayout && !topSeq) {
-	  // If fixed layout override the incremental data/length advance and
-	  // advance over the whole thing, including the length prefix
-	  advance(startData, m_nBytes, startLength);
-	  assert(startData >= data && startLength <= length);
-	  data = startData;
-	  length = startLength;
-	}
-      }
+      marshalPlan().write(writer, data, length, topSeq);
     }
 
     // Fill the linear buffer from a reader object
     void Member::
     read(Reader &reader, uint8_t *&data, size_t &length, bool fake, bool top) const {
-      size_t nElements = 1;
-      uint8_t *startData = NULL; // quiet warning
-      size_t startLength = 0; // quiet warning
-      if (m_isSequence) {
-	ralign(data, m_align, length);
-	startData = data;
-	startLength = length;
-	nElements = reader.beginSequence(*this);
-	if (m_sequenceLength != 0 && nElements > m_sequenceLength)
-	  throw Error("Sequence being read (%zu) exceeds max length (%zu)", nElements, m_sequenceLength);
-	if (!fake)
-	  *(uint32_t *)data = (uint32_t)nElements;
-	if (!nElements) {
-	  // Sequence is empty. skip over header or whole thing if fixedLayout
-	  radvance(data, m_fixedLayout && !top ? m_nBytes : m_align, length);
-	  return;
-	}
-	// Non empty - skip over header for now
-	radvance(data, m_align, length);
-      }
-      if (m_arrayRank)
-	reader.beginArray(*this, m_nItems);
-      nElements *= m_nItems;
-      ralign(data, m_dataAlign, length);
-      switch (m_baseType) {
-      case OA::OCPI_Struct:
-	reader.beginStruct(*this);
-	for (unsigned n = 0; n < nElements; n++) {
-	  ralign(data, m_dataAlign, length);
-	  for (unsigned nn = 0; nn < m_nMembers; nn++)
-	    m_members[nn].read(reader, data, length, fake);
-        }
-	reader.endStruct(*this);
-	break;
-      case OA::OCPI_Type:
-	reader.beginType(*this);
-	for (unsigned n = 0; n < nElements; n++)
-	  m_type->read(reader, data, length, fake);
-	reader.endType(*this);
-	break;
-      case OA::OCPI_String:
-	for (unsigned n = 0; n < nElements; n++) {
-	  ralign(data, 4, length);
-	  const char *chars;
-	  size_t strLength = reader.beginString(*this, chars, n == 0);
-	  if (m_stringLength != 0 && strLength > m_stringLength)
-	    throw Error("String being read is larger than max length");
-	  uint8_t *start = data;
-	  // Error check before copy
-	  radvance(data, m_fixedLayout ? (m_stringLength + 4) & ~3u : strLength + 1, length);
-	  if (!fake) {
-	    memcpy(start, chars, strLength);
-	    start[strLength] = 0;
-	  }
-	}
-	break;
-      default:
-	{ // Scalar - write them all at once
-	  ralign(data, m_align, length);
-	  ReadDataPtr p = {data};
-	  size_t nBytes = nElements * m_elementBytes;
-	  radvance(data, nBytes, length);
-	  reader.readData(*this, p, nBytes, nElements, fake);
-	  break;
-	}
-      case OA::OCPI_none:
-      case OA::OCPI_scalar_type_limit:
-	ocpiAssert(0);
-      }
-      if (m_arrayRank)
-	reader.endArray(*this);
-      if (m_isSequence) {
-	reader.endSequence(*this);
-	if (m_fixedLayout && !top) {
-	  // If fixed layout override the incremental data/length advance and
-	  // advance over the whole thing, including the length prefix
-          // ocpiDebug("radvance(<ptr>, %zu, %zu)", m_nBytes, startLength);
-	  radvance(startData, m_nBytes, startLength);
-	  assert(startData >= data && startLength <= length);
-	  data = startData;
-	  length = startLength;
-	}
-      }
+      marshalPlan().read(reader, data, length, fake, top);
     }
     void Member::
     generate(const char *name, unsigned ordinal, unsigned depth) {
@@ -919,9 +753,22 @@ namespace OCPI {
 	  return err;
       return 0;
     }
+    // Find this argument in a message, e.g. to use it as a hash key.  Only scalars, strings
+    // and other fixed size members are found: they have fixed offsets in the message.
+    // The caller must check that the message is long enough.
     uint8_t *Member::
-    getField(uint8_t */*data*/, size_t &/*length*/) const {
-      return NULL;
+    getField(uint8_t *data, size_t &length) const {
+      if (!data || m_isSequence)
+	return NULL;
+      if (m_baseType == OA::OCPI_String) {
+	if (m_arrayRank)
+	  return NULL;
+	length = strnlen((char *)data + m_offset, m_nBytes);
+      } else if (isFixed(false))
+	length = m_nBytes;
+      else
+	return NULL;
+      return data + m_offset;
     }
 
     const char *baseTypeNames[] = {
@@ -959,6 +806,7 @@ namespace OCPI {
     void Reader::beginType(const Member &) {}
     void Reader::endType(const Member &) {}
     void Reader::end() {}
+    bool Reader::readBlock(ReadDataPtr, size_t, bool) { return false; }
     Writer::Writer() {}
     Writer::~Writer() {}
     void Writer::endSequence(const Member &) {}
@@ -970,5 +818,6 @@ namespace OCPI {
     void Writer::beginType(const Member &) {}
     void Writer::endType(const Member &) {}
     void Writer::end() {}
+    bool Writer::writeBlock(WriteDataPtr, size_t) { return false; }
   }
 }
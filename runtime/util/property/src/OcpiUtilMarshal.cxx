@@ -0,0 +1,458 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "OcpiOsAssert.h"
+#include "OcpiUtilException.h"
+#include "OcpiUtilMisc.h"
+#include "OcpiUtilMarshal.h"
+
+namespace OCPI {
+  namespace Util {
+    namespace OA = OCPI::API;
+
+    inline void advance(const uint8_t *&p, size_t nBytes, size_t &length) {
+      if (nBytes > length)
+	throw Error("Aligning data exceeds buffer when writing: length %zu advance %zu",
+		    length, nBytes);
+      // p is NULL in the "fake" prepass that only determines the buffer size
+      length -= nBytes;
+      p += nBytes;
+    }
+    inline void radvance(uint8_t *&p, size_t nBytes, size_t &length) {
+      advance(*(const uint8_t **)&p, nBytes, length);
+    }
+    inline void align(const uint8_t *&p, size_t n, size_t &length) {
+      uint8_t *tmp = (uint8_t *)(((uintptr_t)p + (n - 1)) & ~((uintptr_t)(n)-1));
+      advance(p, OCPI_SIZE_T_DIFF(tmp, p), length);
+    }
+    // We clear bytes we skip
+    inline void ralign(uint8_t *&p, size_t n, size_t &length) {
+      align(*(const uint8_t **)&p, n, length);
+    }
+    // Alignment of zero is unset, like one
+    inline size_t alignTo(size_t n, size_t a) {
+      return a > 1 ? (n + a - 1) & ~(a - 1) : n;
+    }
+    // Can this member be part of a block: fixed in size and free of strings, sequences and
+    // recursive types?
+    static bool
+    isBlock(const Member &m) {
+      if (m.m_isSequence)
+	return false;
+      switch (m.m_baseType) {
+      case OA::OCPI_String:
+      case OA::OCPI_Type:
+	return false;
+      case OA::OCPI_Struct:
+	for (unsigned n = 0; n < m.m_nMembers; n++)
+	  if (!isBlock(m.m_members[n]))
+	    return false;
+      default:
+	return true;
+      }
+    }
+    // The largest alignment of anything in the member
+    static size_t
+    maxAlign(const Member &m) {
+      size_t a = std::max(m.m_dataAlign, m.m_align);
+      for (unsigned n = 0; n < m.m_nMembers; n++)
+	a = std::max(a, maxAlign(m.m_members[n]));
+      return a;
+    }
+    // The alignment the walk gives the start of the member
+    static size_t
+    startAlign(const Member &m) {
+      return m.m_baseType == OA::OCPI_Struct ? m.m_dataAlign : std::max(m.m_dataAlign, m.m_align);
+    }
+
+    MarshalPlan::
+    MarshalPlan(const Member *members, size_t nMembers)
+      : m_nBlocks(0) {
+      compile(members, nMembers, m_first, m_count);
+    }
+
+    void MarshalPlan::
+    addEvent(Event::Type type, const Member &m, size_t offset, size_t nBytes, size_t nElements) {
+      Event e = { type, &m, offset, nBytes, nElements };
+      m_events.push_back(e);
+    }
+
+    // Lay out a member inside a block, as the walk would if the block started at offset 0.
+    void MarshalPlan::
+    compileFixed(const Member &m, size_t &offset) {
+      if (m.m_arrayRank)
+	addEvent(Event::BeginArray, m);
+      offset = alignTo(offset, m.m_dataAlign);
+      if (m.m_baseType == OA::OCPI_Struct) {
+	addEvent(Event::BeginStruct, m);
+	for (size_t n = 0; n < m.m_nItems; n++) {
+	  offset = alignTo(offset, m.m_dataAlign);
+	  for (unsigned nn = 0; nn < m.m_nMembers; nn++)
+	    compileFixed(m.m_members[nn], offset);
+	}
+	addEvent(Event::EndStruct, m);
+      } else {
+	offset = alignTo(offset, m.m_align);
+	size_t nBytes = m.m_nItems * m.m_elementBytes;
+	addEvent(Event::Data, m, offset, nBytes, m.m_nItems);
+	offset += nBytes;
+      }
+      if (m.m_arrayRank)
+	addEvent(Event::EndArray, m);
+    }
+
+    // Compile the steps for a list of members, which are then contiguous in m_steps.
+    // A block continues while the next member needs no more alignment than the block's start,
+    // so that offsets in the block do not depend on where the block lands.
+    void MarshalPlan::
+    compile(const Member *members, size_t nMembers, size_t &first, size_t &count) {
+      std::vector<Step> steps;
+      Step block;
+      bool inBlock = false;
+      for (size_t n = 0; n < nMembers; n++) {
+	const Member &m = members[n];
+	if (isBlock(m) && maxAlign(m) <= (inBlock ? block.m_align : startAlign(m))) {
+	  if (!inBlock) {
+	    Step s = { NULL, std::max(startAlign(m), (size_t)1), 0, m_events.size(), 0, 0 };
+	    block = s;
+	    inBlock = true;
+	  }
+	  compileFixed(m, block.m_nBytes);
+	  continue;
+	}
+	if (inBlock) {
+	  block.m_count = m_events.size() - block.m_first;
+	  steps.push_back(block);
+	  m_nBlocks++;
+	  inBlock = false;
+	}
+	Step s = { &m, 1, 0, 0, 0, 0 };
+	switch (m.m_baseType) {
+	case OA::OCPI_Struct:
+	  compile(m.m_members, m.m_nMembers, s.m_first, s.m_count);
+	  if (s.m_count == 1) {
+	    const Step &e = m_steps[s.m_first];
+	    if (!e.m_member && e.m_align <= m.m_dataAlign)
+	      s.m_stride = alignTo(e.m_nBytes, m.m_dataAlign);
+	  }
+	  break;
+	case OA::OCPI_Type:
+	  compile(m.m_type, 1, s.m_first, s.m_count);
+	default:
+	  ;
+	}
+	steps.push_back(s);
+      }
+      if (inBlock) {
+	block.m_count = m_events.size() - block.m_first;
+	steps.push_back(block);
+	m_nBlocks++;
+      }
+      first = m_steps.size();
+      count = steps.size();
+      m_steps.insert(m_steps.end(), steps.begin(), steps.end());
+    }
+
+    void MarshalPlan::
+    write(Writer &writer, const uint8_t *&data, size_t &length, bool topSeq) const {
+      writeSteps(m_first, m_count, writer, data, length, topSeq);
+    }
+
+    void MarshalPlan::
+    writeSteps(size_t first, size_t count, Writer &writer, const uint8_t *&data, size_t &length,
+	       bool topSeq) const {
+      for (const Step *s = &m_steps[first]; count; count--, s++)
+	if (s->m_member)
+	  writeMember(*s, writer, data, length, topSeq);
+	else {
+	  align(data, s->m_align, length);
+	  const uint8_t *start = data;
+	  advance(data, s->m_nBytes, length);
+	  WriteDataPtr p = {start};
+	  if (!writer.writeBlock(p, s->m_nBytes))
+	    writeEvents(*s, writer, start);
+	}
+    }
+
+    void MarshalPlan::
+    writeEvents(const Step &s, Writer &writer, const uint8_t *data) const {
+      for (const Event *e = &m_events[s.m_first], *end = e + s.m_count; e < end; e++)
+	switch (e->m_type) {
+	case Event::Data:
+	  {
+	    WriteDataPtr p = {data + e->m_offset};
+	    writer.writeData(*e->m_member, p, e->m_nBytes, e->m_nElements);
+	  }
+	  break;
+	case Event::BeginStruct: writer.beginStruct(*e->m_member); break;
+	case Event::EndStruct: writer.endStruct(*e->m_member); break;
+	case Event::BeginArray: writer.beginArray(*e->m_member, e->m_member->m_nItems); break;
+	case Event::EndArray: writer.endArray(*e->m_member);
+	}
+    }
+
+    // Push the data in the linear buffer into a writer object
+    void MarshalPlan::
+    writeMember(const Step &s, Writer &writer, const uint8_t *&data, size_t &length,
+		bool topSeq) const {
+      const Member &m = *s.m_member;
+      size_t nElements = 1;
+      const uint8_t *startData = NULL; // quiet warning
+      size_t startLength = 0; // quiet warning
+      if (m.m_isSequence) {
+	if (topSeq && !m.m_fixedLayout) {
+	  ocpiAssert(((uintptr_t)data & (m.m_align - 1u)) == 0);
+	  ocpiAssert(length % m.m_nBytes == 0);
+	  nElements = length / m.m_nBytes;
+	} else {
+	  align(data, m.m_align, length);
+	  nElements = *(uint32_t *)data;
+	}
+	startData = data;
+	startLength = length;
+	if (m.m_sequenceLength != 0 && nElements > m.m_sequenceLength)
+	  throw Error("Sequence in buffer (%zu) exceeds maximum length (%zu)", nElements,
+		      m.m_sequenceLength);
+	writer.beginSequence(m, nElements);
+	if (!nElements) {
+	  advance(data, m.m_fixedLayout && !topSeq ? m.m_nBytes : m.m_align, length);
+	  return;
+	}
+	advance(data, m.m_align, length);
+      }
+      nElements *= m.m_nItems;
+      bool block = false;
+      if (s.m_stride) {
+	// Offer all the elements as one block
+	const uint8_t *start = data;
+	size_t startLen = length;
+	align(start, m.m_dataAlign, startLen);
+	size_t nBytes = (nElements - 1) * s.m_stride + m_steps[s.m_first].m_nBytes;
+	if (nBytes <= startLen) {
+	  WriteDataPtr p = {start};
+	  if ((block = writer.writeBlock(p, nBytes))) {
+	    data = start + nBytes;
+	    length = startLen - nBytes;
+	  }
+	}
+      }
+      if (!block) {
+	if (m.m_arrayRank)
+	  writer.beginArray(m, m.m_nItems);
+	align(data, m.m_dataAlign, length);
+	switch (m.m_baseType) {
+	case OA::OCPI_Struct:
+	  writer.beginStruct(m);
+	  for (unsigned n = 0; n < nElements; n++) {
+	    align(data, m.m_dataAlign, length);
+	    writeSteps(s.m_first, s.m_count, writer, data, length, false);
+	  }
+	  writer.endStruct(m);
+	  break;
+	case OA::OCPI_Type:
+	  writer.beginType(m);
+	  for (unsigned n = 0; n < nElements; n++)
+	    writeSteps(s.m_first, s.m_count, writer, data, length, false);
+	  writer.endType(m);
+	  break;
+	case OA::OCPI_String:
+	  for (unsigned n = 0; n < nElements; n++) {
+	    align(data, 4, length);
+	    WriteDataPtr p = {data};
+	    size_t nBytes = strlen((const char *)data) + 1;
+	    advance(data, m.m_fixedLayout ?  (m.m_stringLength + 4) & ~3u : nBytes, length);
+	    writer.writeString(m, p, nBytes - 1, n == 0, topSeq);
+	  }
+	  break;
+	default:
+	  { // Scalar - write them all at once
+	    align(data, m.m_align, length);
+	    WriteDataPtr p = {data};
+	    size_t nBytes = nElements * m.m_elementBytes;
+	    advance(data, nBytes, length);
+	    writer.writeData(m, p, nBytes, nElements);
+	    break;
+	  }
+	case OA::OCPI_none:
+	case OA::OCPI_scalar_type_limit:
+	  ocpiAssert(0);
+	}
+	if (m.m_arrayRank)
+	  writer.endArray(m);
+      }
+      if (m.m_isSequence) {
+	writer.endSequence(m);
+	if (m.m_fixedLayout && !topSeq) {
+	  // If fixed layout override the incremental data/length advance and
+	  // advance over the whole thing, including the length prefix
+	  advance(startData, m.m_nBytes, startLength);
+	  assert(startData >= data && startLength <= length);
+	  data = startData;
+	  length = startLength;
+	}
+      }
+    }
+
+    void MarshalPlan::
+    read(Reader &reader, uint8_t *&data, size_t &length, bool fake, bool top) const {
+      readSteps(m_first, m_count, reader, data, length, fake, top);
+    }
+
+    void MarshalPlan::
+    readSteps(size_t first, size_t count, Reader &reader, uint8_t *&data, size_t &length,
+	      bool fake, bool top) const {
+      for (const Step *s = &m_steps[first]; count; count--, s++)
+	if (s->m_member)
+	  readMember(*s, reader, data, length, fake, top);
+	else {
+	  ralign(data, s->m_align, length);
+	  uint8_t *start = data;
+	  radvance(data, s->m_nBytes, length);
+	  ReadDataPtr p = {start};
+	  if (!reader.readBlock(p, s->m_nBytes, fake))
+	    readEvents(*s, reader, start, fake);
+	}
+    }
+
+    void MarshalPlan::
+    readEvents(const Step &s, Reader &reader, uint8_t *data, bool fake) const {
+      for (const Event *e = &m_events[s.m_first], *end = e + s.m_count; e < end; e++)
+	switch (e->m_type) {
+	case Event::Data:
+	  {
+	    ReadDataPtr p = {data + e->m_offset};
+	    reader.readData(*e->m_member, p, e->m_nBytes, e->m_nElements, fake);
+	  }
+	  break;
+	case Event::BeginStruct: reader.beginStruct(*e->m_member); break;
+	case Event::EndStruct: reader.endStruct(*e->m_member); break;
+	case Event::BeginArray: reader.beginArray(*e->m_member, e->m_member->m_nItems); break;
+	case Event::EndArray: reader.endArray(*e->m_member);
+	}
+    }
+
+    // Fill the linear buffer from a reader object
+    void MarshalPlan::
+    readMember(const Step &s, Reader &reader, uint8_t *&data, size_t &length, bool fake,
+	       bool top) const {
+      const Member &m = *s.m_member;
+      size_t nElements = 1;
+      uint8_t *startData = NULL; // quiet warning
+      size_t startLength = 0; // quiet warning
+      if (m.m_isSequence) {
+	ralign(data, m.m_align, length);
+	startData = data;
+	startLength = length;
+	nElements = reader.beginSequence(m);
+	if (m.m_sequenceLength != 0 && nElements > m.m_sequenceLength)
+	  throw Error("Sequence being read (%zu) exceeds max length (%zu)", nElements,
+		      m.m_sequenceLength);
+	if (!fake)
+	  *(uint32_t *)data = (uint32_t)nElements;
+	if (!nElements) {
+	  // Sequence is empty. skip over header or whole thing if fixedLayout
+	  radvance(data, m.m_fixedLayout && !top ? m.m_nBytes : m.m_align, length);
+	  return;
+	}
+	// Non empty - skip over header for now
+	radvance(data, m.m_align, length);
+      }
+      nElements *= m.m_nItems;
+      bool block = false;
+      if (s.m_stride) {
+	// Ask for all the elements as one block
+	uint8_t *start = data;
+	size_t startLen = length;
+	ralign(start, m.m_dataAlign, startLen);
+	size_t nBytes = (nElements - 1) * s.m_stride + m_steps[s.m_first].m_nBytes;
+	if (nBytes <= startLen) {
+	  ReadDataPtr p = {start};
+	  if ((block = reader.readBlock(p, nBytes, fake))) {
+	    data = start + nBytes;
+	    length = startLen - nBytes;
+	  }
+	}
+      }
+      if (!block) {
+	if (m.m_arrayRank)
+	  reader.beginArray(m, m.m_nItems);
+	ralign(data, m.m_dataAlign, length);
+	switch (m.m_baseType) {
+	case OA::OCPI_Struct:
+	  reader.beginStruct(m);
+	  for (unsigned n = 0; n < nElements; n++) {
+	    ralign(data, m.m_dataAlign, length);
+	    readSteps(s.m_first, s.m_count, reader, data, length, fake, false);
+	  }
+	  reader.endStruct(m);
+	  break;
+	case OA::OCPI_Type:
+	  reader.beginType(m);
+	  for (unsigned n = 0; n < nElements; n++)
+	    readSteps(s.m_first, s.m_count, reader, data, length, fake, false);
+	  reader.endType(m);
+	  break;
+	case OA::OCPI_String:
+	  for (unsigned n = 0; n < nElements; n++) {
+	    ralign(data, 4, length);
+	    const char *chars;
+	    size_t strLength = reader.beginString(m, chars, n == 0);
+	    if (m.m_stringLength != 0 && strLength > m.m_stringLength)
+	      throw Error("String being read is larger than max length");
+	    uint8_t *start = data;
+	    // Error check before copy
+	    radvance(data, m.m_fixedLayout ? (m.m_stringLength + 4) & ~3u : strLength + 1, length);
+	    if (!fake) {
+	      memcpy(start, chars, strLength);
+	      start[strLength] = 0;
+	    }
+	  }
+	  break;
+	default:
+	  { // Scalar - read them all at once
+	    ralign(data, m.m_align, length);
+	    ReadDataPtr p = {data};
+	    size_t nBytes = nElements * m.m_elementBytes;
+	    radvance(data, nBytes, length);
+	    reader.readData(m, p, nBytes, nElements, fake);
+	    break;
+	  }
+	case OA::OCPI_none:
+	case OA::OCPI_scalar_type_limit:
+	  ocpiAssert(0);
+	}
+	if (m.m_arrayRank)
+	  reader.endArray(m);
+      }
+      if (m.m_isSequence) {
+	reader.endSequence(m);
+	if (m.m_fixedLayout && !top) {
+	  // If fixed layout override the incremental data/length advance and
+	  // advance over the whole thing, including the length prefix
+	  radvance(startData, m.m_nBytes, startLength);
+	  assert(startData >= data && startLength <= length);
+	  data = startData;
+	  length = startLength;
+	}
+      }
+    }
+  }
+}
@@ -25,6 +25,7 @@
 #include "OcpiUtilException.h"
 #include "OcpiUtilProtocol.h"
 #include "OcpiUtilValue.h"
+#include "OcpiUtilMarshal.h"
 #include "OcpiUtilMisc.h"
 
 namespace OCPI {
@@ -34,13 +35,14 @@ namespace OCPI {
 
     Operation::Operation()
       : m_isTwoWay(false), m_nArgs(0), m_args(NULL), m_nExceptions(0), m_exceptions(NULL),
-	m_myOffset(0), m_topFixedSequence(false) {
+	m_myOffset(0), m_topFixedSequence(false), m_plan(NULL) {
     }
     Operation::~Operation() {
       if (m_args)
 	delete [] m_args;
       if (m_exceptions)
 	delete [] m_exceptions;
+      delete m_plan;
     }
     Operation & 
     Operation::
@@ -65,6 +67,8 @@ namespace OCPI {
 	m_exceptions[n] = p->m_exceptions[n];
       m_myOffset = p->m_myOffset;
       m_topFixedSequence = p->m_topFixedSequence;
+      delete m_plan;
+      m_plan = NULL;
       return *this;
     }
     const char *Operation::parse(ezxml_t op, Protocol &p) {
@@ -146,16 +150,23 @@ namespace OCPI {
       } else
 	formatAdd(out, "/>\n");
     }
+    // Fixed runs of data across args are blocks in one plan for the operation
+    const MarshalPlan &Operation::marshalPlan() const {
+      if (!m_plan) {
+	MarshalPlan *plan = new MarshalPlan(m_args, m_nArgs);
+	if (!__sync_bool_compare_and_swap(&m_plan, NULL, plan))
+	  delete plan;
+      }
+      return *m_plan;
+    }
+
     void Operation::write(Writer &writer, const uint8_t *data, size_t length) {
-      for (size_t n = 0; n < m_nArgs; n++)
-	m_args[n].write(writer, data, length, isTopFixedSequence());
+      marshalPlan().write(writer, data, length, isTopFixedSequence());
     }
 
     size_t Operation::read(Reader &reader, uint8_t *data, size_t maxLength) {
       size_t max = maxLength;
-      bool fake = data == NULL;
-      for (unsigned n = 0; n < m_nArgs; n++)
-	m_args[n].read(reader, data, maxLength, fake);
+      marshalPlan().read(reader, data, maxLength, data == NULL, false);
       return max - maxLength;
     }
 
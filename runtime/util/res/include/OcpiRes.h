@@ -29,12 +29,30 @@ namespace OCPI {
     // This data type is the offset within an allocation pool.
     // It must be a type with an explicit width (e.g. uint32_t),
     // that does not vary with compiler or architecture.
+    // It must be the same size as endpoint offsets (DataTransfer::Offset), so it follows
+    // the same OCPI_EP_SIZE_BITS build option, which is what allows pools above 4GB.
     // If you change it, change the printf macro also
+#if defined(OCPI_EP_SIZE_BITS) && OCPI_EP_SIZE_BITS == 64
+    typedef uint64_t ResAddr;
+#define OCPI_UTIL_RESADDR_PRIx PRIx64
+#else
     typedef uint32_t ResAddr;
 #define OCPI_UTIL_RESADDR_PRIx PRIx32
+#endif
 
     typedef ResAddr ResAddrType; // backwards compatibility
     struct ResPool;
+    // Usage of a pool.  Fragmentation is the fraction of free space outside the largest
+    // free block, i.e. that a single allocation cannot use.
+    struct MemBlockStats {
+      uint64_t size, used, highWater, freeBytes, largestFree;
+      unsigned nAllocated, nFree;
+      double fragmentation() const {
+	return freeBytes ? 1. - (double)largestFree / (double)freeBytes : 0.;
+      }
+    };
+    // Allocator of blocks of a pool of addresses that is usually not in our memory
+    // (e.g. an endpoint), so its bookkeeping is kept separately.  Alloc and free are O(1).
     class MemBlockMgr
     {
     public:
@@ -42,10 +60,12 @@ namespace OCPI {
         throw( std::bad_alloc );
       ~MemBlockMgr()
         throw();
+      // Alignment must be zero or a power of two.  Returns zero on success.
       int alloc(size_t nbytes, unsigned alignment, ResAddr& req_addr)
         throw( std::bad_alloc );
       int free(ResAddr  addr )
         throw( std::bad_alloc );
+      void stats(MemBlockStats &stats) const;
 
 
     private:
@@ -19,8 +19,25 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+/*
+ * Abstract:
+ *   A two-level segregated fit allocator (as in TLSF) for MemBlockMgr.
+ *
+ *   Block sizes map to a first level by power of two, and a second level by the
+ *   SL_BITS bits below the top bit.  Each (first, second) pair has a list of free
+ *   blocks whose sizes are in that range, and bitmaps record which lists are not
+ *   empty.  Allocation rounds the size up to the next range so that any block on the
+ *   first non-empty list at or above it is big enough, which bit scans find in
+ *   constant time.  Free coalesces with free neighbors in address order, so no two
+ *   free blocks are ever adjacent.
+ *
+ *   The pool is usually memory in some endpoint, so block descriptors are kept in a
+ *   vector of our own, linked by index, and allocated addresses are found by hashing.
+ */
+
 #include <inttypes.h>
-#include <list>
+#include <vector>
+#include <unordered_map>
 #include <cstdio>
 #include "OcpiOsDataTypes.h"
 #include "OcpiOsAssert.h"
@@ -29,206 +46,301 @@
 
 namespace OCPI {
   namespace Util {
+    const unsigned
+      SL_BITS = 4,
+      SL_COUNT = 1 << SL_BITS,
+      FL_COUNT = 64 - SL_BITS + 1;
+    const uint32_t NONE = UINT32_MAX;
+
     struct Block {
-      ResPool*                 rp;
-      size_t                   size;
-      ResAddrType  addr;
-      ResAddrType  aligned_addr;      
-      Block( ResPool* rpp, size_t s, ResAddrType adr,  ResAddrType a_adr)
-        :rp(rpp),size(s),addr(adr),aligned_addr(a_adr){}
-      int operator<(const Block& rhs)const;
+      uint64_t addr, size;
+      uint32_t prevPhys, nextPhys; // neighbors in address order
+      uint32_t prevFree, nextFree; // free list links, or list of unused descriptors
+      bool     free;
     };
+
     struct ResPool {
-      OCPI::Util::ResAddrType  start_off;
-      size_t  total_size, used;
-      std::list<Block> free_list;
-      std::list<Block> alloc_list;
-      bool             sort_by_size;
-      ResPool():sort_by_size(true){}
-      void defrag();
+      uint64_t total_size, used, highWater;
+      unsigned nAllocated, nFree;
+      uint64_t flBitmap;
+      uint32_t slBitmap[FL_COUNT];
+      uint32_t heads[FL_COUNT][SL_COUNT];
+      std::vector<Block> blocks;
+      uint32_t unused;                                  // descriptors available for reuse
+      std::unordered_map<uint64_t, uint32_t> allocated; // address to descriptor
+
+      ResPool(uint64_t start, uint64_t size);
+      static unsigned msb(uint64_t v) { return 63 - (unsigned)__builtin_clzll(v); }
+      static void mapping(uint64_t size, unsigned &fl, unsigned &sl);
+      uint32_t newBlock(uint64_t addr, uint64_t size);
+      void releaseBlock(uint32_t b);
+      void insertFree(uint32_t b);
+      void removeFree(uint32_t b);
+      uint32_t findFree(uint64_t size);
+      uint32_t searchFree(uint64_t nbytes, unsigned alignment);
+      uint32_t split(uint32_t b, uint64_t size);
+      void merge(uint32_t b, uint32_t next);
     };
-    int Block::operator<(const Block& rhs)const
-    {
-      if ( rp->sort_by_size ) {
-        if ( this->size < rhs.size ) return 1;
-      }
-      else {
-        if ( this->addr < rhs.addr ) return 1;
+
+    ResPool::
+    ResPool(uint64_t start, uint64_t size)
+      : total_size(size), used(0), highWater(0), nAllocated(0), nFree(0), flBitmap(0),
+	unused(NONE) {
+      for (unsigned fl = 0; fl < FL_COUNT; fl++) {
+	slBitmap[fl] = 0;
+	for (unsigned sl = 0; sl < SL_COUNT; sl++)
+	  heads[fl][sl] = NONE;
       }
-      return 0;
+      if (size)
+	insertFree(newBlock(start, size));
     }
-  }
-}
 
-#ifndef NDEBUG
-static void dumpList( std::list<OCPI::Util::Block>& list )
-{
+    // The list a block of this size belongs on
+    void ResPool::
+    mapping(uint64_t size, unsigned &fl, unsigned &sl) {
+      if (size < SL_COUNT) {
+	fl = 0;
+	sl = (unsigned)size;
+      } else {
+	unsigned top = msb(size);
+	fl = top - SL_BITS + 1;
+	sl = (unsigned)(size >> (top - SL_BITS)) - SL_COUNT;
+      }
+    }
 
-#ifdef DEBUG_LISTS
-  std::list<OCPI::Util::Block>::iterator it;
-  for ( it=list.begin(); it !=list.end(); it++ ) {
-    ocpiDebug("addr = %" PRIx32 ", aligned_addr = %" PRIx32 ", size = %zu", 
-	      (*it).addr, 
-	      (*it).aligned_addr, 
-	      (*it).size );
-  }
-#else
-  (void)list;
-#endif
+    uint32_t ResPool::
+    newBlock(uint64_t addr, uint64_t size) {
+      uint32_t b;
+      if (unused != NONE) {
+	b = unused;
+	unused = blocks[b].nextFree;
+      } else {
+	b = OCPI_UTRUNCATE(uint32_t, blocks.size());
+	blocks.resize(blocks.size() + 1);
+      }
+      Block &blk = blocks[b];
+      blk.addr = addr;
+      blk.size = size;
+      blk.prevPhys = blk.nextPhys = blk.prevFree = blk.nextFree = NONE;
+      blk.free = false;
+      return b;
+    }
 
-}
-#endif
+    void ResPool::
+    releaseBlock(uint32_t b) {
+      blocks[b].nextFree = unused;
+      unused = b;
+    }
 
-// Round the address UP to the next aligned boundary
-static OCPI::Util::ResAddrType 
-ALIGN(OCPI::Util::ResAddrType addr, unsigned int alignment) {
-  return alignment ? (addr + alignment - 1) & ~(alignment - 1) : addr;
-}
+    void ResPool::
+    insertFree(uint32_t b) {
+      Block &blk = blocks[b];
+      unsigned fl, sl;
+      mapping(blk.size, fl, sl);
+      blk.free = true;
+      blk.prevFree = NONE;
+      blk.nextFree = heads[fl][sl];
+      if (blk.nextFree != NONE)
+	blocks[blk.nextFree].prevFree = b;
+      heads[fl][sl] = b;
+      slBitmap[fl] |= 1u << sl;
+      flBitmap |= 1ull << fl;
+      nFree++;
+    }
 
+    void ResPool::
+    removeFree(uint32_t b) {
+      Block &blk = blocks[b];
+      unsigned fl, sl;
+      mapping(blk.size, fl, sl);
+      if (blk.prevFree != NONE)
+	blocks[blk.prevFree].nextFree = blk.nextFree;
+      else if ((heads[fl][sl] = blk.nextFree) == NONE &&
+	       !(slBitmap[fl] &= ~(1u << sl)))
+	flBitmap &= ~(1ull << fl);
+      if (blk.nextFree != NONE)
+	blocks[blk.nextFree].prevFree = blk.prevFree;
+      blk.free = false;
+      nFree--;
+    }
 
-void OCPI::Util::ResPool::defrag()
-{
-  sort_by_size = false;
-  bool not_done;
-  do {
-    not_done=false;
-    free_list.sort();
-    std::list<Block>::iterator it1, it2;
-    it1=it2=free_list.begin();
-    it2++;
-    for ( ; it2 !=free_list.end(); it2++, it1++ ) {
-      if ( ((*it1).addr+(*it1).size) == (*it2).addr ) {
-        (*it1).size += (*it2).size;
-        free_list.erase(it2);
-        not_done=true;
-        break;
+    // Find a free block at least this big, in constant time.
+    uint32_t ResPool::
+    findFree(uint64_t size) {
+      // Round up to the next list, so anything on it or above is big enough
+      if (size >= SL_COUNT) {
+	uint64_t rounded = size + (1ull << (msb(size) - SL_BITS)) - 1;
+	if (rounded < size)
+	  return NONE;
+	size = rounded;
+      }
+      unsigned fl, sl;
+      mapping(size, fl, sl);
+      uint32_t slMap = slBitmap[fl] & (~0u << sl);
+      if (!slMap) {
+	uint64_t flMap = fl + 1 < FL_COUNT ? flBitmap & (~0ull << (fl + 1)) : 0;
+	if (!flMap)
+	  return NONE;
+	fl = (unsigned)__builtin_ctzll(flMap);
+	slMap = slBitmap[fl];
       }
+      return heads[fl][(unsigned)__builtin_ctz(slMap)];
     }
-  }
-  while ( not_done );
-  sort_by_size = true;  
-
-#ifdef DEBUG_LISTS
-  ocpiDebug("defrag: Alloc list");
-  dumpList(alloc_list);
-  ocpiDebug("defrag: Free list");
-  dumpList(free_list);
-#endif
 
-}
+    // Find a free block for an aligned allocation
+    uint32_t ResPool::
+    searchFree(uint64_t nbytes, unsigned alignment) {
+      uint64_t need = nbytes + (alignment > 1 ? alignment - 1 : 0);
+      uint32_t b = findFree(need);
+      if (b != NONE)
+	return b;
+      // When nearly full, look at the blocks that the rounding skipped over,
+      // since one of them may fit exactly or already be aligned.
+      unsigned fl, sl, lastFl, lastSl;
+      mapping(nbytes, fl, sl);
+      mapping(need, lastFl, lastSl);
+      for (; fl < lastFl || (fl == lastFl && sl <= lastSl); sl = (sl + 1) % SL_COUNT, fl += !sl)
+	for (b = heads[fl][sl]; b != NONE; b = blocks[b].nextFree) {
+	  Block &blk = blocks[b];
+	  uint64_t skip = (alignment ? (blk.addr + alignment - 1) & ~(uint64_t)(alignment - 1) :
+			   blk.addr) - blk.addr;
+	  if (skip < blk.size && blk.size - skip >= nbytes)
+	    return b;
+	}
+      return NONE;
+    }
+
+    // Split an unlisted block so it has this size, returning the rest, which is also unlisted
+    uint32_t ResPool::
+    split(uint32_t b, uint64_t size) {
+      uint32_t rest = newBlock(blocks[b].addr + size, blocks[b].size - size);
+      Block &blk = blocks[b], &rblk = blocks[rest];
+      blk.size = size;
+      rblk.prevPhys = b;
+      rblk.nextPhys = blk.nextPhys;
+      if (blk.nextPhys != NONE)
+	blocks[blk.nextPhys].prevPhys = rest;
+      blk.nextPhys = rest;
+      return rest;
+    }
 
+    // Absorb the next block into this one, releasing its descriptor
+    void ResPool::
+    merge(uint32_t b, uint32_t next) {
+      Block &blk = blocks[b], &nblk = blocks[next];
+      blk.size += nblk.size;
+      blk.nextPhys = nblk.nextPhys;
+      if (nblk.nextPhys != NONE)
+	blocks[nblk.nextPhys].prevPhys = b;
+      releaseBlock(next);
+    }
+  }
+}
 
 int OCPI::Util::MemBlockMgr::
 alloc(size_t nbytes, unsigned int alignment, OCPI::Util::ResAddrType& req_addr)
   throw(std::bad_alloc) 
 {
-
-  if (nbytes > 2000000) {
-    ocpiInfo("Allocating large mem %zuK in %p %zu of %zu used",
+  if (nbytes > 2000000)
+    ocpiInfo("Allocating large mem %zuK in %p %" PRIu64 " of %" PRIu64 " used",
 	     nbytes/1024, this, m_pool->used, m_pool->total_size);
-    // OCPI::OS::dumpStack(std::cerr);
+  if (!nbytes)
+    nbytes = 1; // so every allocation has a unique address
+  ResPool &p = *m_pool;
+  uint32_t b = p.searchFree(nbytes, alignment);
+  if (b == NONE) {
+    ocpiDebug("Allocation of %zu bytes aligned to %u failed in %p: %" PRIu64 " of %" PRIu64
+	      " used", nbytes, alignment, this, p.used, p.total_size);
+    return -1;
   }
-#ifdef DEBUG_LISTS
-  ocpiDebug("alloc: Alloc list");
-  dumpList(m_pool->alloc_list);
-  ocpiDebug("alloc: Free list");
-  dumpList(m_pool->free_list);
-#endif
-
-  m_pool->free_list.sort();
-  for (unsigned retry = 2; retry; retry--) {
-    for (std::list<Block>::iterator it = m_pool->free_list.begin(); it !=m_pool->free_list.end();
-	 ++it) {
-      ResAddr taddr = (*it).addr;
-      req_addr = ALIGN(taddr, alignment);
-      size_t skip = req_addr - taddr;
-      if (skip >= (*it).size)
-	continue;
-      size_t size = (*it).size - skip; // size net of alignment
-      if (size < nbytes)
-	continue;
-      if (size > nbytes) {
-        (*it).addr = OCPI_UTRUNCATE(ResAddrType, req_addr + nbytes);
-	nbytes += skip; // number of bytes taken out of this block
-        (*it).size -= nbytes;
-        m_pool->alloc_list.push_back(Block(m_pool, nbytes, taddr, req_addr));
-      } else { // size matches
-	nbytes = (*it).size;
-        (*it).aligned_addr = req_addr;
-        m_pool->alloc_list.push_back(*it);
-        m_pool->free_list.erase(it);      
-      }
-      m_pool->used += nbytes;
-      //ocpiDebug("**** Alloc of %zu Returning address = %" OCPI_UTIL_RESADDR_PRIx ", %" 
-      //          OCPI_UTIL_RESADDR_PRIx " used %zu", nbytes, taddr, req_addr, m_pool->used);
-      return 0;
-    }
-    m_pool->defrag();  
+  p.removeFree(b);
+  uint64_t addr = p.blocks[b].addr;
+  uint64_t aligned = alignment ? (addr + alignment - 1) & ~(uint64_t)(alignment - 1) : addr;
+  if (aligned != addr) {
+    // Alignment padding is left free
+    uint32_t front = b;
+    b = p.split(front, aligned - addr);
+    p.insertFree(front);
   }
-
-#ifndef NDEBUG
-  ocpiDebug("alloc2: Alloc list");
-  dumpList(m_pool->alloc_list);
-  ocpiDebug("alloc2: xoFree list");
-  dumpList(m_pool->free_list);
-#endif
-
-  return -1;
+  if (p.blocks[b].size > nbytes)
+    p.insertFree(p.split(b, nbytes));
+  p.allocated[aligned] = b;
+  p.nAllocated++;
+  if ((p.used += nbytes) > p.highWater)
+    p.highWater = p.used;
+  req_addr = OCPI_UTRUNCATE(ResAddrType, aligned);
+  return 0;
 }
 
-
 int OCPI::Util::MemBlockMgr::free( OCPI::Util::ResAddrType addr )
   throw( std::bad_alloc ) 
 {
-
-  std::list<Block>::iterator it;
-  for ( it=m_pool->alloc_list.begin(); it !=m_pool->alloc_list.end(); it++ ) {
-    if ( (*it).aligned_addr == addr )  {
-
+  ResPool &p = *m_pool;
+  std::unordered_map<uint64_t, uint32_t>::iterator it = p.allocated.find(addr);
+  if (it == p.allocated.end()) {
+    ocpiAssert(0);
+    return -1;
+  }
+  uint32_t b = it->second;
+  p.allocated.erase(it);
+  p.nAllocated--;
+  p.used -= p.blocks[b].size;
 #ifndef NDEBUG
-      if ( (*it).size > 2000000 ) {
-	ocpiInfo("Freeing large mem %zuK in %p %zu of %zu used",
-		 (*it).size/1024, this, m_pool->used, m_pool->total_size);
-	//        OCPI::OS::dumpStack (std::cerr);
-      }
-#ifdef DEBUG_LISTS
-      ocpiDebug("free: Alloc list");
-      dumpList(m_pool->alloc_list);
-      ocpiDebug("free: Free list");
-      dumpList(m_pool->free_list);
-#endif
+  if (p.blocks[b].size > 2000000)
+    ocpiInfo("Freeing large mem %" PRIu64 "K in %p %" PRIu64 " of %" PRIu64 " used",
+	     p.blocks[b].size/1024, this, p.used, p.total_size);
 #endif
-
-
-      m_pool->used -= (*it).size;
-      m_pool->free_list.push_back( Block( m_pool, (*it).size, addr, addr ) );
-      m_pool->alloc_list.erase( it );
-      m_pool->defrag();  
-      // ocpiDebug("**** Free of = %" OCPI_UTIL_RESADDR_PRIx " used %zu", addr, m_pool->used);
-      return 0;
-    }
+  uint32_t next = p.blocks[b].nextPhys, prev = p.blocks[b].prevPhys;
+  if (next != NONE && p.blocks[next].free) {
+    p.removeFree(next);
+    p.merge(b, next);
+  }
+  if (prev != NONE && p.blocks[prev].free) {
+    p.removeFree(prev);
+    p.merge(prev, b);
+    b = prev;
   }
+  p.insertFree(b);
+  return 0;
+}
 
-  ocpiAssert(0);
-return -1;
+void OCPI::Util::MemBlockMgr::
+stats(MemBlockStats &s) const {
+  const ResPool &p = *m_pool;
+  s.size = p.total_size;
+  s.used = p.used;
+  s.highWater = p.highWater;
+  s.freeBytes = p.total_size - p.used;
+  s.nAllocated = p.nAllocated;
+  s.nFree = p.nFree;
+  s.largestFree = 0;
+  // The largest free block is on the highest non-empty list
+  if (p.flBitmap) {
+    unsigned fl = ResPool::msb(p.flBitmap), sl = 31 - (unsigned)__builtin_clz(p.slBitmap[fl]);
+    for (uint32_t b = p.heads[fl][sl]; b != NONE; b = p.blocks[b].nextFree)
+      if (p.blocks[b].size > s.largestFree)
+	s.largestFree = p.blocks[b].size;
+  }
 }
 
 OCPI::Util::MemBlockMgr::MemBlockMgr(OCPI::Util::ResAddrType start, size_t size )
   throw( std::bad_alloc ) 
 {
-  
-  m_pool = new OCPI::Util::ResPool;
-  m_pool->total_size = size;
-  m_pool->used = 0;
-  m_pool->free_list.push_back( Block( m_pool, size, start, start ) );
+  uint64_t limit = (uint64_t)(ResAddrType)~0 + 1 - start;
+  if (sizeof(ResAddrType) < sizeof(uint64_t) && size > limit) {
+    ocpiBad("Memory pool of %zu bytes at %" OCPI_UTIL_RESADDR_PRIx " exceeds the %zu bit "
+	    "address limit and is reduced to %" PRIu64 " bytes", size, start,
+	    sizeof(ResAddrType) * 8, limit);
+    size = OCPI_UTRUNCATE(size_t, limit);
+  }
+  m_pool = new OCPI::Util::ResPool(start, size);
 }
 
 
 OCPI::Util::MemBlockMgr::~MemBlockMgr()
   throw()
 {
-  ocpiDebug("Memory pool is using %zu of %zu on deletion", m_pool->used, m_pool->total_size);
+  ocpiDebug("Memory pool is using %" PRIu64 " of %" PRIu64 " on deletion, high water %" PRIu64,
+	    m_pool->used, m_pool->total_size, m_pool->highWater);
   delete m_pool;
 }
-
-
@@ -61,6 +61,13 @@
    // File name to dump time data into
    "OCPI_TIME_EMIT_DUMP_FILENAME"
 
+   // Record events in lock-free per-thread rings of this many entries (0 = off),
+   // merged into the event queues by a background drainer thread
+   "OCPI_TIME_EMIT_THREAD_RINGS"
+
+   // Drainer thread polling period in milliseconds (default 10)
+   "OCPI_TIME_EMIT_DRAIN_MS"
+
     Make options:
 
     // compile in the support for the emit macros
@@ -77,6 +84,7 @@
 
 #include <OcpiOsDataTypes.h>
 #include <sys/time.h>
+#include <pthread.h>
 #include <string>
 #include <vector>
 #include <map>
@@ -324,6 +332,8 @@ namespace OCPI {
       struct Header;
       struct HeaderEntry;
       struct EventMap;
+      struct RingEntry;
+      struct ThreadRing;
 
     public:
       friend class EmitFormatter;
@@ -440,6 +450,17 @@ namespace OCPI {
       static void sEmit( EventId id, EventTriggerRole role=NoTrigger );
       static void sEmitT( EventId id, Time t, EventTriggerRole role=NoTrigger );
 
+      // Switch to per-thread ring mode: each thread appends to its own single-producer ring
+      // without locking and a background thread merges the rings into the event queues.
+      // A zero size uses the OCPI_TIME_EMIT_THREAD_RINGS default.
+      static void enableThreadRings( unsigned entries = 0 );
+
+      // Merge everything currently in the per-thread rings into the event queues
+      static void drainThreadRings();
+      // How many events were dropped because a per-thread ring was full, as of the last drain
+      static OCPI::OS::uint64_t threadRingsDropped();
+      inline static bool threadRings() { return m_threadRings; }
+
       // Stop collecting events now
       void stop( bool globally = true );
       static void endQue();
@@ -498,6 +519,13 @@ namespace OCPI {
       // Process event trigger
       inline void processTrigger( EventTriggerRole role );
 
+      // Record an event in this object's event queue, mutex protected
+      inline void qEmit( EventId id, OCPI::OS::uint64_t v, Time t, EventTriggerRole role );
+
+      // Record an event in the calling thread's ring
+      inline void ringEmit( EventId id, OCPI::OS::uint64_t v, Time t, EventTriggerRole role );
+      static ThreadRing* getThreadRing();
+
       // Determines if this id is a child of this class
       bool isChild( Emit::OwnerId id );
 
@@ -512,6 +540,8 @@ namespace OCPI {
       TimeSource*    m_ts;
       static uint32_t m_categories;
       static uint32_t m_sub_categories;
+      static bool     m_threadRings;
+      static pthread_key_t s_ringKey;
     };
 
 
@@ -32,6 +32,7 @@
 #include <fstream>
 #include <iostream>
 #include <OcpiOsAssert.h>
+#include <OcpiOsThreadManager.h>
 #include <OcpiUtilDataTypesApi.h>
 
 #ifndef OCPI_TIME_ANALYZER_INLINE_VALID_USE__
@@ -134,6 +135,54 @@ namespace OCPI {
         :id(pid),eventName(en),width(w),type(t),dtype(dt){}
     };
 
+    // One event recorded in a per-thread ring, waiting to be merged into its owner's queue
+    struct Emit::RingEntry {
+      Emit*     emitter;
+      Time      time_ticks;
+      uint64_t  value;
+      EventId   eid;
+      uint8_t   role;
+    };
+
+    // Single-producer/single-consumer ring owned by one emitting thread.
+    // Only the owning thread writes "head" and only the drainer writes "tail",
+    // so appending never blocks: when the ring is full the event is counted and dropped.
+    struct Emit::ThreadRing {
+      RingEntry*         entries;
+      uint64_t           mask;
+      uint8_t            pad0[64];
+      volatile uint64_t  head;
+      uint8_t            pad1[64];
+      volatile uint64_t  tail;
+      uint8_t            pad2[64];
+      volatile uint64_t  dropped;
+      volatile bool      owned;
+      ThreadRing( unsigned size )
+	: entries(new RingEntry[size]), mask(size - 1), head(0), tail(0), dropped(0), owned(true) {}
+      ~ThreadRing() { delete [] entries; }
+      inline void push( Emit* e, EventId id, uint64_t v, Time t, EventTriggerRole role ) {
+	uint64_t h = head;
+	if ( h - tail > mask ) {
+	  __sync_fetch_and_add( &dropped, 1 );
+	  return;
+	}
+	RingEntry& re = entries[h & mask];
+	re.emitter = e;
+	re.time_ticks = t;
+	re.value = v;
+	re.eid = id;
+	re.role = (uint8_t)role;
+	// The entry must be visible before the head moves.  x86 does not reorder stores
+	// so only the compiler needs fencing there.
+#if defined(__x86_64__) || defined(__i386__)
+	__asm__ __volatile__("" ::: "memory");
+#else
+	__sync_synchronize();
+#endif
+	head = h + 1;
+      }
+    };
+
     struct Emit::Header {
       OCPI::OS::Mutex *                    g_mutex;
       bool                                 init;
@@ -148,7 +197,15 @@ namespace OCPI {
       std::string                          dumpFileName;
       std::fstream                         dumpFileStream;
       Emit::TimeSource                     *ts;  // Default time source
-      Header():init(false),nextEventId(0),shuttingDown(false),dumpOnExit(false)
+      OCPI::OS::Mutex                      ringMutex;    // protects "rings" and draining
+      std::vector<ThreadRing*>             rings;
+      unsigned                             ringEntries;
+      unsigned                             drainMs;
+      uint64_t                             ringDropped;
+      OCPI::OS::ThreadManager *            drainer;
+      volatile bool                        drainerStop;
+      Header():init(false),nextEventId(0),shuttingDown(false),dumpOnExit(false),
+	       ringEntries(0),drainMs(10),ringDropped(0),drainer(NULL),drainerStop(false)
       {
 	g_mutex = new OCPI::OS::Mutex(true);
 
@@ -166,6 +223,14 @@ namespace OCPI {
 	}	  
       };
       ~Header() {
+	if ( drainer ) {
+	  drainerStop = true;
+	  drainer->join();
+	  delete drainer;
+	}
+	for ( unsigned int n=0; n<rings.size(); n++ ) {
+	  delete rings[n];
+	}
 	for ( unsigned int n=0; n<eventQ.size(); n++ ) {
 	  delete eventQ[n];
 	}
@@ -281,6 +346,25 @@ inline void OCPI::Time::Emit::emitT( OCPI::Time::Emit::EventId id,
 				     Time pticks,
 				    EventTriggerRole role)
 {        
+  if ( m_threadRings )
+    ringEmit( id, v, pticks, role );
+  else
+    qEmit( id, v, pticks, role );
+}
+
+inline void OCPI::Time::Emit::ringEmit( EventId id, uint64_t v, Time t, EventTriggerRole role )
+{
+  ThreadRing* r = static_cast<ThreadRing*>(pthread_getspecific( s_ringKey ));
+  if ( !r )
+    r = getThreadRing();
+  r->push( this, id, v, t, role );
+}
+
+inline void OCPI::Time::Emit::qEmit( OCPI::Time::Emit::EventId id, 
+				     uint64_t v,
+				     Time pticks,
+				     EventTriggerRole role)
+{        
 
   uint32_t size = sizeof(uint64_t);
   AUTO_MUTEX( m_mutex ); 
@@ -327,6 +411,28 @@ inline void OCPI::Time::Emit::emit( EventId id, OCPI::API::PValue& p, EventTrigg
 
 inline void OCPI::Time::Emit::emitT( EventId id, OCPI::API::PValue& p, Time t, EventTriggerRole role )
 {
+  // Strings are variable length and so always take the queue path
+  if ( m_threadRings && p.type != OCPI::API::OCPI_String ) {
+    OCPI::Time::SValue sv;
+    switch ( p.type ) {
+    case OCPI::API::OCPI_Short:     sv.ivalue = p.vShort; break;
+    case OCPI::API::OCPI_Long:      sv.ivalue = p.vLong; break;
+    case OCPI::API::OCPI_Char:      sv.ivalue = p.vChar; break;
+    case OCPI::API::OCPI_LongLong:  sv.ivalue = p.vLongLong; break;
+    case OCPI::API::OCPI_Bool:      sv.uvalue = p.vBool; break;
+    case OCPI::API::OCPI_ULong:     sv.uvalue = p.vULong; break;
+    case OCPI::API::OCPI_UShort:    sv.uvalue = p.vUShort; break;
+    case OCPI::API::OCPI_ULongLong: sv.uvalue = p.vULongLong; break;
+    case OCPI::API::OCPI_UChar:     sv.uvalue = p.vUChar; break;
+    case OCPI::API::OCPI_Double:    sv.dvalue = p.vDouble; break;
+    case OCPI::API::OCPI_Float:     sv.dvalue = p.vFloat; break;
+    default:
+      ocpiAssert(0);
+      return;
+    }
+    ringEmit( id, sv.uvalue, t, role );
+    return;
+  }
   INIT_EVENT(id, role, sizeof(uint64_t), t );
 
   OCPI::Time::SValue* dp = (OCPI::Time::SValue*)(m_q->current + 1);
@@ -358,7 +464,7 @@ inline void OCPI::Time::Emit::emitT( EventId id, OCPI::API::PValue& p, Time t, E
     dp->uvalue = p.vULongLong;
     break;    
   case OCPI::API::OCPI_UChar:
-    dp->uvalue = p.vUShort;
+    dp->uvalue = p.vUChar;
     break;    
   case OCPI::API::OCPI_Double:
     dp->dvalue = p.vDouble;
@@ -393,6 +499,10 @@ inline void OCPI::Time::Emit::emitT( OCPI::Time::Emit::EventId id,
 				     Time t,
 				     EventTriggerRole role )
 {        
+  if ( m_threadRings ) {
+    ringEmit( id, 0, t, role );
+    return;
+  }
   INIT_EVENT(id, role, sizeof(uint64_t),t );
   FINI_EVENT;
 }
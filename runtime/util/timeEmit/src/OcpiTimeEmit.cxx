@@ -41,6 +41,8 @@ namespace OCPI {
 
     uint32_t Emit::m_categories = 0;
     uint32_t Emit::m_sub_categories = 0;
+    bool Emit::m_threadRings = false;
+    pthread_key_t Emit::s_ringKey;
 
     extern "C" {
       int OcpiTimeARegister( char* signal_name )
@@ -112,6 +114,14 @@ namespace OCPI {
 	m_sub_categories = atoi(tmp);
       }
 
+      if ( ( tmp = getenv("OCPI_TIME_EMIT_DRAIN_MS") ) != NULL ) {
+	getHeader().drainMs = (unsigned)atoi(tmp);
+      }
+
+      if ( ( tmp = getenv("OCPI_TIME_EMIT_THREAD_RINGS") ) != NULL && atoi(tmp) > 0 ) {
+	enableThreadRings( (unsigned)atoi(tmp) );
+      }
+
       // Try to open the stream now so that we can report any errors before exit
       if ( getHeader().dumpOnExit ) {
 	getHeader().dumpFileStream.open( getHeader().dumpFileName.c_str(), std::ios::out | std::ios::trunc | std::ios::binary );
@@ -301,6 +311,12 @@ namespace OCPI {
     Emit::
     endQue()
     {
+      if ( m_threadRings ) {
+	drainThreadRings();
+	if ( getHeader().ringDropped )
+	  ocpiInfo("Time::Emit per-thread rings dropped %" PRIu64 " events because they were full",
+		   getHeader().ringDropped);
+      }
       AUTO_MUTEX(Emit::getGMutex());
   
       std::vector<EventQ*>::iterator it;    
@@ -383,7 +399,131 @@ namespace OCPI {
     Emit::~Emit()
       throw ()
     {
+      // Ring entries refer to this object, so they must be merged before it goes away
+      if ( m_threadRings ) {
+	try {
+	  drainThreadRings();
+	} catch ( ... ) {
+	  // Ignore
+	}
+      }
+    }
+
+    // Thread exit: the ring stays registered so its contents are still drained,
+    // but it may be adopted by a new thread once it is empty.
+    static void
+    releaseThreadRing( void* ring )
+    {
+      static_cast<Emit::ThreadRing*>(ring)->owned = false;
+    }
+
+    static void
+    drainerThread( void* )
+    {
+      Emit::Header& h = Emit::getHeader();
+      while ( !h.drainerStop ) {
+	Emit::drainThreadRings();
+	OCPI::OS::sleep( h.drainMs );
+      }
+    }
+
+    void
+    Emit::
+    enableThreadRings( unsigned entries )
+    {
+      AUTO_MUTEX(Emit::getGMutex());
+      if ( m_threadRings ) {
+	return;
+      }
+      Header& h = getHeader();
+      if ( !entries ) {
+	const char* tmp = getenv("OCPI_TIME_EMIT_THREAD_RINGS");
+	entries = tmp && atoi(tmp) > 0 ? (unsigned)atoi(tmp) : 16 * 1024;
+      }
+      // Round up to a power of two so the ring index is a mask
+      for ( h.ringEntries = 2; h.ringEntries < entries; h.ringEntries <<= 1 )
+	;
+      ocpiCheck(pthread_key_create(&s_ringKey, releaseThreadRing) == 0);
+      h.drainerStop = false;
+      h.drainer = new OCPI::OS::ThreadManager;
+      h.drainer->start( drainerThread, NULL );
+      m_threadRings = true;
+    }
+
+    Emit::ThreadRing*
+    Emit::
+    getThreadRing()
+    {
+      Header& h = getHeader();
+      OCPI::Util::AutoMutex guard( h.ringMutex, true );
+      ThreadRing* r = NULL;
+      for ( unsigned n = 0; n < h.rings.size(); n++ ) {
+	if ( !h.rings[n]->owned && h.rings[n]->head == h.rings[n]->tail ) {
+	  r = h.rings[n];
+	  r->owned = true;
+	  break;
+	}
+      }
+      if ( !r ) {
+	r = new ThreadRing( h.ringEntries );
+	h.rings.push_back( r );
+      }
+      pthread_setspecific( s_ringKey, r );
+      return r;
+    }
+
+    OCPI::OS::uint64_t
+    Emit::
+    threadRingsDropped()
+    {
+      Header& h = getHeader();
+      OCPI::Util::AutoMutex guard( h.ringMutex, true );
+      return h.ringDropped;
+    }
 
+    // Merge the current contents of all rings into the event queues in time order.
+    // Only what was published when the drain started is consumed; producers keep appending.
+    void
+    Emit::
+    drainThreadRings()
+    {
+      Header& h = getHeader();
+      OCPI::Util::AutoMutex guard( h.ringMutex, true );
+      size_t nRings = h.rings.size();
+      if ( !nRings ) {
+	return;
+      }
+      std::vector<uint64_t> pos( nRings ), last( nRings );
+      for ( unsigned n = 0; n < nRings; n++ ) {
+	pos[n] = h.rings[n]->tail;
+	last[n] = h.rings[n]->head;
+      }
+      __sync_synchronize(); // entries up to "last" are now visible
+      while ( true ) {
+	ThreadRing* r = NULL;
+	unsigned which = 0;
+	for ( unsigned n = 0; n < nRings; n++ ) {
+	  if ( pos[n] != last[n] &&
+	       ( !r || h.rings[n]->entries[pos[n] & h.rings[n]->mask].time_ticks <
+		 r->entries[pos[which] & r->mask].time_ticks ) ) {
+	    r = h.rings[n];
+	    which = n;
+	  }
+	}
+	if ( !r ) {
+	  break;
+	}
+	RingEntry& re = r->entries[pos[which]++ & r->mask];
+	re.emitter->qEmit( re.eid, re.value, re.time_ticks, (EventTriggerRole)re.role );
+      }
+      __sync_synchronize(); // entries are consumed before the producers may reuse them
+      for ( unsigned n = 0; n < nRings; n++ ) {
+	ThreadRing& r = *h.rings[n];
+	r.tail = pos[n];
+	if ( r.dropped ) {
+	  h.ringDropped += __atomic_exchange_n( &r.dropped, 0, __ATOMIC_RELAXED );
+	}
+      }
     }
 
 
@@ -407,6 +547,10 @@ namespace OCPI {
 
       try {
 	getHeader().shuttingDown = true;
+	if ( m_threadRings ) {
+	  drainThreadRings();
+	  m_threadRings = false;
+	}
 	delete g_header;
       }
       catch ( ... ) {
@@ -554,6 +698,9 @@ namespace OCPI {
 
     std::ostream& EmitFormatter::formatDumpToStreamRAW( std::ostream& out ) 
     {
+      if ( Emit::threadRings() ) {
+	Emit::drainThreadRings();
+      }
       AUTO_MUTEX(Emit::getGMutex());
 
       // Now do the timed events
@@ -0,0 +1,139 @@
+/*
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of OpenCPI <http://www.opencpi.org>
+ *
+ * OpenCPI is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenCPI is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "OcpiOsDebug.h"
+#include "OcpiOsAssert.h"
+
+namespace OS = OCPI::OS;
+
+namespace
+{
+  class TestOcpiOsLog : public ::testing::Test
+  {
+    protected:
+      // Capture what is written to stderr, without the time stamps
+      FILE *d_file;
+      int d_saved;
+      void SetUp ( )
+      {
+        fflush ( stderr );
+        d_file = tmpfile ( );
+        d_saved = dup ( 2 );
+        dup2 ( fileno ( d_file ), 2 );
+      }
+      std::string output ( )
+      {
+        OS::logFlush ( );
+        fflush ( stderr );
+        dup2 ( d_saved, 2 );
+        close ( d_saved );
+        std::string s;
+        char line[1024];
+        rewind ( d_file );
+        while ( fgets ( line, sizeof ( line ), d_file ) ) {
+          const char *cp = strstr ( line, "): " );
+          s += cp ? cp + 3 : line;
+        }
+        fclose ( d_file );
+        return s;
+      }
+  };
+
+  int g_evaluated;
+  int evaluate ( )
+  {
+    return ++g_evaluated;
+  }
+
+  void logAll ( char *dynamic )
+  {
+    const char *none = NULL;
+    ocpiBad ( "int %d %5i|%-#6x|%o %c %hd", -7, 42, 255u, 8, 'Q', 70000 );
+    ocpiBad ( "long %ld %lld %zu %td %lu", -5L, -123456789012LL, (size_t)42, (ptrdiff_t)-3, 7ul );
+    ocpiBad ( "float %f %.3e %g %10.4f %Lf", 3.14159, 1e-7, 2.5, -1.0/3, (long double)1.25 );
+    ocpiBad ( "string %s|%8s|%-6s|%.2s %s %s", "abc", "right", "left", "trunc",
+              std::string ( "temporary" ).c_str ( ), none );
+    ocpiBad ( "star %*d|%-*d|%.*s|%*.*f", 6, 1, 4, 2, 3, "abcdef", 8, 2, 3.14159 );
+    ocpiBad ( "pointer %p percent %%", (void *)0x1234 );
+    ocpiBad ( "newline\n" );
+    ocpiBad ( dynamic, 17 );
+    ocpiBad ( "%2$s %1$s", "positional", "args" );
+  }
+
+  // Test 1: Queued records are formatted as they would be directly
+  TEST_F( TestOcpiOsLog, test_1 )
+  {
+    unsigned level = OS::logGetLevel ( );
+    OS::logSetLevel ( OCPI_LOG_BAD );
+    char dynamic[32];
+    strcpy ( dynamic, "dynamic %d" );
+    logAll ( dynamic );
+    OS::logSetAsync ( true );
+    logAll ( dynamic );
+    strcpy ( dynamic, "overwritten %d" );
+    OS::logSetAsync ( false );
+    OS::logSetLevel ( level );
+    std::string s = output ( );
+    ASSERT_EQ( 0u, s.size ( ) % 2 );
+    EXPECT_EQ( s.substr ( 0, s.size ( ) / 2 ), s.substr ( s.size ( ) / 2 ) );
+    EXPECT_NE( std::string::npos, s.find ( "dynamic 17" ) );
+  }
+
+  // Test 2: Arguments are not evaluated unless the level is enabled for the file
+  TEST_F( TestOcpiOsLog, test_2 )
+  {
+    unsigned level = OS::logGetLevel ( );
+    OS::logSetLevel ( OCPI_LOG_BAD );
+    g_evaluated = 0;
+    ocpiInfo ( "not logged %d", evaluate ( ) );
+    EXPECT_EQ( 0, g_evaluated );
+    OS::logSetSubsystemLevels ( "test-log=8,no-such-file=10" );
+    ocpiInfo ( "logged %d", evaluate ( ) );
+    ocpiLog ( 10, "not logged %d", evaluate ( ) );
+    EXPECT_EQ( 1, g_evaluated );
+    EXPECT_FALSE( OS::logWillLogAt ( OCPI_LOG_INFO, "other.cxx" ) );
+    OS::logSetSubsystemLevels ( "" );
+    OS::logSetLevel ( level );
+    EXPECT_EQ( "logged 1\n", output ( ) );
+  }
+
+  // Test 3: The flight recorder keeps the last records, whether printed or not
+  TEST_F( TestOcpiOsLog, test_3 )
+  {
+    unsigned level = OS::logGetLevel ( );
+    OS::logSetLevel ( OCPI_LOG_BAD );
+    OS::logSetRecorder ( 3, OCPI_LOG_INFO );
+    for ( int i = 0; i < 10; i++ )
+      ocpiInfo ( "record %d", i );
+    ocpiLog ( 10, "not recorded" );
+    OS::logDumpRecorder ( 2 );
+    OS::logSetRecorder ( 0 );
+    OS::logSetLevel ( level );
+    EXPECT_EQ( "OCPI flight recorder: the last 3 of 10 log records:\n"
+               "record 7\nrecord 8\nrecord 9\n", output ( ) );
+  }
+}
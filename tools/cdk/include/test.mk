@@ -35,6 +35,7 @@ export ExcludePlatforms
 export Cases
 export KeepSimulations
 export TestTimeout
+export TestBatch
 include $(OCPI_CDK_DIR)/include/util.mk
 
 ifneq ($(Model),test)
@@ -222,6 +223,8 @@ The following variables can be set, usually on the command line:
   Cases                - set to specific cases, including wildcards for execute and/or verify
   KeepSimulations      - set to 1 to preserve simulation outputs rather than delete on success
   TestTimeout          - set to number of seconds to limit execution for any case
+  TestBatch            - set to 1 to run each platform's cases with ocpitestrun, many per process
+                         and in parallel for RCC, or set to the number of processes to use
   OnlyPlatforms        - set to platforms to run tests on, rather than those available
   View                 - set to 1 to enable the "view" script during verify
   TestApplications     - set to C++ programs to build (set only in the Makefile)
@@ -356,6 +356,12 @@ OcpiFixPathArgs=\
         $p)))
 OcpiGenArg=$(call OcpiGenTool, $1 -M $(dir $@)$(@F).deps $2)
 OcpiGen=$(call OcpiGenArg,,$1)$(infox OGA:$(call OcpiGenArg,,$1))
+# Several ocpigen commands can be run by one ocpigen process, which parses the XML files they
+# share once for all of them.  OcpiGenJob makes one command, given the file it generates
+# (for its dependency file) and its arguments, and OcpiGenBatch runs a list of them.
+# $(call OcpiGenBatch,$(call OcpiGenJob,<file>,<args>) $(call OcpiGenJob,<file>,<args>)...)
+OcpiGenJob='$(call OcpiFixPathArgs,$(patsubst %,-I%,$(XmlIncludeDirsInternal)) -M $1.deps $2)'
+OcpiGenBatch=printf '%s\n' $1 | $(OcpiGenEnv) $(OCPI_VALGRIND) $(ToolsDir)/ocpigen -J -
 
 # Return stderr and the exit status as variables
 # Return non-empty on failure, empty on success, and set var
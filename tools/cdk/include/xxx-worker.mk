@@ -32,15 +32,6 @@ ifeq ($(origin ImplHeaderFiles),undefined)
 ImplHeaderFiles=$(foreach w,$(Workers),$(call ImplHeaderFile,$w))
 ImplHeaderFile=$(GeneratedDir)/$1$(ImplSuffix)
 $(call OcpiDbgVar,ImplHeaderFiles)
-# FIXME: HdlPlatform is incorrect here
-$(ImplHeaderFiles): $(GeneratedDir)/%$(ImplSuffix) : $$(Worker_%_xml) | $(GeneratedDir)
-	$(AT)echo Generating the implementation header file: $@ from $< 
-	$(AT)$(call OcpiGen, -D $(GeneratedDir) $(and $(Package),-p $(Package)) \
-        $(and $(Assembly),-S $(Assembly)) \
-	$(and $(HdlPlatform),-P $(HdlPlatform)) \
-	$(and $(PlatformDir),-F $(PlatformDir)) \
-	$(and $(filter-out 1,$(words $(Workers))),-N ) \
-	$(HdlVhdlLibraries) -i $<)
 
 ifeq ($(origin SkelFiles),undefined)
   SkelFiles=$(foreach w,$(Workers),$(GeneratedDir)/$w$(SkelSuffix))
@@ -59,14 +50,25 @@ skeleton:  $(ImplHeaderFiles) $(SkelFiles)
 
 all: skeleton
 
-$(SkelFiles): $(GeneratedDir)/%$(SkelSuffix) : $$(Worker_%_xml) | $(GeneratedDir)
+# The implementation header and the skeleton of a worker are generated together, by one
+# ocpigen process, so the spec and protocol files they both use are only parsed once.
+# FIXME: HdlPlatform is incorrect here
+$(GeneratedDir)/%$(ImplSuffix) $(GeneratedDir)/%$(SkelSuffix): $$(Worker_%_xml) | $(GeneratedDir)
 	$(AT)$(OcpiRemoveSkeletons)
-	$(AT)echo Generating the implementation skeleton file: $@
-	$(AT)$(call OcpiGen, -D $(GeneratedDir) \
-              $(and $(Assembly),-S $(Assembly)) \
-	      $(and $(Platform),-P $(Platform)) \
-              $(and $(PlatformDir),-F $(PlatformDir)) \
-              $(and $(Package),-p $(Package)) -s $<)
+	$(AT)echo Generating the implementation header and skeleton files for $* from $<
+	$(AT)$(call OcpiGenBatch,\
+	  $(call OcpiGenJob,$(GeneratedDir)/$*$(ImplSuffix), -D $(GeneratedDir) \
+            $(and $(Package),-p $(Package)) \
+            $(and $(Assembly),-S $(Assembly)) \
+	    $(and $(HdlPlatform),-P $(HdlPlatform)) \
+	    $(and $(PlatformDir),-F $(PlatformDir)) \
+	    $(and $(filter-out 1,$(words $(Workers))),-N ) \
+	    $(HdlVhdlLibraries) -i $<) \
+	  $(call OcpiGenJob,$(GeneratedDir)/$*$(SkelSuffix), -D $(GeneratedDir) \
+            $(and $(Assembly),-S $(Assembly)) \
+	    $(and $(Platform),-P $(Platform)) \
+            $(and $(PlatformDir),-F $(PlatformDir)) \
+            $(and $(Package),-p $(Package)) -s $<))
 endif
 
 clean:: cleanfirst
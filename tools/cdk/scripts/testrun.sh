@@ -50,7 +50,36 @@ ports=($*)
                    ./run.sh run remote
     exit $?
 }
+# doverify <model> <worker> <case> <subcase>, after running it with exit status in $r
+function doverify {
+  if [ "$r" = 0 ]; then
+    if [ -f $3.$4.$2.$1.props ]; then
+      ../../gen/applications/verify_$3.sh $2.$1 $4 $view $verify
+      r=$?
+      [ -n "$verify" -a $r = 0 -a "$KeepSimulations" != 1 ] && rm -r -f $3.$4.$2.$1.simulation
+      if (( r > 128 )); then
+        let s=r-128
+        echo Verification exited with signal $s. 1>&2
+        [ $s = 2 ] && exit $r
+      fi
+      [ $r = 0 ] && return 0
+      failed=1
+      [ "$TestAccumulateErrors" = 1 ] && return 0
+      exit 1
+    else
+      $tput setaf 1 2>/dev/null
+      echo '    'Verification for $3.$4:  FAILED.  No execution using $2.$1 on platform $platform. 1>&2
+      $tput sgr0 2>/dev/null
+      failed=1
+      [ "$TestAccumulateErrors" = 1 ] && return 0
+      exit 1
+    fi
+  else
+    echo Execution failed so verify or view not performed.
+  fi
+}
 # docase <model> <worker> <case> <subcase> <timeout> <duration>
+# When TestBatch is set and running locally, subcases to run are collected for dobatch
 function docase {
   [ -z "$Cases" ] || {
      local ok
@@ -70,6 +99,11 @@ function docase {
     echo ".  Functions are: $run $verify $view"
   } 1>&2
   r=0
+  [ -n "$TestBatch" -a "$TestBatch" != 0 -a -n "$run" -a -z "$remote" ] && [ ! -x runremote.sh ] && {
+    rm -f -r $3.$4.$2.$1.*
+    batched+=("$*")
+    return 0
+  }
   [ -z "$run" ] || {
     local output outputs timearg
     for o in ${ports[@]}; do
@@ -141,30 +175,46 @@ function docase {
       return 0
     fi
   }
-  [ -z "$view" -a -z "$verify" ] ||
-    if [ "$r" = 0 ]; then
-      if [ -f $3.$4.$2.$1.props ]; then
-        ../../gen/applications/verify_$3.sh $2.$1 $4 $view $verify
-        r=$?
-        [ -n "$verify" -a $r = 0 -a "$KeepSimulations" != 1 ] && rm -r -f $3.$4.$2.$1.simulation
-        if (( r > 128 )); then
-          let s=r-128
-          echo Verification exited with signal $s. 1>&2
-          [ $s = 2 ] && exit $r
-        fi
-        [ $r = 0 ] && return 0
-        failed=1
-        [ "$TestAccumulateErrors" = 1 ] && return 0
-        exit 1
-      else
-        $tput setaf 1 2>/dev/null
-        echo '    'Verification for $3.$4:  FAILED.  No execution using $2.$1 on platform $platform. 1>&2
-        $tput sgr0 2>/dev/null
-        failed=1
-        [ "$TestAccumulateErrors" = 1 ] && return 0
-        exit 1
-      fi
+  [ -z "$view" -a -z "$verify" ] || doverify $1 $2 $3 $4
+}
+# Run the subcases collected by docase using ocpitestrun, which runs many subcases per process and,
+# for RCC, several processes at once, and then verify them in order as docase would have.
+function dobatch {
+  [ ${#batched[@]} = 0 ] && return 0
+  local o outputs timearg procs lockrcc m w c s
+  for o in ${ports[@]}; do
+    outputs="$outputs -o $o"
+  done
+  [ -n "$TestTimeout" ] && timearg=--timeout=$TestTimeout
+  [ "$TestBatch" -gt 1 ] 2>/dev/null && procs=--processes=$TestBatch
+  [ "$OCPI_ENABLE_REMOTE_DISCOVERY" = 1 -o -n "$OCPI_SERVER_ADDRESS" -o \
+    -n "$OCPI_SERVER_ADDRESSES" -o -n "$OCPI_SERVER_ADDRESSES_FILE" ] &&
+      lockrcc=(-s '?ocpi.core.file_read=model!="rcc"||platform==host_platform' \
+               -s '?ocpi.core.file_write=model!="rcc"||platform==host_platform')
+  rm -f batch.results
+  setStartTime
+  printf '%s\n' "${batched[@]}" |
+    OCPI_LIBRARY_PATH=../../../lib/rcc:../../../lib/ocl:../../gen/assemblies:$OCPI_CDK_DIR/$OCPI_TOOL_DIR/artifacts \
+    $OCPI_CDK_DIR/$OCPI_TOOL_DIR/bin/ocpitestrun --component=$component --platform=$platform \
+       $outputs $timearg $procs "${lockrcc[@]}" --results=batch.results -
+  echo '  'Ran ${#batched[@]} subcases on platform $platform in $(getElapsedTime). 1>&2
+  [ -f batch.results ] || {
+    $tput setaf 1 2>/dev/null
+    echo '    'Execution FAILED - ocpitestrun did not complete on platform $platform 1>&2
+    $tput sgr0 2>/dev/null
+    exit 1
+  }
+  [ "$TestVerbose" = 1 ] && for o in "${batched[@]}"; do
+    set -- $o
+    cat $3.$4.$2.$1.log
+  done
+  # Results are read on another descriptor so verification scripts do not consume them
+  while read -u 3 m w c s r; do
+    if [ "$r" != 0 ]; then
+      [ "$TestAccumulateErrors" != 1 ] && exit 1
+      failed=1
     else
-      echo Execution failed so verify or view not performed.
+      [ -z "$view" -a -z "$verify" ] || doverify $m $w $c $s
     fi
+  done 3< batch.results
 }
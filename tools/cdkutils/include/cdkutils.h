@@ -47,6 +47,8 @@ extern void
   addInclude(const char *inc),
   addInclude(const std::string &inc),
   addDep(const char *dep, bool child),
+  // The absolute paths of the XML files parsed so far by this process
+  parsedXmlFiles(StringSet &files),
   printgen(FILE *f, const char *comment, const char *file, bool orig = false,
 	   const char *endComment = "");  
 
@@ -65,6 +67,8 @@ extern const char
   *getPlatforms(const char *attr, StringSet &targets, Model m, bool onlyValidPlatformsPlatforms = true),
   *getTargets(const char *attr, OrderedStringSet &targets, Model m),
   *closeDep(),
+  // Parse a file ahead of time so that it is already parsed in processes forked afterwards
+  *preloadXml(const char *file),
   // Optional allows the element type might not match
   // NonExistentOK allows the file to not exist at all.
   *parseFile(const char *file, const std::string &parent, const char *element,
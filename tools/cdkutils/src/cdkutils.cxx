@@ -20,12 +20,14 @@
 
 #include <cerrno>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <ctime>
 #include <cstdlib>
 #include <cstring>
 #include <vector>
 #include <string>
 #include <list>
+#include <map>
 #include <memory>
 #include <fstream>
 
@@ -52,6 +54,232 @@ addInclude(const char *inc) {
   includes.push_back(inc);
 }
 
+// Parsed XML files are kept for the life of the process, keyed by the identity of the file
+// and checked against its size and times, so that a file used many times is parsed once.
+// Each caller gets its own copy since some modify what they are given.  When
+// OCPI_XML_CACHE_DIR is set, parsed files are also saved there in a preparsed form that is
+// quicker to load than the XML, so other processes can use them too.
+namespace {
+  struct XmlFileId {
+    uint64_t dev, ino, size, mtime, mtimeNsec, ctime, ctimeNsec;
+    XmlFileId(const struct stat &st)
+      : dev(st.st_dev), ino(st.st_ino), size((uint64_t)st.st_size), mtime((uint64_t)st.st_mtime),
+	ctime((uint64_t)st.st_ctime) {
+#ifdef OCPI_OS_macos
+      mtimeNsec = (uint64_t)st.st_mtimespec.tv_nsec;
+      ctimeNsec = (uint64_t)st.st_ctimespec.tv_nsec;
+#else
+      mtimeNsec = (uint64_t)st.st_mtim.tv_nsec;
+      ctimeNsec = (uint64_t)st.st_ctim.tv_nsec;
+#endif
+    }
+    bool operator==(const XmlFileId &other) const { return !memcmp(this, &other, sizeof(*this)); }
+  };
+  struct CachedXml {
+    XmlFileId m_id;
+    ezxml_t m_xml; // never freed since copies share its strings
+    std::string m_path; // absolute
+    CachedXml(const XmlFileId &id, ezxml_t xml, const std::string &path)
+      : m_id(id), m_xml(xml), m_path(path) {}
+  };
+  typedef std::map<std::pair<uint64_t, uint64_t>, CachedXml> XmlCache;
+  XmlCache xmlCache;
+  // A preparsed file is this header, the nodes in document order, the name/value offsets of
+  // the attributes of each node in turn, and then the strings.  The magic number includes
+  // the sizes of the header and node structures, so files written by a build with a
+  // different layout are not used.
+  struct XmlCacheNode {
+    uint32_t parent;    // index plus one, zero for the root
+    uint32_t name, txt; // offsets of strings
+    uint32_t nAttrs;
+    uint64_t off;
+  };
+  struct XmlCacheHeader {
+    char      magic[8];
+    uint32_t  abi;
+    uint32_t  nNodes, nAttrs;
+    XmlFileId id;
+    uint64_t  nChars;
+  };
+  const char xmlCacheMagic[8] = { 'O', 'C', 'P', 'I', 'X', 'M', 'L', '2' };
+  const uint32_t xmlCacheAbi = (uint32_t)(sizeof(XmlCacheHeader) << 16 | sizeof(XmlCacheNode));
+}
+
+static uint32_t
+addXmlString(std::string &chars, const char *s) {
+  uint32_t offset = (uint32_t)chars.size();
+  chars.append(s, strlen(s) + 1);
+  return offset;
+}
+
+static void
+flattenXml(ezxml_t x, uint32_t parent, std::vector<XmlCacheNode> &nodes,
+	   std::vector<uint32_t> &attrs, std::string &chars) {
+  XmlCacheNode n;
+  n.parent = parent;
+  n.name = addXmlString(chars, x->name);
+  n.txt = addXmlString(chars, x->txt);
+  n.nAttrs = 0;
+  n.off = x->off;
+  for (char **ap = x->attr; *ap; ap += 2, n.nAttrs++) {
+    attrs.push_back(addXmlString(chars, ap[0]));
+    attrs.push_back(addXmlString(chars, ap[1]));
+  }
+  nodes.push_back(n);
+  uint32_t me = (uint32_t)nodes.size();
+  for (ezxml_t c = x->child; c; c = c->ordered)
+    flattenXml(c, me, nodes, attrs, chars);
+}
+
+// Save the preparsed form, atomically replacing any previous one.  Failures are ignored.
+static void
+saveXml(const std::string &cacheFile, const XmlFileId &id, ezxml_t x) {
+  std::vector<XmlCacheNode> nodes;
+  std::vector<uint32_t> attrs;
+  std::string chars;
+  flattenXml(x, 0, nodes, attrs, chars);
+  XmlCacheHeader h = { {}, xmlCacheAbi, (uint32_t)nodes.size(), (uint32_t)(attrs.size()/2), id,
+			chars.size() };
+  memcpy(h.magic, xmlCacheMagic, sizeof(h.magic));
+  std::string temp(cacheFile + ".XXXXXX");
+  int fd = mkstemp(&temp[0]);
+  if (fd < 0)
+    return;
+  size_t nodeBytes = nodes.size() * sizeof(XmlCacheNode), attrBytes = attrs.size() * sizeof(uint32_t);
+  bool ok =
+    write(fd, &h, sizeof(h)) == (ssize_t)sizeof(h) &&
+    write(fd, &nodes[0], nodeBytes) == (ssize_t)nodeBytes &&
+    (!attrBytes || write(fd, &attrs[0], attrBytes) == (ssize_t)attrBytes) &&
+    write(fd, chars.data(), chars.size()) == (ssize_t)chars.size();
+  if (close(fd) || !ok || rename(temp.c_str(), cacheFile.c_str())) {
+    ocpiDebug("Could not save preparsed XML file \"%s\"", cacheFile.c_str());
+    unlink(temp.c_str());
+  }
+}
+
+// Check that a preparsed file is for this version of the file and that everything in it
+// refers to something within it: nodes to earlier nodes, strings to NUL-terminated strings
+// in its string area, and the offset of each child to within its parent's text.
+static bool
+checkXml(const char *buf, size_t size, const XmlFileId &id) {
+  if (size < sizeof(XmlCacheHeader))
+    return false;
+  const XmlCacheHeader &h = *(const XmlCacheHeader *)buf;
+  if (memcmp(h.magic, xmlCacheMagic, sizeof(h.magic)) || h.abi != xmlCacheAbi || !(h.id == id) ||
+      !h.nNodes || !h.nChars ||
+      (uint64_t)size != sizeof(XmlCacheHeader) + (uint64_t)h.nNodes * sizeof(XmlCacheNode) +
+                        (uint64_t)h.nAttrs * 2 * sizeof(uint32_t) + h.nChars)
+    return false;
+  const XmlCacheNode *nodes = (const XmlCacheNode *)(&h + 1);
+  const uint32_t *attrs = (const uint32_t *)(nodes + h.nNodes);
+  const char *chars = (const char *)(attrs + 2 * (size_t)h.nAttrs);
+  if (chars[h.nChars - 1])
+    return false;
+  uint64_t nAttrs = 0;
+  for (uint32_t i = 0; i < h.nNodes; i++) {
+    const XmlCacheNode &n = nodes[i];
+    if ((i ? !n.parent || n.parent > i : n.parent != 0) || n.name >= h.nChars ||
+	n.txt >= h.nChars || (nAttrs += n.nAttrs) > h.nAttrs ||
+	(i && n.off > strlen(chars + nodes[n.parent - 1].txt)))
+      return false;
+  }
+  for (uint64_t a = 0; a < 2 * nAttrs; a++)
+    if (attrs[a] >= h.nChars)
+      return false;
+  return true;
+}
+
+// Load the preparsed form if it is for this version of the file.  The buffer is kept since the
+// tree's strings are in it.
+static ezxml_t
+loadXml(const std::string &cacheFile, const XmlFileId &id) {
+  int fd = open(cacheFile.c_str(), O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  char *buf = NULL;
+  ezxml_t x = NULL;
+  if (!fstat(fd, &st) && (size_t)st.st_size >= sizeof(XmlCacheHeader) &&
+      (buf = (char *)malloc((size_t)st.st_size)) && read(fd, buf, (size_t)st.st_size) == st.st_size &&
+      checkXml(buf, (size_t)st.st_size, id)) {
+    const XmlCacheHeader &h = *(XmlCacheHeader *)buf;
+    const XmlCacheNode *nodes = (const XmlCacheNode *)(&h + 1);
+    const uint32_t *attrs = (const uint32_t *)(nodes + h.nNodes);
+    const char *chars = (const char *)(attrs + 2 * (size_t)h.nAttrs);
+    std::vector<ezxml_t> made(h.nNodes);
+    for (uint32_t i = 0; i < h.nNodes; i++) {
+      const XmlCacheNode &n = nodes[i];
+      ezxml_t e = made[i] = i ?
+	ezxml_add_child(made[n.parent - 1], chars + n.name, n.off) : ezxml_new(chars + n.name);
+      ezxml_set_txt(e, chars + n.txt);
+      for (uint32_t a = 0; a < n.nAttrs; a++, attrs += 2)
+	ezxml_set_attr(e, chars + attrs[0], chars + attrs[1]);
+    }
+    x = made[0];
+  }
+  close(fd);
+  if (!x)
+    free(buf);
+  return x;
+}
+
+// Parse an open file, using the caches when it is a regular file
+static ezxml_t
+parseXml(int fd, const char *file) {
+  struct stat st;
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode))
+    return ezxml_parse_fd(fd);
+  XmlFileId id(st);
+  XmlCache::iterator it = xmlCache.find(std::make_pair(id.dev, id.ino));
+  if (it != xmlCache.end() && it->second.m_id == id)
+    return ezxml_dup(it->second.m_xml);
+  std::string cacheFile;
+  const char *dir = getenv("OCPI_XML_CACHE_DIR");
+  if (dir && dir[0])
+    OU::format(cacheFile, "%s/%llx-%llx.ezxml", dir, (unsigned long long)id.dev,
+	       (unsigned long long)id.ino);
+  ezxml_t x = cacheFile.empty() ? NULL : loadXml(cacheFile, id), copy;
+  if (x)
+    copy = ezxml_dup(x);
+  else {
+    x = ezxml_parse_fd(fd);
+    // Documents with errors are not copied, and so are not cached
+    if (!(copy = ezxml_dup(x)))
+      return x;
+    if (!cacheFile.empty())
+      saveXml(cacheFile, id, x);
+  }
+  // A previous version of the file is left in memory since copies of it may still be in use
+  if (it != xmlCache.end())
+    xmlCache.erase(it);
+  char *path = realpath(file, NULL);
+  xmlCache.insert(std::make_pair(std::make_pair(id.dev, id.ino),
+				 CachedXml(id, x, path ? path : file)));
+  free(path);
+  return copy;
+}
+
+void
+parsedXmlFiles(StringSet &files) {
+  for (XmlCache::const_iterator it = xmlCache.begin(); it != xmlCache.end(); ++it)
+    files.insert(it->second.m_path);
+}
+
+const char *
+preloadXml(const char *file) {
+  int fd = open(file, O_RDONLY);
+  if (fd < 0)
+    return OU::esprintf("Cannot open XML file \"%s\": %s", file, strerror(errno));
+  ezxml_t x = parseXml(fd, file);
+  close(fd);
+  const char *err = NULL;
+  if (!x || ezxml_error(x)[0])
+    err = OU::esprintf("XML Parsing error in file \"%s\"%s%s", file, x ? ": " : "",
+		       x ? ezxml_error(x) : "");
+  ezxml_free(x);
+  return err;
+}
+
 // The "optional" argument says the file may not exist at all, or it
 // may have the wrong top level element.  If the filename is "-",
 // stdin is assumed.
@@ -126,7 +354,7 @@ parseFile(const char *file, const std::string &parent, const char *element,
 	break;
       }
     }
-    ezxml_t x = ezxml_parse_fd(fd);
+    ezxml_t x = parseXml(fd, cp);
     if (x && ezxml_error(x)[0]) {
       err = OU::esprintf("XML Parsing error in file \"%s\": %s", cp, ezxml_error(x));
       break;
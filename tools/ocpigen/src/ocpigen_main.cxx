@@ -21,7 +21,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/wait.h>
 #include <memory>
+#include <vector>
+#include <string>
 #include "OcpiOsFileSystem.h"
 #include "OcpiDriverManager.h"
 #include "OcpiLibraryManager.h"
@@ -99,13 +106,15 @@ add to tree.
   CMD_OPTION  (dynamic,   Z,    Bool,   NULL, "Whether the artifact should be dynamic") \
   CMD_OPTION  (nworkers,  N,    Bool,   NULL, "Multiple workers are actually implemented here (rcc)") \
   CMD_OPTION  (comp,      G,    Bool,   NULL, "Generate component output for use with ocpidev") \
+  CMD_OPTION  (batch,     J,    String, NULL, "<file>\n" \
+	                                      "Run each line of the file (- for stdin) as an ocpigen command line") \
 
 #define OCPI_OPTION
 #define OCPI_OPTIONS_NO_MAIN
 #include "CmdOption.h"
 
-int
-main(int argc, const char **argv) {
+static int
+generate(int argc, const char **argv) {
   OCPI::Driver::ManagerManager::suppressDiscovery();
   if (options.setArgv(argv))
     return 1;
@@ -146,6 +155,7 @@ main(int argc, const char **argv) {
             " -S <assembly> Specify the name of the assembly for a container\n"
             " -T            Generate test artifacts\n"
             " -G            Generate Component Artifact for use with ocpidev\n"
+            " -J <file>     Run the ocpigen command lines in <file> (- for stdin), one per line\n"
             );
     return 1;
   }
@@ -260,6 +270,9 @@ main(int argc, const char **argv) {
       case 'G':
         doCompArt = true;
         break;
+      case 'J':
+        err = "The -J (batch) option must be the only option";
+        break;
       default:
 	err = OU::esprintf("Unknown flag: %s\n", *ap);
       }
@@ -377,3 +390,150 @@ main(int argc, const char **argv) {
     fprintf(stderr, "%s\n", err);
  return err ? 1 : 0;
 }
+
+// Split a line into words, quoted as they would be in the shell
+static const char *
+splitLine(const char *line, std::vector<std::string> &words) {
+  words.clear();
+  for (const char *cp = line; *cp;) {
+    if (isspace(*cp)) {
+      cp++;
+      continue;
+    }
+    std::string word;
+    char quote = 0;
+    for (; *cp && (quote || !isspace(*cp)); cp++)
+      if (quote && *cp == quote)
+	quote = 0;
+      else if (!quote && (*cp == '"' || *cp == '\''))
+	quote = *cp;
+      else if (*cp == '\\' && quote != '\'' && cp[1])
+	word += *++cp;
+      else
+	word += *cp;
+    if (quote)
+      return "unterminated quote";
+    words.push_back(word);
+  }
+  return NULL;
+}
+
+static void
+removeDir(const std::string &dir) {
+  DIR *d = opendir(dir.c_str());
+  if (d) {
+    for (struct dirent *ent; (ent = readdir(d));)
+      if (strcmp(ent->d_name, ".") && strcmp(ent->d_name, ".."))
+	unlink((dir + "/" + ent->d_name).c_str());
+    closedir(d);
+  }
+  rmdir(dir.c_str());
+}
+
+// Batch mode: run the command lines in a file, one per line, each in a child process forked
+// from this one.  Each job starts with the same state as a separate ocpigen would, but without
+// the cost of starting one.  A line of "cd <dir>" sets the directory for the following jobs,
+// and lines starting with # are ignored.  Each job reports the XML files it parsed, and they
+// are parsed here after it ends, so later jobs inherit them already parsed.  These parses load
+// the preparsed files the job saved, in a temporary directory unless OCPI_XML_CACHE_DIR is set.
+// The first job to fail ends the batch.
+static int
+batch(const char *argv0, const char *file) {
+  FILE *f = strcmp(file, "-") ? fopen(file, "r") : stdin;
+  if (!f) {
+    fprintf(stderr, "Cannot open batch file \"%s\": %s\n", file, strerror(errno));
+    return 1;
+  }
+  // Read the whole file first, since a job's exit may move the file offset it shares with us
+  std::vector<std::string> lines;
+  char *line = NULL;
+  size_t lineSize = 0;
+  while (getline(&line, &lineSize, f) >= 0)
+    lines.push_back(line);
+  free(line);
+  if (f != stdin)
+    fclose(f);
+  std::string tempDir;
+  const char *cacheDir = getenv("OCPI_XML_CACHE_DIR");
+  if (!cacheDir || !cacheDir[0]) {
+    char dir[] = "/tmp/ocpigen-XXXXXX";
+    if (mkdtemp(dir)) {
+      tempDir = dir;
+      setenv("OCPI_XML_CACHE_DIR", dir, 1);
+    }
+  }
+  const char *err = NULL;
+  std::vector<std::string> words;
+  std::vector<const char *> args;
+  unsigned lineNo = 0, nJobs = 0;
+  for (; !err && lineNo < lines.size(); lineNo++) {
+    if ((err = splitLine(lines[lineNo].c_str(), words)) || words.empty() || words[0][0] == '#')
+      continue;
+    if (words[0] == "cd") {
+      if (words.size() != 2)
+	err = "cd needs one directory";
+      else if (chdir(words[1].c_str()))
+	err = OU::esprintf("cannot change to directory \"%s\": %s", words[1].c_str(),
+			   strerror(errno));
+      continue;
+    }
+    args.clear();
+    args.push_back(argv0);
+    for (unsigned n = 0; n < words.size(); n++)
+      args.push_back(words[n].c_str());
+    args.push_back(NULL);
+    nJobs++;
+    fflush(stdout);
+    fflush(stderr);
+    int fds[2];
+    pid_t pid = -1;
+    if (!pipe(fds) && (pid = fork()) < 0) {
+      close(fds[0]);
+      close(fds[1]);
+    }
+    if (pid == 0) {
+      close(fds[0]);
+      int rc = generate((int)args.size() - 1, &args[0]);
+      StringSet files;
+      parsedXmlFiles(files);
+      for (StringSetIter it = files.begin(); !rc && it != files.end(); ++it)
+	if (write(fds[1], it->c_str(), it->size() + 1) != (ssize_t)(it->size() + 1))
+	  break;
+      exit(rc);
+    }
+    int status;
+    if (pid < 0) {
+      err = OU::esprintf("cannot start job: %s", strerror(errno));
+      continue;
+    }
+    close(fds[1]);
+    std::string files;
+    char buf[4096];
+    for (ssize_t n; (n = read(fds[0], buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR);)
+      if (n > 0)
+	files.append(buf, (size_t)n);
+    close(fds[0]);
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status))
+      err = "job failed";
+    else
+      for (size_t pos = 0, nul; (nul = files.find('\0', pos)) != std::string::npos; pos = nul + 1) {
+	const char *perr = preloadXml(files.c_str() + pos);
+	if (perr)
+	  ocpiDebug("ocpigen batch: %s", perr);
+      }
+  }
+  if (err)
+    fprintf(stderr, "%s:%u: %s: %s", file, lineNo, err, lines[lineNo - 1].c_str());
+  else
+    ocpiInfo("ocpigen batch %s: %u jobs succeeded", file, nJobs);
+  if (!tempDir.empty())
+    removeDir(tempDir);
+  return err ? 1 : 0;
+}
+
+int
+main(int argc, const char **argv) {
+  if (argc == 3 && !strcmp(argv[1], "-J"))
+    return batch(argv[0], argv[2]);
+  return generate(argc, argv);
+}
@@ -2141,6 +2141,7 @@ createCases(const char **platforms, const char */*package*/, const char */*outDi
       if (m_run) {
         for (RunsIter ri = m_runs.begin(); ri != m_runs.end(); ++ri)
           fprintf(m_run, "%s", ri->second.c_str());
+        fprintf(m_run, "dobatch\n"); // run any subcases collected when TestBatch is set
         fprintf(m_run, "exit $failed\n");
         fclose(m_run);
       }